@@ -210,6 +210,68 @@ static TranslationBlock *tb_htable_lookup(CPUState *cpu, TCGTBCPUState s)
     return qht_lookup_custom(&tb_ctx.htable, &desc, h, tb_lookup_cmp);
 }
 
+static inline bool tb_jmp_cache_match(TranslationBlock *tb, vaddr pc,
+                                      TCGTBCPUState s)
+{
+    return (tb &&
+            pc == s.pc &&
+            tb->cs_base == s.cs_base &&
+            tb->flags == s.flags &&
+            tb_cflags(tb) == s.cflags);
+}
+
+static TranslationBlock *tb_jmp_l2_lookup(CPUJumpCache *jc, TCGTBCPUState s)
+{
+    uint32_t set = tb_jmp_l2_hash_func(s.pc);
+
+    for (int i = 0; i < TB_JMP_L2_WAYS; i++) {
+        TranslationBlock *tb = qatomic_read(&jc->l2[set].way[i].tb);
+
+        if (tb_jmp_cache_match(tb, jc->l2[set].way[i].pc, s)) {
+            return tb;
+        }
+    }
+    return NULL;
+}
+
+/* Insert @tb as the most recent entry of its set, dropping the oldest. */
+static void tb_jmp_l2_insert(CPUJumpCache *jc, vaddr pc, TranslationBlock *tb)
+{
+    uint32_t set = tb_jmp_l2_hash_func(pc);
+    int i;
+
+    for (i = 0; i < TB_JMP_L2_WAYS - 1; i++) {
+        if (qatomic_read(&jc->l2[set].way[i].tb) == tb &&
+            jc->l2[set].way[i].pc == pc) {
+            break;
+        }
+    }
+    for (; i > 0; i--) {
+        jc->l2[set].way[i].pc = jc->l2[set].way[i - 1].pc;
+        qatomic_set(&jc->l2[set].way[i].tb,
+                    qatomic_read(&jc->l2[set].way[i - 1].tb));
+    }
+    jc->l2[set].way[0].pc = pc;
+    qatomic_set(&jc->l2[set].way[0].tb, tb);
+}
+
+/*
+ * Install @tb in the first level of @cpu's jump cache.  The entry it
+ * replaces is demoted to the second level instead of being forgotten.
+ */
+static void tb_jmp_cache_insert(CPUState *cpu, uint32_t hash, vaddr pc,
+                                TranslationBlock *tb)
+{
+    CPUJumpCache *jc = cpu->tb_jmp_cache;
+    TranslationBlock *old = qatomic_read(&jc->array[hash].tb);
+
+    if (old && old != tb) {
+        tb_jmp_l2_insert(jc, jc->array[hash].pc, old);
+    }
+    jc->array[hash].pc = pc;
+    qatomic_set(&jc->array[hash].tb, tb);
+}
+
 /**
  * tb_lookup:
  * @cpu: CPU that will execute the returned translation block
@@ -237,21 +299,26 @@ static inline TranslationBlock *tb_lookup(CPUState *cpu, TCGTBCPUState s)
     jc = cpu->tb_jmp_cache;
 
     tb = qatomic_read(&jc->array[hash].tb);
-    if (likely(tb &&
-               jc->array[hash].pc == s.pc &&
-               tb->cs_base == s.cs_base &&
-               tb->flags == s.flags &&
-               tb_cflags(tb) == s.cflags)) {
+    if (likely(tb_jmp_cache_match(tb, jc->array[hash].pc, s))) {
         goto hit;
     }
 
-    tb = tb_htable_lookup(cpu, s);
-    if (tb == NULL) {
-        return NULL;
+    /*
+     * Invalidated entries in the second level are harmless: the
+     * CF_INVALID bit makes the cflags comparison fail.
+     */
+    tb = tb_jmp_l2_lookup(jc, s);
+    if (tb) {
+        qatomic_set(&jc->l2_hit_count, jc->l2_hit_count + 1);
+    } else {
+        qatomic_set(&jc->l2_miss_count, jc->l2_miss_count + 1);
+        tb = tb_htable_lookup(cpu, s);
+        if (tb == NULL) {
+            return NULL;
+        }
     }
 
-    jc->array[hash].pc = s.pc;
-    qatomic_set(&jc->array[hash].tb, tb);
+    tb_jmp_cache_insert(cpu, hash, s.pc, tb);
 
 hit:
     /*
@@ -965,9 +1032,6 @@ cpu_exec_loop(CPUState *cpu, SyncClocks *sc)
 
             tb = tb_lookup(cpu, s);
             if (tb == NULL) {
-                CPUJumpCache *jc;
-                uint32_t h;
-
                 mmap_lock();
                 tb = tb_gen_code(cpu, s);
                 mmap_unlock();
@@ -976,10 +1040,8 @@ cpu_exec_loop(CPUState *cpu, SyncClocks *sc)
                  * We add the TB in the virtual pc hash table
                  * for the fast lookup
                  */
-                h = tb_jmp_cache_hash_func(s.pc);
-                jc = cpu->tb_jmp_cache;
-                jc->array[h].pc = s.pc;
-                qatomic_set(&jc->array[h].tb, tb);
+                tb_jmp_cache_insert(cpu, tb_jmp_cache_hash_func(s.pc),
+                                    s.pc, tb);
             }
 
 #ifndef CONFIG_USER_ONLY
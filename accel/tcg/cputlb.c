@@ -159,6 +159,13 @@ static void tb_jmp_cache_clear_page(CPUState *cpu, vaddr page_addr)
     for (i = 0; i < TB_JMP_PAGE_SIZE; i++) {
         qatomic_set(&jc->array[i0 + i].tb, NULL);
     }
+
+    i0 = tb_jmp_l2_hash_page(page_addr);
+    for (i = 0; i < TB_JMP_L2_PAGE_SIZE; i++) {
+        for (int j = 0; j < TB_JMP_L2_WAYS; j++) {
+            qatomic_set(&jc->l2[i0 + i].way[j].tb, NULL);
+        }
+    }
 }
 
 /**
@@ -276,6 +283,29 @@ static void tlb_mmu_resize_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast,
     }
 }
 
+/* Return the index of the first way of the stlb set that may hold @page. */
+static inline size_t tlb_stlb_set(vaddr page)
+{
+    /*
+     * Do not simply use the low bits of the page number: those select
+     * the entry in the main tlb, so all of the pages that conflict there
+     * would also conflict here.
+     */
+    uint64_t h = (uint64_t)(page >> TARGET_PAGE_BITS) * 0x9e3779b97f4a7c15ull;
+
+    return (h >> (64 - CPU_STLB_SET_BITS)) * CPU_STLB_WAYS;
+}
+
+static void tlb_stlb_flush_locked(CPUTLBDesc *desc)
+{
+    CPUTLBSecond *stlb = desc->stlb;
+
+    if (stlb && stlb->dirty) {
+        memset(stlb->table, -1, sizeof(stlb->table));
+        stlb->dirty = false;
+    }
+}
+
 static void tlb_mmu_flush_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast)
 {
     desc->n_used_entries = 0;
@@ -284,6 +314,7 @@ static void tlb_mmu_flush_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast)
     desc->vindex = 0;
     memset(fast->table, -1, sizeof_tlb(fast));
     memset(desc->vtable, -1, sizeof(desc->vtable));
+    tlb_stlb_flush_locked(desc);
 }
 
 static void tlb_flush_one_mmuidx_locked(CPUState *cpu, int mmu_idx,
@@ -344,6 +375,7 @@ void tlb_destroy(CPUState *cpu)
 
         g_free(fast->table);
         g_free(desc->fulltlb);
+        g_free(desc->stlb);
     }
 }
 
@@ -491,6 +523,19 @@ static void tlb_flush_vtlb_page_mask_locked(CPUState *cpu, int mmu_idx,
             tlb_n_used_entries_dec(cpu, mmu_idx);
         }
     }
+
+    if (d->stlb && d->stlb->dirty) {
+        if (mask != -1) {
+            /* The set index depends on the bits that @mask ignores. */
+            tlb_stlb_flush_locked(d);
+        } else {
+            size_t set = tlb_stlb_set(page);
+
+            for (k = 0; k < CPU_STLB_WAYS; k++) {
+                tlb_flush_entry_locked(&d->stlb->table[set + k], page);
+            }
+        }
+    }
 }
 
 static inline void tlb_flush_vtlb_page_locked(CPUState *cpu, int mmu_idx,
@@ -935,6 +980,14 @@ void tlb_reset_dirty(CPUState *cpu, uintptr_t start, uintptr_t length)
             tlb_reset_dirty_range_locked(&desc->vfulltlb[i], &desc->vtable[i],
                                          start, length);
         }
+
+        if (desc->stlb && desc->stlb->dirty) {
+            for (i = 0; i < CPU_STLB_SIZE; i++) {
+                tlb_reset_dirty_range_locked(&desc->stlb->fulltlb[i],
+                                             &desc->stlb->table[i],
+                                             start, length);
+            }
+        }
     }
     qemu_spin_unlock(&cpu->neg.tlb.c.lock);
 }
@@ -968,9 +1021,104 @@ static void tlb_set_dirty(CPUState *cpu, vaddr addr)
             tlb_set_dirty1_locked(&cpu->neg.tlb.d[mmu_idx].vtable[k], addr);
         }
     }
+
+    for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+        CPUTLBSecond *stlb = cpu->neg.tlb.d[mmu_idx].stlb;
+
+        if (stlb && stlb->dirty) {
+            size_t set = tlb_stlb_set(addr);
+            int k;
+
+            for (k = 0; k < CPU_STLB_WAYS; k++) {
+                tlb_set_dirty1_locked(&stlb->table[set + k], addr);
+            }
+        }
+    }
     qemu_spin_unlock(&cpu->neg.tlb.c.lock);
 }
 
+/* Return the page address of a valid tlb entry. */
+static vaddr tlb_entry_page(const CPUTLBEntry *te)
+{
+    uint64_t addr = te->addr_read;
+
+    if (addr == -1) {
+        addr = tlb_addr_write(te);
+    }
+    if (addr == -1) {
+        addr = te->addr_code;
+    }
+    return addr & TARGET_PAGE_MASK;
+}
+
+static CPUTLBSecond *tlb_stlb_new(void)
+{
+    CPUTLBSecond *stlb = g_new0(CPUTLBSecond, 1);
+
+    memset(stlb->table, -1, sizeof(stlb->table));
+    return stlb;
+}
+
+/*
+ * Called with tlb_c.lock held.
+ * Move an entry that drops out of the victim tlb into the second level tlb,
+ * replacing the entries of each set in round-robin order.  The entry is
+ * simply dropped if the second level tlb has not been allocated yet.
+ */
+static void tlb_stlb_insert_locked(CPUTLBDesc *desc, const CPUTLBEntry *te,
+                                   const CPUTLBEntryFull *full)
+{
+    CPUTLBSecond *stlb = desc->stlb;
+    vaddr page;
+    size_t set, way;
+
+    if (!stlb) {
+        return;
+    }
+
+    page = tlb_entry_page(te);
+    set = tlb_stlb_set(page);
+    for (way = 0; way < CPU_STLB_WAYS; way++) {
+        CPUTLBEntry *ts = &stlb->table[set + way];
+
+        if (tlb_entry_is_empty(ts) || tlb_hit_page_anyprot(ts, page)) {
+            break;
+        }
+    }
+    if (way == CPU_STLB_WAYS) {
+        size_t n = set / CPU_STLB_WAYS;
+
+        way = stlb->next_way[n];
+        stlb->next_way[n] = (way + 1) % CPU_STLB_WAYS;
+    }
+
+    copy_tlb_helper_locked(&stlb->table[set + way], te);
+    stlb->fulltlb[set + way] = *full;
+    stlb->dirty = true;
+}
+
+/*
+ * Called with tlb_c.lock held.
+ * Evict the main tlb entry at @index into the victim tlb, pushing the
+ * oldest victim into the second level tlb.
+ */
+static void tlb_evict_locked(CPUState *cpu, int mmu_idx, size_t index)
+{
+    CPUTLBDesc *desc = &cpu->neg.tlb.d[mmu_idx];
+    CPUTLBEntry *te = &cpu_tlb_fast(cpu, mmu_idx)->table[index];
+    unsigned vidx = desc->vindex++ % CPU_VTLB_SIZE;
+    CPUTLBEntry *tv = &desc->vtable[vidx];
+
+    if (!tlb_entry_is_empty(tv)) {
+        tlb_stlb_insert_locked(desc, tv, &desc->vfulltlb[vidx]);
+    }
+
+    /* Evict the old entry into the victim tlb.  */
+    copy_tlb_helper_locked(tv, te);
+    desc->vfulltlb[vidx] = desc->fulltlb[index];
+    tlb_n_used_entries_dec(cpu, mmu_idx);
+}
+
 /* Our TLB does not support large pages, so remember the area covered by
    large pages and trigger a full TLB flush if these are invalidated.  */
 static void tlb_add_large_page(CPUState *cpu, int mmu_idx,
@@ -1026,6 +1174,7 @@ void tlb_set_page_full(CPUState *cpu, int mmu_idx,
 {
     CPUTLB *tlb = &cpu->neg.tlb;
     CPUTLBDesc *desc = &tlb->d[mmu_idx];
+    CPUTLBSecond *new_stlb = NULL;
     MemoryRegionSection *section;
     unsigned int index, read_flags, write_flags;
     uintptr_t addend;
@@ -1108,6 +1257,15 @@ void tlb_set_page_full(CPUState *cpu, int mmu_idx,
     index = tlb_index(cpu, mmu_idx, addr_page);
     te = tlb_entry(cpu, mmu_idx, addr_page);
 
+    /*
+     * Once the victim tlb has wrapped around, its evicted entries go to
+     * the second level tlb.  Only this vCPU installs it, so it can be
+     * allocated here, before taking the spinlock.
+     */
+    if (unlikely(!desc->stlb) && desc->vindex >= CPU_VTLB_SIZE) {
+        new_stlb = tlb_stlb_new();
+    }
+
     /*
      * Hold the TLB lock for the rest of the function. We could acquire/release
      * the lock several times in the function, but it is faster to amortize the
@@ -1117,6 +1275,10 @@ void tlb_set_page_full(CPUState *cpu, int mmu_idx,
      */
     qemu_spin_lock(&tlb->c.lock);
 
+    if (new_stlb) {
+        desc->stlb = new_stlb;
+    }
+
     /* Note that the tlb is no longer clean.  */
     tlb->c.dirty |= 1 << mmu_idx;
 
@@ -1128,13 +1290,7 @@ void tlb_set_page_full(CPUState *cpu, int mmu_idx,
      * different page; otherwise just overwrite the stale data.
      */
     if (!tlb_hit_page_anyprot(te, addr_page) && !tlb_entry_is_empty(te)) {
-        unsigned vidx = desc->vindex++ % CPU_VTLB_SIZE;
-        CPUTLBEntry *tv = &desc->vtable[vidx];
-
-        /* Evict the old entry into the victim tlb.  */
-        copy_tlb_helper_locked(tv, te);
-        desc->vfulltlb[vidx] = desc->fulltlb[index];
-        tlb_n_used_entries_dec(cpu, mmu_idx);
+        tlb_evict_locked(cpu, mmu_idx, index);
     }
 
     /* refill the tlb */
@@ -1301,8 +1457,56 @@ static void io_failed(CPUState *cpu, CPUTLBEntryFull *full, vaddr addr,
     }
 }
 
-/* Return true if ADDR is present in the victim tlb, and has been copied
-   back to the main tlb.  */
+/* Return true if ADDR is present in the second level tlb, and has been
+   moved to the main tlb.  */
+static bool stlb_hit(CPUState *cpu, size_t mmu_idx, size_t index,
+                     MMUAccessType access_type, vaddr page)
+{
+    CPUTLBDesc *desc = &cpu->neg.tlb.d[mmu_idx];
+    CPUTLBSecond *stlb = desc->stlb;
+    size_t set, way;
+
+    if (!stlb) {
+        return false;
+    }
+
+    set = tlb_stlb_set(page);
+    for (way = 0; way < CPU_STLB_WAYS; way++) {
+        CPUTLBEntry *ts = &stlb->table[set + way];
+
+        if (tlb_read_idx(ts, access_type) == page) {
+            CPUTLBEntry tmptlb, *te = &cpu_tlb_fast(cpu, mmu_idx)->table[index];
+            CPUTLBEntryFull tmpf = stlb->fulltlb[set + way];
+
+            /*
+             * The main tlb entry cannot simply be swapped in, because it
+             * belongs to a different set; send it down the victim tlb.
+             * Free our slot first, as the eviction may refill this set.
+             */
+            qemu_spin_lock(&cpu->neg.tlb.c.lock);
+            copy_tlb_helper_locked(&tmptlb, ts);
+            memset(ts, -1, sizeof(*ts));
+            if (!tlb_entry_is_empty(te)) {
+                tlb_evict_locked(cpu, mmu_idx, index);
+            }
+            copy_tlb_helper_locked(te, &tmptlb);
+            desc->fulltlb[index] = tmpf;
+            tlb_n_used_entries_inc(cpu, mmu_idx);
+            qemu_spin_unlock(&cpu->neg.tlb.c.lock);
+
+            qatomic_set(&cpu->neg.tlb.c.stlb_hit_count,
+                        cpu->neg.tlb.c.stlb_hit_count + 1);
+            return true;
+        }
+    }
+
+    qatomic_set(&cpu->neg.tlb.c.stlb_miss_count,
+                cpu->neg.tlb.c.stlb_miss_count + 1);
+    return false;
+}
+
+/* Return true if ADDR is present in the victim tlb or the second level tlb,
+   and has been copied back to the main tlb.  */
 static bool victim_tlb_hit(CPUState *cpu, size_t mmu_idx, size_t index,
                            MMUAccessType access_type, vaddr page)
 {
@@ -1330,7 +1534,7 @@ static bool victim_tlb_hit(CPUState *cpu, size_t mmu_idx, size_t index,
             return true;
         }
     }
-    return false;
+    return stlb_hit(cpu, mmu_idx, index, access_type, page);
 }
 
 static void notdirty_write(CPUState *cpu, vaddr mem_vaddr, unsigned size,
@@ -1513,6 +1717,53 @@ void *probe_access(CPUArchState *env, vaddr addr, int size,
     return host;
 }
 
+size_t probe_access_range(CPUArchState *env, vaddr addr, size_t size,
+                          MMUAccessType access_type, int mmu_idx,
+                          void **phost, uintptr_t retaddr)
+{
+    CPUState *cpu = env_cpu(env);
+    CPUTLBEntryFull *full;
+    void *start = NULL;
+    size_t done, len;
+
+    g_assert(size != 0);
+
+    for (done = 0; done < size; done += len) {
+        vaddr page_addr = addr + done;
+        void *host;
+        int flags;
+
+        len = MIN(size - done, -(page_addr | TARGET_PAGE_MASK));
+
+        /* Only the first page may fault; the rest just end the span. */
+        flags = probe_access_internal(cpu, page_addr, 1, access_type,
+                                      mmu_idx, done != 0, &host, &full,
+                                      retaddr, true);
+
+        /*
+         * Leave watchpoints, I/O, alignment checks and invalid pages to
+         * the per-element slow path.  The pages in the span must also be
+         * adjacent in host memory, which is usual within a RAMBlock.
+         */
+        if (flags & ~TLB_NOTDIRTY) {
+            break;
+        }
+        if (done == 0) {
+            start = host;
+        } else if (host != start + done) {
+            break;
+        }
+
+        /* Handle clean RAM pages.  */
+        if (unlikely(flags & TLB_NOTDIRTY)) {
+            notdirty_write(cpu, page_addr, len, full, retaddr);
+        }
+    }
+
+    *phost = start;
+    return done;
+}
+
 void *tlb_vaddr_to_host(CPUArchState *env, vaddr addr,
                         MMUAccessType access_type, int mmu_idx)
 {
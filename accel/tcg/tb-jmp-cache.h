@@ -15,6 +15,16 @@
 #define TB_JMP_CACHE_BITS 12
 #define TB_JMP_CACHE_SIZE (1 << TB_JMP_CACHE_BITS)
 
+/*
+ * Second level of the jump cache: a set-associative cache that keeps
+ * the TBs evicted from the direct-mapped first level, so that large code
+ * working sets do not fall back to the shared QHT on every conflict miss.
+ * Within a set, way 0 is the most recently inserted entry.
+ */
+#define TB_JMP_L2_BITS 10
+#define TB_JMP_L2_SIZE (1 << TB_JMP_L2_BITS)
+#define TB_JMP_L2_WAYS 4
+
 /*
  * Invalidated in parallel; all accesses to 'tb' must be atomic.
  * A valid entry is read/written by a single CPU, therefore there is
@@ -28,6 +38,15 @@ typedef struct CPUJumpCache {
         TranslationBlock *tb;
         vaddr pc;
     } array[TB_JMP_CACHE_SIZE];
+    struct {
+        struct {
+            TranslationBlock *tb;
+            vaddr pc;
+        } way[TB_JMP_L2_WAYS];
+    } l2[TB_JMP_L2_SIZE];
+    /* Written by the owning CPU only, read with qatomic_read() */
+    size_t l2_hit_count;
+    size_t l2_miss_count;
 } CPUJumpCache;
 
 #endif /* ACCEL_TCG_TB_JMP_CACHE_H */
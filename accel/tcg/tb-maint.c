@@ -902,6 +902,7 @@ static void tb_jmp_cache_inval_tb(TranslationBlock *tb)
         }
     } else {
         uint32_t h = tb_jmp_cache_hash_func(tb->pc);
+        uint32_t set = tb_jmp_l2_hash_func(tb->pc);
 
         CPU_FOREACH(cpu) {
             CPUJumpCache *jc = cpu->tb_jmp_cache;
@@ -909,6 +910,11 @@ static void tb_jmp_cache_inval_tb(TranslationBlock *tb)
             if (qatomic_read(&jc->array[h].tb) == tb) {
                 qatomic_set(&jc->array[h].tb, NULL);
             }
+            for (int i = 0; i < TB_JMP_L2_WAYS; i++) {
+                if (qatomic_read(&jc->l2[set].way[i].tb) == tb) {
+                    qatomic_set(&jc->l2[set].way[i].tb, NULL);
+                }
+            }
         }
     }
 }
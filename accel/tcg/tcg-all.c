@@ -53,6 +53,7 @@ struct TCGState {
     OnOffAuto mttcg_enabled;
     bool one_insn_per_tb;
     int splitwx_enabled;
+    bool tb_hugepages;
     unsigned long tb_size;
 };
 typedef struct TCGState TCGState;
@@ -151,7 +152,8 @@ static int tcg_init_machine(AccelState *as, MachineState *ms)
 
     page_init();
     tb_htable_init();
-    tcg_init(s->tb_size * MiB, s->splitwx_enabled, max_threads);
+    tcg_init(s->tb_size * MiB, s->splitwx_enabled, s->tb_hugepages,
+             max_threads);
 
 #if defined(CONFIG_SOFTMMU)
     /*
@@ -228,6 +230,18 @@ static void tcg_set_splitwx(Object *obj, bool value, Error **errp)
     s->splitwx_enabled = value;
 }
 
+static bool tcg_get_tb_hugepages(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    return s->tb_hugepages;
+}
+
+static void tcg_set_tb_hugepages(Object *obj, bool value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    s->tb_hugepages = value;
+}
+
 static bool tcg_get_one_insn_per_tb(Object *obj, Error **errp)
 {
     TCGState *s = TCG_STATE(obj);
@@ -283,6 +297,11 @@ static void tcg_accel_class_init(ObjectClass *oc, const void *data)
     object_class_property_set_description(oc, "split-wx",
         "Map jit pages into separate RW and RX regions");
 
+    object_class_property_add_bool(oc, "tb-hugepages",
+        tcg_get_tb_hugepages, tcg_set_tb_hugepages);
+    object_class_property_set_description(oc, "tb-hugepages",
+        "Back the TCG translation block cache with huge pages");
+
     object_class_property_add_bool(oc, "one-insn-per-tb",
                                    tcg_get_one_insn_per_tb,
                                    tcg_set_one_insn_per_tb);
@@ -21,6 +21,7 @@
 #include "qemu/host-utils.h"
 #include "exec/helper-proto-common.h"
 #include "tcg/tcg-gvec-desc.h"
+#include "host/gvec-accel.c.inc"
 
 
 static inline void clear_high(void *d, intptr_t oprsz, uint32_t desc)
@@ -1104,9 +1105,9 @@ void HELPER(gvec_ssadd16)(void *d, void *a, void *b, uint32_t desc)
 void HELPER(gvec_ssadd32)(void *d, void *a, void *b, uint32_t desc)
 {
     intptr_t oprsz = simd_oprsz(desc);
-    intptr_t i;
+    intptr_t i = gvec_accel_3(ssadd32, d, a, b, oprsz);
 
-    for (i = 0; i < oprsz; i += sizeof(int32_t)) {
+    for (; i < oprsz; i += sizeof(int32_t)) {
         int32_t ai = *(int32_t *)(a + i);
         int32_t bi = *(int32_t *)(b + i);
         int32_t di;
@@ -1121,9 +1122,9 @@ void HELPER(gvec_ssadd32)(void *d, void *a, void *b, uint32_t desc)
 void HELPER(gvec_ssadd64)(void *d, void *a, void *b, uint32_t desc)
 {
     intptr_t oprsz = simd_oprsz(desc);
-    intptr_t i;
+    intptr_t i = gvec_accel_3(ssadd64, d, a, b, oprsz);
 
-    for (i = 0; i < oprsz; i += sizeof(int64_t)) {
+    for (; i < oprsz; i += sizeof(int64_t)) {
         int64_t ai = *(int64_t *)(a + i);
         int64_t bi = *(int64_t *)(b + i);
         int64_t di;
@@ -1172,9 +1173,9 @@ void HELPER(gvec_sssub16)(void *d, void *a, void *b, uint32_t desc)
 void HELPER(gvec_sssub32)(void *d, void *a, void *b, uint32_t desc)
 {
     intptr_t oprsz = simd_oprsz(desc);
-    intptr_t i;
+    intptr_t i = gvec_accel_3(sssub32, d, a, b, oprsz);
 
-    for (i = 0; i < oprsz; i += sizeof(int32_t)) {
+    for (; i < oprsz; i += sizeof(int32_t)) {
         int32_t ai = *(int32_t *)(a + i);
         int32_t bi = *(int32_t *)(b + i);
         int32_t di;
@@ -1189,9 +1190,9 @@ void HELPER(gvec_sssub32)(void *d, void *a, void *b, uint32_t desc)
 void HELPER(gvec_sssub64)(void *d, void *a, void *b, uint32_t desc)
 {
     intptr_t oprsz = simd_oprsz(desc);
-    intptr_t i;
+    intptr_t i = gvec_accel_3(sssub64, d, a, b, oprsz);
 
-    for (i = 0; i < oprsz; i += sizeof(int64_t)) {
+    for (; i < oprsz; i += sizeof(int64_t)) {
         int64_t ai = *(int64_t *)(a + i);
         int64_t bi = *(int64_t *)(b + i);
         int64_t di;
@@ -1236,9 +1237,9 @@ void HELPER(gvec_usadd16)(void *d, void *a, void *b, uint32_t desc)
 void HELPER(gvec_usadd32)(void *d, void *a, void *b, uint32_t desc)
 {
     intptr_t oprsz = simd_oprsz(desc);
-    intptr_t i;
+    intptr_t i = gvec_accel_3(usadd32, d, a, b, oprsz);
 
-    for (i = 0; i < oprsz; i += sizeof(uint32_t)) {
+    for (; i < oprsz; i += sizeof(uint32_t)) {
         uint32_t ai = *(uint32_t *)(a + i);
         uint32_t bi = *(uint32_t *)(b + i);
         uint32_t di;
@@ -1253,9 +1254,9 @@ void HELPER(gvec_usadd32)(void *d, void *a, void *b, uint32_t desc)
 void HELPER(gvec_usadd64)(void *d, void *a, void *b, uint32_t desc)
 {
     intptr_t oprsz = simd_oprsz(desc);
-    intptr_t i;
+    intptr_t i = gvec_accel_3(usadd64, d, a, b, oprsz);
 
-    for (i = 0; i < oprsz; i += sizeof(uint64_t)) {
+    for (; i < oprsz; i += sizeof(uint64_t)) {
         uint64_t ai = *(uint64_t *)(a + i);
         uint64_t bi = *(uint64_t *)(b + i);
         uint64_t di;
@@ -1300,9 +1301,9 @@ void HELPER(gvec_ussub16)(void *d, void *a, void *b, uint32_t desc)
 void HELPER(gvec_ussub32)(void *d, void *a, void *b, uint32_t desc)
 {
     intptr_t oprsz = simd_oprsz(desc);
-    intptr_t i;
+    intptr_t i = gvec_accel_3(ussub32, d, a, b, oprsz);
 
-    for (i = 0; i < oprsz; i += sizeof(uint32_t)) {
+    for (; i < oprsz; i += sizeof(uint32_t)) {
         uint32_t ai = *(uint32_t *)(a + i);
         uint32_t bi = *(uint32_t *)(b + i);
         uint32_t di;
@@ -1317,9 +1318,9 @@ void HELPER(gvec_ussub32)(void *d, void *a, void *b, uint32_t desc)
 void HELPER(gvec_ussub64)(void *d, void *a, void *b, uint32_t desc)
 {
     intptr_t oprsz = simd_oprsz(desc);
-    intptr_t i;
+    intptr_t i = gvec_accel_3(ussub64, d, a, b, oprsz);
 
-    for (i = 0; i < oprsz; i += sizeof(uint64_t)) {
+    for (; i < oprsz; i += sizeof(uint64_t)) {
         uint64_t ai = *(uint64_t *)(a + i);
         uint64_t bi = *(uint64_t *)(b + i);
         uint64_t di;
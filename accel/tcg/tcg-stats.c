@@ -16,6 +16,7 @@
 #include "tcg/tcg.h"
 #include "internal-common.h"
 #include "tb-context.h"
+#include "tb-jmp-cache.h"
 #include <math.h>
 
 static void dump_drift_info(GString *buf)
@@ -147,9 +148,41 @@ static void tlb_flush_counts(size_t *pfull, size_t *ppart, size_t *pelide)
     *pelide = elide;
 }
 
+static void tlb_stlb_counts(size_t *phit, size_t *pmiss)
+{
+    CPUState *cpu;
+    size_t hit = 0, miss = 0;
+
+    CPU_FOREACH(cpu) {
+        hit += qatomic_read(&cpu->neg.tlb.c.stlb_hit_count);
+        miss += qatomic_read(&cpu->neg.tlb.c.stlb_miss_count);
+    }
+    *phit = hit;
+    *pmiss = miss;
+}
+
+static void tb_jmp_l2_counts(size_t *phit, size_t *pmiss)
+{
+    CPUState *cpu;
+    size_t hit = 0, miss = 0;
+
+    CPU_FOREACH(cpu) {
+        CPUJumpCache *jc = cpu->tb_jmp_cache;
+
+        if (jc) {
+            hit += qatomic_read(&jc->l2_hit_count);
+            miss += qatomic_read(&jc->l2_miss_count);
+        }
+    }
+    *phit = hit;
+    *pmiss = miss;
+}
+
 static void tcg_dump_flush_info(GString *buf)
 {
     size_t flush_full, flush_part, flush_elide;
+    size_t l2_hit, l2_miss;
+    size_t stlb_hit, stlb_miss;
 
     g_string_append_printf(buf, "TB flush count      %u\n",
                            qatomic_read(&tb_ctx.tb_flush_count));
@@ -160,6 +193,18 @@ static void tcg_dump_flush_info(GString *buf)
     g_string_append_printf(buf, "TLB full flushes    %zu\n", flush_full);
     g_string_append_printf(buf, "TLB partial flushes %zu\n", flush_part);
     g_string_append_printf(buf, "TLB elided flushes  %zu\n", flush_elide);
+
+    tlb_stlb_counts(&stlb_hit, &stlb_miss);
+    g_string_append_printf(buf, "TLB L2 hits         %zu (%zu%%)\n", stlb_hit,
+                           stlb_hit + stlb_miss ?
+                           (stlb_hit * 100) / (stlb_hit + stlb_miss) : 0);
+    g_string_append_printf(buf, "TLB L2 misses       %zu\n", stlb_miss);
+
+    tb_jmp_l2_counts(&l2_hit, &l2_miss);
+    g_string_append_printf(buf, "TB L2 cache hits    %zu (%zu%%)\n", l2_hit,
+                           l2_hit + l2_miss ?
+                           (l2_hit * 100) / (l2_hit + l2_miss) : 0);
+    g_string_append_printf(buf, "TB htable lookups   %zu\n", l2_miss);
 }
 
 static void dump_exec_info(GString *buf)
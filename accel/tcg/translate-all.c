@@ -637,4 +637,9 @@ void tcg_flush_jmp_cache(CPUState *cpu)
     for (int i = 0; i < TB_JMP_CACHE_SIZE; i++) {
         qatomic_set(&jc->array[i].tb, NULL);
     }
+    for (int i = 0; i < TB_JMP_L2_SIZE; i++) {
+        for (int j = 0; j < TB_JMP_L2_WAYS; j++) {
+            qatomic_set(&jc->l2[i].way[j].tb, NULL);
+        }
+    }
 }
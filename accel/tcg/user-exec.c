@@ -808,6 +808,29 @@ void *probe_access(CPUArchState *env, vaddr addr, int size,
     return size ? g2h(env_cpu(env), addr) : NULL;
 }
 
+size_t probe_access_range(CPUArchState *env, vaddr addr, size_t size,
+                          MMUAccessType access_type, int mmu_idx,
+                          void **phost, uintptr_t ra)
+{
+    size_t done, len;
+
+    g_assert(size != 0);
+
+    for (done = 0; done < size; done += len) {
+        vaddr page_addr = addr + done;
+
+        len = MIN(size - done, -(page_addr | TARGET_PAGE_MASK));
+        /* Only the first page may fault; the rest just end the span. */
+        if (probe_access_internal(env, page_addr, 1, access_type,
+                                  done != 0, ra)) {
+            break;
+        }
+    }
+
+    *phost = done ? g2h(env_cpu(env), addr) : NULL;
+    return done;
+}
+
 void *tlb_vaddr_to_host(CPUArchState *env, vaddr addr,
                         MMUAccessType access_type, int mmu_idx)
 {
@@ -441,7 +441,7 @@ BlockCopyState *block_copy_state_new(BdrvChild *source, BdrvChild *target,
 
     ratelimit_init(&s->rate_limit);
     qemu_co_mutex_init(&s->lock);
-    QLIST_INIT(&s->reqs);
+    reqlist_init(&s->reqs);
     QLIST_INIT(&s->calls);
 
     return s;
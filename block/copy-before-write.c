@@ -506,7 +506,7 @@ static int cbw_open(BlockDriverState *bs, QDict *options, int flags,
                                      true);
 
     qemu_co_mutex_init(&s->lock);
-    QLIST_INIT(&s->frozen_read_reqs);
+    reqlist_init(&s->frozen_read_reqs);
     return 0;
 }
 
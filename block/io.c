@@ -575,6 +575,25 @@ void bdrv_drain_all(void)
     bdrv_drain_all_end();
 }
 
+/*
+ * Last byte of the interval that indexes a tracked request.  Zero-length
+ * requests are indexed as one byte long, so that the tree finds a superset
+ * of the requests that tracked_request_overlaps() accepts.
+ */
+static uint64_t tracked_request_last(int64_t offset, int64_t bytes)
+{
+    return offset + MAX(bytes, 1) - 1;
+}
+
+/* Called with req->bs->reqs_lock held */
+static void tracked_request_index(BdrvTrackedRequest *req)
+{
+    req->itree.start = req->overlap_offset;
+    req->itree.last = tracked_request_last(req->overlap_offset,
+                                           req->overlap_bytes);
+    interval_tree_insert(&req->itree, &req->bs->tracked_requests_tree);
+}
+
 /**
  * Remove an active request from the tracked requests list
  *
@@ -588,6 +607,7 @@ static void coroutine_fn tracked_request_end(BdrvTrackedRequest *req)
 
     qemu_mutex_lock(&req->bs->reqs_lock);
     QLIST_REMOVE(req, list);
+    interval_tree_remove(&req->itree, &req->bs->tracked_requests_tree);
     qemu_mutex_unlock(&req->bs->reqs_lock);
 
     /*
@@ -624,6 +644,7 @@ static void coroutine_fn tracked_request_begin(BdrvTrackedRequest *req,
 
     qemu_mutex_lock(&bs->reqs_lock);
     QLIST_INSERT_HEAD(&bs->tracked_requests, req, list);
+    tracked_request_index(req);
     qemu_mutex_unlock(&bs->reqs_lock);
 }
 
@@ -647,9 +668,17 @@ static bool tracked_request_overlaps(BdrvTrackedRequest *req,
 static coroutine_fn BdrvTrackedRequest *
 bdrv_find_conflicting_request(BdrvTrackedRequest *self)
 {
-    BdrvTrackedRequest *req;
+    uint64_t start = self->overlap_offset;
+    uint64_t last = tracked_request_last(self->overlap_offset,
+                                         self->overlap_bytes);
+    IntervalTreeNode *node;
+
+    for (node = interval_tree_iter_first(&self->bs->tracked_requests_tree,
+                                         start, last);
+         node;
+         node = interval_tree_iter_next(node, start, last)) {
+        BdrvTrackedRequest *req = container_of(node, BdrvTrackedRequest, itree);
 
-    QLIST_FOREACH(req, &self->bs->tracked_requests, list) {
         if (req == self || (!req->serialising && !self->serialising)) {
             continue;
         }
@@ -705,8 +734,15 @@ static void tracked_request_set_serialising(BdrvTrackedRequest *req,
         req->serialising = true;
     }
 
-    req->overlap_offset = MIN(req->overlap_offset, overlap_offset);
-    req->overlap_bytes = MAX(req->overlap_bytes, overlap_bytes);
+    overlap_offset = MIN(req->overlap_offset, overlap_offset);
+    overlap_bytes = MAX(req->overlap_bytes, overlap_bytes);
+    if (overlap_offset != req->overlap_offset ||
+        overlap_bytes != req->overlap_bytes) {
+        interval_tree_remove(&req->itree, &req->bs->tracked_requests_tree);
+        req->overlap_offset = overlap_offset;
+        req->overlap_bytes = overlap_bytes;
+        tracked_request_index(req);
+    }
 }
 
 /**
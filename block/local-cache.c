@@ -0,0 +1,1431 @@
+/*
+ * Local cache filter block driver
+ *
+ * Copyright (c) 2026 The QEMU Project Developers
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "block/block-io.h"
+#include "block/block_int.h"
+#include "block/dirty-bitmap.h"
+#include "block/qdict.h"
+#include "block/reqlist.h"
+#include "qapi/error.h"
+#include "qapi/qapi-commands-block-core.h"
+#include "qapi/util.h"
+#include "qemu/bitmap.h"
+#include "qemu/bswap.h"
+#include "qemu/error-report.h"
+#include "qemu/memalign.h"
+#include "qemu/module.h"
+#include "qemu/option.h"
+#include "qemu/units.h"
+#include "qobject/qdict.h"
+#include "trace.h"
+
+/*
+ * The filter keeps a copy of the data of its "file" child, typically a
+ * slow network backend, in its "local" child, typically an image on a
+ * local SSD.  Data is cached in chunks of @granularity bytes, at the same
+ * offset in the local image as in the cached node.  Two bitmaps describe
+ * the chunks:
+ *
+ * - valid: the local image holds the data of the chunk;
+ * - dirty: the chunk may differ between the two images.  With the
+ *   write-back policy the local image holds the newer data.  Otherwise
+ *   the cached node does, and a chunk that is still dirty when QEMU
+ *   starts again is dropped from the cache.
+ *
+ * The bitmaps are stored in the local image after the cached data:
+ *
+ *   [0, size)                           cached data
+ *   [meta_offset, valid_offset)         LocalCacheHeader, one page
+ *   [valid_offset, dirty_offset)        valid bitmap, nb_pages pages
+ *   [dirty_offset, meta_end)            dirty bitmap, nb_pages pages
+ *
+ * After a crash, the bitmaps on disk never claim more than the data
+ * supports: a dirty bit is written before the data of its chunk changes,
+ * a valid bit is written only once the data of its chunk is stable, and
+ * a chunk is dropped from the cache on disk before the cached node is
+ * written behind its back.  Discards are the exception, as they allow
+ * reading the old data.  Setting valid bits and clearing dirty bits
+ * is safe to delay, so these changes are only written on the next flush.
+ */
+
+#define LOCAL_CACHE_MAGIC           0x514c434143484500ULL /* "QLCACHE\0" */
+#define LOCAL_CACHE_VERSION         1
+
+/* Dirty chunks hold data that only the local image has */
+#define LOCAL_CACHE_F_WRITE_BACK    (1 << 0)
+
+#define LOCAL_CACHE_PAGE_SIZE       4096
+/* Alignment of the metadata in the local image */
+#define LOCAL_CACHE_META_ALIGN      (1 * MiB)
+
+#define LOCAL_CACHE_MIN_GRANULARITY (4 * KiB)
+#define LOCAL_CACHE_MAX_GRANULARITY (16 * MiB)
+#define LOCAL_CACHE_DEF_GRANULARITY (64 * KiB)
+
+/* Writeback keeps the guest off this much of the disk at a time */
+#define LOCAL_CACHE_WINDOW          (64 * MiB)
+/* Buffer size for copying dirty data to the cached node */
+#define LOCAL_CACHE_COPY_SIZE       (1 * MiB)
+
+typedef struct QEMU_PACKED LocalCacheHeader {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t flags;
+    uint64_t size;
+    uint32_t granularity;
+} LocalCacheHeader;
+
+typedef struct BDRVLocalCacheState {
+    BdrvChild *local;
+    LocalCachePolicy policy;
+    uint32_t granularity;
+    /* Size of the cached node when it was opened */
+    int64_t size;
+
+    /* Layout of the metadata in the local image */
+    int64_t meta_offset;
+    int64_t valid_offset;
+    int64_t dirty_offset;
+    int64_t meta_end;
+    /* Bytes of the cached node described by one page of a bitmap */
+    int64_t page_coverage;
+    uint64_t nb_pages;
+
+    /*
+     * Protects the bitmaps, the request list and the metadata I/O.  Chunks
+     * are locked in @reqs by whoever reads or changes them.
+     */
+    CoMutex lock;
+    BdrvDirtyBitmap *valid;
+    BdrvDirtyBitmap *dirty;
+    /* Pages of the bitmaps that differ from the local image */
+    unsigned long *stale_pages;
+    /* Chunks became valid since the local image was last flushed */
+    bool data_unflushed;
+    BlockReqList reqs;
+    uint8_t *page_buf;
+
+    /* Serializes writebacks, which lock several windows at once */
+    CoMutex writeback_lock;
+} BDRVLocalCacheState;
+
+typedef struct LocalCacheCo {
+    BlockDriverState *bs;
+    bool has_granularity;
+    Error **errp;
+    int ret;
+} LocalCacheCo;
+
+#define LOCAL_CACHE_OPT_POLICY      "policy"
+#define LOCAL_CACHE_OPT_GRANULARITY "granularity"
+static QemuOptsList local_cache_runtime_opts = {
+    .name = "local-cache",
+    .head = QTAILQ_HEAD_INITIALIZER(local_cache_runtime_opts.head),
+    .desc = {
+        {
+            .name = LOCAL_CACHE_OPT_POLICY,
+            .type = QEMU_OPT_STRING,
+            .help = "Cache policy (read-through, write-through, "
+                "write-back), default write-through",
+        },
+        {
+            .name = LOCAL_CACHE_OPT_GRANULARITY,
+            .type = QEMU_OPT_SIZE,
+            .help = "Unit of caching, default 64K",
+        },
+        { /* end of list */ }
+    },
+};
+
+static bool local_cache_absorb_opts(BDRVLocalCacheState *s, QDict *options,
+                                    bool *has_granularity, Error **errp)
+{
+    QemuOpts *opts = qemu_opts_create(&local_cache_runtime_opts, NULL, 0,
+                                      &error_abort);
+    uint64_t granularity;
+    bool ok = false;
+    int policy;
+
+    if (!qemu_opts_absorb_qdict(opts, options, errp)) {
+        goto out;
+    }
+
+    policy = qapi_enum_parse(&LocalCachePolicy_lookup,
+                             qemu_opt_get(opts, LOCAL_CACHE_OPT_POLICY),
+                             LOCAL_CACHE_POLICY_WRITE_THROUGH, errp);
+    if (policy < 0) {
+        goto out;
+    }
+    s->policy = policy;
+
+    *has_granularity = qemu_opt_get(opts, LOCAL_CACHE_OPT_GRANULARITY);
+    granularity = qemu_opt_get_size(opts, LOCAL_CACHE_OPT_GRANULARITY,
+                                    LOCAL_CACHE_DEF_GRANULARITY);
+    if (!is_power_of_2(granularity) ||
+        granularity < LOCAL_CACHE_MIN_GRANULARITY ||
+        granularity > LOCAL_CACHE_MAX_GRANULARITY) {
+        error_setg(errp, "granularity of local-cache filter must be a power "
+                   "of 2 between %d and %d", LOCAL_CACHE_MIN_GRANULARITY,
+                   LOCAL_CACHE_MAX_GRANULARITY);
+        goto out;
+    }
+    s->granularity = granularity;
+    ok = true;
+
+out:
+    qemu_opts_del(opts);
+    return ok;
+}
+
+/* Called with s->lock held */
+static void local_cache_mark_stale(BDRVLocalCacheState *s, int64_t offset,
+                                   int64_t bytes)
+{
+    uint64_t first = offset / s->page_coverage;
+    uint64_t last = (offset + bytes - 1) / s->page_coverage;
+
+    bitmap_set(s->stale_pages, first, last - first + 1);
+}
+
+/*
+ * Wait for the requests on the chunks of [@offset, @offset + @bytes) and
+ * lock these chunks in @req.
+ */
+static void coroutine_fn local_cache_lock(BDRVLocalCacheState *s,
+                                          BlockReq *req, int64_t offset,
+                                          int64_t bytes)
+{
+    int64_t start = QEMU_ALIGN_DOWN(offset, s->granularity);
+    int64_t end = MIN(QEMU_ALIGN_UP(offset + bytes, s->granularity),
+                      s->size);
+
+    QEMU_LOCK_GUARD(&s->lock);
+    reqlist_wait_all(&s->reqs, start, end - start, &s->lock);
+    reqlist_init_req(&s->reqs, req, start, end - start);
+}
+
+static void coroutine_fn local_cache_unlock(BDRVLocalCacheState *s,
+                                            BlockReq *req)
+{
+    QEMU_LOCK_GUARD(&s->lock);
+    reqlist_remove_req(req);
+}
+
+/* Called with s->lock held */
+static int coroutine_fn GRAPH_RDLOCK
+local_cache_co_write_page(BlockDriverState *bs, BdrvDirtyBitmap *bitmap,
+                          uint64_t page, BdrvRequestFlags flags)
+{
+    BDRVLocalCacheState *s = bs->opaque;
+    int64_t offset = page * s->page_coverage;
+    int64_t bytes = MIN(s->page_coverage, s->size - offset);
+    int64_t pos = bitmap == s->valid ? s->valid_offset : s->dirty_offset;
+
+    memset(s->page_buf, 0, LOCAL_CACHE_PAGE_SIZE);
+    bdrv_dirty_bitmap_serialize_part(bitmap, s->page_buf, offset, bytes);
+    return bdrv_co_pwrite(s->local, pos + page * LOCAL_CACHE_PAGE_SIZE,
+                          LOCAL_CACHE_PAGE_SIZE, s->page_buf, flags);
+}
+
+/*
+ * Write the pages of @bitmap that cover [@offset, @offset + @bytes) right
+ * away.  Called with s->lock held.
+ */
+static int coroutine_fn GRAPH_RDLOCK
+local_cache_co_persist(BlockDriverState *bs, BdrvDirtyBitmap *bitmap,
+                       int64_t offset, int64_t bytes)
+{
+    BDRVLocalCacheState *s = bs->opaque;
+    uint64_t page = offset / s->page_coverage;
+    uint64_t last = (offset + bytes - 1) / s->page_coverage;
+    int ret = 0;
+
+    /* The pages may also hold valid bits whose data is not stable yet */
+    if (bitmap == s->valid && s->data_unflushed) {
+        ret = bdrv_co_flush(s->local->bs);
+        if (ret == 0) {
+            s->data_unflushed = false;
+        }
+    }
+
+    for (; ret == 0 && page <= last; page++) {
+        ret = local_cache_co_write_page(bs, bitmap, page, BDRV_REQ_FUA);
+    }
+
+    if (ret < 0) {
+        /* Try again on the next flush */
+        local_cache_mark_stale(s, offset, bytes);
+    }
+    return ret;
+}
+
+/*
+ * Make the data in the local image and the delayed changes to the bitmaps
+ * stable.
+ */
+static int coroutine_fn GRAPH_RDLOCK local_cache_co_sync(BlockDriverState *bs)
+{
+    BDRVLocalCacheState *s = bs->opaque;
+    bool written = false;
+    unsigned long page;
+    int ret;
+
+    QEMU_LOCK_GUARD(&s->lock);
+
+    ret = bdrv_co_flush(s->local->bs);
+    if (ret < 0) {
+        return ret;
+    }
+    s->data_unflushed = false;
+
+    for (page = find_first_bit(s->stale_pages, s->nb_pages);
+         page < s->nb_pages;
+         page = find_next_bit(s->stale_pages, s->nb_pages, page + 1)) {
+        clear_bit(page, s->stale_pages);
+        ret = local_cache_co_write_page(bs, s->valid, page, 0);
+        if (ret == 0) {
+            ret = local_cache_co_write_page(bs, s->dirty, page, 0);
+        }
+        if (ret < 0) {
+            set_bit(page, s->stale_pages);
+            return ret;
+        }
+        written = true;
+    }
+
+    return written ? bdrv_co_flush(s->local->bs) : 0;
+}
+
+/* Mark the chunks of a locked range dirty, before their data changes */
+static int coroutine_fn GRAPH_RDLOCK
+local_cache_co_set_dirty(BlockDriverState *bs, int64_t offset, int64_t bytes)
+{
+    BDRVLocalCacheState *s = bs->opaque;
+
+    QEMU_LOCK_GUARD(&s->lock);
+
+    if (bdrv_dirty_bitmap_next_zero(s->dirty, offset, bytes) < 0) {
+        return 0;
+    }
+    bdrv_set_dirty_bitmap(s->dirty, offset, bytes);
+    return local_cache_co_persist(bs, s->dirty, offset, bytes);
+}
+
+/* Mark the chunks of a locked range valid, once their data is written */
+static void coroutine_fn local_cache_set_valid(BDRVLocalCacheState *s,
+                                               int64_t offset, int64_t bytes)
+{
+    QEMU_LOCK_GUARD(&s->lock);
+
+    bdrv_set_dirty_bitmap(s->valid, offset, bytes);
+    local_cache_mark_stale(s, offset, bytes);
+    s->data_unflushed = true;
+}
+
+/* Drop the chunks of a locked range from the cache */
+static int coroutine_fn GRAPH_RDLOCK
+local_cache_co_invalidate(BlockDriverState *bs, int64_t offset,
+                          int64_t bytes)
+{
+    BDRVLocalCacheState *s = bs->opaque;
+    int ret;
+
+    QEMU_LOCK_GUARD(&s->lock);
+
+    if (bdrv_dirty_bitmap_next_dirty(s->valid, offset, bytes) < 0 &&
+        bdrv_dirty_bitmap_next_dirty(s->dirty, offset, bytes) < 0) {
+        return 0;
+    }
+
+    trace_local_cache_invalidate(bs, offset, bytes);
+
+    bdrv_reset_dirty_bitmap(s->valid, offset, bytes);
+    bdrv_reset_dirty_bitmap(s->dirty, offset, bytes);
+
+    /* A dirty chunk that is not valid is ignored, so clear valid first */
+    ret = local_cache_co_persist(bs, s->valid, offset, bytes);
+    if (ret == 0) {
+        ret = local_cache_co_persist(bs, s->dirty, offset, bytes);
+    }
+    return ret;
+}
+
+/* Copy the dirty chunks of a locked range to the cached node */
+static int coroutine_fn GRAPH_RDLOCK
+local_cache_co_copy_dirty(BlockDriverState *bs, int64_t offset,
+                          int64_t bytes)
+{
+    BDRVLocalCacheState *s = bs->opaque;
+    int64_t end = offset + bytes;
+    uint8_t *buf = NULL;
+    int ret = 0;
+
+    while (ret == 0) {
+        int64_t start, n;
+        bool found;
+
+        qemu_co_mutex_lock(&s->lock);
+        found = bdrv_dirty_bitmap_next_dirty_area(s->dirty, offset, end,
+                                                  LOCAL_CACHE_COPY_SIZE,
+                                                  &start, &n);
+        qemu_co_mutex_unlock(&s->lock);
+        if (!found) {
+            break;
+        }
+
+        if (!buf) {
+            buf = qemu_try_blockalign(s->local->bs, LOCAL_CACHE_COPY_SIZE);
+            if (!buf) {
+                ret = -ENOMEM;
+                break;
+            }
+        }
+
+        trace_local_cache_writeback(bs, start, n);
+        ret = bdrv_co_pread(s->local, start, n, buf, 0);
+        if (ret == 0) {
+            ret = bdrv_co_pwrite(bs->file, start, n, buf, 0);
+        }
+        offset = start + n;
+    }
+
+    qemu_vfree(buf);
+    return ret;
+}
+
+static void coroutine_fn local_cache_unlock_windows(BDRVLocalCacheState *s,
+                                                    GPtrArray *locked)
+{
+    guint i;
+
+    for (i = 0; i < locked->len; i++) {
+        local_cache_unlock(s, g_ptr_array_index(locked, i));
+    }
+    g_ptr_array_set_size(locked, 0);
+}
+
+/*
+ * Once the cached node has the data of the dirty chunks in the @locked
+ * windows, make it stable and mark the chunks clean, or drop them from
+ * the cache if @evict is true.  Unlocks the windows.
+ */
+static int coroutine_fn GRAPH_RDLOCK
+local_cache_co_clean(BlockDriverState *bs, GPtrArray *locked, bool evict)
+{
+    BDRVLocalCacheState *s = bs->opaque;
+    guint i;
+    int ret;
+
+    ret = bdrv_co_flush(bs->file->bs);
+
+    for (i = 0; ret == 0 && i < locked->len; i++) {
+        BlockReq *req = g_ptr_array_index(locked, i);
+
+        if (evict) {
+            ret = local_cache_co_invalidate(bs, req->offset, req->bytes);
+            if (ret == 0) {
+                /* Only frees space, the data is not used anymore */
+                bdrv_co_pdiscard(s->local, req->offset, req->bytes);
+            }
+        } else {
+            WITH_QEMU_LOCK_GUARD(&s->lock) {
+                bdrv_reset_dirty_bitmap(s->dirty, req->offset, req->bytes);
+                local_cache_mark_stale(s, req->offset, req->bytes);
+            }
+        }
+    }
+
+    local_cache_unlock_windows(s, locked);
+    return ret;
+}
+
+/*
+ * Make the data of all dirty chunks stable in the cached node and mark
+ * them clean.  With @copy, the data is copied from the local image first;
+ * otherwise it was already written to both images.  With @evict, also
+ * drop all chunks from the cache.
+ */
+static int coroutine_fn GRAPH_RDLOCK
+local_cache_co_writeback(BlockDriverState *bs, bool copy, bool evict)
+{
+    BDRVLocalCacheState *s = bs->opaque;
+    g_autoptr(GPtrArray) locked = g_ptr_array_new_with_free_func(g_free);
+    int64_t offset;
+    int ret = 0;
+
+    qemu_co_mutex_lock(&s->writeback_lock);
+
+    for (offset = 0; ret == 0 && offset < s->size;
+         offset += LOCAL_CACHE_WINDOW) {
+        int64_t bytes = MIN(LOCAL_CACHE_WINDOW, s->size - offset);
+        BlockReq *req;
+        bool needed;
+
+        qemu_co_mutex_lock(&s->lock);
+        needed = bdrv_dirty_bitmap_next_dirty(s->dirty, offset, bytes) >= 0 ||
+                 (evict &&
+                  bdrv_dirty_bitmap_next_dirty(s->valid, offset, bytes) >= 0);
+        qemu_co_mutex_unlock(&s->lock);
+        if (!needed) {
+            continue;
+        }
+
+        req = g_new(BlockReq, 1);
+        local_cache_lock(s, req, offset, bytes);
+        g_ptr_array_add(locked, req);
+
+        if (copy) {
+            ret = local_cache_co_copy_dirty(bs, offset, bytes);
+        }
+        /*
+         * Copying or dropping data keeps the guest waiting, so do it one
+         * window at a time.  Otherwise a single flush covers all windows.
+         */
+        if (ret == 0 && (copy || evict)) {
+            ret = local_cache_co_clean(bs, locked, evict);
+        }
+    }
+
+    if (ret == 0 && locked->len) {
+        ret = local_cache_co_clean(bs, locked, evict);
+    }
+    local_cache_unlock_windows(s, locked);
+
+    qemu_co_mutex_unlock(&s->writeback_lock);
+    return ret;
+}
+
+static int coroutine_fn GRAPH_RDLOCK
+local_cache_co_write_header(BlockDriverState *bs)
+{
+    BDRVLocalCacheState *s = bs->opaque;
+    LocalCacheHeader *header = (LocalCacheHeader *)s->page_buf;
+
+    memset(s->page_buf, 0, LOCAL_CACHE_PAGE_SIZE);
+    *header = (LocalCacheHeader) {
+        .magic = cpu_to_be64(LOCAL_CACHE_MAGIC),
+        .version = cpu_to_be32(LOCAL_CACHE_VERSION),
+        .flags = cpu_to_be32(s->policy == LOCAL_CACHE_POLICY_WRITE_BACK ?
+                             LOCAL_CACHE_F_WRITE_BACK : 0),
+        .size = cpu_to_be64(s->size),
+        .granularity = cpu_to_be32(s->granularity),
+    };
+    return bdrv_co_pwrite(s->local, s->meta_offset, LOCAL_CACHE_PAGE_SIZE,
+                          s->page_buf, BDRV_REQ_FUA);
+}
+
+/* Start with an empty cache, whatever the local image holds */
+static int coroutine_fn GRAPH_RDLOCK
+local_cache_co_format(BlockDriverState *bs, Error **errp)
+{
+    BDRVLocalCacheState *s = bs->opaque;
+    int64_t len;
+    int ret;
+
+    bdrv_reset_dirty_bitmap(s->valid, 0, s->size);
+    bdrv_reset_dirty_bitmap(s->dirty, 0, s->size);
+    bitmap_zero(s->stale_pages, s->nb_pages);
+
+    len = bdrv_co_getlength(s->local->bs);
+    if (len < 0) {
+        error_setg_errno(errp, -len, "Could not get the size of the cache "
+                         "image");
+        return len;
+    }
+    if (len < s->meta_end) {
+        ret = bdrv_co_truncate(s->local, s->meta_end, false,
+                               PREALLOC_MODE_OFF, 0, errp);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+
+    /* Write the header last, so that an interrupted format is not valid */
+    ret = bdrv_co_pwrite_zeroes(s->local, s->meta_offset,
+                                s->meta_end - s->meta_offset, 0);
+    if (ret == 0) {
+        ret = bdrv_co_flush(s->local->bs);
+    }
+    if (ret == 0) {
+        ret = local_cache_co_write_header(bs);
+    }
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "Could not initialize the cache image");
+    }
+    return ret;
+}
+
+static int coroutine_fn GRAPH_RDLOCK
+local_cache_co_read_bitmap(BlockDriverState *bs, BdrvDirtyBitmap *bitmap,
+                           int64_t pos)
+{
+    BDRVLocalCacheState *s = bs->opaque;
+    uint64_t page;
+    int ret;
+
+    for (page = 0; page < s->nb_pages; page++) {
+        int64_t offset = page * s->page_coverage;
+        int64_t bytes = MIN(s->page_coverage, s->size - offset);
+
+        ret = bdrv_co_pread(s->local, pos + page * LOCAL_CACHE_PAGE_SIZE,
+                            LOCAL_CACHE_PAGE_SIZE, s->page_buf, 0);
+        if (ret < 0) {
+            return ret;
+        }
+        bdrv_dirty_bitmap_deserialize_part(bitmap, s->page_buf, offset, bytes,
+                                           false);
+    }
+    bdrv_dirty_bitmap_deserialize_finish(bitmap);
+    return 0;
+}
+
+/*
+ * Bring the bitmaps back in line with the data after QEMU stopped without
+ * closing the cache.  Dirty chunks that were being written are dropped;
+ * the others are written back if they hold write-back data that the new
+ * policy does not keep, and dropped if the cached node has their data.
+ */
+static int coroutine_fn GRAPH_RDLOCK
+local_cache_co_recover(BlockDriverState *bs, bool write_back)
+{
+    BDRVLocalCacheState *s = bs->opaque;
+    int64_t offset = 0, start, n;
+
+    while (bdrv_dirty_bitmap_next_dirty_area(s->dirty, offset, s->size,
+                                             INT64_MAX, &start, &n)) {
+        for (offset = start; offset < start + n; offset += s->granularity) {
+            int64_t bytes = MIN(s->granularity, s->size - offset);
+
+            if (!write_back || !bdrv_dirty_bitmap_get(s->valid, offset)) {
+                bdrv_reset_dirty_bitmap(s->valid, offset, bytes);
+                bdrv_reset_dirty_bitmap(s->dirty, offset, bytes);
+                local_cache_mark_stale(s, offset, bytes);
+            }
+        }
+    }
+
+    if (write_back && s->policy != LOCAL_CACHE_POLICY_WRITE_BACK) {
+        return local_cache_co_writeback(bs, true, false);
+    }
+    return 0;
+}
+
+/*
+ * Check the header of the local image and take the granularity from it.
+ * Returns 1 if the header is valid, 0 if there is none, and a negative
+ * errno value if the local image does not fit the cached node.
+ */
+static int coroutine_fn GRAPH_RDLOCK
+local_cache_co_read_header(BlockDriverState *bs, bool has_granularity,
+                           bool *write_back, Error **errp)
+{
+    BDRVLocalCacheState *s = bs->opaque;
+    LocalCacheHeader header;
+    uint32_t granularity;
+    int64_t len;
+    int ret;
+
+    len = bdrv_co_getlength(s->local->bs);
+    if (len < 0) {
+        error_setg_errno(errp, -len, "Could not get the size of the cache "
+                         "image");
+        return len;
+    }
+    if (len < s->meta_offset + LOCAL_CACHE_PAGE_SIZE) {
+        return 0;
+    }
+
+    ret = bdrv_co_pread(s->local, s->meta_offset, sizeof(header), &header, 0);
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "Could not read the cache header");
+        return ret;
+    }
+    if (be64_to_cpu(header.magic) != LOCAL_CACHE_MAGIC) {
+        return 0;
+    }
+
+    if (be32_to_cpu(header.version) != LOCAL_CACHE_VERSION) {
+        error_setg(errp, "Unsupported local cache version %" PRIu32,
+                   be32_to_cpu(header.version));
+        return -ENOTSUP;
+    }
+    if (be64_to_cpu(header.size) != s->size) {
+        error_setg(errp, "The cache image was created for a node of %" PRIu64
+                   " bytes, not %" PRId64, be64_to_cpu(header.size), s->size);
+        return -EINVAL;
+    }
+    granularity = be32_to_cpu(header.granularity);
+    if (!is_power_of_2(granularity) ||
+        granularity < LOCAL_CACHE_MIN_GRANULARITY ||
+        granularity > LOCAL_CACHE_MAX_GRANULARITY) {
+        error_setg(errp, "Invalid granularity %" PRIu32 " in the cache image",
+                   granularity);
+        return -EINVAL;
+    }
+    if (has_granularity && granularity != s->granularity) {
+        error_setg(errp, "The cache image was created with granularity %"
+                   PRIu32 ", not %" PRIu32, granularity, s->granularity);
+        return -EINVAL;
+    }
+    s->granularity = granularity;
+    *write_back = be32_to_cpu(header.flags) & LOCAL_CACHE_F_WRITE_BACK;
+
+    return 1;
+}
+
+/* Set up the bitmaps and the layout of the metadata for s->granularity */
+static int local_cache_setup(BlockDriverState *bs, Error **errp)
+{
+    BDRVLocalCacheState *s = bs->opaque;
+
+    s->valid = bdrv_create_dirty_bitmap(bs, s->granularity, NULL, errp);
+    if (!s->valid) {
+        return -EINVAL;
+    }
+    bdrv_disable_dirty_bitmap(s->valid);
+
+    s->dirty = bdrv_create_dirty_bitmap(bs, s->granularity, NULL, errp);
+    if (!s->dirty) {
+        return -EINVAL;
+    }
+    bdrv_disable_dirty_bitmap(s->dirty);
+
+    s->page_coverage =
+        bdrv_dirty_bitmap_serialization_coverage(LOCAL_CACHE_PAGE_SIZE,
+                                                 s->valid);
+    s->nb_pages = DIV_ROUND_UP(s->size, s->page_coverage);
+    s->stale_pages = bitmap_new(s->nb_pages);
+
+    s->valid_offset = s->meta_offset + LOCAL_CACHE_PAGE_SIZE;
+    s->dirty_offset = s->valid_offset + s->nb_pages * LOCAL_CACHE_PAGE_SIZE;
+    s->meta_end = s->dirty_offset + s->nb_pages * LOCAL_CACHE_PAGE_SIZE;
+    return 0;
+}
+
+static void local_cache_cleanup(BlockDriverState *bs)
+{
+    BDRVLocalCacheState *s = bs->opaque;
+
+    if (s->valid) {
+        bdrv_release_dirty_bitmap(s->valid);
+    }
+    if (s->dirty) {
+        bdrv_release_dirty_bitmap(s->dirty);
+    }
+    g_free(s->stale_pages);
+    qemu_vfree(s->page_buf);
+}
+
+static void coroutine_fn local_cache_open_entry(void *opaque)
+{
+    LocalCacheCo *lco = opaque;
+    BlockDriverState *bs = lco->bs;
+    BDRVLocalCacheState *s = bs->opaque;
+    bool active = !(bs->open_flags & BDRV_O_INACTIVE);
+    bool write_back = false;
+    int found = 0;
+    int ret;
+
+    GRAPH_RDLOCK_GUARD();
+
+    if (active) {
+        found = local_cache_co_read_header(bs, lco->has_granularity,
+                                           &write_back, lco->errp);
+        if (found < 0) {
+            ret = found;
+            goto out;
+        }
+    }
+
+    ret = local_cache_setup(bs, lco->errp);
+    if (ret < 0 || !active) {
+        /* An inactive cache is set up when it is activated */
+        goto out;
+    }
+
+    if (!found) {
+        ret = local_cache_co_format(bs, lco->errp);
+        goto out;
+    }
+
+    ret = local_cache_co_read_bitmap(bs, s->valid, s->valid_offset);
+    if (ret == 0) {
+        ret = local_cache_co_read_bitmap(bs, s->dirty, s->dirty_offset);
+    }
+    if (ret < 0) {
+        error_setg_errno(lco->errp, -ret, "Could not read the cache bitmaps");
+        goto out;
+    }
+
+    if (write_back && s->policy != LOCAL_CACHE_POLICY_WRITE_BACK &&
+        bdrv_is_read_only(bs) && bdrv_get_dirty_count(s->dirty)) {
+        error_setg(lco->errp, "The cache image holds data that was not "
+                   "written back yet, which needs a writable node");
+        ret = -EPERM;
+        goto out;
+    }
+
+    ret = local_cache_co_recover(bs, write_back);
+    if (ret == 0) {
+        ret = local_cache_co_sync(bs);
+    }
+    /* Only now do the dirty chunks on disk match the policy */
+    if (ret == 0 &&
+        write_back != (s->policy == LOCAL_CACHE_POLICY_WRITE_BACK)) {
+        ret = local_cache_co_write_header(bs);
+    }
+    if (ret < 0) {
+        error_setg_errno(lco->errp, -ret, "Could not recover the cache");
+    }
+
+out:
+    lco->ret = ret;
+    aio_wait_kick();
+}
+
+static void local_cache_local_options(BdrvChildRole role,
+                                      bool parent_is_format, int *child_flags,
+                                      QDict *child_options, int parent_flags,
+                                      QDict *parent_options)
+{
+    /* The cache image is written even if the cached node is read-only */
+    qdict_set_default_str(child_options, BDRV_OPT_READ_ONLY, "off");
+    qdict_set_default_str(child_options, BDRV_OPT_AUTO_READ_ONLY, "off");
+    child_of_bds.inherit_options(role, parent_is_format, child_flags,
+                                 child_options, parent_flags, parent_options);
+}
+
+static BdrvChildClass child_local_cache;
+
+static int local_cache_open(BlockDriverState *bs, QDict *options, int flags,
+                            Error **errp)
+{
+    BDRVLocalCacheState *s = bs->opaque;
+    LocalCacheCo lco = {
+        .bs = bs,
+        .errp = errp,
+        .ret = -EINPROGRESS,
+    };
+    const char *local_ref;
+    int ret;
+
+    GLOBAL_STATE_CODE();
+
+    /* The permissions on the children depend on the policy */
+    if (!local_cache_absorb_opts(s, options, &lco.has_granularity, errp)) {
+        return -EINVAL;
+    }
+
+    ret = bdrv_open_file_child(NULL, options, "file", bs, errp);
+    if (ret < 0) {
+        return ret;
+    }
+
+    local_ref = qdict_get_try_str(options, "local");
+    if (local_ref) {
+        BlockDriverState *local_bs = bdrv_lookup_bs(local_ref, local_ref,
+                                                    NULL);
+
+        if (local_bs && bdrv_is_read_only(local_bs) &&
+            !(local_bs->open_flags & BDRV_O_AUTO_RDONLY)) {
+            error_setg(errp, "The cache image '%s' must not be read-only",
+                       local_ref);
+            return -EACCES;
+        }
+    }
+
+    s->local = bdrv_open_child(NULL, options, "local", bs, &child_local_cache,
+                               BDRV_CHILD_DATA | BDRV_CHILD_METADATA, false,
+                               errp);
+    if (!s->local) {
+        return -EINVAL;
+    }
+
+    bdrv_graph_rdlock_main_loop();
+    s->size = bdrv_getlength(bs->file->bs);
+    s->page_buf = qemu_blockalign(s->local->bs, LOCAL_CACHE_PAGE_SIZE);
+
+    bs->supported_write_flags = BDRV_REQ_WRITE_UNCHANGED | BDRV_REQ_FUA;
+    if (s->policy == LOCAL_CACHE_POLICY_WRITE_BACK) {
+        /* Zeroes are written to the local image, like data */
+        bs->supported_zero_flags = BDRV_REQ_WRITE_UNCHANGED | BDRV_REQ_FUA |
+            ((BDRV_REQ_MAY_UNMAP | BDRV_REQ_NO_FALLBACK) &
+                s->local->bs->supported_zero_flags);
+    } else {
+        bs->supported_zero_flags = BDRV_REQ_WRITE_UNCHANGED |
+            ((BDRV_REQ_FUA | BDRV_REQ_MAY_UNMAP | BDRV_REQ_NO_FALLBACK) &
+                bs->file->bs->supported_zero_flags);
+    }
+    bdrv_graph_rdunlock_main_loop();
+
+    if (s->size < 0) {
+        error_setg_errno(errp, -s->size, "Could not get the size of the "
+                         "cached node");
+        qemu_vfree(s->page_buf);
+        return s->size;
+    }
+    s->meta_offset = ROUND_UP(s->size, LOCAL_CACHE_META_ALIGN);
+
+    qemu_co_mutex_init(&s->lock);
+    qemu_co_mutex_init(&s->writeback_lock);
+    reqlist_init(&s->reqs);
+
+    aio_co_enter(bdrv_get_aio_context(bs),
+                 qemu_coroutine_create(local_cache_open_entry, &lco));
+    AIO_WAIT_WHILE_UNLOCKED(NULL, lco.ret == -EINPROGRESS);
+
+    if (lco.ret < 0) {
+        local_cache_cleanup(bs);
+    }
+    return lco.ret;
+}
+
+static void coroutine_fn local_cache_writeback_entry(void *opaque)
+{
+    LocalCacheCo *lco = opaque;
+    BlockDriverState *bs = lco->bs;
+    BDRVLocalCacheState *s = bs->opaque;
+    int ret;
+
+    GRAPH_RDLOCK_GUARD();
+
+    ret = local_cache_co_writeback(bs,
+                                   s->policy == LOCAL_CACHE_POLICY_WRITE_BACK,
+                                   false);
+    if (ret == 0) {
+        ret = local_cache_co_sync(bs);
+    }
+
+    lco->ret = ret;
+    aio_wait_kick();
+}
+
+/* Write back all dirty data and the bitmaps, outside of coroutine context */
+static int local_cache_writeback_all(BlockDriverState *bs)
+{
+    LocalCacheCo lco = {
+        .bs = bs,
+        .ret = -EINPROGRESS,
+    };
+
+    aio_co_enter(bdrv_get_aio_context(bs),
+                 qemu_coroutine_create(local_cache_writeback_entry, &lco));
+    BDRV_POLL_WHILE(bs, lco.ret == -EINPROGRESS);
+    return lco.ret;
+}
+
+static int GRAPH_RDLOCK local_cache_inactivate(BlockDriverState *bs)
+{
+    /* Whoever uses the cached node next must find all of its data there */
+    return local_cache_writeback_all(bs);
+}
+
+static void coroutine_fn GRAPH_RDLOCK
+local_cache_co_invalidate_cache(BlockDriverState *bs, Error **errp)
+{
+    /*
+     * The cached node may have been written while this node was inactive,
+     * for example by the destination of a migration, so start over.
+     */
+    local_cache_co_format(bs, errp);
+}
+
+static void GRAPH_UNLOCKED local_cache_close(BlockDriverState *bs)
+{
+    int ret;
+
+    GLOBAL_STATE_CODE();
+
+    if (!(bs->open_flags & BDRV_O_INACTIVE)) {
+        ret = local_cache_writeback_all(bs);
+        if (ret < 0) {
+            warn_report("local-cache: Failed to write back the cache of '%s',"
+                        " dirty data stays in the cache image: %s",
+                        bdrv_get_node_name(bs), strerror(-ret));
+        }
+    }
+
+    local_cache_cleanup(bs);
+}
+
+static void local_cache_child_perm(BlockDriverState *bs, BdrvChild *c,
+                                   BdrvChildRole role,
+                                   BlockReopenQueue *reopen_queue,
+                                   uint64_t perm, uint64_t shared,
+                                   uint64_t *nperm, uint64_t *nshared)
+{
+    BDRVLocalCacheState *s = bs->opaque;
+    bool active = !(bs->open_flags & BDRV_O_INACTIVE);
+
+    if (!(role & BDRV_CHILD_FILTERED)) {
+        /* The cache image belongs to this node */
+        *nperm = BLK_PERM_CONSISTENT_READ;
+        if (active) {
+            *nperm |= BLK_PERM_WRITE | BLK_PERM_RESIZE;
+        }
+        *nshared = BLK_PERM_CONSISTENT_READ | BLK_PERM_WRITE_UNCHANGED;
+        return;
+    }
+
+    /*
+     * Writes that bypass the filter would leave stale data in the cache,
+     * and the cache is laid out for the current size of the cached node.
+     */
+    *nperm = perm & (BLK_PERM_CONSISTENT_READ | BLK_PERM_WRITE);
+    *nshared = shared & ~(BLK_PERM_WRITE | BLK_PERM_RESIZE);
+
+    /*
+     * Writeback changes the data of the cached node, which is stale until
+     * then, whether it runs on flush, at close and inactivation, or when a
+     * write-back cache is recovered at open.  Only the write-back policy
+     * and that recovery leave dirty data to write back, and the recovery
+     * fails on a read-only node, so leave a read-only cached node alone
+     * otherwise.
+     */
+    if (active && (s->policy == LOCAL_CACHE_POLICY_WRITE_BACK ||
+                   !bdrv_is_read_only(bs))) {
+        *nperm |= BLK_PERM_WRITE;
+    }
+}
+
+static int64_t coroutine_fn GRAPH_RDLOCK
+local_cache_co_getlength(BlockDriverState *bs)
+{
+    BDRVLocalCacheState *s = bs->opaque;
+
+    return s->size;
+}
+
+/* Read a run of chunks that are not cached, and cache them */
+static int coroutine_fn GRAPH_RDLOCK
+local_cache_co_read_miss(BlockDriverState *bs, int64_t offset, int64_t bytes,
+                         QEMUIOVector *qiov, size_t qiov_offset)
+{
+    BDRVLocalCacheState *s = bs->opaque;
+    int64_t start = QEMU_ALIGN_DOWN(offset, s->granularity);
+    int64_t end = MIN(QEMU_ALIGN_UP(offset + bytes, s->granularity),
+                      s->size);
+    uint8_t *buf = NULL;
+    int ret;
+
+    if (!(bs->open_flags & BDRV_O_INACTIVE)) {
+        buf = qemu_try_blockalign(s->local->bs, end - start);
+    }
+    if (!buf) {
+        return bdrv_co_preadv_part(bs->file, offset, bytes, qiov, qiov_offset,
+                                   0);
+    }
+
+    ret = bdrv_co_pread(bs->file, start, end - start, buf, 0);
+    if (ret == 0) {
+        qemu_iovec_from_buf(qiov, qiov_offset, buf + (offset - start), bytes);
+
+        /* The guest has its data, failing to cache it is not an error */
+        if (bdrv_co_pwrite(s->local, start, end - start, buf, 0) == 0) {
+            trace_local_cache_populate(bs, start, end - start);
+            local_cache_set_valid(s, start, end - start);
+        }
+    }
+
+    qemu_vfree(buf);
+    return ret;
+}
+
+static int coroutine_fn GRAPH_RDLOCK
+local_cache_co_preadv_part(BlockDriverState *bs, int64_t offset, int64_t bytes,
+                           QEMUIOVector *qiov, size_t qiov_offset,
+                           BdrvRequestFlags flags)
+{
+    BDRVLocalCacheState *s = bs->opaque;
+    BlockReq req;
+    int ret = 0;
+
+    local_cache_lock(s, &req, offset, bytes);
+
+    while (bytes) {
+        int64_t n;
+        bool valid;
+
+        qemu_co_mutex_lock(&s->lock);
+        valid = bdrv_dirty_bitmap_status(s->valid, offset, bytes, &n);
+        qemu_co_mutex_unlock(&s->lock);
+
+        if (valid) {
+            ret = bdrv_co_preadv_part(s->local, offset, n, qiov, qiov_offset,
+                                      0);
+        } else {
+            ret = local_cache_co_read_miss(bs, offset, n, qiov, qiov_offset);
+        }
+        if (ret < 0) {
+            break;
+        }
+
+        offset += n;
+        qiov_offset += n;
+        bytes -= n;
+    }
+
+    local_cache_unlock(s, &req);
+    return ret;
+}
+
+/*
+ * Write to both images.  The chunks are dirty until the cached node has
+ * their data, so that they are dropped from the cache if QEMU stops in
+ * between.
+ */
+static int coroutine_fn GRAPH_RDLOCK
+local_cache_co_write_through(BlockDriverState *bs, BlockReq *req,
+                             int64_t offset, int64_t bytes,
+                             QEMUIOVector *qiov, size_t qiov_offset,
+                             BdrvRequestFlags flags)
+{
+    BDRVLocalCacheState *s = bs->opaque;
+    int64_t pos, n;
+    bool cached;
+    int ret;
+
+    qemu_co_mutex_lock(&s->lock);
+    cached = bdrv_dirty_bitmap_next_dirty(s->valid, req->offset,
+                                          req->bytes) >= 0;
+    qemu_co_mutex_unlock(&s->lock);
+
+    if (cached) {
+        ret = local_cache_co_set_dirty(bs, req->offset, req->bytes);
+        if (ret < 0) {
+            return ret;
+        }
+
+        for (pos = offset; pos < offset + bytes; pos += n) {
+            bool valid;
+
+            qemu_co_mutex_lock(&s->lock);
+            valid = bdrv_dirty_bitmap_status(s->valid, pos,
+                                             offset + bytes - pos, &n);
+            qemu_co_mutex_unlock(&s->lock);
+
+            if (valid &&
+                bdrv_co_pwritev_part(s->local, pos, n, qiov,
+                                     qiov_offset + (pos - offset), 0) < 0) {
+                /* The cached node still gets the data */
+                ret = local_cache_co_invalidate(bs, req->offset, req->bytes);
+                if (ret < 0) {
+                    return ret;
+                }
+                cached = false;
+                break;
+            }
+        }
+    }
+
+    ret = bdrv_co_pwritev_part(bs->file, offset, bytes, qiov, qiov_offset,
+                               flags);
+    if (ret < 0 && cached) {
+        /* Nobody knows which of the two images has the right data */
+        local_cache_co_invalidate(bs, req->offset, req->bytes);
+    }
+    return ret;
+}
+
+/* Copy [@offset, @offset + @bytes) from the cached node to the local image */
+static int coroutine_fn GRAPH_RDLOCK
+local_cache_co_fill(BlockDriverState *bs, int64_t offset, int64_t bytes)
+{
+    BDRVLocalCacheState *s = bs->opaque;
+    uint8_t *buf;
+    int ret;
+
+    buf = qemu_try_blockalign(s->local->bs, bytes);
+    if (!buf) {
+        return -ENOMEM;
+    }
+
+    ret = bdrv_co_pread(bs->file, offset, bytes, buf, 0);
+    if (ret == 0) {
+        ret = bdrv_co_pwrite(s->local, offset, bytes, buf, 0);
+    }
+
+    qemu_vfree(buf);
+    return ret;
+}
+
+/* Mark the chunks of a locked range clean if they are not valid */
+static void coroutine_fn local_cache_clean_invalid(BDRVLocalCacheState *s,
+                                                   int64_t offset,
+                                                   int64_t bytes)
+{
+    int64_t end = offset + bytes;
+    int64_t n;
+
+    QEMU_LOCK_GUARD(&s->lock);
+
+    for (; offset < end; offset += n) {
+        if (!bdrv_dirty_bitmap_status(s->valid, offset, end - offset, &n)) {
+            bdrv_reset_dirty_bitmap(s->dirty, offset, n);
+            local_cache_mark_stale(s, offset, n);
+        }
+    }
+}
+
+/*
+ * Write to the local image only, the chunks stay dirty until writeback.
+ * With a NULL @qiov, write zeroes.
+ */
+static int coroutine_fn GRAPH_RDLOCK
+local_cache_co_write_back(BlockDriverState *bs, BlockReq *req,
+                          int64_t offset, int64_t bytes,
+                          QEMUIOVector *qiov, size_t qiov_offset,
+                          BdrvRequestFlags flags)
+{
+    BDRVLocalCacheState *s = bs->opaque;
+    int64_t end = offset + bytes;
+    int64_t req_end = req->offset + req->bytes;
+    bool head_valid, tail_valid;
+    int ret;
+
+    ret = local_cache_co_set_dirty(bs, req->offset, req->bytes);
+    if (ret < 0) {
+        return ret;
+    }
+
+    qemu_co_mutex_lock(&s->lock);
+    head_valid = bdrv_dirty_bitmap_get(s->valid, req->offset);
+    tail_valid = bdrv_dirty_bitmap_get(s->valid, req_end - 1);
+    qemu_co_mutex_unlock(&s->lock);
+
+    /* Chunks that are not cached yet need the rest of their data */
+    if (offset > req->offset && !head_valid) {
+        ret = local_cache_co_fill(bs, req->offset, offset - req->offset);
+    }
+    if (ret == 0 && end < req_end && !tail_valid) {
+        ret = local_cache_co_fill(bs, end, req_end - end);
+    }
+    if (ret == 0 && qiov) {
+        ret = bdrv_co_pwritev_part(s->local, offset, bytes, qiov, qiov_offset,
+                                   0);
+    } else if (ret == 0) {
+        ret = bdrv_co_pwrite_zeroes(s->local, offset, bytes,
+                                    flags & (BDRV_REQ_MAY_UNMAP |
+                                             BDRV_REQ_NO_FALLBACK));
+    }
+    if (ret < 0) {
+        /* Chunks that were not cached yet hold nothing to write back */
+        local_cache_clean_invalid(s, req->offset, req->bytes);
+        return ret;
+    }
+
+    local_cache_set_valid(s, req->offset, req->bytes);
+
+    if (flags & BDRV_REQ_FUA) {
+        return local_cache_co_sync(bs);
+    }
+    return 0;
+}
+
+static int coroutine_fn GRAPH_RDLOCK
+local_cache_co_pwritev_part(BlockDriverState *bs, int64_t offset,
+                            int64_t bytes, QEMUIOVector *qiov,
+                            size_t qiov_offset, BdrvRequestFlags flags)
+{
+    BDRVLocalCacheState *s = bs->opaque;
+    BlockReq req;
+    int ret;
+
+    local_cache_lock(s, &req, offset, bytes);
+
+    switch (s->policy) {
+    case LOCAL_CACHE_POLICY_READ_THROUGH:
+        ret = local_cache_co_invalidate(bs, req.offset, req.bytes);
+        if (ret == 0) {
+            ret = bdrv_co_pwritev_part(bs->file, offset, bytes, qiov,
+                                       qiov_offset, flags);
+        }
+        break;
+    case LOCAL_CACHE_POLICY_WRITE_THROUGH:
+        ret = local_cache_co_write_through(bs, &req, offset, bytes, qiov,
+                                           qiov_offset, flags);
+        break;
+    case LOCAL_CACHE_POLICY_WRITE_BACK:
+        ret = local_cache_co_write_back(bs, &req, offset, bytes, qiov,
+                                        qiov_offset, flags);
+        break;
+    default:
+        abort();
+    }
+
+    local_cache_unlock(s, &req);
+    return ret;
+}
+
+static int coroutine_fn GRAPH_RDLOCK
+local_cache_co_pwrite_zeroes(BlockDriverState *bs, int64_t offset,
+                             int64_t bytes, BdrvRequestFlags flags)
+{
+    BDRVLocalCacheState *s = bs->opaque;
+    BlockReq req;
+    int ret;
+
+    local_cache_lock(s, &req, offset, bytes);
+
+    if (s->policy == LOCAL_CACHE_POLICY_WRITE_BACK) {
+        ret = local_cache_co_write_back(bs, &req, offset, bytes, NULL, 0,
+                                        flags);
+    } else {
+        ret = local_cache_co_invalidate(bs, req.offset, req.bytes);
+        if (ret == 0) {
+            ret = bdrv_co_pwrite_zeroes(bs->file, offset, bytes, flags);
+        }
+    }
+
+    local_cache_unlock(s, &req);
+    return ret;
+}
+
+/*
+ * In write-back mode, the chunks are dropped from the cache only once the
+ * cached node has discarded them, so that their data stays the newest if
+ * the discard fails.  If QEMU stops in between, the cache may still
+ * return the old data, which a discard allows.  The chunks that the
+ * request only partly covers stay in the cache, with the rest of their
+ * data.
+ */
+static int coroutine_fn GRAPH_RDLOCK
+local_cache_co_pdiscard(BlockDriverState *bs, int64_t offset, int64_t bytes)
+{
+    BDRVLocalCacheState *s = bs->opaque;
+    int64_t start = QEMU_ALIGN_UP(offset, s->granularity);
+    int64_t end = offset + bytes;
+    BlockReq req;
+    int ret;
+
+    if (end < s->size) {
+        end = QEMU_ALIGN_DOWN(end, s->granularity);
+    }
+
+    local_cache_lock(s, &req, offset, bytes);
+
+    if (s->policy == LOCAL_CACHE_POLICY_WRITE_BACK) {
+        ret = bdrv_co_pdiscard(bs->file, offset, bytes);
+        if (ret == 0 && start < end) {
+            ret = local_cache_co_invalidate(bs, start, end - start);
+            if (ret == 0) {
+                /* Only frees space, the data is not used anymore */
+                bdrv_co_pdiscard(s->local, start, end - start);
+            }
+        }
+    } else {
+        ret = local_cache_co_invalidate(bs, req.offset, req.bytes);
+        if (ret == 0) {
+            ret = bdrv_co_pdiscard(bs->file, offset, bytes);
+        }
+    }
+
+    local_cache_unlock(s, &req);
+    return ret;
+}
+
+static int coroutine_fn GRAPH_RDLOCK local_cache_co_flush(BlockDriverState *bs)
+{
+    BDRVLocalCacheState *s = bs->opaque;
+    int ret;
+
+    /* Chunks written to both images are clean once both are stable */
+    if (s->policy == LOCAL_CACHE_POLICY_WRITE_THROUGH) {
+        ret = local_cache_co_writeback(bs, false, false);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+
+    ret = local_cache_co_sync(bs);
+    if (ret < 0) {
+        return ret;
+    }
+
+    return bdrv_co_flush(bs->file->bs);
+}
+
+static BlockDriver bdrv_local_cache = {
+    .format_name                        = "local-cache",
+    .instance_size                      = sizeof(BDRVLocalCacheState),
+
+    .bdrv_open                          = local_cache_open,
+    .bdrv_close                         = local_cache_close,
+    .bdrv_child_perm                    = local_cache_child_perm,
+
+    .bdrv_inactivate                    = local_cache_inactivate,
+    .bdrv_co_invalidate_cache           = local_cache_co_invalidate_cache,
+
+    .bdrv_co_getlength                  = local_cache_co_getlength,
+
+    .bdrv_co_preadv_part                = local_cache_co_preadv_part,
+    .bdrv_co_pwritev_part               = local_cache_co_pwritev_part,
+    .bdrv_co_pwrite_zeroes              = local_cache_co_pwrite_zeroes,
+    .bdrv_co_pdiscard                   = local_cache_co_pdiscard,
+    .bdrv_co_flush                      = local_cache_co_flush,
+
+    .is_filter                          = true,
+};
+
+void coroutine_fn qmp_local_cache_flush(const char *node_name,
+                                        bool has_evict, bool evict,
+                                        Error **errp)
+{
+    BlockDriverState *bs;
+    BDRVLocalCacheState *s;
+    AioContext *old_ctx;
+    int ret;
+
+    bs = bdrv_find_node(node_name);
+    if (!bs) {
+        error_setg(errp, "Node '%s' not found", node_name);
+        return;
+    }
+    if (bs->drv != &bdrv_local_cache) {
+        error_setg(errp, "Node '%s' is not a local-cache filter", node_name);
+        return;
+    }
+    if (bs->open_flags & BDRV_O_INACTIVE) {
+        error_setg(errp, "Node '%s' is inactive", node_name);
+        return;
+    }
+    s = bs->opaque;
+
+    bdrv_ref(bs);
+    old_ctx = bdrv_co_enter(bs);
+    bdrv_inc_in_flight(bs);
+    bdrv_graph_co_rdlock();
+
+    ret = local_cache_co_writeback(bs,
+                                   s->policy == LOCAL_CACHE_POLICY_WRITE_BACK,
+                                   has_evict && evict);
+    if (ret == 0) {
+        ret = local_cache_co_sync(bs);
+    }
+
+    bdrv_graph_co_rdunlock();
+    bdrv_dec_in_flight(bs);
+    bdrv_co_leave(bs, old_ctx);
+    bdrv_co_unref(bs);
+
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "Failed to flush the cache of '%s'",
+                         node_name);
+    }
+}
+
+static void bdrv_local_cache_init(void)
+{
+    child_local_cache = child_of_bds;
+    child_local_cache.inherit_options = local_cache_local_options;
+    bdrv_register(&bdrv_local_cache);
+}
+
+block_init(bdrv_local_cache_init);
@@ -24,7 +24,9 @@
 
 #include "qemu/osdep.h"
 #include "block/block-io.h"
+#include "qemu/bitmap.h"
 #include "qemu/memalign.h"
+#include "qemu/queue.h"
 #include "qcow2.h"
 #include "trace.h"
 
@@ -33,8 +35,14 @@ typedef struct Qcow2CachedTable {
     uint64_t lru_counter;
     int      ref;
     bool     dirty;
+    /* Bucket chain of the offset index, only linked while offset != 0 */
+    QLIST_ENTRY(Qcow2CachedTable) hash_entry;
+    /* Eviction order, only linked while ref == 0 */
+    QTAILQ_ENTRY(Qcow2CachedTable) lru_entry;
 } Qcow2CachedTable;
 
+typedef QLIST_HEAD(, Qcow2CachedTable) Qcow2CacheBucket;
+
 struct Qcow2Cache {
     Qcow2CachedTable       *entries;
     struct Qcow2Cache      *depends;
@@ -44,6 +52,20 @@ struct Qcow2Cache {
     void                   *table_array;
     uint64_t                lru_counter;
     uint64_t                cache_clean_lru_counter;
+
+    /*
+     * Offset-keyed index of the cached tables, so that lookups don't have
+     * to scan all entries.  The number of buckets is a power of two.
+     */
+    Qcow2CacheBucket       *buckets;
+    unsigned                bucket_mask;
+
+    /*
+     * Unreferenced entries, least recently used first.  Unused entries
+     * (offset == 0) are kept at the head so that they are recycled before
+     * anything that still holds a table.
+     */
+    QTAILQ_HEAD(, Qcow2CachedTable) lru;
 };
 
 static inline void *qcow2_cache_get_table_addr(Qcow2Cache *c, int table)
@@ -59,6 +81,63 @@ static inline int qcow2_cache_get_table_idx(Qcow2Cache *c, void *table)
     return idx;
 }
 
+static inline int qcow2_cache_entry_idx(Qcow2Cache *c, Qcow2CachedTable *t)
+{
+    return t - c->entries;
+}
+
+static inline Qcow2CacheBucket *qcow2_cache_bucket(Qcow2Cache *c,
+                                                   uint64_t offset)
+{
+    uint64_t key = offset / c->table_size;
+
+    /* Fibonacci hashing, so that strided table offsets spread evenly */
+    key *= 0x9e3779b97f4a7c15ULL;
+    return &c->buckets[(key >> 32) & c->bucket_mask];
+}
+
+static Qcow2CachedTable *qcow2_cache_lookup(Qcow2Cache *c, uint64_t offset)
+{
+    Qcow2CachedTable *t;
+
+    QLIST_FOREACH(t, qcow2_cache_bucket(c, offset), hash_entry) {
+        if (t->offset == offset) {
+            return t;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Change the offset of a cache entry and keep the offset index in sync.
+ * An offset of 0 marks the entry as unused.
+ */
+static void qcow2_cache_set_offset(Qcow2Cache *c, Qcow2CachedTable *t,
+                                   uint64_t offset)
+{
+    if (t->offset) {
+        QLIST_REMOVE(t, hash_entry);
+    }
+    t->offset = offset;
+    if (offset) {
+        QLIST_INSERT_HEAD(qcow2_cache_bucket(c, offset), t, hash_entry);
+    }
+}
+
+/*
+ * Turn an unreferenced entry into an unused one and queue it for reuse
+ * ahead of all entries that still hold a table.
+ */
+static void qcow2_cache_entry_reset(Qcow2Cache *c, Qcow2CachedTable *t)
+{
+    assert(t->ref == 0);
+
+    qcow2_cache_set_offset(c, t, 0);
+    t->lru_counter = 0;
+    QTAILQ_REMOVE(&c->lru, t, lru_entry);
+    QTAILQ_INSERT_HEAD(&c->lru, t, lru_entry);
+}
+
 static inline const char *qcow2_cache_get_name(BDRVQcow2State *s, Qcow2Cache *c)
 {
     if (c == s->refcount_block_cache) {
@@ -95,25 +174,38 @@ static inline bool can_clean_entry(Qcow2Cache *c, int i)
 
 void qcow2_cache_clean_unused(Qcow2Cache *c)
 {
-    int i = 0;
-    while (i < c->size) {
-        int to_clean = 0;
-
-        /* Skip the entries that we don't need to clean */
-        while (i < c->size && !can_clean_entry(c, i)) {
-            i++;
+    g_autofree unsigned long *cleaned = NULL;
+    Qcow2CachedTable *t, *next;
+    long start, end;
+
+    /*
+     * The LRU list is sorted by lru_counter, so all candidates are found
+     * at its head and we can stop at the first entry that has been used
+     * since the last run.
+     */
+    QTAILQ_FOREACH_SAFE(t, &c->lru, lru_entry, next) {
+        int i = qcow2_cache_entry_idx(c, t);
+
+        if (t->lru_counter > c->cache_clean_lru_counter) {
+            break;
         }
-
-        /* And count how many we can clean in a row */
-        while (i < c->size && can_clean_entry(c, i)) {
-            c->entries[i].offset = 0;
-            c->entries[i].lru_counter = 0;
-            i++;
-            to_clean++;
+        if (!can_clean_entry(c, i)) {
+            continue;
+        }
+        if (!cleaned) {
+            cleaned = bitmap_new(c->size);
         }
+        set_bit(i, cleaned);
+        qcow2_cache_entry_reset(c, t);
+    }
 
-        if (to_clean > 0) {
-            qcow2_cache_table_release(c, i - to_clean, to_clean);
+    /* Release the memory of adjacent tables in one go */
+    if (cleaned) {
+        start = find_first_bit(cleaned, c->size);
+        while (start < c->size) {
+            end = find_next_zero_bit(cleaned, c->size, start);
+            qcow2_cache_table_release(c, start, end - start);
+            start = find_next_bit(cleaned, c->size, end);
         }
     }
 
@@ -125,6 +217,7 @@ Qcow2Cache *qcow2_cache_create(BlockDriverState *bs, int num_tables,
 {
     BDRVQcow2State *s = bs->opaque;
     Qcow2Cache *c;
+    int i;
 
     assert(num_tables > 0);
     assert(is_power_of_2(table_size));
@@ -135,14 +228,22 @@ Qcow2Cache *qcow2_cache_create(BlockDriverState *bs, int num_tables,
     c->size = num_tables;
     c->table_size = table_size;
     c->entries = g_try_new0(Qcow2CachedTable, num_tables);
+    c->bucket_mask = pow2ceil(num_tables) - 1;
+    c->buckets = g_try_new0(Qcow2CacheBucket, c->bucket_mask + 1);
     c->table_array = qemu_try_blockalign(bs->file->bs,
                                          (size_t) num_tables * c->table_size);
 
-    if (!c->entries || !c->table_array) {
+    if (!c->entries || !c->buckets || !c->table_array) {
         qemu_vfree(c->table_array);
+        g_free(c->buckets);
         g_free(c->entries);
         g_free(c);
-        c = NULL;
+        return NULL;
+    }
+
+    QTAILQ_INIT(&c->lru);
+    for (i = 0; i < num_tables; i++) {
+        QTAILQ_INSERT_TAIL(&c->lru, &c->entries[i], lru_entry);
     }
 
     return c;
@@ -157,6 +258,7 @@ int qcow2_cache_destroy(Qcow2Cache *c)
     }
 
     qemu_vfree(c->table_array);
+    g_free(c->buckets);
     g_free(c->entries);
     g_free(c);
 
@@ -308,9 +410,7 @@ int qcow2_cache_empty(BlockDriverState *bs, Qcow2Cache *c)
     }
 
     for (i = 0; i < c->size; i++) {
-        assert(c->entries[i].ref == 0);
-        c->entries[i].offset = 0;
-        c->entries[i].lru_counter = 0;
+        qcow2_cache_entry_reset(c, &c->entries[i]);
     }
 
     qcow2_cache_table_release(c, 0, c->size);
@@ -325,11 +425,9 @@ qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
                    void **table, bool read_from_disk)
 {
     BDRVQcow2State *s = bs->opaque;
+    Qcow2CachedTable *t;
     int i;
     int ret;
-    int lookup_index;
-    uint64_t min_lru_counter = UINT64_MAX;
-    int min_lru_index = -1;
 
     assert(offset != 0);
 
@@ -344,29 +442,21 @@ qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
     }
 
     /* Check if the table is already cached */
-    i = lookup_index = (offset / c->table_size * 4) % c->size;
-    do {
-        const Qcow2CachedTable *t = &c->entries[i];
-        if (t->offset == offset) {
-            goto found;
-        }
-        if (t->ref == 0 && t->lru_counter < min_lru_counter) {
-            min_lru_counter = t->lru_counter;
-            min_lru_index = i;
-        }
-        if (++i == c->size) {
-            i = 0;
-        }
-    } while (i != lookup_index);
+    t = qcow2_cache_lookup(c, offset);
+    if (t) {
+        i = qcow2_cache_entry_idx(c, t);
+        goto found;
+    }
 
-    if (min_lru_index == -1) {
+    t = QTAILQ_FIRST(&c->lru);
+    if (!t) {
         /* This can't happen in current synchronous code, but leave the check
          * here as a reminder for whoever starts using AIO with the cache */
         abort();
     }
 
     /* Cache miss: write a table back and replace it */
-    i = min_lru_index;
+    i = qcow2_cache_entry_idx(c, t);
     trace_qcow2_cache_get_replace_entry(qemu_coroutine_self(),
                                         c == s->l2_table_cache, i);
 
@@ -377,7 +467,7 @@ qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
 
     trace_qcow2_cache_get_read(qemu_coroutine_self(),
                                c == s->l2_table_cache, i);
-    c->entries[i].offset = 0;
+    qcow2_cache_set_offset(c, t, 0);
     if (read_from_disk) {
         if (c == s->l2_table_cache) {
             BLKDBG_EVENT(bs->file, BLKDBG_L2_LOAD);
@@ -390,11 +480,13 @@ qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
         }
     }
 
-    c->entries[i].offset = offset;
+    qcow2_cache_set_offset(c, t, offset);
 
     /* And return the right table */
 found:
-    c->entries[i].ref++;
+    if (t->ref++ == 0) {
+        QTAILQ_REMOVE(&c->lru, t, lru_entry);
+    }
     *table = qcow2_cache_get_table_addr(c, i);
 
     trace_qcow2_cache_get_done(qemu_coroutine_self(),
@@ -424,6 +516,7 @@ void qcow2_cache_put(Qcow2Cache *c, void **table)
 
     if (c->entries[i].ref == 0) {
         c->entries[i].lru_counter = ++c->lru_counter;
+        QTAILQ_INSERT_TAIL(&c->lru, &c->entries[i], lru_entry);
     }
 
     assert(c->entries[i].ref >= 0);
@@ -438,24 +531,19 @@ void qcow2_cache_entry_mark_dirty(Qcow2Cache *c, void *table)
 
 void *qcow2_cache_is_table_offset(Qcow2Cache *c, uint64_t offset)
 {
-    int i;
+    Qcow2CachedTable *t = offset ? qcow2_cache_lookup(c, offset) : NULL;
 
-    for (i = 0; i < c->size; i++) {
-        if (c->entries[i].offset == offset) {
-            return qcow2_cache_get_table_addr(c, i);
-        }
+    if (!t) {
+        return NULL;
     }
-    return NULL;
+    return qcow2_cache_get_table_addr(c, qcow2_cache_entry_idx(c, t));
 }
 
 void qcow2_cache_discard(Qcow2Cache *c, void *table)
 {
     int i = qcow2_cache_get_table_idx(c, table);
 
-    assert(c->entries[i].ref == 0);
-
-    c->entries[i].offset = 0;
-    c->entries[i].lru_counter = 0;
+    qcow2_cache_entry_reset(c, &c->entries[i]);
     c->entries[i].dirty = false;
 
     qcow2_cache_table_release(c, i, 1);
@@ -1582,6 +1582,92 @@ out:
     return ret;
 }
 
+static Qcow2AllocArena *alloc_arena_get(BDRVQcow2State *s)
+{
+    AioContext *ctx = qemu_get_current_aio_context();
+    Qcow2AllocArena *arena;
+
+    QLIST_FOREACH(arena, &s->alloc_arenas, next) {
+        if (arena->ctx == ctx) {
+            return arena;
+        }
+    }
+
+    arena = g_new0(Qcow2AllocArena, 1);
+    arena->ctx = ctx;
+    QLIST_INSERT_HEAD(&s->alloc_arenas, arena, next);
+    return arena;
+}
+
+/*
+ * Like do_alloc_cluster_offset(), but take the clusters from the arena of
+ * the current AioContext.  The arena is refilled when it is empty; if
+ * *host_offset is given, only with clusters that start there.  Fewer
+ * clusters than requested may be returned in *nb_clusters.
+ */
+static int coroutine_fn GRAPH_RDLOCK
+alloc_from_arena(BlockDriverState *bs, uint64_t *host_offset,
+                 uint64_t *nb_clusters)
+{
+    BDRVQcow2State *s = bs->opaque;
+    Qcow2AllocArena *arena = alloc_arena_get(s);
+    uint64_t avail;
+
+    if (arena->offset == arena->end) {
+        if (*host_offset == INV_OFFSET) {
+            int64_t offset = qcow2_alloc_clusters(bs, s->alloc_arena_clusters *
+                                                      s->cluster_size);
+            if (offset < 0) {
+                return offset;
+            }
+            arena->offset = offset;
+            arena->end = offset + s->alloc_arena_clusters * s->cluster_size;
+        } else {
+            int64_t ret = qcow2_alloc_clusters_at(bs, *host_offset,
+                                                  s->alloc_arena_clusters);
+            if (ret < 0) {
+                return ret;
+            }
+            arena->offset = *host_offset;
+            arena->end = *host_offset + ret * s->cluster_size;
+        }
+        trace_qcow2_alloc_arena_refill(qemu_coroutine_self(), arena->offset,
+                                       arena->end);
+    }
+
+    if (*host_offset != INV_OFFSET && *host_offset != arena->offset) {
+        /* Can't extend contiguous allocation */
+        *nb_clusters = 0;
+        return 0;
+    }
+
+    avail = (arena->end - arena->offset) >> s->cluster_bits;
+    *nb_clusters = MIN(*nb_clusters, avail);
+    *host_offset = arena->offset;
+    arena->offset += *nb_clusters * s->cluster_size;
+    return 0;
+}
+
+/*
+ * Give the clusters that are reserved in the allocation arenas back.  Must be
+ * called before anything that expects all clusters with a nonzero refcount
+ * to be in use, like closing or checking the image.
+ */
+void qcow2_alloc_arenas_release(BlockDriverState *bs)
+{
+    BDRVQcow2State *s = bs->opaque;
+    Qcow2AllocArena *arena, *next;
+
+    QLIST_FOREACH_SAFE(arena, &s->alloc_arenas, next, next) {
+        if (arena->offset < arena->end) {
+            qcow2_free_clusters(bs, arena->offset, arena->end - arena->offset,
+                                QCOW2_DISCARD_NEVER);
+        }
+        QLIST_REMOVE(arena, next);
+        g_free(arena);
+    }
+}
+
 /*
  * Allocates new clusters for the given guest_offset.
  *
@@ -1619,6 +1705,9 @@ do_alloc_cluster_offset(BlockDriverState *bs, uint64_t guest_offset,
 
     /* Allocate new clusters */
     trace_qcow2_cluster_alloc_phys(qemu_coroutine_self());
+    if (s->alloc_arena_clusters) {
+        return alloc_from_arena(bs, host_offset, nb_clusters);
+    }
     if (*host_offset == INV_OFFSET) {
         int64_t cluster_offset =
             qcow2_alloc_clusters(bs, *nb_clusters * s->cluster_size);
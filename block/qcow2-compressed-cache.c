@@ -0,0 +1,409 @@
+/*
+ * Decompressed cluster cache for the QCOW2 format
+ *
+ * Copyright (c) 2026 The QEMU Project Developers
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "block/block-io.h"
+#include "qemu/interval-tree.h"
+#include "qemu/memalign.h"
+#include "qemu/queue.h"
+#include "qcow2.h"
+#include "trace.h"
+
+/*
+ * A compressed cluster is always read and decompressed as a whole, however
+ * small the guest request.  The cache keeps the clusters that were
+ * decompressed last, so that a guest reading a compressed cluster in small
+ * chunks only decompresses it once, and decompresses the following
+ * clusters in advance when the guest reads sequentially.
+ *
+ * Entries are indexed by the range of their compressed data in the image
+ * file.  That data does not change until its host cluster is freed, which
+ * invalidates the entries that overlap the cluster.  A request may yield
+ * between reading the L2 entry and looking up the cache, so it reads the
+ * invalidation generation together with the L2 entry, under s->lock, and
+ * does not add an entry if the cache was invalidated since.
+ */
+
+/* Number of clusters decompressed ahead of a sequential reader */
+#define QCOW2_COMPRESSED_READAHEAD 4
+
+typedef struct Qcow2CompressedCluster {
+    /* Compressed data in the image file, only indexed while in_tree */
+    IntervalTreeNode itree;
+    bool in_tree;
+    /* Being decompressed, not on the LRU list */
+    bool loading;
+    CoQueue waiters;
+    uint8_t *data;
+    QTAILQ_ENTRY(Qcow2CompressedCluster) lru_entry;
+} Qcow2CompressedCluster;
+
+struct Qcow2CompressedCache {
+    QemuMutex lock;
+    Qcow2CompressedCluster *entries;
+    int size;
+    void *data_array;
+    IntervalTreeRoot tree;
+
+    /*
+     * Entries that are not loading, least recently used first.  Unused
+     * entries are kept at the head so that they are recycled first.
+     */
+    QTAILQ_HEAD(, Qcow2CompressedCluster) lru;
+
+    /* Incremented by every invalidation */
+    uint64_t generation;
+
+    /* Sequential read detection, in guest clusters */
+    int readahead_clusters;
+    uint64_t last_cluster;
+    uint64_t readahead_end;
+    bool readahead_in_flight;
+};
+
+typedef struct Qcow2CompressedReadahead {
+    BlockDriverState *bs;
+    uint64_t offset;
+    uint64_t end;
+} Qcow2CompressedReadahead;
+
+Qcow2CompressedCache *qcow2_compressed_cache_create(BlockDriverState *bs,
+                                                    int num_clusters)
+{
+    BDRVQcow2State *s = bs->opaque;
+    Qcow2CompressedCache *c;
+    int i;
+
+    assert(num_clusters > 0);
+
+    c = g_new0(Qcow2CompressedCache, 1);
+    c->size = num_clusters;
+    c->entries = g_try_new0(Qcow2CompressedCluster, num_clusters);
+    c->data_array = qemu_try_memalign(qemu_real_host_page_size(),
+                                      (size_t)num_clusters * s->cluster_size);
+    if (!c->entries || !c->data_array) {
+        qemu_vfree(c->data_array);
+        g_free(c->entries);
+        g_free(c);
+        return NULL;
+    }
+
+    qemu_mutex_init(&c->lock);
+    QTAILQ_INIT(&c->lru);
+    for (i = 0; i < num_clusters; i++) {
+        Qcow2CompressedCluster *e = &c->entries[i];
+
+        e->data = (uint8_t *)c->data_array + (size_t)i * s->cluster_size;
+        qemu_co_queue_init(&e->waiters);
+        QTAILQ_INSERT_TAIL(&c->lru, e, lru_entry);
+    }
+
+    /* Don't let readahead push out everything the guest reads */
+    c->readahead_clusters = MIN(QCOW2_COMPRESSED_READAHEAD, num_clusters / 4);
+
+    return c;
+}
+
+void qcow2_compressed_cache_destroy(Qcow2CompressedCache *c)
+{
+    int i;
+
+    for (i = 0; i < c->size; i++) {
+        assert(!c->entries[i].loading);
+    }
+    assert(!c->readahead_in_flight);
+
+    qemu_mutex_destroy(&c->lock);
+    qemu_vfree(c->data_array);
+    g_free(c->entries);
+    g_free(c);
+}
+
+/* Called with c->lock held */
+static void compressed_cache_unlink(Qcow2CompressedCache *c,
+                                    Qcow2CompressedCluster *e)
+{
+    if (e->in_tree) {
+        interval_tree_remove(&e->itree, &c->tree);
+        e->in_tree = false;
+    }
+}
+
+/* Called with c->lock held */
+static Qcow2CompressedCluster *
+compressed_cache_find(Qcow2CompressedCache *c, uint64_t coffset, int csize)
+{
+    uint64_t last = coffset + csize - 1;
+    IntervalTreeNode *node;
+
+    for (node = interval_tree_iter_first(&c->tree, coffset, coffset);
+         node;
+         node = interval_tree_iter_next(node, coffset, coffset)) {
+        if (node->start == coffset && node->last == last) {
+            return container_of(node, Qcow2CompressedCluster, itree);
+        }
+    }
+    return NULL;
+}
+
+void qcow2_compressed_cache_invalidate(Qcow2CompressedCache *c,
+                                       uint64_t offset, uint64_t bytes)
+{
+    uint64_t last = offset + bytes - 1;
+    IntervalTreeNode *node;
+
+    QEMU_LOCK_GUARD(&c->lock);
+    c->generation++;
+    while ((node = interval_tree_iter_first(&c->tree, offset, last))) {
+        Qcow2CompressedCluster *e =
+            container_of(node, Qcow2CompressedCluster, itree);
+
+        compressed_cache_unlink(c, e);
+        if (!e->loading) {
+            QTAILQ_REMOVE(&c->lru, e, lru_entry);
+            QTAILQ_INSERT_HEAD(&c->lru, e, lru_entry);
+        }
+    }
+}
+
+/*
+ * Return the invalidation generation, to be read with s->lock held
+ * together with the L2 entry that is passed to compressed_cache_get().
+ */
+static uint64_t compressed_cache_generation(Qcow2CompressedCache *c)
+{
+    QEMU_LOCK_GUARD(&c->lock);
+    return c->generation;
+}
+
+/*
+ * Return the entry that holds the cluster compressed at @coffset,
+ * decompressing it into the least recently used entry if it is not
+ * cached yet.  Returns NULL if the cluster cannot be cached, either
+ * because all entries are being loaded or the cache was invalidated
+ * since @generation (*ret is 0), or because of an error (*ret is
+ * negative).
+ *
+ * Called with c->lock held; the lock is dropped while decompressing.
+ */
+static Qcow2CompressedCluster * coroutine_fn GRAPH_RDLOCK
+compressed_cache_get(BlockDriverState *bs, uint64_t coffset, int csize,
+                     uint64_t generation, int *ret)
+{
+    BDRVQcow2State *s = bs->opaque;
+    Qcow2CompressedCache *c = s->compressed_cache;
+    Qcow2CompressedCluster *e;
+
+    *ret = 0;
+    while ((e = compressed_cache_find(c, coffset, csize))) {
+        if (!e->loading) {
+            QTAILQ_REMOVE(&c->lru, e, lru_entry);
+            QTAILQ_INSERT_TAIL(&c->lru, e, lru_entry);
+            return e;
+        }
+        qemu_co_queue_wait(&e->waiters, &c->lock);
+    }
+
+    if (c->generation != generation) {
+        /* The cluster may have been freed and reused since */
+        return NULL;
+    }
+
+    e = QTAILQ_FIRST(&c->lru);
+    if (!e) {
+        return NULL;
+    }
+
+    QTAILQ_REMOVE(&c->lru, e, lru_entry);
+    compressed_cache_unlink(c, e);
+    e->itree.start = coffset;
+    e->itree.last = coffset + csize - 1;
+    interval_tree_insert(&e->itree, &c->tree);
+    e->in_tree = true;
+    e->loading = true;
+    qemu_mutex_unlock(&c->lock);
+
+    *ret = qcow2_co_read_compressed(bs, coffset, csize, e->data);
+
+    qemu_mutex_lock(&c->lock);
+    e->loading = false;
+    qemu_co_queue_restart_all(&e->waiters);
+
+    if (*ret < 0 || !e->in_tree) {
+        /*
+         * If the cluster was freed in the meantime, the data can still
+         * complete the request that raced with the free, but must not be
+         * found by later requests.
+         */
+        compressed_cache_unlink(c, e);
+        QTAILQ_INSERT_HEAD(&c->lru, e, lru_entry);
+        return *ret < 0 ? NULL : e;
+    }
+
+    QTAILQ_INSERT_TAIL(&c->lru, e, lru_entry);
+    return e;
+}
+
+static void coroutine_fn compressed_cache_readahead_entry(void *opaque)
+{
+    Qcow2CompressedReadahead *ra = opaque;
+    BlockDriverState *bs = ra->bs;
+    BDRVQcow2State *s = bs->opaque;
+    Qcow2CompressedCache *c = s->compressed_cache;
+    uint64_t offset;
+
+    bdrv_graph_co_rdlock();
+
+    for (offset = ra->offset; offset < ra->end; offset += s->cluster_size) {
+        unsigned int bytes = s->cluster_size;
+        QCow2SubclusterType type;
+        uint64_t l2_entry, coffset, generation;
+        int csize, ret;
+
+        qemu_co_mutex_lock(&s->lock);
+        ret = qcow2_get_host_offset(bs, offset, &bytes, &l2_entry, &type);
+        generation = compressed_cache_generation(c);
+        qemu_co_mutex_unlock(&s->lock);
+        if (ret < 0 || type != QCOW2_SUBCLUSTER_COMPRESSED) {
+            /* The run of compressed clusters ends here */
+            break;
+        }
+
+        qcow2_parse_compressed_l2_entry(bs, l2_entry, &coffset, &csize);
+
+        qemu_mutex_lock(&c->lock);
+        compressed_cache_get(bs, coffset, csize, generation, &ret);
+        qemu_mutex_unlock(&c->lock);
+        if (ret < 0) {
+            break;
+        }
+    }
+
+    qemu_mutex_lock(&c->lock);
+    c->readahead_in_flight = false;
+    qemu_mutex_unlock(&c->lock);
+
+    bdrv_graph_co_rdunlock();
+    bdrv_dec_in_flight(bs);
+    g_free(ra);
+}
+
+/*
+ * When the guest moves on to the cluster that follows the one it read
+ * last, start decompressing the next clusters in the background.  Any
+ * other jump starts a new stream, whose readahead starts from scratch.
+ */
+static void coroutine_fn compressed_cache_readahead(BlockDriverState *bs,
+                                                    uint64_t offset)
+{
+    BDRVQcow2State *s = bs->opaque;
+    Qcow2CompressedCache *c = s->compressed_cache;
+    uint64_t cluster = offset >> s->cluster_bits;
+    uint64_t nb_clusters = size_to_clusters(s, bs->total_sectors *
+                                               BDRV_SECTOR_SIZE);
+    Qcow2CompressedReadahead *ra;
+    uint64_t start, end;
+    Coroutine *co;
+
+    WITH_QEMU_LOCK_GUARD(&c->lock) {
+        bool sequential = cluster == c->last_cluster + 1;
+
+        if (cluster == c->last_cluster) {
+            /* Still reading the same cluster, in smaller requests */
+            return;
+        }
+        c->last_cluster = cluster;
+        if (!sequential) {
+            c->readahead_end = 0;
+            return;
+        }
+        if (c->readahead_in_flight) {
+            return;
+        }
+
+        start = MAX(cluster + 1, c->readahead_end);
+        end = MIN(cluster + 1 + c->readahead_clusters, nb_clusters);
+        if (start >= end) {
+            return;
+        }
+        c->readahead_end = end;
+        c->readahead_in_flight = true;
+    }
+
+    trace_qcow2_compressed_cache_readahead(bs, start << s->cluster_bits,
+                                           end << s->cluster_bits);
+
+    ra = g_new(Qcow2CompressedReadahead, 1);
+    *ra = (Qcow2CompressedReadahead) {
+        .bs = bs,
+        .offset = start << s->cluster_bits,
+        .end = end << s->cluster_bits,
+    };
+
+    bdrv_inc_in_flight(bs);
+    co = qemu_coroutine_create(compressed_cache_readahead_entry, ra);
+    aio_co_enter(qemu_get_current_aio_context(), co);
+}
+
+int coroutine_fn GRAPH_RDLOCK
+qcow2_compressed_cache_co_preadv(BlockDriverState *bs, uint64_t l2_entry,
+                                 uint64_t offset, uint64_t bytes,
+                                 QEMUIOVector *qiov, size_t qiov_offset)
+{
+    BDRVQcow2State *s = bs->opaque;
+    Qcow2CompressedCache *c = s->compressed_cache;
+    int offset_in_cluster = offset_into_cluster(s, offset);
+    Qcow2CompressedCluster *e;
+    QCow2SubclusterType type;
+    uint64_t coffset, cur_l2_entry, generation;
+    unsigned int cur_bytes = bytes;
+    uint8_t *out_buf;
+    int csize, ret;
+
+    qcow2_parse_compressed_l2_entry(bs, l2_entry, &coffset, &csize);
+
+    if (c->readahead_clusters) {
+        compressed_cache_readahead(bs, offset);
+    }
+
+    /*
+     * @l2_entry was read before the request could yield.  Read it again
+     * together with the generation, and leave the cache alone if it
+     * changed: the request raced with a write and can complete with the
+     * old data, but later requests must not find it.
+     */
+    qemu_co_mutex_lock(&s->lock);
+    ret = qcow2_get_host_offset(bs, offset, &cur_bytes, &cur_l2_entry, &type);
+    generation = compressed_cache_generation(c);
+    qemu_co_mutex_unlock(&s->lock);
+
+    if (ret >= 0 && type == QCOW2_SUBCLUSTER_COMPRESSED &&
+        cur_l2_entry == l2_entry) {
+        QEMU_LOCK_GUARD(&c->lock);
+        e = compressed_cache_get(bs, coffset, csize, generation, &ret);
+        if (e) {
+            qemu_iovec_from_buf(qiov, qiov_offset,
+                                e->data + offset_in_cluster, bytes);
+            return 0;
+        } else if (ret < 0) {
+            return ret;
+        }
+    }
+
+    /* The cluster cannot be cached, decompress it directly */
+    out_buf = qemu_blockalign(bs, s->cluster_size);
+    ret = qcow2_co_read_compressed(bs, coffset, csize, out_buf);
+    if (ret >= 0) {
+        qemu_iovec_from_buf(qiov, qiov_offset,
+                            out_buf + offset_in_cluster, bytes);
+    }
+    qemu_vfree(out_buf);
+
+    return ret;
+}
@@ -32,6 +32,13 @@
 #include "qemu/memalign.h"
 #include "trace.h"
 
+/*
+ * Don't keep a map of the free clusters for images with more clusters than
+ * this (32 MiB of bitmap); allocation then probes the refcounts one cluster
+ * at a time.
+ */
+#define QCOW2_FREE_CLUSTER_MAP_MAX_SIZE (1ULL << 28)
+
 static int64_t alloc_clusters_noref(BlockDriverState *bs, uint64_t size,
                                     uint64_t max);
 
@@ -136,6 +143,7 @@ int coroutine_fn qcow2_refcount_init(BlockDriverState *bs)
 void qcow2_refcount_close(BlockDriverState *bs)
 {
     BDRVQcow2State *s = bs->opaque;
+    qcow2_free_cluster_map_invalidate(bs);
     g_free(s->refcount_table);
 }
 
@@ -804,6 +812,189 @@ found:
     }
 }
 
+/*
+ * Drop the map of free clusters.  Must be called whenever refcounts drop to
+ * zero without going through update_refcount(), e.g. when the refcount
+ * structures are rebuilt; the map is created again by the next allocation.
+ */
+void qcow2_free_cluster_map_invalidate(BlockDriverState *bs)
+{
+    BDRVQcow2State *s = bs->opaque;
+
+    if (s->free_cluster_map) {
+        hbitmap_free(s->free_cluster_map);
+        g_free(s->free_cluster_map_loaded);
+        s->free_cluster_map = NULL;
+        s->free_cluster_map_loaded = NULL;
+        s->free_cluster_map_size = 0;
+    }
+}
+
+/*
+ * Create the map of free clusters.  All clusters start out marked free; the
+ * refcount blocks are loaded into the map by free_cluster_map_find(), the
+ * first time a search reaches them.
+ */
+static void free_cluster_map_init(BlockDriverState *bs)
+{
+    BDRVQcow2State *s = bs->opaque;
+    uint64_t size;
+
+    size = ((uint64_t)s->max_refcount_table_index + 1) <<
+           s->refcount_block_bits;
+    if (size > QCOW2_FREE_CLUSTER_MAP_MAX_SIZE) {
+        return;
+    }
+
+    s->free_cluster_map = hbitmap_alloc(size, 0);
+    hbitmap_set(s->free_cluster_map, 0, size);
+    s->free_cluster_map_loaded = bitmap_new(s->max_refcount_table_index + 1);
+    s->free_cluster_map_size = size;
+}
+
+/* Record that the refcount of a cluster became zero, or stopped being zero */
+static void free_cluster_map_update(BlockDriverState *bs,
+                                    uint64_t cluster_index, bool free)
+{
+    BDRVQcow2State *s = bs->opaque;
+    uint64_t old_size = s->free_cluster_map_size;
+    uint64_t new_size;
+
+    if (!s->free_cluster_map) {
+        return;
+    }
+
+    if (cluster_index >= old_size) {
+        if (free) {
+            return;
+        }
+        /* Grow geometrically, the image usually grows one cluster at a time */
+        new_size = MAX(ROUND_UP(cluster_index + 1, s->refcount_block_size),
+                       old_size * 2);
+        if (new_size > QCOW2_FREE_CLUSTER_MAP_MAX_SIZE) {
+            qcow2_free_cluster_map_invalidate(bs);
+            return;
+        }
+        hbitmap_truncate(s->free_cluster_map, new_size);
+        hbitmap_set(s->free_cluster_map, old_size, new_size - old_size);
+        s->free_cluster_map_loaded =
+            bitmap_zero_extend(s->free_cluster_map_loaded,
+                               old_size >> s->refcount_block_bits,
+                               new_size >> s->refcount_block_bits);
+        s->free_cluster_map_size = new_size;
+    }
+
+    if (free) {
+        hbitmap_set(s->free_cluster_map, cluster_index, 1);
+    } else {
+        hbitmap_reset(s->free_cluster_map, cluster_index, 1);
+    }
+}
+
+/*
+ * Load the refcounts that refcount table entry @i describes into the map.
+ * Refcount blocks that are in the cache may be newer than on disk, so they
+ * are taken from there; the others are read directly, so that loading them
+ * does not evict anything from the cache.  If the read fails, the clusters
+ * stay marked as they were, and the allocation checks their refcounts one
+ * by one as it did without the map.
+ */
+static void GRAPH_RDLOCK free_cluster_map_load(BlockDriverState *bs,
+                                               uint64_t i)
+{
+    BDRVQcow2State *s = bs->opaque;
+    uint64_t first = i << s->refcount_block_bits;
+    uint64_t refblock_offset = 0;
+    uint64_t j, run_start;
+    void *buf = NULL;
+    void *refblock;
+    int ret = 0;
+
+    set_bit(i, s->free_cluster_map_loaded);
+
+    if (i < s->refcount_table_size) {
+        refblock_offset = s->refcount_table[i] & REFT_OFFSET_MASK;
+    }
+    if (!refblock_offset) {
+        hbitmap_set(s->free_cluster_map, first, s->refcount_block_size);
+        goto out;
+    }
+
+    refblock = qcow2_cache_is_table_offset(s->refcount_block_cache,
+                                           refblock_offset);
+    if (!refblock) {
+        buf = qemu_try_blockalign(bs->file->bs, s->cluster_size);
+        if (!buf) {
+            ret = -ENOMEM;
+            goto out;
+        }
+        ret = bdrv_pread(bs->file, refblock_offset, s->cluster_size, buf, 0);
+        if (ret < 0) {
+            goto out;
+        }
+        refblock = buf;
+    }
+
+    /* Set the runs of free clusters at once */
+    hbitmap_reset(s->free_cluster_map, first, s->refcount_block_size);
+    run_start = s->refcount_block_size;
+    for (j = 0; j < s->refcount_block_size; j++) {
+        if (s->get_refcount(refblock, j) == 0) {
+            run_start = MIN(run_start, j);
+        } else if (run_start < j) {
+            hbitmap_set(s->free_cluster_map, first + run_start, j - run_start);
+            run_start = s->refcount_block_size;
+        }
+    }
+    if (run_start < j) {
+        hbitmap_set(s->free_cluster_map, first + run_start, j - run_start);
+    }
+
+out:
+    trace_qcow2_free_cluster_map_load(bs, i, ret);
+    qemu_vfree(buf);
+}
+
+/*
+ * Return the first cluster at or after @start that begins a run of
+ * @nb_clusters clusters marked free.  The refcount blocks that describe the
+ * run are loaded into the map before it is returned, so that a search only
+ * reads the refcount blocks that it goes through, like the probing did.
+ */
+static uint64_t GRAPH_RDLOCK
+free_cluster_map_find(BlockDriverState *bs, uint64_t start,
+                      uint64_t nb_clusters)
+{
+    BDRVQcow2State *s = bs->opaque;
+    uint64_t size = s->free_cluster_map_size;
+    int64_t area, count;
+    uint64_t i;
+    bool loaded;
+
+    while (hbitmap_next_dirty_area(s->free_cluster_map, start, size,
+                                   nb_clusters, &area, &count)) {
+        loaded = false;
+        for (i = area >> s->refcount_block_bits;
+             i <= (area + count - 1) >> s->refcount_block_bits; i++) {
+            if (!test_bit(i, s->free_cluster_map_loaded)) {
+                free_cluster_map_load(bs, i);
+                loaded = true;
+            }
+        }
+        if (loaded) {
+            /* The run may have shrunk, look at it again */
+            continue;
+        }
+
+        /* A run that reaches the end of the map goes on beyond it */
+        if (count == nb_clusters || area + count == size) {
+            return area;
+        }
+        start = area + count;
+    }
+    return MAX(start, size);
+}
+
 /* XXX: cache several refcount block clusters ? */
 /* @addend is the absolute value of the addend; if @decrease is set, @addend
  * will be subtracted from the current refcount, otherwise it will be added */
@@ -839,7 +1030,7 @@ update_refcount(BlockDriverState *bs, int64_t offset, int64_t length,
         cluster_offset += s->cluster_size)
     {
         int block_index;
-        uint64_t refcount;
+        uint64_t refcount, old_refcount;
         int64_t cluster_index = cluster_offset >> s->cluster_bits;
         int64_t table_index = cluster_index >> s->refcount_block_bits;
 
@@ -867,7 +1058,7 @@ update_refcount(BlockDriverState *bs, int64_t offset, int64_t length,
         /* we can update the count and save it */
         block_index = cluster_index & (s->refcount_block_size - 1);
 
-        refcount = s->get_refcount(refcount_block, block_index);
+        refcount = old_refcount = s->get_refcount(refcount_block, block_index);
         if (decrease ? (refcount - addend > refcount)
                      : (refcount + addend < refcount ||
                         refcount + addend > s->refcount_max))
@@ -884,6 +1075,9 @@ update_refcount(BlockDriverState *bs, int64_t offset, int64_t length,
             s->free_cluster_index = cluster_index;
         }
         s->set_refcount(refcount_block, block_index, refcount);
+        if (!refcount != !old_refcount) {
+            free_cluster_map_update(bs, cluster_index, refcount == 0);
+        }
 
         if (refcount == 0) {
             void *table;
@@ -901,6 +1095,12 @@ update_refcount(BlockDriverState *bs, int64_t offset, int64_t length,
                 qcow2_cache_discard(s->l2_table_cache, table);
             }
 
+            if (s->compressed_cache) {
+                qcow2_compressed_cache_invalidate(s->compressed_cache,
+                                                  cluster_offset,
+                                                  s->cluster_size);
+            }
+
             if (s->discard_passthrough[type]) {
                 queue_discard(bs, cluster_offset, s->cluster_size);
             }
@@ -978,7 +1178,21 @@ alloc_clusters_noref(BlockDriverState *bs, uint64_t size, uint64_t max)
     }
 
     nb_clusters = size_to_clusters(s, size);
+
+    if (!s->free_cluster_map) {
+        free_cluster_map_init(bs);
+    }
+
 retry:
+    if (s->free_cluster_map) {
+        /*
+         * Skip to the next run that looks free.  The map can say that a
+         * cluster is free when it is not (e.g. refcount blocks that describe
+         * themselves are marked used directly), so check the refcounts.
+         */
+        s->free_cluster_index = free_cluster_map_find(bs, s->free_cluster_index,
+                                                      nb_clusters);
+    }
     for(i = 0; i < nb_clusters; i++) {
         uint64_t next_cluster_index = s->free_cluster_index++;
         ret = qcow2_get_refcount(bs, next_cluster_index, &refcount);
@@ -986,6 +1200,7 @@ retry:
         if (ret < 0) {
             return ret;
         } else if (refcount != 0) {
+            free_cluster_map_update(bs, next_cluster_index, false);
             goto retry;
         }
     }
@@ -2782,6 +2997,7 @@ rebuild_refcount_structure(BlockDriverState *bs, BdrvCheckResult *res,
     s->refcount_table_offset = reftable_offset;
     s->refcount_table_size = on_disk_reftable_entries;
     update_max_refcount_table_index(s);
+    qcow2_free_cluster_map_invalidate(bs);
 
     return 0;
 
@@ -3532,6 +3748,7 @@ int qcow2_change_refcount_order(BlockDriverState *bs, int refcount_order,
 
     s->get_refcount = new_get_refcount;
     s->set_refcount = new_set_refcount;
+    qcow2_free_cluster_map_invalidate(bs);
 
     /* For cleaning up all old refblocks and the old reftable below the "done"
      * label */
@@ -3629,6 +3846,7 @@ qcow2_discard_refcount_block(BlockDriverState *bs, uint64_t discard_block_offs)
     if (cluster_index < s->free_cluster_index) {
         s->free_cluster_index = cluster_index;
     }
+    free_cluster_map_update(bs, cluster_index, true);
 
     refblock = qcow2_cache_is_table_offset(s->refcount_block_cache,
                                            discard_block_offs);
@@ -614,6 +614,9 @@ qcow2_co_check_locked(BlockDriverState *bs, BdrvCheckResult *result,
 
     memset(result, 0, sizeof(*result));
 
+    /* Reserved clusters would look leaked */
+    qcow2_alloc_arenas_release(bs);
+
     ret = qcow2_check_read_snapshot_table(bs, &snapshot_res, fix);
     if (ret < 0) {
         qcow2_add_check_result(result, &snapshot_res, false);
@@ -701,6 +704,7 @@ static const char *const mutable_opts[] = {
     QCOW2_OPT_L2_CACHE_ENTRY_SIZE,
     QCOW2_OPT_REFCOUNT_CACHE_SIZE,
     QCOW2_OPT_CACHE_CLEAN_INTERVAL,
+    QCOW2_OPT_COMPRESSED_CACHE_SIZE,
     NULL
 };
 
@@ -817,6 +821,17 @@ static QemuOptsList qcow2_runtime_opts = {
             .type = QEMU_OPT_NUMBER,
             .help = "Clean unused cache entries after this time (in seconds)",
         },
+        {
+            .name = QCOW2_OPT_ALLOC_ARENA_SIZE,
+            .type = QEMU_OPT_SIZE,
+            .help = "Reserve clusters for the data of each I/O thread in "
+                    "chunks of this size",
+        },
+        {
+            .name = QCOW2_OPT_COMPRESSED_CACHE_SIZE,
+            .type = QEMU_OPT_SIZE,
+            .help = "Maximum size of the decompressed cluster cache",
+        },
         BLOCK_CRYPTO_OPT_DEF_KEY_SECRET("encrypt.",
             "ID of secret providing qcow2 AES key or LUKS passphrase"),
         { /* end of list */ }
@@ -1051,6 +1066,8 @@ typedef struct Qcow2ReopenState {
     bool discard_passthrough[QCOW2_DISCARD_MAX];
     bool discard_no_unref;
     uint64_t cache_clean_interval;
+    uint64_t alloc_arena_clusters;
+    Qcow2CompressedCache *compressed_cache;
     QCryptoBlockOpenOptions *crypto_opts; /* Disk encryption runtime options */
 } Qcow2ReopenState;
 
@@ -1063,6 +1080,7 @@ qcow2_update_options_prepare(BlockDriverState *bs, Qcow2ReopenState *r,
     const char *opt_overlap_check, *opt_overlap_check_template;
     int overlap_check_template = 0;
     uint64_t l2_cache_size, l2_cache_entry_size, refcount_cache_size;
+    uint64_t alloc_arena_size, compressed_cache_size;
     int i;
     const char *encryptfmt;
     QDict *encryptopts = NULL;
@@ -1151,6 +1169,33 @@ qcow2_update_options_prepare(BlockDriverState *bs, Qcow2ReopenState *r,
         goto fail;
     }
 
+    alloc_arena_size = qemu_opt_get_size(opts, QCOW2_OPT_ALLOC_ARENA_SIZE, 0);
+    if (alloc_arena_size > QCOW2_MAX_ALLOC_ARENA_SIZE) {
+        error_setg(errp, QCOW2_OPT_ALLOC_ARENA_SIZE " must not exceed %" PRId64,
+                   QCOW2_MAX_ALLOC_ARENA_SIZE);
+        ret = -EINVAL;
+        goto fail;
+    }
+    r->alloc_arena_clusters = size_to_clusters(s, alloc_arena_size);
+
+    compressed_cache_size =
+        qemu_opt_get_size(opts, QCOW2_OPT_COMPRESSED_CACHE_SIZE, 0);
+    compressed_cache_size = size_to_clusters(s, compressed_cache_size);
+    if (compressed_cache_size > INT_MAX) {
+        error_setg(errp, "Compressed cache size too big");
+        ret = -EINVAL;
+        goto fail;
+    }
+    if (compressed_cache_size) {
+        r->compressed_cache =
+            qcow2_compressed_cache_create(bs, compressed_cache_size);
+        if (!r->compressed_cache) {
+            error_setg(errp, "Could not allocate compressed cluster cache");
+            ret = -ENOMEM;
+            goto fail;
+        }
+    }
+
     /* lazy-refcounts; flush if going from enabled to disabled */
     r->use_lazy_refcounts = qemu_opt_get_bool(opts, QCOW2_OPT_LAZY_REFCOUNTS,
         (s->compatible_features & QCOW2_COMPAT_LAZY_REFCOUNTS));
@@ -1287,9 +1332,9 @@ fail:
 }
 
 /* s_locked specifies whether s->lock is held or not */
-static void qcow2_update_options_commit(BlockDriverState *bs,
-                                        Qcow2ReopenState *r,
-                                        bool s_locked)
+static void GRAPH_RDLOCK
+qcow2_update_options_commit(BlockDriverState *bs, Qcow2ReopenState *r,
+                            bool s_locked)
 {
     BDRVQcow2State *s = bs->opaque;
     int i;
@@ -1327,6 +1372,17 @@ static void qcow2_update_options_commit(BlockDriverState *bs,
     s->cache_clean_interval = r->cache_clean_interval;
     cache_clean_timer_init(bs, bdrv_get_aio_context(bs));
 
+    if (s->alloc_arena_clusters != r->alloc_arena_clusters) {
+        /* The arenas were reserved with the old size, or must go away */
+        qcow2_alloc_arenas_release(bs);
+        s->alloc_arena_clusters = r->alloc_arena_clusters;
+    }
+
+    if (s->compressed_cache) {
+        qcow2_compressed_cache_destroy(s->compressed_cache);
+    }
+    s->compressed_cache = r->compressed_cache;
+
     qapi_free_QCryptoBlockOpenOptions(s->crypto_opts);
     s->crypto_opts = r->crypto_opts;
 }
@@ -1340,6 +1396,9 @@ static void qcow2_update_options_abort(BlockDriverState *bs,
     if (r->refcount_block_cache) {
         qcow2_cache_destroy(r->refcount_block_cache);
     }
+    if (r->compressed_cache) {
+        qcow2_compressed_cache_destroy(r->compressed_cache);
+    }
     qapi_free_QCryptoBlockOpenOptions(r->crypto_opts);
 }
 
@@ -1710,6 +1769,7 @@ qcow2_do_open(BlockDriverState *bs, QDict *options, int flags,
     }
 
     QLIST_INIT(&s->cluster_allocs);
+    QLIST_INIT(&s->alloc_arenas);
     QTAILQ_INIT(&s->discards);
 
     /* read qcow2 extensions */
@@ -1998,6 +2058,9 @@ qcow2_do_open(BlockDriverState *bs, QDict *options, int flags,
     if (s->refcount_block_cache) {
         qcow2_cache_destroy(s->refcount_block_cache);
     }
+    if (s->compressed_cache) {
+        qcow2_compressed_cache_destroy(s->compressed_cache);
+    }
     qcrypto_block_free(s->crypto);
     qapi_free_QCryptoBlockOpenOptions(s->crypto_opts);
     return ret;
@@ -2092,6 +2155,8 @@ qcow2_reopen_prepare(BDRVReopenState *state,BlockReopenQueue *queue,
 
     /* We need to write out any unwritten data if we reopen read-only. */
     if ((state->flags & BDRV_O_RDWR) == 0) {
+        qcow2_alloc_arenas_release(state->bs);
+
         ret = qcow2_reopen_bitmaps_ro(state->bs, errp);
         if (ret < 0) {
             goto fail;
@@ -2848,6 +2913,8 @@ static int GRAPH_RDLOCK qcow2_inactivate(BlockDriverState *bs)
     int ret, result = 0;
     Error *local_err = NULL;
 
+    qcow2_alloc_arenas_release(bs);
+
     qcow2_store_persistent_dirty_bitmaps(bs, true, &local_err);
     if (local_err != NULL) {
         result = -EINVAL;
@@ -2892,6 +2959,9 @@ qcow2_do_close(BlockDriverState *bs, bool close_data_file)
     cache_clean_timer_del_and_wait(bs);
     qcow2_cache_destroy(s->l2_table_cache);
     qcow2_cache_destroy(s->refcount_block_cache);
+    if (s->compressed_cache) {
+        qcow2_compressed_cache_destroy(s->compressed_cache);
+    }
 
     qcrypto_block_free(s->crypto);
     s->crypto = NULL;
@@ -4410,6 +4480,9 @@ qcow2_co_truncate(BlockDriverState *bs, int64_t offset, bool exact,
 
     qemu_co_mutex_lock(&s->lock);
 
+    /* Reserved clusters could keep the image file from shrinking */
+    qcow2_alloc_arenas_release(bs);
+
     /*
      * Even though we store snapshot size for all images, it was not
      * required until v3, so it is not safe to proceed for v2.
@@ -4907,49 +4980,74 @@ qcow2_co_pwritev_compressed_part(BlockDriverState *bs,
     return ret;
 }
 
-static int coroutine_fn GRAPH_RDLOCK
-qcow2_co_preadv_compressed(BlockDriverState *bs,
-                           uint64_t l2_entry,
-                           uint64_t offset,
-                           uint64_t bytes,
-                           QEMUIOVector *qiov,
-                           size_t qiov_offset)
+/*
+ * Read the compressed cluster of @csize bytes at @coffset in the image file
+ * and decompress it into @dest, which is s->cluster_size bytes long.
+ */
+int coroutine_fn GRAPH_RDLOCK
+qcow2_co_read_compressed(BlockDriverState *bs, uint64_t coffset, int csize,
+                         void *dest)
 {
     BDRVQcow2State *s = bs->opaque;
-    int ret = 0, csize;
-    uint64_t coffset;
-    uint8_t *buf, *out_buf;
-    int offset_in_cluster = offset_into_cluster(s, offset);
-
-    qcow2_parse_compressed_l2_entry(bs, l2_entry, &coffset, &csize);
+    uint8_t *buf;
+    int ret;
 
     buf = g_try_malloc(csize);
     if (!buf) {
         return -ENOMEM;
     }
 
-    out_buf = qemu_blockalign(bs, s->cluster_size);
-
     BLKDBG_CO_EVENT(bs->file, BLKDBG_READ_COMPRESSED);
     ret = bdrv_co_pread(bs->file, coffset, csize, buf, 0);
     if (ret < 0) {
         goto fail;
     }
 
-    if (qcow2_co_decompress(bs, out_buf, s->cluster_size, buf, csize) < 0) {
+    if (qcow2_co_decompress(bs, dest, s->cluster_size, buf, csize) < 0) {
         ret = -EIO;
         goto fail;
     }
 
-    qemu_iovec_from_buf(qiov, qiov_offset, out_buf + offset_in_cluster, bytes);
-
 fail:
-    qemu_vfree(out_buf);
     g_free(buf);
 
     return ret;
 }
 
+static int coroutine_fn GRAPH_RDLOCK
+qcow2_co_preadv_compressed(BlockDriverState *bs,
+                           uint64_t l2_entry,
+                           uint64_t offset,
+                           uint64_t bytes,
+                           QEMUIOVector *qiov,
+                           size_t qiov_offset)
+{
+    BDRVQcow2State *s = bs->opaque;
+    int ret, csize;
+    uint64_t coffset;
+    uint8_t *out_buf;
+    int offset_in_cluster = offset_into_cluster(s, offset);
+
+    if (s->compressed_cache) {
+        return qcow2_compressed_cache_co_preadv(bs, l2_entry, offset, bytes,
+                                                qiov, qiov_offset);
+    }
+
+    qcow2_parse_compressed_l2_entry(bs, l2_entry, &coffset, &csize);
+
+    out_buf = qemu_blockalign(bs, s->cluster_size);
+
+    ret = qcow2_co_read_compressed(bs, coffset, csize, out_buf);
+    if (ret >= 0) {
+        qemu_iovec_from_buf(qiov, qiov_offset, out_buf + offset_in_cluster,
+                            bytes);
+    }
+
+    qemu_vfree(out_buf);
+
+    return ret;
+}
+
 static int GRAPH_RDLOCK make_completely_empty(BlockDriverState *bs)
 {
     BDRVQcow2State *s = bs->opaque;
@@ -5061,6 +5159,11 @@ static int GRAPH_RDLOCK make_completely_empty(BlockDriverState *bs)
     s->refcount_table[0] = 2 * s->cluster_size;
 
     s->free_cluster_index = 0;
+    qcow2_free_cluster_map_invalidate(bs);
+    if (s->compressed_cache) {
+        /* All compressed clusters were freed without update_refcount() */
+        qcow2_compressed_cache_invalidate(s->compressed_cache, 0, INT64_MAX);
+    }
     assert(3 + l1_clusters <= s->refcount_block_size);
     offset = qcow2_alloc_clusters(bs, 3 * s->cluster_size + l1_size2);
     if (offset < 0) {
@@ -5110,6 +5213,8 @@ static int GRAPH_RDLOCK qcow2_make_empty(BlockDriverState *bs)
 
     l1_clusters = DIV_ROUND_UP(s->l1_size, s->cluster_size / L1E_SIZE);
 
+    qcow2_alloc_arenas_release(bs);
+
     if (s->qcow_version >= 3 && !s->snapshots && !s->nb_bitmaps &&
         3 + l1_clusters <= s->refcount_block_size &&
         s->crypt_method_header != QCOW_CRYPT_LUKS &&
@@ -5919,6 +6024,7 @@ qcow2_amend_options(BlockDriverState *bs, QemuOpts *opts,
             return -EINVAL;
         }
 
+        qcow2_alloc_arenas_release(bs);
         helper_cb_info.current_operation = QCOW2_CHANGING_REFCOUNT_ORDER;
         ret = qcow2_change_refcount_order(bs, refcount_order,
                                           &qcow2_amend_helper_cb,
@@ -28,6 +28,7 @@
 #include "crypto/block.h"
 #include "qemu/bswap.h"
 #include "qemu/coroutine.h"
+#include "qemu/hbitmap.h"
 #include "qemu/units.h"
 #include "block/block_int.h"
 
@@ -151,6 +152,11 @@
 #define QCOW2_OPT_L2_CACHE_ENTRY_SIZE "l2-cache-entry-size"
 #define QCOW2_OPT_REFCOUNT_CACHE_SIZE "refcount-cache-size"
 #define QCOW2_OPT_CACHE_CLEAN_INTERVAL "cache-clean-interval"
+#define QCOW2_OPT_ALLOC_ARENA_SIZE "alloc-arena-size"
+#define QCOW2_OPT_COMPRESSED_CACHE_SIZE "compressed-cache-size"
+
+/* Maximum value of the alloc-arena-size option */
+#define QCOW2_MAX_ALLOC_ARENA_SIZE (1 * GiB)
 
 typedef struct QCowHeader {
     uint32_t magic;
@@ -231,6 +237,7 @@ typedef struct QCowSnapshot {
 
 struct Qcow2Cache;
 typedef struct Qcow2Cache Qcow2Cache;
+typedef struct Qcow2CompressedCache Qcow2CompressedCache;
 
 typedef struct Qcow2CryptoHeaderExtension {
     uint64_t offset;
@@ -346,6 +353,8 @@ typedef struct BDRVQcow2State {
 
     Qcow2Cache *l2_table_cache;
     Qcow2Cache *refcount_block_cache;
+    /* Decompressed clusters, NULL if the cache is disabled */
+    Qcow2CompressedCache *compressed_cache;
     /* Non-NULL while the timer is running */
     Coroutine *cache_clean_timer_co;
     unsigned cache_clean_interval;
@@ -354,12 +363,27 @@ typedef struct BDRVQcow2State {
 
     QLIST_HEAD(, QCowL2Meta) cluster_allocs;
 
+    /* Number of clusters in an allocation arena, 0 if arenas are disabled */
+    uint64_t alloc_arena_clusters;
+    QLIST_HEAD(, Qcow2AllocArena) alloc_arenas;
+
     uint64_t *refcount_table;
     uint64_t refcount_table_offset;
     uint32_t refcount_table_size;
     uint32_t max_refcount_table_index; /* Last used entry in refcount_table */
     uint64_t free_cluster_index;
     uint64_t free_byte_offset;
+    /*
+     * Clusters whose refcount was 0 when last seen, created by the first
+     * allocation.  A refcount block is loaded into the map when a search
+     * first reaches it, which sets its bit in free_cluster_map_loaded (one
+     * bit per refcount table entry); until then its clusters are marked
+     * free.  Clusters at or beyond free_cluster_map_size are all free.
+     * NULL if not created.
+     */
+    HBitmap *free_cluster_map;
+    unsigned long *free_cluster_map_loaded;
+    uint64_t free_cluster_map_size;
 
     CoMutex lock;
 
@@ -439,6 +463,18 @@ typedef struct Qcow2COWRegion {
     unsigned    nb_bytes;
 } Qcow2COWRegion;
 
+/*
+ * Clusters that were reserved (their refcount is already 1) for the data
+ * written from one AioContext, and that are not used yet.
+ */
+typedef struct Qcow2AllocArena {
+    AioContext *ctx;
+    /* Host offsets of the first reserved cluster and of the end */
+    uint64_t offset;
+    uint64_t end;
+    QLIST_ENTRY(Qcow2AllocArena) next;
+} Qcow2AllocArena;
+
 /**
  * Describes an in-flight (part of a) write request that writes to clusters
  * that need to have their L2 table entries updated (because they are
@@ -852,9 +888,14 @@ int qcow2_validate_table(BlockDriverState *bs, uint64_t offset,
                          int64_t max_size_bytes, const char *table_name,
                          Error **errp);
 
+int coroutine_fn GRAPH_RDLOCK
+qcow2_co_read_compressed(BlockDriverState *bs, uint64_t coffset, int csize,
+                         void *dest);
+
 /* qcow2-refcount.c functions */
 int coroutine_fn GRAPH_RDLOCK qcow2_refcount_init(BlockDriverState *bs);
 void qcow2_refcount_close(BlockDriverState *bs);
+void qcow2_free_cluster_map_invalidate(BlockDriverState *bs);
 
 int GRAPH_RDLOCK qcow2_get_refcount(BlockDriverState *bs, int64_t cluster_index,
                                     uint64_t *refcount);
@@ -932,6 +973,7 @@ int coroutine_fn GRAPH_RDLOCK
 qcow2_shrink_l1_table(BlockDriverState *bs, uint64_t max_size);
 
 int GRAPH_RDLOCK qcow2_write_l1_entry(BlockDriverState *bs, int l1_index);
+void GRAPH_RDLOCK qcow2_alloc_arenas_release(BlockDriverState *bs);
 int qcow2_encrypt_sectors(BDRVQcow2State *s, int64_t sector_num,
                           uint8_t *buf, int nb_sectors, bool enc, Error **errp);
 
@@ -1030,6 +1072,17 @@ void qcow2_cache_put(Qcow2Cache *c, void **table);
 void *qcow2_cache_is_table_offset(Qcow2Cache *c, uint64_t offset);
 void qcow2_cache_discard(Qcow2Cache *c, void *table);
 
+/* qcow2-compressed-cache.c functions */
+Qcow2CompressedCache *qcow2_compressed_cache_create(BlockDriverState *bs,
+                                                    int num_clusters);
+void qcow2_compressed_cache_destroy(Qcow2CompressedCache *c);
+void qcow2_compressed_cache_invalidate(Qcow2CompressedCache *c,
+                                       uint64_t offset, uint64_t bytes);
+int coroutine_fn GRAPH_RDLOCK
+qcow2_compressed_cache_co_preadv(BlockDriverState *bs, uint64_t l2_entry,
+                                 uint64_t offset, uint64_t bytes,
+                                 QEMUIOVector *qiov, size_t qiov_offset);
+
 /* qcow2-bitmap.c functions */
 int coroutine_fn GRAPH_RDLOCK
 qcow2_check_bitmaps_refcounts(BlockDriverState *bs, BdrvCheckResult *res,
@@ -17,29 +17,43 @@
 
 #include "block/reqlist.h"
 
+void reqlist_init(BlockReqList *reqs)
+{
+    *reqs = (BlockReqList) {};
+}
+
+static void reqlist_insert(BlockReq *req)
+{
+    assert(req->bytes > 0);
+    req->itree.start = req->offset;
+    req->itree.last = range_get_last(req->offset, req->bytes);
+    interval_tree_insert(&req->itree, req->reqs);
+}
+
 void reqlist_init_req(BlockReqList *reqs, BlockReq *req, int64_t offset,
                       int64_t bytes)
 {
     *req = (BlockReq) {
         .offset = offset,
         .bytes = bytes,
+        .reqs = reqs,
     };
     qemu_co_queue_init(&req->wait_queue);
-    QLIST_INSERT_HEAD(reqs, req, list);
+    reqlist_insert(req);
 }
 
 BlockReq *reqlist_find_conflict(BlockReqList *reqs, int64_t offset,
                                 int64_t bytes)
 {
-    BlockReq *r;
+    IntervalTreeNode *node;
 
-    QLIST_FOREACH(r, reqs, list) {
-        if (ranges_overlap(offset, bytes, r->offset, r->bytes)) {
-            return r;
-        }
+    if (bytes <= 0) {
+        return NULL;
     }
 
-    return NULL;
+    node = interval_tree_iter_first(reqs, offset,
+                                    range_get_last(offset, bytes));
+    return node ? container_of(node, BlockReq, itree) : NULL;
 }
 
 bool coroutine_fn reqlist_wait_one(BlockReqList *reqs, int64_t offset,
@@ -72,12 +86,14 @@ void coroutine_fn reqlist_shrink_req(BlockReq *req, int64_t new_bytes)
 
     assert(new_bytes > 0 && new_bytes < req->bytes);
 
+    interval_tree_remove(&req->itree, req->reqs);
     req->bytes = new_bytes;
+    reqlist_insert(req);
     qemu_co_queue_restart_all(&req->wait_queue);
 }
 
 void coroutine_fn reqlist_remove_req(BlockReq *req)
 {
-    QLIST_REMOVE(req, list);
+    interval_tree_remove(&req->itree, req->reqs);
     qemu_co_queue_restart_all(&req->wait_queue);
 }
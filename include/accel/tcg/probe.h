@@ -65,6 +65,35 @@ int probe_access_flags(CPUArchState *env, vaddr addr, int size,
                        MMUAccessType access_type, int mmu_idx,
                        bool nonfault, void **phost, uintptr_t retaddr);
 
+/**
+ * probe_access_range:
+ * @env: CPUArchState
+ * @addr: guest virtual address of the first byte
+ * @size: number of bytes wanted, non-zero
+ * @access_type: read or write permission
+ * @mmu_idx: MMU index to use for lookup
+ * @phost: return value for host address
+ * @retaddr: return address for unwinding
+ *
+ * Probe as much of the range (@addr, @size) as can be accessed through
+ * a single contiguous span of host memory, for use by memcpy/memset-like
+ * helpers.  Return the length of that span and store its start in @phost.
+ *
+ * Only the page containing @addr may raise an exception; later pages are
+ * probed without faulting and simply end the span.  The span also ends
+ * at the first page that requires I/O, has a watchpoint, is not host
+ * contiguous with the previous page, or would otherwise need the slow
+ * path.  For writes, clean pages within the span are marked dirty.
+ *
+ * Return 0 and set @phost to NULL if the first page cannot be accessed
+ * directly; the caller should then fall back to a single element access
+ * through the normal load/store functions, which will handle the
+ * watchpoint, I/O or whatever else is present.
+ */
+size_t probe_access_range(CPUArchState *env, vaddr addr, size_t size,
+                          MMUAccessType access_type, int mmu_idx,
+                          void **phost, uintptr_t retaddr);
+
 #ifndef CONFIG_USER_ONLY
 
 /**
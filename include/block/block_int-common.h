@@ -28,6 +28,7 @@
 #include "block/block-global-state.h"
 #include "block/snapshot.h"
 #include "qemu/aiocb.h"
+#include "qemu/interval-tree.h"
 #include "qemu/iov.h"
 #include "qemu/rcu.h"
 
@@ -81,6 +82,8 @@ typedef struct BdrvTrackedRequest {
     bool serialising;
     int64_t overlap_offset;
     int64_t overlap_bytes;
+    /* overlap_offset/overlap_bytes, indexed in bs->tracked_requests_tree */
+    IntervalTreeNode itree;
 
     QLIST_ENTRY(BdrvTrackedRequest) list;
     Coroutine *co; /* owner, used for deadlock detection */
@@ -1272,6 +1275,7 @@ struct BlockDriverState {
     /* Protected by reqs_lock.  */
     QemuMutex reqs_lock;
     QLIST_HEAD(, BdrvTrackedRequest) tracked_requests;
+    IntervalTreeRoot tracked_requests_tree;
     CoQueue flush_queue;                  /* Serializing flush queue */
     bool active_flush_req;                /* Flush request in flight? */
 
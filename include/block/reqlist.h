@@ -16,22 +16,30 @@
 #define REQLIST_H
 
 #include "qemu/coroutine.h"
+#include "qemu/interval-tree.h"
 
 /*
  * The API is not thread-safe and shouldn't be. The struct is public to be part
  * of other structures and protected by third-party locks, see
  * block/block-copy.c for example.
+ *
+ * Requests are indexed by their range, so that looking for a conflict costs
+ * O(log n) in the number of requests rather than O(n).
  */
 
+typedef IntervalTreeRoot BlockReqList;
+
 typedef struct BlockReq {
     int64_t offset;
     int64_t bytes;
 
     CoQueue wait_queue; /* coroutines blocked on this req */
-    QLIST_ENTRY(BlockReq) list;
+    IntervalTreeNode itree;
+    BlockReqList *reqs;
 } BlockReq;
 
-typedef QLIST_HEAD(, BlockReq) BlockReqList;
+/* Initialize an empty list. */
+void reqlist_init(BlockReqList *reqs);
 
 /*
  * Initialize new request and add it to the list. Caller must be sure that
@@ -275,6 +275,26 @@ struct CPUTLBEntryFull {
     } extra;
 };
 
+/*
+ * A set-associative second level tlb, which catches the entries that
+ * are evicted from the victim tlb.  It is allocated on first use, so
+ * that mmu modes with a small working set do not pay for it.
+ */
+#define CPU_STLB_SET_BITS 6
+#define CPU_STLB_SETS (1 << CPU_STLB_SET_BITS)
+#define CPU_STLB_WAYS 4
+#define CPU_STLB_SIZE (CPU_STLB_SETS * CPU_STLB_WAYS)
+
+typedef struct CPUTLBSecond {
+    /* Set N occupies entries [N * CPU_STLB_WAYS, (N + 1) * CPU_STLB_WAYS). */
+    CPUTLBEntry table[CPU_STLB_SIZE];
+    CPUTLBEntryFull fulltlb[CPU_STLB_SIZE];
+    /* The next way to replace in each set.  */
+    uint8_t next_way[CPU_STLB_SETS];
+    /* True if any entry may be valid since the last flush.  */
+    bool dirty;
+} CPUTLBSecond;
+
 /*
  * Data elements that are per MMU mode, minus the bits accessed by
  * the TCG fast path.
@@ -299,6 +319,8 @@ typedef struct CPUTLBDesc {
     CPUTLBEntry vtable[CPU_VTLB_SIZE];
     CPUTLBEntryFull vfulltlb[CPU_VTLB_SIZE];
     CPUTLBEntryFull *fulltlb;
+    /* The second level tlb, or NULL if the victim tlb never overflowed. */
+    CPUTLBSecond *stlb;
 } CPUTLBDesc;
 
 /*
@@ -321,6 +343,9 @@ typedef struct CPUTLBCommon {
     size_t full_flush_count;
     size_t part_flush_count;
     size_t elide_flush_count;
+    /* Lookups in the second level tlb, after a victim tlb miss. */
+    size_t stlb_hit_count;
+    size_t stlb_miss_count;
 } CPUTLBCommon;
 
 /*
@@ -29,6 +29,8 @@
 #define TYPE_QIO_CHANNEL_SOCKET "qio-channel-socket"
 OBJECT_DECLARE_SIMPLE_TYPE(QIOChannelSocket, QIO_CHANNEL_SOCKET)
 
+typedef struct QIOChannelSocketUring QIOChannelSocketUring;
+
 
 /**
  * QIOChannelSocket:
@@ -55,6 +57,8 @@ struct QIOChannelSocket {
      * zerocopy since the last qio_channel_socket_flush() call.
      */
     bool new_zero_copy_sent_success;
+    /* Set by qio_channel_socket_set_uring() */
+    QIOChannelSocketUring *uring;
 };
 
 
@@ -281,4 +285,53 @@ int qio_channel_socket_set_send_buffer(QIOChannelSocket *ioc,
                                        size_t size,
                                        Error **errp);
 
+/**
+ * qio_channel_socket_set_uring:
+ * @ioc: the socket channel object
+ * @entries: number of submission queue entries
+ * @errp: pointer to a NULL-initialized error object
+ *
+ * Perform the reads and writes of @ioc through a private
+ * io_uring instead of recvmsg() and sendmsg().  A write is
+ * submitted as a single chain of linked send requests and
+ * completes only once all of its data has been queued on the
+ * socket; likewise a read completes only once all of its buffers
+ * are full, or at end of file.  Zero-copy writes are reported
+ * through the completion ring and qio_channel_flush() does not
+ * need to read the socket error queue.
+ *
+ * The channel is switched to blocking mode and cannot be made
+ * non-blocking again.  It must not be read and written
+ * concurrently from different threads.  Writes of more than
+ * @entries buffers are split.
+ *
+ * Returns: 0 on success, or -1 on error (including if the host
+ * has no io_uring support).
+ */
+int qio_channel_socket_set_uring(QIOChannelSocket *ioc,
+                                 unsigned int entries,
+                                 Error **errp);
+
+/**
+ * qio_channel_socket_uring_register:
+ * @ioc: the socket channel object
+ * @iov: the memory regions to register
+ * @niov: the length of the @iov array
+ * @errp: pointer to a NULL-initialized error object
+ *
+ * Register long-lived memory with the io_uring of @ioc, so that
+ * zero-copy writes from it do not have to pin and unpin the pages
+ * for each request.  All of the memory is populated and stays
+ * pinned until the channel is closed; the caller must make sure
+ * that it is not discarded or remapped in the meanwhile.
+ *
+ * Can be called only once, after qio_channel_socket_set_uring().
+ *
+ * Returns: 0 on success, or -1 on error.
+ */
+int qio_channel_socket_uring_register(QIOChannelSocket *ioc,
+                                      const struct iovec *iov,
+                                      size_t niov,
+                                      Error **errp);
+
 #endif /* QIO_CHANNEL_SOCKET_H */
@@ -214,6 +214,17 @@ struct VMStateDescription {
      */
 
     bool early_setup;
+    /*
+     * With the x-parallel-vmstate migration capability, the state of
+     * this VMSD is saved at switchover on a worker thread, concurrently
+     * with other devices, and sent through a multifd channel.  The VM
+     * is stopped, but the worker does not hold the BQL: only set this if
+     * pre_save, post_save, needed and the fields of the device (and of
+     * its subsections) can be accessed from another thread.  Loading is
+     * not affected and still happens in the main thread, in stream
+     * order.
+     */
+    bool parallel_save;
     int version_id;
     int minimum_version_id;
     MigrationPriority priority;
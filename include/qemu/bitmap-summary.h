@@ -0,0 +1,93 @@
+/*
+ * Summary of a sparse bitmap
+ *
+ * Copyright (c) 2026 The QEMU Project Developers
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef QEMU_BITMAP_SUMMARY_H
+#define QEMU_BITMAP_SUMMARY_H
+
+/*
+ * A BitmapSummary speeds up the search for set bits in a large bitmap
+ * that is owned and modified by the caller, so that the cost of the
+ * search is proportional to the number of set bits rather than to the
+ * size of the bitmap.
+ *
+ * Like HBitmap, the summary has several levels: bit N of level 0 covers
+ * long N of the bitmap, bit N of level 1 covers long N of level 0, and
+ * so on.  Unlike HBitmap, a set bit only means that the long below *may*
+ * be nonzero.  The caller must mark the summary whenever it sets bits in
+ * the bitmap, but it can clear bits in the bitmap freely; the summary
+ * bits that became stale are cleared by bitmap_summary_find_next() the
+ * next time it walks over them.
+ *
+ * The bitmap and the summary must be protected by the same lock, except
+ * as noted for bitmap_summary_mark_long().
+ */
+
+typedef struct BitmapSummary BitmapSummary;
+
+/**
+ * bitmap_summary_new: allocate an empty summary
+ * @nbits: size of the bitmap that is summarized
+ */
+BitmapSummary *bitmap_summary_new(unsigned long nbits);
+
+/**
+ * bitmap_summary_free: free a summary allocated by bitmap_summary_new
+ */
+void bitmap_summary_free(BitmapSummary *s);
+
+/**
+ * bitmap_summary_mark: note that bits may have been set in the bitmap
+ * @s: the summary
+ * @start: first bit of the bitmap that may have been set
+ * @nr: number of bits
+ */
+void bitmap_summary_mark(BitmapSummary *s, unsigned long start,
+                         unsigned long nr);
+
+/**
+ * bitmap_summary_mark_long: note that bits may have been set in a long
+ * @s: the summary
+ * @word: index of the long of the bitmap that may have become nonzero
+ *
+ * Only update level 0 of the summary; the caller must then call
+ * bitmap_summary_propagate() on the range that contains @word before
+ * the next search.  Different threads may call this function
+ * concurrently, provided each uses its own range of
+ * BITS_PER_LONG * BITS_PER_LONG bits of the bitmap.
+ */
+void bitmap_summary_mark_long(BitmapSummary *s, unsigned long word);
+
+/**
+ * bitmap_summary_propagate: update the upper levels of the summary
+ * @s: the summary
+ * @start: first bit of the bitmap that was marked
+ * @nr: number of bits
+ *
+ * Complete the work of bitmap_summary_mark_long() for the range.
+ */
+void bitmap_summary_propagate(BitmapSummary *s, unsigned long start,
+                              unsigned long nr);
+
+/**
+ * bitmap_summary_find_next: find the next set bit of a summarized bitmap
+ * @s: the summary
+ * @map: the bitmap
+ * @size: the bitmap size in bits, at most the size passed to
+ *        bitmap_summary_new
+ * @offset: the bit number to start searching at
+ *
+ * Returns the bit number of the next set bit, or @size if there is none,
+ * just like find_next_bit(@map, @size, @offset).
+ */
+unsigned long bitmap_summary_find_next(BitmapSummary *s,
+                                       const unsigned long *map,
+                                       unsigned long size,
+                                       unsigned long offset);
+
+#endif
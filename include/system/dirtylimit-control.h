@@ -0,0 +1,52 @@
+/*
+ * Dirty page rate limit controller
+ *
+ * Copyright (c) 2026 The QEMU Project Developers
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#ifndef QEMU_DIRTYLIMIT_CONTROL_H
+#define QEMU_DIRTYLIMIT_CONTROL_H
+
+/*
+ * Max vcpu sleep time percentage during a cycle
+ * composed of dirty ring full and sleep time.
+ */
+#define DIRTYLIMIT_THROTTLE_PCT_MAX 99
+
+/*
+ * State of the controller that drives the throttle of a vcpu when the
+ * vcpus share a dirty page rate target.
+ */
+typedef struct DirtyLimitPid {
+    /*
+     * Logarithm of the slowdown, i.e. of
+     * (ring full time + throttle) / ring full time
+     */
+    double output;
+    /* Errors of the last two periods */
+    double error[2];
+} DirtyLimitPid;
+
+void dirtylimit_pid_reset(DirtyLimitPid *pid);
+
+/*
+ * Update the controller with the dirty page rate @current measured in
+ * the last period, for a vcpu that must not exceed @quota.  Both are in
+ * MB/s and must be nonzero.  Returns the throttle time, as a multiple
+ * of the ring full time.
+ */
+double dirtylimit_pid_update(DirtyLimitPid *pid, uint64_t quota,
+                             uint64_t current);
+
+/*
+ * Split @target among @n vcpus with max-min fairness: the vcpus whose
+ * @demand is below an equal share keep what they use, and the others
+ * divide what remains equally.  Fills in @quota, which is at least 1
+ * for every vcpu.
+ */
+void dirtylimit_split_target(uint64_t target, const uint64_t *demand,
+                             uint64_t *quota, int n);
+
+#endif
@@ -15,6 +15,7 @@
 #define SYSTEM_RAMBLOCK_H
 
 #include "qemu/rcu.h"
+#include "qemu/bitmap-summary.h"
 #include "system/ram_addr.h"
 #include "system/ramlist.h"
 #include "system/hostmem.h"
@@ -45,6 +46,12 @@ struct RAMBlock {
     size_t page_size;
     /* dirty bitmap used during migration */
     unsigned long *bmap;
+    /*
+     * Summary of bmap, used to find dirty pages quickly on the source
+     * side.  It must be marked whenever bits are set in bmap.  NULL
+     * when not in use.  Protected by ram_state.bitmap_mutex.
+     */
+    BitmapSummary *bmap_summary;
 
     /*
      * Below fields are only used by mapped-ram migration
@@ -133,6 +140,8 @@ static inline void *ramblock_ptr(RAMBlock *block, ram_addr_t offset)
 /* memory API */
 
 void qemu_ram_remap(ram_addr_t addr);
+int qemu_ram_map_file(RAMBlock *block, uint64_t start, size_t length,
+                      int fd, off_t fd_offset);
 /* This should not be used by devices.  */
 ram_addr_t qemu_ram_addr_from_host(void *ptr);
 ram_addr_t qemu_ram_addr_from_host_nofail(void *ptr);
@@ -29,12 +29,14 @@
  * tcg_init: Initialize the TCG runtime
  * @tb_size: translation buffer size
  * @splitwx: use separate rw and rx mappings
+ * @hugepages: align the JIT buffer and its regions for huge pages
  * @max_threads: number of vcpu threads in system mode
  *
  * Allocate and initialize TCG resources, especially the JIT buffer.
  * In user-only mode, @max_threads is unused.
  */
-void tcg_init(size_t tb_size, int splitwx, unsigned max_threads);
+void tcg_init(size_t tb_size, int splitwx, bool hugepages,
+              unsigned max_threads);
 
 /**
  * tcg_register_thread: Register this thread with the TCG runtime
@@ -26,6 +26,7 @@
 #include "io/channel-watch.h"
 #include "trace.h"
 #include "qapi/clone-visitor.h"
+#include "qemu/iov.h"
 #ifdef CONFIG_LINUX
 #include <linux/errqueue.h>
 #include <sys/socket.h>
@@ -35,6 +36,12 @@
 #endif
 #endif
 
+#if defined(QEMU_MSG_ZEROCOPY) && defined(CONFIG_LINUX_IO_URING) && \
+    defined(HAVE_IO_URING_PREP_SENDMSG_ZC)
+#include <liburing.h>
+#define QEMU_SOCKET_URING
+#endif
+
 #define SOCKET_MAX_FDS 16
 
 #ifdef QEMU_MSG_ZEROCOPY
@@ -440,6 +447,488 @@ qio_channel_socket_accept(QIOChannelSocket *ioc,
     return NULL;
 }
 
+#ifdef QEMU_SOCKET_URING
+/* The kernel does not register buffers larger than 1 GiB */
+#define SOCKET_URING_BUF_MAX (1ULL << 30)
+
+/* user_data of the request that cancels the others after an error */
+#define SOCKET_URING_CANCEL UINT64_MAX
+
+typedef struct {
+    uintptr_t start;
+    size_t len;
+} QIOChannelSocketUringBuf;
+
+typedef struct {
+    size_t len;
+    int res;
+} QIOChannelSocketUringReq;
+
+struct QIOChannelSocketUring {
+    struct io_uring ring;
+    unsigned int entries;
+    /* Whether the kernel supports zero-copy sends through the ring */
+    bool zero_copy;
+    /* Registered buffers, sorted by address */
+    QIOChannelSocketUringBuf *bufs;
+    unsigned int nbufs;
+    /* Requests of the read or write in progress, indexed by user_data */
+    struct msghdr *msg;
+    QIOChannelSocketUringReq *reqs;
+};
+
+static void qio_channel_socket_uring_free(QIOChannelSocket *sioc)
+{
+    QIOChannelSocketUring *u = sioc->uring;
+
+    if (!u) {
+        return;
+    }
+
+    /* This also cancels the requests in flight and unregisters buffers */
+    io_uring_queue_exit(&u->ring);
+    g_free(u->bufs);
+    g_free(u->msg);
+    g_free(u->reqs);
+    g_free(u);
+    sioc->uring = NULL;
+}
+
+/*
+ * The ring can no longer be used safely.  Shut the socket down so that
+ * the channel fails from now on and the requests in flight end quickly,
+ * then tear the ring down: this cancels them and drops the ones that
+ * were never submitted, together with their references to the caller's
+ * msghdr and iovec.  Their zero-copy notifications go away with it.
+ */
+static void qio_channel_socket_uring_break(QIOChannelSocket *sioc)
+{
+    shutdown(sioc->fd, SHUT_RDWR);
+    qio_channel_socket_uring_free(sioc);
+    sioc->zero_copy_sent = sioc->zero_copy_queued;
+}
+
+static void qio_channel_socket_uring_complete(QIOChannelSocket *sioc,
+                                              struct io_uring_cqe *cqe)
+{
+    QIOChannelSocketUring *u = sioc->uring;
+
+    if (cqe->user_data == SOCKET_URING_CANCEL) {
+        return;
+    }
+
+    if (cqe->flags & IORING_CQE_F_NOTIF) {
+        /* The kernel is done with the pages of a zero-copy send */
+        sioc->zero_copy_sent++;
+#ifdef IORING_NOTIF_USAGE_ZC_COPIED
+        if (!(cqe->res & IORING_NOTIF_USAGE_ZC_COPIED)) {
+            sioc->new_zero_copy_sent_success = true;
+        }
+#else
+        sioc->new_zero_copy_sent_success = true;
+#endif
+        return;
+    }
+
+    if (cqe->flags & IORING_CQE_F_MORE) {
+        /* A notification will follow */
+        sioc->zero_copy_queued++;
+    }
+    u->reqs[cqe->user_data].res = cqe->res;
+}
+
+/*
+ * Waiting for the completion of @nr submitted requests failed.  They
+ * still reference the caller's iovec and data, so cancel them and reap
+ * their completions before the error is returned.  If waiting fails
+ * again, give up on the ring and break the channel.
+ */
+static void qio_channel_socket_uring_drain(QIOChannelSocket *sioc,
+                                           unsigned int nr)
+{
+    struct io_uring *ring = &sioc->uring->ring;
+    struct io_uring_sqe *sqe = io_uring_get_sqe(ring);
+    struct io_uring_cqe *cqe;
+    int ret;
+
+    if (sqe) {
+        io_uring_prep_cancel64(sqe, 0, IORING_ASYNC_CANCEL_ANY);
+        sqe->user_data = SOCKET_URING_CANCEL;
+        io_uring_submit(ring);
+    }
+
+    while (nr) {
+        ret = io_uring_wait_cqe(ring, &cqe);
+        if (ret == -EINTR) {
+            continue;
+        }
+        if (ret < 0) {
+            qio_channel_socket_uring_break(sioc);
+            return;
+        }
+        if (cqe->user_data != SOCKET_URING_CANCEL &&
+            !(cqe->flags & IORING_CQE_F_NOTIF)) {
+            nr--;
+        }
+        qio_channel_socket_uring_complete(sioc, cqe);
+        io_uring_cqe_seen(ring, cqe);
+    }
+}
+
+/*
+ * Submit the @nr requests that have been prepared and wait for all of
+ * them to complete.  Zero-copy notifications that are already available
+ * are processed as well, so that they do not pile up until the next
+ * flush.  If the requests cannot all be submitted, the channel is
+ * broken, because the rest cannot be taken back out of the ring.
+ */
+static int qio_channel_socket_uring_run(QIOChannelSocket *sioc,
+                                        unsigned int nr,
+                                        Error **errp)
+{
+    struct io_uring *ring = &sioc->uring->ring;
+    struct io_uring_cqe *cqe;
+    int ret;
+
+    do {
+        ret = io_uring_submit_and_wait(ring, nr);
+    } while (ret == -EINTR);
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "Unable to submit socket requests");
+        qio_channel_socket_uring_break(sioc);
+        return -1;
+    }
+    if (ret < nr) {
+        error_setg(errp, "Unable to submit all socket requests");
+        qio_channel_socket_uring_break(sioc);
+        return -1;
+    }
+
+    while (nr) {
+        ret = io_uring_wait_cqe(ring, &cqe);
+        if (ret == -EINTR) {
+            continue;
+        }
+        if (ret < 0) {
+            error_setg_errno(errp, -ret, "Unable to wait for socket requests");
+            qio_channel_socket_uring_drain(sioc, nr);
+            return -1;
+        }
+        if (cqe->user_data != SOCKET_URING_CANCEL &&
+            !(cqe->flags & IORING_CQE_F_NOTIF)) {
+            nr--;
+        }
+        qio_channel_socket_uring_complete(sioc, cqe);
+        io_uring_cqe_seen(ring, cqe);
+    }
+
+    while (io_uring_peek_cqe(ring, &cqe) == 0) {
+        qio_channel_socket_uring_complete(sioc, cqe);
+        io_uring_cqe_seen(ring, cqe);
+    }
+    return 0;
+}
+
+static const QIOChannelSocketUringBuf *
+qio_channel_socket_uring_find_buf(QIOChannelSocketUring *u,
+                                  const struct iovec *iov)
+{
+    uintptr_t start = (uintptr_t)iov->iov_base;
+    unsigned int lo = 0, hi = u->nbufs;
+
+    while (lo < hi) {
+        unsigned int mid = lo + (hi - lo) / 2;
+        const QIOChannelSocketUringBuf *buf = &u->bufs[mid];
+
+        if (start < buf->start) {
+            hi = mid;
+        } else if (start - buf->start >= buf->len) {
+            lo = mid + 1;
+        } else {
+            return iov->iov_len <= buf->len - (start - buf->start) ? buf : NULL;
+        }
+    }
+    return NULL;
+}
+
+static ssize_t qio_channel_socket_uring_readv(QIOChannelSocket *sioc,
+                                              const struct iovec *iov,
+                                              size_t niov,
+                                              Error **errp)
+{
+    QIOChannelSocketUring *u = sioc->uring;
+    struct io_uring_sqe *sqe = io_uring_get_sqe(&u->ring);
+    struct msghdr *msg = &u->msg[0];
+    int res;
+
+    memset(msg, 0, sizeof(*msg));
+    msg->msg_iov = (struct iovec *)iov;
+    msg->msg_iovlen = niov;
+    io_uring_prep_recvmsg(sqe, sioc->fd, msg, MSG_WAITALL);
+    sqe->user_data = 0;
+
+    if (qio_channel_socket_uring_run(sioc, 1, errp) < 0) {
+        return -1;
+    }
+
+    res = u->reqs[0].res;
+    if (res < 0) {
+        if (res == -EAGAIN) {
+            return QIO_CHANNEL_ERR_BLOCK;
+        }
+        error_setg_errno(errp, -res, "Unable to read from socket");
+        return -1;
+    }
+    return res;
+}
+
+/*
+ * Buffers that lie in registered memory are sent with one zero-copy
+ * request per contiguous run; the others are grouped in a single
+ * sendmsg request.  The requests are linked and use MSG_WAITALL, so
+ * that a short send cancels the ones that follow and the data reaches
+ * the socket in order.
+ */
+static ssize_t qio_channel_socket_uring_writev(QIOChannelSocket *sioc,
+                                               const struct iovec *iov,
+                                               size_t niov,
+                                               int flags,
+                                               Error **errp)
+{
+    QIOChannelSocketUring *u = sioc->uring;
+    bool zero_copy = flags & QIO_CHANNEL_WRITE_FLAG_ZERO_COPY;
+    bool registered = zero_copy && u->nbufs;
+    struct io_uring_sqe *sqe = NULL;
+    unsigned int nr, i;
+    size_t cur = 0;
+    ssize_t done = 0;
+    int err = 0;
+
+    if (!niov) {
+        return 0;
+    }
+
+    for (nr = 0; cur < niov && nr < u->entries; nr++) {
+        const QIOChannelSocketUringBuf *buf = NULL;
+        size_t next = cur + 1;
+
+        if (registered) {
+            buf = qio_channel_socket_uring_find_buf(u, &iov[cur]);
+        }
+
+        sqe = io_uring_get_sqe(&u->ring);
+        if (buf) {
+            uint8_t *base = iov[cur].iov_base;
+            size_t len = iov[cur].iov_len;
+            uintptr_t end = buf->start + buf->len;
+
+            while (next < niov && iov[next].iov_base == base + len &&
+                   iov[next].iov_len <= end - (uintptr_t)(base + len)) {
+                len += iov[next++].iov_len;
+            }
+            io_uring_prep_send_zc_fixed(sqe, sioc->fd, base, len,
+                                        MSG_WAITALL, 0, buf - u->bufs);
+            u->reqs[nr].len = len;
+        } else {
+            struct msghdr *msg = &u->msg[nr];
+
+            while (next < niov &&
+                   !(registered &&
+                     qio_channel_socket_uring_find_buf(u, &iov[next]))) {
+                next++;
+            }
+            memset(msg, 0, sizeof(*msg));
+            msg->msg_iov = (struct iovec *)&iov[cur];
+            msg->msg_iovlen = next - cur;
+            if (zero_copy) {
+                io_uring_prep_sendmsg_zc(sqe, sioc->fd, msg, MSG_WAITALL);
+            } else {
+                io_uring_prep_sendmsg(sqe, sioc->fd, msg, MSG_WAITALL);
+            }
+            u->reqs[nr].len = iov_size(msg->msg_iov, msg->msg_iovlen);
+        }
+#ifdef IORING_SEND_ZC_REPORT_USAGE
+        if (zero_copy) {
+            sqe->ioprio |= IORING_SEND_ZC_REPORT_USAGE;
+        }
+#endif
+        sqe->user_data = nr;
+        sqe->flags |= IOSQE_IO_LINK;
+        cur = next;
+    }
+    sqe->flags &= ~IOSQE_IO_LINK;
+
+    if (qio_channel_socket_uring_run(sioc, nr, errp) < 0) {
+        return -1;
+    }
+
+    for (i = 0; i < nr; i++) {
+        int res = u->reqs[i].res;
+
+        if (res <= 0) {
+            err = res ? -res : EPIPE;
+            break;
+        }
+        done += res;
+        if (res < u->reqs[i].len) {
+            break;
+        }
+    }
+
+    /* Report any error on the next call, once the data sent is consumed */
+    if (done || !err) {
+        return done;
+    }
+    if (err == EAGAIN) {
+        return QIO_CHANNEL_ERR_BLOCK;
+    }
+    error_setg_errno(errp, err, "Unable to write to socket");
+    return -1;
+}
+
+static int qio_channel_socket_uring_flush(QIOChannelSocket *sioc,
+                                          bool block,
+                                          Error **errp)
+{
+    struct io_uring *ring = &sioc->uring->ring;
+    struct io_uring_cqe *cqe;
+    int ret;
+
+    while (sioc->zero_copy_sent < sioc->zero_copy_queued) {
+        ret = block ? io_uring_wait_cqe(ring, &cqe)
+                    : io_uring_peek_cqe(ring, &cqe);
+        if (ret == -EINTR) {
+            continue;
+        }
+        if (ret == -EAGAIN && !block) {
+            return 0;
+        }
+        if (ret < 0) {
+            error_setg_errno(errp, -ret,
+                             "Unable to wait for zero copy notifications");
+            return -1;
+        }
+        qio_channel_socket_uring_complete(sioc, cqe);
+        io_uring_cqe_seen(ring, cqe);
+    }
+    return 0;
+}
+#endif /* QEMU_SOCKET_URING */
+
+int qio_channel_socket_set_uring(QIOChannelSocket *ioc,
+                                 unsigned int entries,
+                                 Error **errp)
+{
+#ifdef QEMU_SOCKET_URING
+    struct io_uring_params params = {};
+    struct io_uring_probe *probe;
+    QIOChannelSocketUring *u;
+    int ret;
+
+    assert(!ioc->uring && entries);
+    if (!qemu_set_blocking(ioc->fd, true, errp)) {
+        return -1;
+    }
+    ioc->blocking = true;
+
+    u = g_new0(QIOChannelSocketUring, 1);
+
+    /* Leave room for the zero-copy notifications */
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = entries * 4;
+    ret = io_uring_queue_init_params(entries, &u->ring, &params);
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "Unable to create io_uring");
+        g_free(u);
+        return -1;
+    }
+
+    probe = io_uring_get_probe_ring(&u->ring);
+    if (probe) {
+        u->zero_copy = io_uring_opcode_supported(probe, IORING_OP_SEND_ZC) &&
+                       io_uring_opcode_supported(probe, IORING_OP_SENDMSG_ZC);
+        io_uring_free_probe(probe);
+    }
+
+    u->entries = entries;
+    u->msg = g_new(struct msghdr, entries);
+    u->reqs = g_new(QIOChannelSocketUringReq, entries);
+    ioc->uring = u;
+
+    trace_qio_channel_socket_set_uring(ioc, entries, u->zero_copy);
+    return 0;
+#else
+    error_setg(errp, "io_uring socket channels are not supported");
+    return -1;
+#endif
+}
+
+#ifdef QEMU_SOCKET_URING
+static gint qio_channel_socket_uring_buf_cmp(gconstpointer a, gconstpointer b)
+{
+    const QIOChannelSocketUringBuf *ba = a, *bb = b;
+
+    return ba->start < bb->start ? -1 : ba->start > bb->start;
+}
+#endif
+
+int qio_channel_socket_uring_register(QIOChannelSocket *ioc,
+                                      const struct iovec *iov,
+                                      size_t niov,
+                                      Error **errp)
+{
+#ifdef QEMU_SOCKET_URING
+    QIOChannelSocketUring *u = ioc->uring;
+    g_autoptr(GArray) bufs = NULL;
+    g_autofree struct iovec *regs = NULL;
+    size_t i, off;
+    int ret;
+
+    assert(u && !u->nbufs);
+    if (!u->zero_copy) {
+        error_setg(errp, "Host kernel does not support io_uring zero copy");
+        return -1;
+    }
+
+    bufs = g_array_new(false, false, sizeof(QIOChannelSocketUringBuf));
+    for (i = 0; i < niov; i++) {
+        for (off = 0; off < iov[i].iov_len; off += SOCKET_URING_BUF_MAX) {
+            QIOChannelSocketUringBuf buf = {
+                .start = (uintptr_t)iov[i].iov_base + off,
+                .len = MIN(iov[i].iov_len - off, SOCKET_URING_BUF_MAX),
+            };
+            g_array_append_val(bufs, buf);
+        }
+    }
+    g_array_sort(bufs, qio_channel_socket_uring_buf_cmp);
+
+    regs = g_new(struct iovec, bufs->len);
+    for (i = 0; i < bufs->len; i++) {
+        QIOChannelSocketUringBuf *buf =
+            &g_array_index(bufs, QIOChannelSocketUringBuf, i);
+
+        regs[i].iov_base = (void *)buf->start;
+        regs[i].iov_len = buf->len;
+    }
+
+    ret = io_uring_register_buffers(&u->ring, regs, bufs->len);
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "Unable to register io_uring buffers");
+        return -1;
+    }
+
+    u->nbufs = bufs->len;
+    u->bufs = (QIOChannelSocketUringBuf *)g_array_free(g_steal_pointer(&bufs),
+                                                       false);
+    trace_qio_channel_socket_uring_register(ioc, u->nbufs);
+    return 0;
+#else
+    error_setg(errp, "io_uring socket channels are not supported");
+    return -1;
+#endif
+}
+
+
 static void qio_channel_socket_init(Object *obj)
 {
     QIOChannelSocket *ioc = QIO_CHANNEL_SOCKET(obj);
@@ -450,6 +939,9 @@ static void qio_channel_socket_finalize(Object *obj)
 {
     QIOChannelSocket *ioc = QIO_CHANNEL_SOCKET(obj);
 
+#ifdef QEMU_SOCKET_URING
+    qio_channel_socket_uring_free(ioc);
+#endif
     if (ioc->fd != -1) {
         QIOChannel *ioc_local = QIO_CHANNEL(ioc);
         if (qio_channel_has_feature(ioc_local, QIO_CHANNEL_FEATURE_LISTEN)) {
@@ -562,6 +1054,13 @@ static ssize_t qio_channel_socket_readv(QIOChannel *ioc,
     char control[CMSG_SPACE(sizeof(int) * SOCKET_MAX_FDS)];
     int sflags = 0;
 
+#ifdef QEMU_SOCKET_URING
+    if (sioc->uring && !(fds && nfds) &&
+        !(flags & QIO_CHANNEL_READ_FLAG_MSG_PEEK)) {
+        return qio_channel_socket_uring_readv(sioc, iov, niov, errp);
+    }
+#endif
+
     memset(control, 0, CMSG_SPACE(sizeof(int) * SOCKET_MAX_FDS));
 
     msg.msg_iov = (struct iovec *)iov;
@@ -630,6 +1129,13 @@ static ssize_t qio_channel_socket_writev(QIOChannel *ioc,
     bool zerocopy_flushed_once = false;
 #endif
 
+#ifdef QEMU_SOCKET_URING
+    if (sioc->uring && !nfds &&
+        (sioc->uring->zero_copy || !(flags & QIO_CHANNEL_WRITE_FLAG_ZERO_COPY))) {
+        return qio_channel_socket_uring_writev(sioc, iov, niov, flags, errp);
+    }
+#endif
+
     memset(control, 0, CMSG_SPACE(sizeof(int) * SOCKET_MAX_FDS));
 
     msg.msg_iov = (struct iovec *)iov;
@@ -820,6 +1326,12 @@ static int qio_channel_socket_flush_internal(QIOChannel *ioc,
         return 0;
     }
 
+#ifdef QEMU_SOCKET_URING
+    if (sioc->uring && sioc->uring->zero_copy) {
+        return qio_channel_socket_uring_flush(sioc, block, errp);
+    }
+#endif
+
     msg.msg_control = control;
     msg.msg_controllen = sizeof(control);
     memset(control, 0, sizeof(control));
@@ -916,6 +1428,13 @@ qio_channel_socket_set_blocking(QIOChannel *ioc,
                                 Error **errp)
 {
     QIOChannelSocket *sioc = QIO_CHANNEL_SOCKET(ioc);
+
+#ifdef QEMU_SOCKET_URING
+    if (sioc->uring && !enabled) {
+        error_setg(errp, "Cannot make an io_uring socket channel non-blocking");
+        return -1;
+    }
+#endif
     sioc->blocking = enabled;
 
     if (!qemu_set_blocking(sioc->fd, enabled, errp)) {
@@ -985,6 +1504,9 @@ qio_channel_socket_close(QIOChannel *ioc,
     int rc = 0;
     Error *err = NULL;
 
+#ifdef QEMU_SOCKET_URING
+    qio_channel_socket_uring_free(sioc);
+#endif
     if (sioc->fd != -1) {
 #ifdef WIN32
         qemu_socket_unselect_nofail(sioc->fd);
@@ -114,6 +114,13 @@ static void migration_dump_blocktime(Monitor *mon, MigrationInfo *info)
         monitor_printf(mon, "]\n");
     }
 
+    if (info->has_postcopy_prefetch_pages) {
+        monitor_printf(mon, "Postcopy Prefetch: pages=%" PRIu64
+                       ", hits=%" PRIu64 "\n",
+                       info->postcopy_prefetch_pages,
+                       info->postcopy_prefetch_hits);
+    }
+
     if (info->has_postcopy_latency_dist) {
         uint64List *item = info->postcopy_latency_dist;
         int count = 0;
@@ -244,6 +251,12 @@ void hmp_info_migrate(Monitor *mon, const QDict *qdict)
                            info->ram->dirty_sync_missed_zero_copy);
         }
         monitor_printf(mon, "\n");
+
+        monitor_printf(mon, "  Phase Times (us): \tdirty_sync=%" PRIu64
+                       ", last_sync=%" PRIu64 ", save=%" PRIu64 "\n",
+                       info->ram->dirty_sync_time,
+                       info->ram->dirty_sync_time_last,
+                       info->ram->ram_save_time);
     }
 
     if (!show_all) {
@@ -259,14 +272,18 @@ void hmp_info_migrate(Monitor *mon, const QDict *qdict)
                        ", miss=%" PRIu64 "\n"
                        "  miss_rate=%0.2f"
                        ", encode_rate=%0.2f"
-                       ", overflow=%" PRIu64 "\n",
+                       ", overflow=%" PRIu64 "\n"
+                       "  hit_rate=%0.2f"
+                       ", evictions=%" PRIu64 "\n",
                        info->xbzrle_cache->cache_size,
                        info->xbzrle_cache->bytes,
                        info->xbzrle_cache->pages,
                        info->xbzrle_cache->cache_miss,
                        info->xbzrle_cache->cache_miss_rate,
                        info->xbzrle_cache->encoding_rate,
-                       info->xbzrle_cache->overflow);
+                       info->xbzrle_cache->overflow,
+                       info->xbzrle_cache->cache_hit_rate,
+                       info->xbzrle_cache->cache_evictions);
     }
 
     if (info->has_cpu_throttle_percentage) {
@@ -284,7 +301,28 @@ void hmp_info_migrate(Monitor *mon, const QDict *qdict)
                        info->dirty_limit_ring_full_time);
     }
 
+    if (info->has_predicted_convergence_time) {
+        monitor_printf(mon, "Predicted convergence (ms): %" PRIu64 "\n",
+                       info->predicted_convergence_time);
+    }
+
     migration_dump_blocktime(mon, info);
+
+    if (info->vmstate_downtime) {
+        VMStateDowntimeList *item;
+
+        monitor_printf(mon, "VMState Downtime (us):\n");
+        for (item = info->vmstate_downtime; item; item = item->next) {
+            VMStateDowntime *d = item->value;
+
+            monitor_printf(mon, "  %s/%" PRIu32 ": %" PRIu64, d->name,
+                           d->instance_id, d->time);
+            if (d->has_size) {
+                monitor_printf(mon, ", size=%" PRIu64, d->size);
+            }
+            monitor_printf(mon, "%s\n", d->parallel ? " (parallel)" : "");
+        }
+    }
 out:
     qapi_free_MigrationInfo(info);
 }
@@ -404,6 +442,9 @@ void hmp_info_migrate_parameters(Monitor *mon, const QDict *qdict)
         monitor_printf(mon, "%s: %" PRIu64 " bytes\n",
             MigrationParameter_str(MIGRATION_PARAMETER_XBZRLE_CACHE_SIZE),
             params->xbzrle_cache_size);
+        monitor_printf(mon, "%s: %u\n",
+            MigrationParameter_str(MIGRATION_PARAMETER_XBZRLE_CACHE_ASSOCIATIVITY),
+            params->xbzrle_cache_associativity);
 
         if (s->has_block_bitmap_mapping) {
             const BitmapMigrationNodeAliasList *bmnal;
@@ -439,6 +480,18 @@ void hmp_info_migrate_parameters(Monitor *mon, const QDict *qdict)
             MigrationParameter_str(MIGRATION_PARAMETER_VCPU_DIRTY_LIMIT),
             params->vcpu_dirty_limit);
 
+        monitor_printf(mon, "%s: %u %%\n",
+        MigrationParameter_str(MIGRATION_PARAMETER_X_DIRTY_LIMIT_BANDWIDTH_PCT),
+        params->x_dirty_limit_bandwidth_pct);
+
+        monitor_printf(mon, "%s: %u\n",
+            MigrationParameter_str(MIGRATION_PARAMETER_X_DIRTY_SYNC_THREADS),
+            params->x_dirty_sync_threads);
+
+        monitor_printf(mon, "%s: %u\n",
+        MigrationParameter_str(MIGRATION_PARAMETER_X_POSTCOPY_PREFETCH_WINDOW),
+        params->x_postcopy_prefetch_window);
+
         assert(params->has_mode);
         monitor_printf(mon, "%s: %s\n",
             MigrationParameter_str(MIGRATION_PARAMETER_MODE),
@@ -694,6 +747,10 @@ void hmp_migrate_set_parameter(Monitor *mon, const QDict *qdict)
         }
         p->xbzrle_cache_size = cache_size;
         break;
+    case MIGRATION_PARAMETER_XBZRLE_CACHE_ASSOCIATIVITY:
+        p->has_xbzrle_cache_associativity = true;
+        visit_type_uint8(v, param, &p->xbzrle_cache_associativity, &err);
+        break;
     case MIGRATION_PARAMETER_MAX_POSTCOPY_BANDWIDTH:
         p->has_max_postcopy_bandwidth = true;
         visit_type_size(v, param, &p->max_postcopy_bandwidth, &err);
@@ -726,6 +783,18 @@ void hmp_migrate_set_parameter(Monitor *mon, const QDict *qdict)
         p->has_vcpu_dirty_limit = true;
         visit_type_size(v, param, &p->vcpu_dirty_limit, &err);
         break;
+    case MIGRATION_PARAMETER_X_DIRTY_LIMIT_BANDWIDTH_PCT:
+        p->has_x_dirty_limit_bandwidth_pct = true;
+        visit_type_uint8(v, param, &p->x_dirty_limit_bandwidth_pct, &err);
+        break;
+    case MIGRATION_PARAMETER_X_DIRTY_SYNC_THREADS:
+        p->has_x_dirty_sync_threads = true;
+        visit_type_uint8(v, param, &p->x_dirty_sync_threads, &err);
+        break;
+    case MIGRATION_PARAMETER_X_POSTCOPY_PREFETCH_WINDOW:
+        p->has_x_postcopy_prefetch_window = true;
+        visit_type_uint8(v, param, &p->x_postcopy_prefetch_window, &err);
+        break;
     case MIGRATION_PARAMETER_MODE:
         p->has_mode = true;
         visit_type_MigMode(v, param, &p->mode, &err);
@@ -51,6 +51,12 @@ typedef struct {
      * copy.
      */
     uint64_t dirty_sync_missed_zero_copy;
+    /*
+     * Microseconds spent synchronizing guest bitmaps, in total and in
+     * the last synchronization.
+     */
+    uint64_t dirty_sync_time;
+    uint64_t dirty_sync_time_last;
     /*
      * Number of bytes sent at migration completion stage while the
      * guest is stopped.
@@ -93,6 +99,11 @@ typedef struct {
      * Number of bytes sent through RDMA.
      */
     uint64_t rdma_bytes;
+    /*
+     * Microseconds spent looking for dirty pages and queuing them for
+     * sending, not counting bitmap synchronization.
+     */
+    uint64_t ram_save_time;
     /*
      * Number of pages transferred that were full of zeros.
      */
@@ -316,6 +316,8 @@ void migration_object_init(void)
 
     qemu_mutex_init(&current_incoming->page_request_mutex);
     qemu_cond_init(&current_incoming->page_request_cond);
+    qemu_mutex_init(&current_incoming->vmstate_bufs_mutex);
+    qemu_cond_init(&current_incoming->vmstate_bufs_cond);
     current_incoming->page_requested = g_tree_new(page_request_addr_cmp);
 
     current_incoming->exit_on_error = INMIGRATE_DEFAULT_EXIT_ON_ERROR;
@@ -526,17 +528,17 @@ static int migrate_send_rp_message(MigrationIncomingState *mis,
     return qemu_fflush(mis->to_src_file);
 }
 
-/* Request one page from the source VM at the given start address.
+/* Request pages from the source VM at the given start address.
  *   rb: the RAMBlock to request the page in
  *   Start: Address offset within the RB
  *   Len: Length in bytes required - must be a multiple of pagesize
  */
 int migrate_send_rp_message_req_pages(MigrationIncomingState *mis,
-                                      RAMBlock *rb, ram_addr_t start)
+                                      RAMBlock *rb, ram_addr_t start,
+                                      size_t len)
 {
     uint8_t bufc[12 + 1 + 255]; /* start (8), len (4), rbname up to 256 */
     size_t msglen = 12; /* start + len */
-    size_t len = qemu_ram_pagesize(rb);
     enum mig_rp_message_type msg_type;
     const char *rbname;
     int rbname_len;
@@ -601,7 +603,8 @@ int migrate_send_rp_req_pages(MigrationIncomingState *mis,
         return 0;
     }
 
-    return migrate_send_rp_message_req_pages(mis, rb, start);
+    return migrate_send_rp_message_req_pages(mis, rb, start,
+                                             qemu_ram_pagesize(rb));
 }
 
 static bool migration_colo_enabled;
@@ -1037,6 +1040,17 @@ static bool migrate_show_downtime(MigrationState *s)
     return (s->state == MIGRATION_STATUS_COMPLETED) || migration_in_postcopy();
 }
 
+/* The list is recorded in reverse order, so cloning it reverses it back */
+static VMStateDowntimeList *vmstate_downtime_clone(VMStateDowntimeList *list)
+{
+    VMStateDowntimeList *clone = NULL;
+
+    for (; list; list = list->next) {
+        QAPI_LIST_PREPEND(clone, QAPI_CLONE(VMStateDowntime, list->value));
+    }
+    return clone;
+}
+
 static void populate_time_info(MigrationInfo *info, MigrationState *s)
 {
     info->has_status = true;
@@ -1061,6 +1075,29 @@ static void populate_time_info(MigrationInfo *info, MigrationState *s)
     }
 }
 
+/*
+ * Estimate when the remaining RAM will fit in the downtime limit, if
+ * the bandwidth and the dirty page rate stay the same.
+ */
+static void migration_predict_convergence(MigrationState *s,
+                                          MigrationInfo *info)
+{
+    double bandwidth = s->mbps * 1000 * 1000 / 8;          /* bytes/s */
+    double dirty_rate = info->ram->dirty_pages_rate * info->ram->page_size;
+    uint64_t pending = 0;
+
+    if (s->state != MIGRATION_STATUS_ACTIVE || bandwidth <= dirty_rate) {
+        return;
+    }
+
+    if (info->ram->remaining > s->threshold_size) {
+        pending = info->ram->remaining - s->threshold_size;
+    }
+    info->has_predicted_convergence_time = true;
+    info->predicted_convergence_time =
+        pending * 1000 / (bandwidth - dirty_rate);
+}
+
 static void populate_ram_info(MigrationInfo *info, MigrationState *s)
 {
     size_t page_size = qemu_target_page_size();
@@ -1084,6 +1121,10 @@ static void populate_ram_info(MigrationInfo *info, MigrationState *s)
     info->ram->precopy_bytes = qatomic_read(&mig_stats.precopy_bytes);
     info->ram->downtime_bytes = qatomic_read(&mig_stats.downtime_bytes);
     info->ram->postcopy_bytes = qatomic_read(&mig_stats.postcopy_bytes);
+    info->ram->dirty_sync_time = qatomic_read(&mig_stats.dirty_sync_time);
+    info->ram->dirty_sync_time_last =
+        qatomic_read(&mig_stats.dirty_sync_time_last);
+    info->ram->ram_save_time = qatomic_read(&mig_stats.ram_save_time);
 
     if (migrate_xbzrle()) {
         info->xbzrle_cache = g_malloc0(sizeof(*info->xbzrle_cache));
@@ -1094,6 +1135,8 @@ static void populate_ram_info(MigrationInfo *info, MigrationState *s)
         info->xbzrle_cache->cache_miss_rate = xbzrle_counters.cache_miss_rate;
         info->xbzrle_cache->encoding_rate = xbzrle_counters.encoding_rate;
         info->xbzrle_cache->overflow = xbzrle_counters.overflow;
+        info->xbzrle_cache->cache_hit_rate = xbzrle_counters.cache_hit_rate;
+        info->xbzrle_cache->cache_evictions = xbzrle_counters.cache_evictions;
     }
 
     if (cpu_throttle_active()) {
@@ -1105,6 +1148,7 @@ static void populate_ram_info(MigrationInfo *info, MigrationState *s)
         info->ram->remaining = ram_bytes_remaining();
         info->ram->dirty_pages_rate =
            qatomic_read(&mig_stats.dirty_pages_rate);
+        migration_predict_convergence(s, info);
     }
 
     if (migrate_dirty_limit() && dirtylimit_in_service()) {
@@ -1171,6 +1215,7 @@ static void fill_source_migration_info(MigrationInfo *info)
         populate_time_info(info, s);
         populate_ram_info(info, s);
         migration_populate_vfio_info(info);
+        info->vmstate_downtime = vmstate_downtime_clone(s->vmstate_downtime);
         break;
     case MIGRATION_STATUS_FAILED:
         info->has_status = true;
@@ -1216,6 +1261,7 @@ static void fill_destination_migration_info(MigrationInfo *info)
     case MIGRATION_STATUS_COMPLETED:
         info->has_status = true;
         fill_destination_postcopy_migration_info(info);
+        info->vmstate_downtime = vmstate_downtime_clone(mis->vmstate_downtime);
         break;
     default:
         return;
@@ -1651,6 +1697,7 @@ int migrate_init(MigrationState *s, Error **errp)
     s->threshold_size = 0;
     s->switchover_acked = false;
     s->rdma_migration = false;
+    g_clear_pointer(&s->vmstate_downtime, qapi_free_VMStateDowntimeList);
     /*
      * set mig_stats memory to zero for a new migration
      */
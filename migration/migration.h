@@ -193,12 +193,32 @@ struct MigrationIncomingState {
     ThreadPool *load_threads;
     bool load_threads_abort;
 
+    /*
+     * Device states received through multifd for x-parallel-vmstate are
+     * handed over to the main thread under this mutex.  The abort flag
+     * is set when the multifd channels stop, so that the main thread
+     * does not wait forever for a state that will not arrive.
+     */
+    QemuMutex vmstate_bufs_mutex;
+    QemuCond vmstate_bufs_cond;
+    bool vmstate_bufs_abort;
+
+    /* Load time of each device section, in reverse stream order */
+    VMStateDowntimeList *vmstate_downtime;
+
     /*
      * PostcopyBlocktimeContext to keep information for postcopy
      * live migration, to calculate vCPU block time
      * */
     struct PostcopyBlocktimeContext *blocktime_ctx;
 
+    /*
+     * Pages requested ahead of a fault by the postcopy prefetcher, and
+     * how many of them were faulted on afterwards
+     */
+    uint64_t postcopy_prefetch_pages;
+    uint64_t postcopy_prefetch_hits;
+
     /* notify PAUSED postcopy incoming migrations to try to continue */
     QemuSemaphore postcopy_pause_sem_dst;
     QemuSemaphore postcopy_pause_sem_fault;
@@ -503,6 +523,9 @@ struct MigrationState {
     /* QEMU_VM_VMDESCRIPTION content filled for all non-iterable devices. */
     JSONWriter *vmdesc;
 
+    /* Save time of each device section, in reverse stream order */
+    VMStateDowntimeList *vmstate_downtime;
+
     /*
      * Indicates whether an ACK from the destination that it's OK to do
      * switchover has been received.
@@ -559,7 +582,8 @@ void migrate_send_rp_pong(MigrationIncomingState *mis,
 int migrate_send_rp_req_pages(MigrationIncomingState *mis, RAMBlock *rb,
                               ram_addr_t start, uint64_t haddr, uint32_t tid);
 int migrate_send_rp_message_req_pages(MigrationIncomingState *mis,
-                                      RAMBlock *rb, ram_addr_t start);
+                                      RAMBlock *rb, ram_addr_t start,
+                                      size_t len);
 void migrate_send_rp_recv_bitmap(MigrationIncomingState *mis,
                                  char *block_name);
 void migrate_send_rp_resume_ack(MigrationIncomingState *mis, uint32_t value);
@@ -0,0 +1,54 @@
+/*
+ * Multifd adaptive compression controller
+ *
+ * Copyright (c) 2026 The QEMU Project Developers
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "multifd-adaptive.h"
+
+bool multifd_adaptive_update(MultiFDAdaptive *a, int64_t write_ns,
+                             int max_effort)
+{
+    int effort = a->effort;
+    bool changed;
+
+    a->write_ns += write_ns;
+    if (++a->packets < MULTIFD_ADAPTIVE_WINDOW) {
+        return false;
+    }
+
+    if (a->backoff) {
+        a->backoff--;
+    }
+    if (effort > 1 && a->out_bytes * 10 > a->in_bytes * 9) {
+        /* Compression saves less than 10%, do not bother for a while */
+        effort = 1;
+        a->backoff = MULTIFD_ADAPTIVE_BACKOFF;
+    } else if (a->write_ns > 2 * a->prepare_ns) {
+        /* Limited by the network */
+        if (effort != 1 || !a->backoff) {
+            effort++;
+        }
+    } else if (a->prepare_ns > a->write_ns) {
+        /* Limited by the CPU; only stop looking for zero pages if none */
+        if (effort > 1 || !a->zero_pages) {
+            effort--;
+        }
+    }
+    effort = MAX(MIN(effort, max_effort), 0);
+
+    changed = effort != a->effort;
+    a->effort = effort;
+
+    a->packets = 0;
+    a->prepare_ns = 0;
+    a->write_ns = 0;
+    a->in_bytes = 0;
+    a->out_bytes = 0;
+    a->zero_pages = 0;
+    return changed;
+}
@@ -0,0 +1,44 @@
+/*
+ * Multifd adaptive compression controller
+ *
+ * Copyright (c) 2026 The QEMU Project Developers
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef QEMU_MIGRATION_MULTIFD_ADAPTIVE_H
+#define QEMU_MIGRATION_MULTIFD_ADAPTIVE_H
+
+/* Packets between two decisions */
+#define MULTIFD_ADAPTIVE_WINDOW 16
+/* Windows to wait before compressing again after a poor ratio */
+#define MULTIFD_ADAPTIVE_BACKOFF 64
+
+typedef struct MultiFDAdaptive {
+    /*
+     * 0 sends pages as they are, 1 also skips zero pages, N > 1
+     * compresses with zstd level N - 1.
+     */
+    int effort;
+    /* Windows to wait before trying again to compress */
+    int backoff;
+    /* Statistics for the current window */
+    unsigned int packets;
+    int64_t prepare_ns;
+    int64_t write_ns;
+    uint64_t in_bytes;
+    uint64_t out_bytes;
+    uint64_t zero_pages;
+} MultiFDAdaptive;
+
+/*
+ * Called before preparing each packet, with the time it took to write
+ * the previous one.  At the end of each window, choose the effort for
+ * the next one, between 0 and @max_effort, and start a new window.
+ * Returns true if the effort changed.
+ */
+bool multifd_adaptive_update(MultiFDAdaptive *a, int64_t write_ns,
+                             int max_effort);
+
+#endif
@@ -85,14 +85,14 @@ static void multifd_nocomp_send_cleanup(MultiFDSendParams *p, Error **errp)
     p->iov = NULL;
 }
 
-static void multifd_ram_prepare_header(MultiFDSendParams *p)
+void multifd_ram_prepare_header(MultiFDSendParams *p)
 {
     p->iov[0].iov_len = p->packet_len;
     p->iov[0].iov_base = p->packet;
     p->iovs_num++;
 }
 
-static void multifd_send_prepare_iovs(MultiFDSendParams *p)
+void multifd_send_prepare_iovs(MultiFDSendParams *p)
 {
     MultiFDPages_t *pages = &p->data->u.ram;
     uint32_t page_size = multifd_ram_page_size();
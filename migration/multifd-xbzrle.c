@@ -0,0 +1,332 @@
+/*
+ * Multifd XBZRLE delta compression implementation
+ *
+ * Copyright (c) 2026 The QEMU Project Developers
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bswap.h"
+#include "qemu/host-utils.h"
+#include "system/ramblock.h"
+#include "exec/target_page.h"
+#include "qapi/error.h"
+#include "migration.h"
+#include "trace.h"
+#include "options.h"
+#include "multifd.h"
+#include "xbzrle.h"
+
+/*
+ * Each channel keeps its own direct-mapped cache of the pages it sent
+ * last.  The sender chooses the cache slot of every page and tells the
+ * receiver, which keeps an identical array of slots: the receiver does
+ * not need to know how the sender indexes its cache, and a page that
+ * moves to another channel simply misses in that channel's cache.
+ *
+ * The payload of a packet is:
+ *
+ *   uint32_t nr_slots;              number of slots of the sender cache
+ *   MultiFDXBZRLEPage pages[normal_num];
+ *   uint8_t data[];                 a full page or an XBZRLE delta
+ *                                   for each entry of @pages
+ *
+ * All integers are big endian.
+ */
+typedef struct {
+    uint32_t slot;
+    /* length of the delta, or MULTIFD_XBZRLE_FULL_PAGE */
+    uint32_t len;
+} MultiFDXBZRLEPage;
+
+#define MULTIFD_XBZRLE_FULL_PAGE UINT32_MAX
+
+/* Deltas longer than this are replaced by the full page */
+#define MULTIFD_XBZRLE_MAX_DELTA(page_size) ((page_size) / 4 * 3)
+
+typedef struct {
+    RAMBlock *block;
+    ram_addr_t offset;
+} MultiFDXBZRLETag;
+
+struct xbzrle_data {
+    uint32_t nr_slots;
+    /* nr_slots pages, as last sent or received */
+    uint8_t *cache;
+    /* sender only: which page each slot holds */
+    MultiFDXBZRLETag *tags;
+    /* sender only: copy of the page being encoded */
+    uint8_t *page;
+    /* payload being built or received */
+    uint8_t *buf;
+    uint32_t buf_len;
+};
+
+static uint32_t multifd_xbzrle_buf_len(void)
+{
+    uint32_t page_count = multifd_ram_page_count();
+
+    return sizeof(uint32_t) + page_count * sizeof(MultiFDXBZRLEPage) +
+           page_count * multifd_ram_page_size();
+}
+
+static void multifd_xbzrle_free(struct xbzrle_data *x)
+{
+    g_free(x->cache);
+    g_free(x->tags);
+    g_free(x->page);
+    g_free(x->buf);
+    g_free(x);
+}
+
+/* Multifd XBZRLE compression */
+
+static int multifd_xbzrle_send_setup(MultiFDSendParams *p, Error **errp)
+{
+    struct xbzrle_data *x = g_new0(struct xbzrle_data, 1);
+    uint32_t page_size = multifd_ram_page_size();
+    uint64_t nr_slots;
+
+    nr_slots = migrate_xbzrle_cache_size() / migrate_multifd_channels() /
+               page_size;
+    x->nr_slots = nr_slots ? pow2floor(MIN(nr_slots, 1u << 30)) : 1;
+    x->cache = g_try_malloc((size_t)x->nr_slots * page_size);
+    x->tags = g_try_new0(MultiFDXBZRLETag, x->nr_slots);
+    x->page = g_try_malloc(page_size);
+    x->buf_len = multifd_xbzrle_buf_len();
+    x->buf = g_try_malloc(x->buf_len);
+    if (!x->cache || !x->tags || !x->page || !x->buf) {
+        error_setg(errp, "multifd %u: out of memory for xbzrle cache",
+                   p->id);
+        multifd_xbzrle_free(x);
+        return -1;
+    }
+    p->compress_data = x;
+
+    /* header and payload */
+    p->iov = g_new0(struct iovec, 2);
+    return 0;
+}
+
+static void multifd_xbzrle_send_cleanup(MultiFDSendParams *p, Error **errp)
+{
+    multifd_xbzrle_free(p->compress_data);
+    p->compress_data = NULL;
+    g_free(p->iov);
+    p->iov = NULL;
+}
+
+static int multifd_xbzrle_send_prepare(MultiFDSendParams *p, Error **errp)
+{
+    MultiFDPages_t *pages = &p->data->u.ram;
+    struct xbzrle_data *x = p->compress_data;
+    uint32_t page_size = multifd_ram_page_size();
+    MultiFDXBZRLEPage *desc;
+    uint32_t out_size, hits = 0;
+    uint32_t i;
+
+    if (!multifd_send_prepare_common(p)) {
+        goto out;
+    }
+
+    stl_be_p(x->buf, x->nr_slots);
+    desc = (MultiFDXBZRLEPage *)(x->buf + sizeof(uint32_t));
+    out_size = sizeof(uint32_t) + pages->normal_num * sizeof(*desc);
+
+    for (i = 0; i < pages->normal_num; i++) {
+        ram_addr_t offset = pages->offset[i];
+        uint32_t slot = ((pages->block->offset + offset) / page_size) &
+                        (x->nr_slots - 1);
+        uint8_t *cached = x->cache + (size_t)slot * page_size;
+        MultiFDXBZRLETag *tag = &x->tags[slot];
+        uint32_t len = MULTIFD_XBZRLE_FULL_PAGE;
+
+        if (tag->block == pages->block && tag->offset == offset) {
+            int ret;
+
+            /*
+             * The guest may be writing to the page, so encode a copy:
+             * the cache must hold exactly what the receiver will have.
+             */
+            memcpy(x->page, pages->block->host + offset, page_size);
+            ret = xbzrle_encode_buffer(cached, x->page, page_size,
+                                       x->buf + out_size,
+                                       MULTIFD_XBZRLE_MAX_DELTA(page_size));
+            if (ret >= 0) {
+                len = ret;
+                memcpy(cached, x->page, page_size);
+                out_size += len;
+                hits++;
+            }
+        }
+
+        if (len == MULTIFD_XBZRLE_FULL_PAGE) {
+            memcpy(cached, pages->block->host + offset, page_size);
+            memcpy(x->buf + out_size, cached, page_size);
+            out_size += page_size;
+            tag->block = pages->block;
+            tag->offset = offset;
+        }
+
+        stl_be_p(&desc[i].slot, slot);
+        stl_be_p(&desc[i].len, len);
+    }
+
+    trace_multifd_xbzrle_send(p->id, pages->normal_num, hits, out_size);
+
+    p->iov[p->iovs_num].iov_base = x->buf;
+    p->iov[p->iovs_num].iov_len = out_size;
+    p->iovs_num++;
+    p->next_packet_size = out_size;
+
+out:
+    p->flags |= MULTIFD_FLAG_XBZRLE;
+    multifd_send_fill_packet(p);
+    return 0;
+}
+
+static int multifd_xbzrle_recv_setup(MultiFDRecvParams *p, Error **errp)
+{
+    struct xbzrle_data *x = g_new0(struct xbzrle_data, 1);
+
+    /* The cache is allocated when the first packet says how big it is */
+    x->buf_len = multifd_xbzrle_buf_len();
+    x->buf = g_try_malloc(x->buf_len);
+    if (!x->buf) {
+        error_setg(errp, "multifd %u: out of memory for xbzrle buffer",
+                   p->id);
+        g_free(x);
+        return -1;
+    }
+    p->compress_data = x;
+    return 0;
+}
+
+static void multifd_xbzrle_recv_cleanup(MultiFDRecvParams *p)
+{
+    multifd_xbzrle_free(p->compress_data);
+    p->compress_data = NULL;
+}
+
+static int multifd_xbzrle_recv(MultiFDRecvParams *p, Error **errp)
+{
+    struct xbzrle_data *x = p->compress_data;
+    uint32_t in_size = p->next_packet_size;
+    uint32_t page_size = multifd_ram_page_size();
+    uint32_t flags = p->flags & MULTIFD_FLAG_COMPRESSION_MASK;
+    MultiFDXBZRLEPage *desc;
+    uint32_t nr_slots, pos;
+    int ret;
+    int i;
+
+    if (flags != MULTIFD_FLAG_XBZRLE) {
+        error_setg(errp, "multifd %u: flags received %x flags expected %x",
+                   p->id, flags, MULTIFD_FLAG_XBZRLE);
+        return -1;
+    }
+
+    multifd_recv_zero_page_process(p);
+
+    if (!p->normal_num) {
+        assert(in_size == 0);
+        return 0;
+    }
+
+    pos = sizeof(uint32_t) + p->normal_num * sizeof(*desc);
+    if (in_size < pos || in_size > x->buf_len) {
+        error_setg(errp, "multifd %u: invalid xbzrle packet size %u",
+                   p->id, in_size);
+        return -1;
+    }
+
+    ret = qio_channel_read_all(p->c, (void *)x->buf, in_size, errp);
+    if (ret != 0) {
+        return ret;
+    }
+
+    nr_slots = ldl_be_p(x->buf);
+    if (!x->cache) {
+        if (!is_power_of_2(nr_slots) || nr_slots > (1u << 30)) {
+            error_setg(errp, "multifd %u: invalid xbzrle cache size %u",
+                       p->id, nr_slots);
+            return -1;
+        }
+        x->nr_slots = nr_slots;
+        x->cache = g_try_malloc0((size_t)nr_slots * page_size);
+        if (!x->cache) {
+            error_setg(errp, "multifd %u: out of memory for xbzrle cache",
+                       p->id);
+            return -1;
+        }
+    } else if (nr_slots != x->nr_slots) {
+        error_setg(errp, "multifd %u: xbzrle cache size changed from %u "
+                   "to %u", p->id, x->nr_slots, nr_slots);
+        return -1;
+    }
+
+    desc = (MultiFDXBZRLEPage *)(x->buf + sizeof(uint32_t));
+    for (i = 0; i < p->normal_num; i++) {
+        uint32_t slot = ldl_be_p(&desc[i].slot);
+        uint32_t len = ldl_be_p(&desc[i].len);
+        uint8_t *cached;
+
+        if (slot >= x->nr_slots) {
+            error_setg(errp, "multifd %u: invalid xbzrle slot %u",
+                       p->id, slot);
+            return -1;
+        }
+        cached = x->cache + (size_t)slot * page_size;
+
+        if (len == MULTIFD_XBZRLE_FULL_PAGE) {
+            if (page_size > in_size - pos) {
+                goto truncated;
+            }
+            memcpy(cached, x->buf + pos, page_size);
+            pos += page_size;
+        } else {
+            if (len > in_size - pos) {
+                goto truncated;
+            }
+            if (len &&
+                xbzrle_decode_buffer(x->buf + pos, len, cached,
+                                     page_size) == -1) {
+                error_setg(errp, "multifd %u: failed to decode xbzrle page",
+                           p->id);
+                return -1;
+            }
+            pos += len;
+        }
+
+        ramblock_recv_bitmap_set_offset(p->block, p->normal[i]);
+        memcpy(p->host + p->normal[i], cached, page_size);
+    }
+
+    if (pos != in_size) {
+        error_setg(errp, "multifd %u: packet size received %u size expected %u",
+                   p->id, in_size, pos);
+        return -1;
+    }
+    return 0;
+
+truncated:
+    error_setg(errp, "multifd %u: truncated xbzrle packet", p->id);
+    return -1;
+}
+
+static const MultiFDMethods multifd_xbzrle_ops = {
+    .send_setup = multifd_xbzrle_send_setup,
+    .send_cleanup = multifd_xbzrle_send_cleanup,
+    .send_prepare = multifd_xbzrle_send_prepare,
+    .recv_setup = multifd_xbzrle_recv_setup,
+    .recv_cleanup = multifd_xbzrle_recv_cleanup,
+    .recv = multifd_xbzrle_recv
+};
+
+static void multifd_xbzrle_register(void)
+{
+    multifd_register_ops(MULTIFD_COMPRESSION_XBZRLE, &multifd_xbzrle_ops);
+}
+
+migration_init(multifd_xbzrle_register);
@@ -37,6 +37,28 @@ static void swap_page_offset(ram_addr_t *pages_offset, int a, int b)
     pages_offset[b] = temp;
 }
 
+static void multifd_send_zero_page_account(MultiFDPages_t *pages)
+{
+    qatomic_add(&mig_stats.normal_pages, pages->normal_num);
+    qatomic_add(&mig_stats.zero_pages, pages->num - pages->normal_num);
+}
+
+/**
+ * multifd_send_zero_page_skip: Treat all pages as normal pages.
+ *
+ * Same as multifd_send_zero_page_detect() with zero page detection
+ * disabled.
+ *
+ * @param p A pointer to the send params.
+ */
+void multifd_send_zero_page_skip(MultiFDSendParams *p)
+{
+    MultiFDPages_t *pages = &p->data->u.ram;
+
+    pages->normal_num = pages->num;
+    multifd_send_zero_page_account(pages);
+}
+
 /**
  * multifd_send_zero_page_detect: Perform zero page detection on all pages.
  *
@@ -53,8 +75,8 @@ void multifd_send_zero_page_detect(MultiFDSendParams *p)
     int j = pages->num - 1;
 
     if (!multifd_zero_page_enabled()) {
-        pages->normal_num = pages->num;
-        goto out;
+        multifd_send_zero_page_skip(p);
+        return;
     }
 
     /*
@@ -75,10 +97,7 @@ void multifd_send_zero_page_detect(MultiFDSendParams *p)
     }
 
     pages->normal_num = i;
-
-out:
-    qatomic_add(&mig_stats.normal_pages, pages->normal_num);
-    qatomic_add(&mig_stats.zero_pages, pages->num - pages->normal_num);
+    multifd_send_zero_page_account(pages);
 }
 
 void multifd_recv_zero_page_process(MultiFDRecvParams *p)
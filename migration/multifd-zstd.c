@@ -13,6 +13,7 @@
 #include "qemu/osdep.h"
 #include <zstd.h>
 #include "qemu/rcu.h"
+#include "qemu/timer.h"
 #include "system/ramblock.h"
 #include "exec/target_page.h"
 #include "qapi/error.h"
@@ -20,6 +21,7 @@
 #include "trace.h"
 #include "options.h"
 #include "multifd.h"
+#include "multifd-adaptive.h"
 
 struct zstd_data {
     /* stream for compression */
@@ -33,11 +35,15 @@ struct zstd_data {
     uint8_t *zbuff;
     /* size of compressed buffer */
     uint32_t zbuff_len;
+
+    /* Adaptive compression only */
+    MultiFDAdaptive adaptive;
 };
 
 /* Multifd zstd compression */
 
-static int multifd_zstd_send_setup(MultiFDSendParams *p, Error **errp)
+static int multifd_zstd_send_setup_common(MultiFDSendParams *p,
+                                          uint32_t niov, Error **errp)
 {
     struct zstd_data *z = g_new0(struct zstd_data, 1);
     int res;
@@ -67,10 +73,14 @@ static int multifd_zstd_send_setup(MultiFDSendParams *p, Error **errp)
         return -1;
     }
     p->compress_data = z;
+    p->iov = g_new0(struct iovec, niov);
+    return 0;
+}
 
+static int multifd_zstd_send_setup(MultiFDSendParams *p, Error **errp)
+{
     /* Needs 2 IOVs, one for packet header and one for compressed data */
-    p->iov = g_new0(struct iovec, 2);
-    return 0;
+    return multifd_zstd_send_setup_common(p, 2, errp);
 }
 
 static void multifd_zstd_send_cleanup(MultiFDSendParams *p, Error **errp)
@@ -88,17 +98,18 @@ static void multifd_zstd_send_cleanup(MultiFDSendParams *p, Error **errp)
     p->iov = NULL;
 }
 
-static int multifd_zstd_send_prepare(MultiFDSendParams *p, Error **errp)
+/*
+ * Compress the normal pages of the packet and add them to p->iov.
+ * @end is applied to the last page.
+ */
+static int multifd_zstd_compress(MultiFDSendParams *p, ZSTD_EndDirective end,
+                                 Error **errp)
 {
     MultiFDPages_t *pages = &p->data->u.ram;
     struct zstd_data *z = p->compress_data;
     int ret;
     uint32_t i;
 
-    if (!multifd_send_prepare_common(p)) {
-        goto out;
-    }
-
     z->out.dst = z->zbuff;
     z->out.size = z->zbuff_len;
     z->out.pos = 0;
@@ -107,7 +118,7 @@ static int multifd_zstd_send_prepare(MultiFDSendParams *p, Error **errp)
         ZSTD_EndDirective flush = ZSTD_e_continue;
 
         if (i == pages->normal_num - 1) {
-            flush = ZSTD_e_flush;
+            flush = end;
         }
         z->in.src = pages->block->host + pages->offset[i];
         z->in.size = multifd_ram_page_size();
@@ -140,8 +151,16 @@ static int multifd_zstd_send_prepare(MultiFDSendParams *p, Error **errp)
     p->iov[p->iovs_num].iov_len = z->out.pos;
     p->iovs_num++;
     p->next_packet_size = z->out.pos;
+    return 0;
+}
+
+static int multifd_zstd_send_prepare(MultiFDSendParams *p, Error **errp)
+{
+    if (multifd_send_prepare_common(p) &&
+        multifd_zstd_compress(p, ZSTD_e_flush, errp) < 0) {
+        return -1;
+    }
 
-out:
     p->flags |= MULTIFD_FLAG_ZSTD;
     multifd_send_fill_packet(p);
     return 0;
@@ -193,23 +212,21 @@ static void multifd_zstd_recv_cleanup(MultiFDRecvParams *p)
     p->compress_data = NULL;
 }
 
-static int multifd_zstd_recv(MultiFDRecvParams *p, Error **errp)
+/*
+ * Read and decompress the normal pages of the packet.  If @whole_frame,
+ * the packet is a complete zstd frame and must be consumed entirely.
+ */
+static int multifd_zstd_decompress(MultiFDRecvParams *p, bool whole_frame,
+                                   Error **errp)
 {
     uint32_t in_size = p->next_packet_size;
     uint32_t out_size = 0;
     uint32_t page_size = multifd_ram_page_size();
     uint32_t expected_size = p->normal_num * page_size;
-    uint32_t flags = p->flags & MULTIFD_FLAG_COMPRESSION_MASK;
     struct zstd_data *z = p->compress_data;
     int ret;
     int i;
 
-    if (flags != MULTIFD_FLAG_ZSTD) {
-        error_setg(errp, "multifd %u: flags received %x flags expected %x",
-                   p->id, flags, MULTIFD_FLAG_ZSTD);
-        return -1;
-    }
-
     multifd_recv_zero_page_process(p);
 
     if (!p->normal_num) {
@@ -262,9 +279,36 @@ static int multifd_zstd_recv(MultiFDRecvParams *p, Error **errp)
                    p->id, out_size, expected_size);
         return -1;
     }
+
+    /* The end of the frame, e.g. an empty last block, has no output */
+    while (whole_frame && z->in.pos < z->in.size) {
+        size_t pos = z->in.pos;
+
+        z->out.size = 0;
+        z->out.pos = 0;
+        ret = ZSTD_decompressStream(z->zds, &z->out, &z->in);
+        if (ZSTD_isError(ret) || z->in.pos == pos) {
+            error_setg(errp, "multifd %u: trailing data in compressed packet",
+                       p->id);
+            return -1;
+        }
+    }
     return 0;
 }
 
+static int multifd_zstd_recv(MultiFDRecvParams *p, Error **errp)
+{
+    uint32_t flags = p->flags & MULTIFD_FLAG_COMPRESSION_MASK;
+
+    if (flags != MULTIFD_FLAG_ZSTD) {
+        error_setg(errp, "multifd %u: flags received %x flags expected %x",
+                   p->id, flags, MULTIFD_FLAG_ZSTD);
+        return -1;
+    }
+
+    return multifd_zstd_decompress(p, false, errp);
+}
+
 static const MultiFDMethods multifd_zstd_ops = {
     .send_setup = multifd_zstd_send_setup,
     .send_cleanup = multifd_zstd_send_cleanup,
@@ -274,9 +318,162 @@ static const MultiFDMethods multifd_zstd_ops = {
     .recv = multifd_zstd_recv
 };
 
+/*
+ * Multifd adaptive compression
+ *
+ * Each channel chooses for each packet whether to send the pages as they
+ * are, to only skip zero pages, or to compress them with zstd at a level
+ * up to multifd-zstd-level.  The choice is recorded in the compression
+ * flags of the packet, so the destination does not need to follow it.
+ *
+ * Every MULTIFD_ADAPTIVE_WINDOW packets, the channel compares the time it
+ * spent preparing packets (mostly compressing) with the time it spent
+ * writing them.  A channel that mostly waits for the network spends more
+ * CPU to send fewer bytes, and vice versa.  Each zstd frame covers exactly
+ * one packet, so that the level can change between packets.
+ *
+ * The channel keeps these statistics itself rather than reading them from
+ * mig_stats: those counters are global, and there is no CPU time in them,
+ * so they cannot tell one channel's compression cost from another's.  The
+ * preparation time is wall-clock time on the channel thread; it is close
+ * to the thread's CPU time, except that it also grows when the host is
+ * short of CPU, which is when compressing less helps too.
+ */
+
+static int multifd_adaptive_max_effort(void)
+{
+    return 1 + MAX(migrate_multifd_zstd_level(), 1);
+}
+
+static int multifd_adaptive_send_setup(MultiFDSendParams *p, Error **errp)
+{
+    struct zstd_data *z;
+
+    /* One IOV for the packet header, and one for each page if raw */
+    if (multifd_zstd_send_setup_common(p, multifd_ram_page_count() + 1,
+                                       errp) < 0) {
+        return -1;
+    }
+
+    z = p->compress_data;
+    z->adaptive.effort = MIN(2, multifd_adaptive_max_effort());
+    ZSTD_CCtx_setParameter(z->zcs, ZSTD_c_compressionLevel,
+                           z->adaptive.effort - 1);
+    return 0;
+}
+
+static void multifd_adaptive_update_effort(MultiFDSendParams *p)
+{
+    struct zstd_data *z = p->compress_data;
+    MultiFDAdaptive *a = &z->adaptive;
+    int old = a->effort;
+
+    /* p->write_ns is the time of the previous packet, which is close enough */
+    if (!multifd_adaptive_update(a, p->write_ns,
+                                 multifd_adaptive_max_effort())) {
+        return;
+    }
+
+    trace_multifd_adaptive_effort(p->id, old, a->effort);
+    if (a->effort > 1) {
+        ZSTD_CCtx_setParameter(z->zcs, ZSTD_c_compressionLevel,
+                               a->effort - 1);
+    }
+}
+
+static int multifd_adaptive_send_prepare(MultiFDSendParams *p, Error **errp)
+{
+    MultiFDPages_t *pages = &p->data->u.ram;
+    struct zstd_data *z = p->compress_data;
+    MultiFDAdaptive *a = &z->adaptive;
+    int64_t start = get_clock();
+
+    multifd_adaptive_update_effort(p);
+
+    if (a->effort == 0) {
+        /* Like multifd_send_prepare_common(), without zero page detection */
+        multifd_ram_prepare_header(p);
+        multifd_send_zero_page_skip(p);
+        multifd_send_prepare_iovs(p);
+        p->flags |= MULTIFD_FLAG_NOCOMP;
+    } else if (!multifd_send_prepare_common(p)) {
+        p->flags |= MULTIFD_FLAG_NOCOMP;
+    } else if (a->effort == 1) {
+        multifd_send_prepare_iovs(p);
+        p->flags |= MULTIFD_FLAG_NOCOMP;
+    } else {
+        if (multifd_zstd_compress(p, ZSTD_e_end, errp) < 0) {
+            return -1;
+        }
+        p->flags |= MULTIFD_FLAG_ZSTD;
+    }
+    multifd_send_fill_packet(p);
+
+    a->prepare_ns += get_clock() - start;
+    a->in_bytes += (uint64_t)pages->normal_num * multifd_ram_page_size();
+    a->out_bytes += p->next_packet_size;
+    a->zero_pages += pages->num - pages->normal_num;
+    return 0;
+}
+
+static int multifd_adaptive_recv_setup(MultiFDRecvParams *p, Error **errp)
+{
+    if (multifd_zstd_recv_setup(p, errp) < 0) {
+        return -1;
+    }
+    p->iov = g_new0(struct iovec, multifd_ram_page_count());
+    return 0;
+}
+
+static void multifd_adaptive_recv_cleanup(MultiFDRecvParams *p)
+{
+    multifd_zstd_recv_cleanup(p);
+    g_free(p->iov);
+    p->iov = NULL;
+}
+
+static int multifd_adaptive_recv(MultiFDRecvParams *p, Error **errp)
+{
+    uint32_t flags = p->flags & MULTIFD_FLAG_COMPRESSION_MASK;
+    int i;
+
+    if (flags == MULTIFD_FLAG_ZSTD) {
+        return multifd_zstd_decompress(p, true, errp);
+    }
+    if (flags != MULTIFD_FLAG_NOCOMP) {
+        error_setg(errp, "multifd %u: flags received %x flags expected %x "
+                   "or %x", p->id, flags, MULTIFD_FLAG_NOCOMP,
+                   MULTIFD_FLAG_ZSTD);
+        return -1;
+    }
+
+    multifd_recv_zero_page_process(p);
+
+    if (!p->normal_num) {
+        return 0;
+    }
+
+    for (i = 0; i < p->normal_num; i++) {
+        p->iov[i].iov_base = p->host + p->normal[i];
+        p->iov[i].iov_len = multifd_ram_page_size();
+        ramblock_recv_bitmap_set_offset(p->block, p->normal[i]);
+    }
+    return qio_channel_readv_all(p->c, p->iov, p->normal_num, errp);
+}
+
+static const MultiFDMethods multifd_adaptive_ops = {
+    .send_setup = multifd_adaptive_send_setup,
+    .send_cleanup = multifd_zstd_send_cleanup,
+    .send_prepare = multifd_adaptive_send_prepare,
+    .recv_setup = multifd_adaptive_recv_setup,
+    .recv_cleanup = multifd_adaptive_recv_cleanup,
+    .recv = multifd_adaptive_recv
+};
+
 static void multifd_zstd_register(void)
 {
     multifd_register_ops(MULTIFD_COMPRESSION_ZSTD, &multifd_zstd_ops);
+    multifd_register_ops(MULTIFD_COMPRESSION_ADAPTIVE, &multifd_adaptive_ops);
 }
 
 migration_init(multifd_zstd_register);
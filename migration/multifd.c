@@ -14,6 +14,7 @@
 #include "qemu/cutils.h"
 #include "qemu/iov.h"
 #include "qemu/rcu.h"
+#include "qemu/timer.h"
 #include "exec/target_page.h"
 #include "system/system.h"
 #include "system/ramblock.h"
@@ -27,6 +28,7 @@
 #include "socket.h"
 #include "tls.h"
 #include "qemu-file.h"
+#include "ram.h"
 #include "trace.h"
 #include "multifd.h"
 #include "options.h"
@@ -35,6 +37,12 @@
 #include "io/channel-socket.h"
 #include "yank_functions.h"
 
+/* Enough for the iovec of a packet of 4 KiB pages, plus its header */
+#define MULTIFD_URING_ENTRIES 256
+
+/* Packets between two decisions to deactivate a channel */
+#define MULTIFD_ACTIVE_WINDOW 256
+
 typedef struct {
     uint32_t magic;
     uint32_t version;
@@ -74,6 +82,19 @@ struct {
     int exiting;
     /* multifd ops */
     const MultiFDMethods *ops;
+    /* Number of channels created at setup */
+    int channels;
+    /*
+     * Channels that multifd_send() prefers; this is always the first
+     * active_channels channels.  Adaptive compression shrinks it when
+     * at most half of them were busy at once over the last
+     * MULTIFD_ACTIVE_WINDOW packets, and multifd_send() grows it back,
+     * up to the number of channels, whenever all of them are busy.
+     * Protected by multifd_send_mutex.
+     */
+    int active_channels;
+    int busy_max;
+    int window;
 } *multifd_send_state;
 
 struct {
@@ -331,6 +352,43 @@ static void multifd_send_kick_main(MultiFDSendParams *p)
     qemu_sem_post(&multifd_send_state->channels_ready);
 }
 
+static bool multifd_send_adaptive(void)
+{
+#ifdef CONFIG_ZSTD
+    return migrate_multifd_compression() == MULTIFD_COMPRESSION_ADAPTIVE;
+#else
+    return false;
+#endif
+}
+
+/*
+ * Called after picking a channel.  Deactivate one channel if, for a
+ * whole window, at most half of the active channels were busy at the
+ * same time.  The set grows again in multifd_send() as soon as all
+ * active channels are busy.
+ */
+static void multifd_send_update_active(void)
+{
+    int active = multifd_send_state->active_channels;
+    int busy = 0;
+    int i;
+
+    for (i = 0; i < active; i++) {
+        busy += qatomic_read(&multifd_send_state->params[i].pending_job);
+    }
+    multifd_send_state->busy_max = MAX(multifd_send_state->busy_max, busy);
+
+    if (++multifd_send_state->window < MULTIFD_ACTIVE_WINDOW) {
+        return;
+    }
+    if (active > 1 && multifd_send_state->busy_max * 2 <= active) {
+        multifd_send_state->active_channels = --active;
+        trace_multifd_send_active_channels(active);
+    }
+    multifd_send_state->busy_max = 0;
+    multifd_send_state->window = 0;
+}
+
 /*
  * multifd_send() works by exchanging the MultiFDSendData object
  * provided by the caller with an unused MultiFDSendData object from
@@ -351,6 +409,7 @@ bool multifd_send(MultiFDSendData **send_data)
     static int next_channel;
     MultiFDSendParams *p = NULL; /* make happy gcc */
     MultiFDSendData *tmp;
+    int active, busy = 0;
 
     if (multifd_send_should_exit()) {
         return false;
@@ -366,8 +425,9 @@ bool multifd_send(MultiFDSendData **send_data)
      * using more channels, so ensure it doesn't overflow if the
      * limit is lower now.
      */
-    next_channel %= migrate_multifd_channels();
-    for (i = next_channel;; i = (i + 1) % migrate_multifd_channels()) {
+    active = multifd_send_state->active_channels;
+    next_channel %= active;
+    for (i = next_channel;; i = (i + 1) % active) {
         if (multifd_send_should_exit()) {
             return false;
         }
@@ -377,9 +437,19 @@ bool multifd_send(MultiFDSendData **send_data)
          * sender thread can clear it.
          */
         if (qatomic_read(&p->pending_job) == false) {
-            next_channel = (i + 1) % migrate_multifd_channels();
+            next_channel = (i + 1) % active;
             break;
         }
+        if (++busy == active && active < multifd_send_state->channels) {
+            /* All active channels are busy, activate one more */
+            multifd_send_state->active_channels = ++active;
+            trace_multifd_send_active_channels(active);
+            busy = 0;
+        }
+    }
+
+    if (multifd_send_adaptive()) {
+        multifd_send_update_active();
     }
 
     /*
@@ -540,6 +610,11 @@ static bool multifd_send_cleanup_channel(MultiFDSendParams *p, Error **errp)
         object_unref(OBJECT(p->c));
         p->c = NULL;
     }
+    if (p->uring_registered) {
+        /* Closing the channel unpinned guest RAM */
+        ram_block_discard_disable(false);
+        p->uring_registered = false;
+    }
     qemu_sem_destroy(&p->sem);
     qemu_sem_destroy(&p->sem_sync);
     g_free(p->name);
@@ -654,6 +729,46 @@ int multifd_send_sync_main(MultiFDSyncReq req)
     return 0;
 }
 
+/*
+ * Register guest RAM with the io_uring of the channel, so that zero-copy
+ * sends do not pin and unpin each page.  This is only an optimization:
+ * if it fails, the pages are pinned by each send as usual.
+ */
+static void multifd_send_uring_register(MultiFDSendParams *p)
+{
+    g_autoptr(GArray) iov = g_array_new(false, false, sizeof(struct iovec));
+    Error *local_err = NULL;
+    RAMBlock *rb;
+
+    /* A discarded page would stay pinned and be sent with stale contents */
+    if (ram_block_discard_disable(true)) {
+        warn_report_once("multifd: cannot register guest RAM with io_uring "
+                         "while RAM discard is in use");
+        return;
+    }
+
+    WITH_RCU_READ_LOCK_GUARD() {
+        RAMBLOCK_FOREACH_NOT_IGNORED(rb) {
+            struct iovec v = {
+                .iov_base = rb->host,
+                .iov_len = rb->used_length,
+            };
+
+            g_array_append_val(iov, v);
+        }
+    }
+
+    if (qio_channel_socket_uring_register(QIO_CHANNEL_SOCKET(p->c),
+                                          (struct iovec *)iov->data,
+                                          iov->len, &local_err) < 0) {
+        error_prepend(&local_err, "multifd: not registering guest RAM: ");
+        warn_report_err_once(local_err);
+        ram_block_discard_disable(false);
+        return;
+    }
+    p->uring_registered = true;
+}
+
 static void *multifd_send_thread(void *opaque)
 {
     MultiFDSendParams *p = opaque;
@@ -664,6 +779,10 @@ static void *multifd_send_thread(void *opaque)
     trace_multifd_send_thread_start(p->id);
     rcu_register_thread();
 
+    if (migrate_multifd_io_uring() && migrate_zero_copy_send()) {
+        multifd_send_uring_register(p);
+    }
+
     if (use_packets) {
         if (multifd_send_initial_packet(p, &local_err) < 0) {
             ret = -1;
@@ -717,10 +836,13 @@ static void *multifd_send_thread(void *opaque)
                 ret = file_write_ramblock_iov(p->c, p->iov, p->iovs_num,
                                               &p->data->u.ram, &local_err);
             } else {
+                int64_t start = get_clock();
+
                 ret = qio_channel_writev_full_all(p->c, p->iov, p->iovs_num,
                                                   NULL, 0,
                                                   p->write_flags & ~write_flags_masked,
                                                   &local_err);
+                p->write_ns = get_clock() - start;
             }
 
             if (ret != 0) {
@@ -867,6 +989,13 @@ static void multifd_new_send_channel_async(QIOTask *task, gpointer opaque)
 
     trace_multifd_set_outgoing_channel(ioc, object_get_typename(OBJECT(ioc)));
 
+    if (migrate_multifd_io_uring() &&
+        qio_channel_socket_set_uring(QIO_CHANNEL_SOCKET(ioc),
+                                     MULTIFD_URING_ENTRIES, &local_err) < 0) {
+        ret = false;
+        goto out;
+    }
+
     if (migrate_channel_requires_tls_upgrade(ioc)) {
         ret = multifd_tls_channel_connect(p, ioc, &local_err);
         if (ret) {
@@ -928,6 +1057,8 @@ bool multifd_send_setup(void)
     qemu_sem_init(&multifd_send_state->channels_ready, 0);
     qatomic_set(&multifd_send_state->exiting, 0);
     multifd_send_state->ops = multifd_ops[migrate_multifd_compression()];
+    multifd_send_state->channels = thread_count;
+    multifd_send_state->active_channels = thread_count;
 
     for (i = 0; i < thread_count; i++) {
         MultiFDSendParams *p = &multifd_send_state->params[i];
@@ -1051,6 +1182,9 @@ static void multifd_recv_terminate_threads(Error *err)
         return;
     }
 
+    /* Device states that did not arrive yet never will */
+    qemu_loadvm_abort_state_buffers();
+
     if (err) {
         MigrationState *s = migrate_get_current();
 
@@ -1542,6 +1676,13 @@ bool multifd_recv_new_channel(QIOChannel *ioc, Error **errp)
         error_propagate(errp, local_err);
         return false;
     }
+    if (migrate_multifd_io_uring() &&
+        qio_channel_socket_set_uring(QIO_CHANNEL_SOCKET(ioc),
+                                     MULTIFD_URING_ENTRIES, &local_err) < 0) {
+        multifd_recv_terminate_threads(error_copy(local_err));
+        error_propagate(errp, local_err);
+        return false;
+    }
     p->c = ioc;
     object_ref(OBJECT(ioc));
 
@@ -66,6 +66,8 @@ MultiFDRecvData *multifd_get_recv_data(void);
 #define MULTIFD_FLAG_QPL (4 << 1)
 #define MULTIFD_FLAG_UADK (8 << 1)
 #define MULTIFD_FLAG_QATZIP (16 << 1)
+/* The methods above use one bit each, this one uses a combination */
+#define MULTIFD_FLAG_XBZRLE (3 << 1)
 
 /*
  * If set it means that this packet contains device state
@@ -193,6 +195,8 @@ typedef struct {
     bool tls_thread_created;
     /* communication channel */
     QIOChannel *c;
+    /* guest RAM is registered with the io_uring of the channel */
+    bool uring_registered;
     /* packet allocated len */
     uint32_t packet_len;
     /* multifd flags for sending ram */
@@ -228,6 +232,8 @@ typedef struct {
     uint32_t next_packet_size;
     /* packets sent through this channel */
     uint64_t packets_sent;
+    /* time spent writing the last packet, in nanoseconds */
+    int64_t write_ns;
     /* buffers to send */
     struct iovec *iov;
     /* number of iovs used */
@@ -379,7 +385,10 @@ typedef struct {
 void multifd_register_ops(int method, const MultiFDMethods *ops);
 void multifd_send_fill_packet(MultiFDSendParams *p);
 bool multifd_send_prepare_common(MultiFDSendParams *p);
+void multifd_ram_prepare_header(MultiFDSendParams *p);
+void multifd_send_prepare_iovs(MultiFDSendParams *p);
 void multifd_send_zero_page_detect(MultiFDSendParams *p);
+void multifd_send_zero_page_skip(MultiFDSendParams *p);
 void multifd_recv_zero_page_process(MultiFDRecvParams *p);
 
 void multifd_channel_connect(MultiFDSendParams *p, QIOChannel *ioc);
@@ -49,6 +49,7 @@
 
 /* Migration XBZRLE default cache size */
 #define DEFAULT_MIGRATE_XBZRLE_CACHE_SIZE (64 * 1024 * 1024)
+#define DEFAULT_MIGRATE_XBZRLE_CACHE_ASSOCIATIVITY 4
 
 /* The delay time (in ms) between two COLO checkpoints */
 #define DEFAULT_MIGRATE_X_CHECKPOINT_DELAY (200 * 100)
@@ -66,6 +67,15 @@
 /* 0: means nocompress, 1: best speed, ... 20: best compress ratio */
 #define DEFAULT_MIGRATE_MULTIFD_ZSTD_LEVEL 1
 
+/* Every vCPU is throttled down to vcpu-dirty-limit */
+#define DEFAULT_MIGRATE_X_DIRTY_LIMIT_BANDWIDTH_PCT 0
+
+/* Dirty bitmap sync is done by the migration thread alone */
+#define DEFAULT_MIGRATE_X_DIRTY_SYNC_THREADS 1
+
+/* Postcopy only requests the pages that faulted */
+#define DEFAULT_MIGRATE_X_POSTCOPY_PREFETCH_WINDOW 0
+
 /* Background transfer rate for postcopy, 0 means unlimited, note
  * that page requests can still exceed this limit.
  */
@@ -149,6 +159,9 @@ const Property migration_properties[] = {
     DEFINE_PROP_SIZE("xbzrle-cache-size", MigrationState,
                       parameters.xbzrle_cache_size,
                       DEFAULT_MIGRATE_XBZRLE_CACHE_SIZE),
+    DEFINE_PROP_UINT8("xbzrle-cache-associativity", MigrationState,
+                      parameters.xbzrle_cache_associativity,
+                      DEFAULT_MIGRATE_XBZRLE_CACHE_ASSOCIATIVITY),
     DEFINE_PROP_SIZE("max-postcopy-bandwidth", MigrationState,
                       parameters.max_postcopy_bandwidth,
                       DEFAULT_MIGRATE_MAX_POSTCOPY_BANDWIDTH),
@@ -177,6 +190,15 @@ const Property migration_properties[] = {
     DEFINE_PROP_UINT64("vcpu-dirty-limit", MigrationState,
                        parameters.vcpu_dirty_limit,
                        DEFAULT_MIGRATE_VCPU_DIRTY_LIMIT),
+    DEFINE_PROP_UINT8("x-dirty-limit-bandwidth-pct", MigrationState,
+                      parameters.x_dirty_limit_bandwidth_pct,
+                      DEFAULT_MIGRATE_X_DIRTY_LIMIT_BANDWIDTH_PCT),
+    DEFINE_PROP_UINT8("x-dirty-sync-threads", MigrationState,
+                      parameters.x_dirty_sync_threads,
+                      DEFAULT_MIGRATE_X_DIRTY_SYNC_THREADS),
+    DEFINE_PROP_UINT8("x-postcopy-prefetch-window", MigrationState,
+                      parameters.x_postcopy_prefetch_window,
+                      DEFAULT_MIGRATE_X_POSTCOPY_PREFETCH_WINDOW),
     DEFINE_PROP_MIG_MODE("mode", MigrationState,
                       parameters.mode,
                       MIG_MODE_NORMAL),
@@ -210,6 +232,12 @@ const Property migration_properties[] = {
     DEFINE_PROP_MIG_CAP("mapped-ram", MIGRATION_CAPABILITY_MAPPED_RAM),
     DEFINE_PROP_MIG_CAP("x-ignore-shared",
                         MIGRATION_CAPABILITY_X_IGNORE_SHARED),
+    DEFINE_PROP_MIG_CAP("x-multifd-io-uring",
+                        MIGRATION_CAPABILITY_X_MULTIFD_IO_URING),
+    DEFINE_PROP_MIG_CAP("x-parallel-vmstate",
+                        MIGRATION_CAPABILITY_X_PARALLEL_VMSTATE),
+    DEFINE_PROP_MIG_CAP("x-instant-restore",
+                        MIGRATION_CAPABILITY_X_INSTANT_RESTORE),
 };
 const size_t migration_properties_count = ARRAY_SIZE(migration_properties);
 
@@ -343,6 +371,13 @@ bool migrate_ignore_shared(void)
     return s->capabilities[MIGRATION_CAPABILITY_X_IGNORE_SHARED];
 }
 
+bool migrate_instant_restore(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->capabilities[MIGRATION_CAPABILITY_X_INSTANT_RESTORE];
+}
+
 bool migrate_late_block_activate(void)
 {
     MigrationState *s = migrate_get_current();
@@ -357,6 +392,20 @@ bool migrate_multifd(void)
     return s->capabilities[MIGRATION_CAPABILITY_MULTIFD];
 }
 
+bool migrate_multifd_io_uring(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->capabilities[MIGRATION_CAPABILITY_X_MULTIFD_IO_URING];
+}
+
+bool migrate_parallel_vmstate(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->capabilities[MIGRATION_CAPABILITY_X_PARALLEL_VMSTATE];
+}
+
 bool migrate_pause_before_switchover(void)
 {
     MigrationState *s = migrate_get_current();
@@ -673,6 +722,36 @@ bool migrate_caps_check(bool *old_caps, bool *new_caps, Error **errp)
         }
     }
 
+    if (new_caps[MIGRATION_CAPABILITY_X_MULTIFD_IO_URING] &&
+        (!new_caps[MIGRATION_CAPABILITY_MULTIFD] ||
+         new_caps[MIGRATION_CAPABILITY_MAPPED_RAM] ||
+         migrate_tls())) {
+        error_setg(errp,
+                   "io_uring only available for non-TLS multifd migration");
+        return false;
+    }
+
+    if (new_caps[MIGRATION_CAPABILITY_X_PARALLEL_VMSTATE] &&
+        (!new_caps[MIGRATION_CAPABILITY_MULTIFD] ||
+         new_caps[MIGRATION_CAPABILITY_MAPPED_RAM] ||
+         migrate_multifd_compression())) {
+        error_setg(errp, "Parallel vmstate only available for "
+                   "non-compressed multifd migration");
+        return false;
+    }
+
+    if (new_caps[MIGRATION_CAPABILITY_X_INSTANT_RESTORE]) {
+#ifdef _WIN32
+        error_setg(errp, "Instant restore is not supported on this host");
+        return false;
+#endif
+        if (!new_caps[MIGRATION_CAPABILITY_MAPPED_RAM]) {
+            error_setg(errp, "Capability 'x-instant-restore' requires "
+                       "capability 'mapped-ram'");
+            return false;
+        }
+    }
+
     if (new_caps[MIGRATION_CAPABILITY_SWITCHOVER_ACK]) {
         if (!new_caps[MIGRATION_CAPABILITY_RETURN_PATH]) {
             error_setg(errp, "Capability 'switchover-ack' requires capability "
@@ -831,6 +910,27 @@ bool migrate_direct_io(void)
         s->capabilities[MIGRATION_CAPABILITY_MULTIFD];
 }
 
+uint8_t migrate_dirty_limit_bandwidth_pct(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->parameters.x_dirty_limit_bandwidth_pct;
+}
+
+int migrate_dirty_sync_threads(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->parameters.x_dirty_sync_threads;
+}
+
+unsigned int migrate_postcopy_prefetch_window(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->parameters.x_postcopy_prefetch_window;
+}
+
 uint64_t migrate_downtime_limit(void)
 {
     MigrationState *s = migrate_get_current();
@@ -978,6 +1078,13 @@ uint64_t migrate_xbzrle_cache_size(void)
     return s->parameters.xbzrle_cache_size;
 }
 
+uint8_t migrate_xbzrle_cache_associativity(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->parameters.xbzrle_cache_associativity;
+}
+
 ZeroPageDetection migrate_zero_page_detection(void)
 {
     MigrationState *s = migrate_get_current();
@@ -1042,11 +1149,15 @@ static void migrate_mark_all_params_present(MigrationParameters *p)
         &p->has_multifd_channels, &p->has_multifd_compression,
         &p->has_multifd_zlib_level, &p->has_multifd_qatzip_level,
         &p->has_multifd_zstd_level, &p->has_xbzrle_cache_size,
+        &p->has_xbzrle_cache_associativity,
         &p->has_max_postcopy_bandwidth, &p->has_max_cpu_throttle,
         &p->has_announce_initial, &p->has_announce_max, &p->has_announce_rounds,
         &p->has_announce_step, &p->has_block_bitmap_mapping,
         &p->has_x_vcpu_dirty_limit_period, &p->has_vcpu_dirty_limit,
-        &p->has_mode, &p->has_zero_page_detection, &p->has_direct_io,
+        &p->has_x_dirty_limit_bandwidth_pct,
+        &p->has_x_dirty_sync_threads, &p->has_x_postcopy_prefetch_window,
+        &p->has_mode,
+        &p->has_zero_page_detection, &p->has_direct_io,
         &p->has_cpr_exec_command,
     };
 
@@ -1097,8 +1208,9 @@ static void migrate_post_update_params(MigrationParameters *new, Error **errp)
         colo_checkpoint_delay_set();
     }
 
-    if (new->has_xbzrle_cache_size) {
-        xbzrle_cache_resize(new->xbzrle_cache_size, errp);
+    if (new->has_xbzrle_cache_size || new->has_xbzrle_cache_associativity) {
+        xbzrle_cache_resize(migrate_xbzrle_cache_size(),
+                            migrate_xbzrle_cache_associativity(), errp);
     }
 
     if (new->has_max_postcopy_bandwidth) {
@@ -1190,6 +1302,13 @@ bool migrate_params_check(MigrationParameters *params, Error **errp)
         return false;
     }
 
+    if (!is_power_of_2(params->xbzrle_cache_associativity) ||
+        params->xbzrle_cache_associativity > 64) {
+        error_setg(errp, "Option xbzrle_cache_associativity expects "
+                   "a power of two between 1 and 64");
+        return false;
+    }
+
     if (params->max_cpu_throttle < params->cpu_throttle_initial ||
         params->max_cpu_throttle > 99) {
         error_setg(errp, "max_Option cpu_throttle expects "
@@ -1233,6 +1352,18 @@ bool migrate_params_check(MigrationParameters *params, Error **errp)
     }
 #endif
 
+    if (migrate_multifd_io_uring() && *params->tls_creds->u.s) {
+        error_setg(errp,
+                   "io_uring only available for non-TLS multifd migration");
+        return false;
+    }
+
+    if (migrate_parallel_vmstate() && params->multifd_compression) {
+        error_setg(errp, "Parallel vmstate only available for "
+                   "non-compressed multifd migration");
+        return false;
+    }
+
     if (migrate_mapped_ram() &&
         (migrate_multifd_compression() || migrate_tls())) {
         error_setg(errp,
@@ -1253,6 +1384,18 @@ bool migrate_params_check(MigrationParameters *params, Error **errp)
         return false;
     }
 
+    if (params->x_dirty_limit_bandwidth_pct > 100) {
+        error_setg(errp, "Option x-dirty-limit-bandwidth-pct expects "
+                   "a value between 0 and 100");
+        return false;
+    }
+
+    if (params->x_dirty_sync_threads < 1) {
+        error_setg(errp, "Option x-dirty-sync-threads expects "
+                   "a value between 1 and 255");
+        return false;
+    }
+
     if (params->direct_io && !qemu_has_direct_io()) {
         error_setg(errp, "No build-time support for direct-io");
         return false;
@@ -1339,6 +1482,10 @@ static void migrate_params_test_apply(MigrationParameters *params,
     if (params->has_xbzrle_cache_size) {
         dest->xbzrle_cache_size = params->xbzrle_cache_size;
     }
+
+    if (params->has_xbzrle_cache_associativity) {
+        dest->xbzrle_cache_associativity = params->xbzrle_cache_associativity;
+    }
     if (params->has_max_postcopy_bandwidth) {
         dest->max_postcopy_bandwidth = params->max_postcopy_bandwidth;
     }
@@ -1371,6 +1518,18 @@ static void migrate_params_test_apply(MigrationParameters *params,
         dest->vcpu_dirty_limit = params->vcpu_dirty_limit;
     }
 
+    if (params->has_x_dirty_limit_bandwidth_pct) {
+        dest->x_dirty_limit_bandwidth_pct = params->x_dirty_limit_bandwidth_pct;
+    }
+
+    if (params->has_x_dirty_sync_threads) {
+        dest->x_dirty_sync_threads = params->x_dirty_sync_threads;
+    }
+
+    if (params->has_x_postcopy_prefetch_window) {
+        dest->x_postcopy_prefetch_window = params->x_postcopy_prefetch_window;
+    }
+
     if (params->has_mode) {
         dest->mode = params->mode;
     }
@@ -1460,6 +1619,11 @@ static void migrate_params_apply(MigrationParameters *params)
     if (params->has_xbzrle_cache_size) {
         s->parameters.xbzrle_cache_size = params->xbzrle_cache_size;
     }
+
+    if (params->has_xbzrle_cache_associativity) {
+        s->parameters.xbzrle_cache_associativity =
+            params->xbzrle_cache_associativity;
+    }
     if (params->has_max_postcopy_bandwidth) {
         s->parameters.max_postcopy_bandwidth = params->max_postcopy_bandwidth;
     }
@@ -1497,6 +1661,20 @@ static void migrate_params_apply(MigrationParameters *params)
         s->parameters.vcpu_dirty_limit = params->vcpu_dirty_limit;
     }
 
+    if (params->has_x_dirty_limit_bandwidth_pct) {
+        s->parameters.x_dirty_limit_bandwidth_pct =
+            params->x_dirty_limit_bandwidth_pct;
+    }
+
+    if (params->has_x_dirty_sync_threads) {
+        s->parameters.x_dirty_sync_threads = params->x_dirty_sync_threads;
+    }
+
+    if (params->has_x_postcopy_prefetch_window) {
+        s->parameters.x_postcopy_prefetch_window =
+            params->x_postcopy_prefetch_window;
+    }
+
     if (params->has_mode) {
         s->parameters.mode = params->mode;
     }
@@ -31,8 +31,11 @@ bool migrate_dirty_bitmaps(void);
 bool migrate_events(void);
 bool migrate_mapped_ram(void);
 bool migrate_ignore_shared(void);
+bool migrate_instant_restore(void);
 bool migrate_late_block_activate(void);
 bool migrate_multifd(void);
+bool migrate_multifd_io_uring(void);
+bool migrate_parallel_vmstate(void);
 bool migrate_pause_before_switchover(void);
 bool migrate_postcopy_blocktime(void);
 bool migrate_postcopy_preempt(void);
@@ -71,6 +74,8 @@ uint8_t migrate_cpu_throttle_increment(void);
 uint8_t migrate_cpu_throttle_initial(void);
 bool migrate_cpu_throttle_tailslow(void);
 bool migrate_direct_io(void);
+uint8_t migrate_dirty_limit_bandwidth_pct(void);
+int migrate_dirty_sync_threads(void);
 uint64_t migrate_downtime_limit(void);
 uint8_t migrate_max_cpu_throttle(void);
 uint64_t migrate_max_bandwidth(void);
@@ -81,11 +86,13 @@ MultiFDCompression migrate_multifd_compression(void);
 int migrate_multifd_zlib_level(void);
 int migrate_multifd_qatzip_level(void);
 int migrate_multifd_zstd_level(void);
+unsigned int migrate_postcopy_prefetch_window(void);
 uint8_t migrate_throttle_trigger_threshold(void);
 const char *migrate_tls_authz(void);
 const char *migrate_tls_creds(void);
 const char *migrate_tls_hostname(void);
 uint64_t migrate_xbzrle_cache_size(void);
+uint8_t migrate_xbzrle_cache_associativity(void);
 ZeroPageDetection migrate_zero_page_detection(void);
 
 /* parameters helpers */
@@ -17,31 +17,54 @@
 #include "qapi/qmp/qerror.h"
 #include "qapi/error.h"
 #include "qemu/host-utils.h"
+#include "qemu/rcu.h"
+#include "qemu/units.h"
 #include "page_cache.h"
 #include "trace.h"
 
 /* the page in cache will not be replaced in two cycles */
 #define CACHED_PAGE_LIFETIME 2
 
+/*
+ * Each hit makes a page look one cycle younger when choosing what to
+ * evict, up to this many cycles.
+ */
+#define CACHED_PAGE_MAX_HITS 4
+
+/* Page data is allocated in shards of this size, when first used */
+#define PAGE_CACHE_SHARD_SIZE (2 * MiB)
+
+#define CACHE_ITEM_EMPTY UINT64_MAX
+
 typedef struct CacheItem CacheItem;
 
 struct CacheItem {
     uint64_t it_addr;
     uint64_t it_age;
-    uint8_t *it_data;
+    uint32_t it_hits;
 };
 
+typedef struct PageCacheShard {
+    /* shard_sets * ways pages, NULL until the first insertion */
+    uint8_t *data;
+} PageCacheShard;
+
 struct PageCache {
+    struct rcu_head rcu;
+    /* num_sets * ways items, the ways of a set are contiguous */
     CacheItem *page_cache;
+    PageCacheShard *shards;
     size_t page_size;
-    size_t max_num_items;
-    size_t num_items;
+    size_t num_sets;
+    size_t shard_sets;
+    unsigned int ways;
 };
 
-PageCache *cache_init(uint64_t new_size, size_t page_size, Error **errp)
+PageCache *cache_init(uint64_t new_size, size_t page_size, unsigned int ways,
+                      Error **errp)
 {
-    int64_t i;
     size_t num_pages = new_size / page_size;
+    size_t i, num_shards;
     PageCache *cache;
 
     if (new_size < page_size) {
@@ -55,31 +78,41 @@ PageCache *cache_init(uint64_t new_size, size_t page_size, Error **errp)
         return NULL;
     }
 
+    if (!is_power_of_2(ways)) {
+        error_setg(errp, "cache associativity is not a power of two");
+        return NULL;
+    }
+
     /* We prefer not to abort if there is no memory */
-    cache = g_try_malloc(sizeof(*cache));
+    cache = g_try_malloc0(sizeof(*cache));
     if (!cache) {
         error_setg(errp, "Failed to allocate cache");
         return NULL;
     }
     cache->page_size = page_size;
-    cache->num_items = 0;
-    cache->max_num_items = num_pages;
+    cache->ways = MIN(ways, num_pages);
+    cache->num_sets = num_pages / cache->ways;
+    cache->shard_sets = PAGE_CACHE_SHARD_SIZE / page_size / cache->ways;
+    cache->shard_sets = MIN(MAX(cache->shard_sets, 1), cache->num_sets);
+    num_shards = cache->num_sets / cache->shard_sets;
 
-    trace_migration_pagecache_init(cache->max_num_items);
+    trace_migration_pagecache_init(cache->num_sets, cache->ways);
 
     /* We prefer not to abort if there is no memory */
-    cache->page_cache = g_try_malloc((cache->max_num_items) *
-                                     sizeof(*cache->page_cache));
-    if (!cache->page_cache) {
+    cache->page_cache = g_try_new(CacheItem, num_pages);
+    cache->shards = g_try_new0(PageCacheShard, num_shards);
+    if (!cache->page_cache || !cache->shards) {
         error_setg(errp, "Failed to allocate page cache");
+        g_free(cache->page_cache);
+        g_free(cache->shards);
         g_free(cache);
         return NULL;
     }
 
-    for (i = 0; i < cache->max_num_items; i++) {
-        cache->page_cache[i].it_data = NULL;
+    for (i = 0; i < num_pages; i++) {
+        cache->page_cache[i].it_addr = CACHE_ITEM_EMPTY;
         cache->page_cache[i].it_age = 0;
-        cache->page_cache[i].it_addr = -1;
+        cache->page_cache[i].it_hits = 0;
     }
 
     return cache;
@@ -87,42 +120,66 @@ PageCache *cache_init(uint64_t new_size, size_t page_size, Error **errp)
 
 void cache_fini(PageCache *cache)
 {
-    int64_t i;
+    size_t i;
 
     g_assert(cache);
     g_assert(cache->page_cache);
 
-    for (i = 0; i < cache->max_num_items; i++) {
-        g_free(cache->page_cache[i].it_data);
+    for (i = 0; i < cache->num_sets / cache->shard_sets; i++) {
+        g_free(cache->shards[i].data);
     }
 
+    g_free(cache->shards);
     g_free(cache->page_cache);
     cache->page_cache = NULL;
     g_free(cache);
 }
 
-static size_t cache_get_cache_pos(const PageCache *cache,
-                                  uint64_t address)
+void cache_fini_rcu(PageCache *cache)
+{
+    call_rcu(cache, cache_fini, rcu);
+}
+
+static size_t cache_get_set(const PageCache *cache, uint64_t address)
 {
-    g_assert(cache->max_num_items);
-    return (address / cache->page_size) & (cache->max_num_items - 1);
+    g_assert(cache->num_sets);
+    return (address / cache->page_size) & (cache->num_sets - 1);
+}
+
+static uint8_t *cache_item_data(const PageCache *cache, const CacheItem *it)
+{
+    size_t pos = it - cache->page_cache;
+    size_t shard_pages = cache->shard_sets * cache->ways;
+    PageCacheShard *shard = &cache->shards[pos / shard_pages];
+
+    if (!shard->data) {
+        return NULL;
+    }
+    return shard->data + (pos % shard_pages) * cache->page_size;
 }
 
 static CacheItem *cache_get_by_addr(const PageCache *cache, uint64_t addr)
 {
-    size_t pos;
+    CacheItem *it;
+    unsigned int i;
 
     g_assert(cache);
     g_assert(cache->page_cache);
 
-    pos = cache_get_cache_pos(cache, addr);
-
-    return &cache->page_cache[pos];
+    it = &cache->page_cache[cache_get_set(cache, addr) * cache->ways];
+    for (i = 0; i < cache->ways; i++) {
+        if (it[i].it_addr == addr) {
+            return &it[i];
+        }
+    }
+    return NULL;
 }
 
 uint8_t *get_cached_data(const PageCache *cache, uint64_t addr)
 {
-    return cache_get_by_addr(cache, addr)->it_data;
+    CacheItem *it = cache_get_by_addr(cache, addr);
+
+    return it ? cache_item_data(cache, it) : NULL;
 }
 
 bool cache_is_cached(const PageCache *cache, uint64_t addr,
@@ -132,42 +189,90 @@ bool cache_is_cached(const PageCache *cache, uint64_t addr,
 
     it = cache_get_by_addr(cache, addr);
 
-    if (it->it_addr == addr) {
+    if (it) {
         /* update the it_age when the cache hit */
         it->it_age = current_age;
+        if (it->it_hits < CACHED_PAGE_MAX_HITS) {
+            it->it_hits++;
+        }
         return true;
     }
     return false;
 }
 
+/*
+ * Find where to insert a page that is not cached: an empty item, else
+ * the item that was least recently and least often used, provided it
+ * is not fresh.
+ */
+static CacheItem *cache_get_victim(const PageCache *cache, uint64_t addr,
+                                   uint64_t current_age)
+{
+    CacheItem *set, *victim = NULL;
+    uint64_t victim_score = UINT64_MAX;
+    unsigned int i;
+
+    set = &cache->page_cache[cache_get_set(cache, addr) * cache->ways];
+    for (i = 0; i < cache->ways; i++) {
+        CacheItem *it = &set[i];
+        uint64_t score;
+
+        if (it->it_addr == CACHE_ITEM_EMPTY) {
+            return it;
+        }
+        if (it->it_age + CACHED_PAGE_LIFETIME > current_age) {
+            /* the cache page is fresh, don't replace it */
+            continue;
+        }
+        score = it->it_age + it->it_hits;
+        if (score < victim_score) {
+            victim = it;
+            victim_score = score;
+        }
+    }
+    return victim;
+}
+
 int cache_insert(PageCache *cache, uint64_t addr, const uint8_t *pdata,
                  uint64_t current_age)
 {
-
+    PageCacheShard *shard;
     CacheItem *it;
+    uint8_t *data;
+    int ret = 0;
 
-    /* actual update of entry */
     it = cache_get_by_addr(cache, addr);
-
-    if (it->it_data && it->it_addr != addr &&
-        it->it_age + CACHED_PAGE_LIFETIME > current_age) {
-        /* the cache page is fresh, don't replace it */
-        return -1;
+    if (!it) {
+        it = cache_get_victim(cache, addr, current_age);
+        if (!it) {
+            return -1;
+        }
     }
-    /* allocate page */
-    if (!it->it_data) {
-        it->it_data = g_try_malloc(cache->page_size);
-        if (!it->it_data) {
+
+    /* allocate the shard */
+    shard = &cache->shards[(it - cache->page_cache) /
+                           (cache->shard_sets * cache->ways)];
+    if (!shard->data) {
+        shard->data = g_try_malloc(cache->shard_sets * cache->ways *
+                                   cache->page_size);
+        if (!shard->data) {
             trace_migration_pagecache_insert();
             return -1;
         }
-        cache->num_items++;
     }
 
-    memcpy(it->it_data, pdata, cache->page_size);
+    if (it->it_addr != addr) {
+        if (it->it_addr != CACHE_ITEM_EMPTY) {
+            ret = 1;
+        }
+        it->it_hits = 0;
+    }
+
+    data = cache_item_data(cache, it);
+    memcpy(data, pdata, cache->page_size);
 
     it->it_age = current_age;
     it->it_addr = addr;
 
-    return 0;
+    return ret;
 }
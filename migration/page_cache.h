@@ -21,20 +21,34 @@ typedef struct PageCache PageCache;
 /**
  * cache_init: Initialize the page cache
  *
+ * The cache is set associative: a page can be stored in any of @ways
+ * items of the set selected by its address.
  *
  * Returns new allocated cache or NULL on error
  *
  * @cache_size: cache size in bytes
  * @page_size: cache page size
+ * @ways: number of pages in each set, a power of two
  * @errp: set *errp if the check failed, with reason
  */
-PageCache *cache_init(uint64_t cache_size, size_t page_size, Error **errp);
+PageCache *cache_init(uint64_t cache_size, size_t page_size, unsigned int ways,
+                      Error **errp);
 /**
  * cache_fini: free all cache resources
  * @cache pointer to the PageCache struct
  */
 void cache_fini(PageCache *cache);
 
+/**
+ * cache_fini_rcu: free all cache resources after an RCU grace period
+ *
+ * The cache can still be used until then by threads that got a
+ * pointer to it within an RCU read-side critical section.
+ *
+ * @cache pointer to the PageCache struct
+ */
+void cache_fini_rcu(PageCache *cache);
+
 /**
  * cache_is_cached: Checks to see if the page is cached
  *
@@ -61,7 +75,12 @@ uint8_t *get_cached_data(const PageCache *cache, uint64_t addr);
  * cache_insert: insert the page into the cache. the page cache
  * will dup the data on insert. the previous value will be overwritten
  *
- * Returns -1 when the page isn't inserted into cache
+ * If the set of the page is full, the page that was least recently
+ * and least often hit is evicted, unless all of them were used in
+ * the last two generations.
+ *
+ * Returns -1 when the page isn't inserted into cache, 1 when another
+ * page was evicted to make room for it, 0 otherwise
  *
  * @cache pointer to the PageCache struct
  * @addr: page address
@@ -0,0 +1,61 @@
+/*
+ * Postcopy prefetch stride detection
+ *
+ * Copyright (c) 2026 The QEMU Project Developers
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "postcopy-prefetch.h"
+
+static bool postcopy_prefetch_stride_valid(size_t pagesize, int64_t stride)
+{
+    int64_t max = POSTCOPY_PREFETCH_MAX_STRIDE * (int64_t)pagesize;
+
+    return stride && stride >= -max && stride <= max;
+}
+
+unsigned int postcopy_prefetch_update(PostcopyPrefetchStream *s,
+                                      RAMBlock *rb, uint64_t offset,
+                                      size_t pagesize,
+                                      unsigned int max_window,
+                                      unsigned int *hits)
+{
+    int64_t delta = (int64_t)offset - (int64_t)s->last;
+
+    *hits = 0;
+    if (s->rb == rb && s->stride && delta % s->stride == 0 &&
+        delta / s->stride >= 1 && delta / s->stride <= s->ahead + 1) {
+        unsigned int steps = delta / s->stride;
+        unsigned int i;
+
+        /* The pages in between did not fault, count those we requested */
+        for (i = 1; i < steps; i++) {
+            if (test_and_clear_bit((s->pos + i) % POSTCOPY_PREFETCH_RING,
+                                   s->requested)) {
+                (*hits)++;
+            }
+        }
+        clear_bit((s->pos + steps) % POSTCOPY_PREFETCH_RING, s->requested);
+        s->pos += steps;
+        s->ahead = s->ahead >= steps ? s->ahead - steps : 0;
+        s->confidence++;
+    } else {
+        bool valid = s->rb == rb &&
+                     postcopy_prefetch_stride_valid(pagesize, delta);
+
+        s->stride = valid ? delta : 0;
+        s->confidence = 0;
+        s->ahead = 0;
+        bitmap_zero(s->requested, POSTCOPY_PREFETCH_RING);
+    }
+    s->rb = rb;
+    s->last = offset;
+
+    if (!s->stride || !s->confidence) {
+        return 0;
+    }
+    return MIN(max_window, 1u << MIN(s->confidence, 16));
+}
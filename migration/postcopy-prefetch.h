@@ -0,0 +1,51 @@
+/*
+ * Postcopy prefetch stride detection
+ *
+ * Copyright (c) 2026 The QEMU Project Developers
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef QEMU_MIGRATION_POSTCOPY_PREFETCH_H
+#define QEMU_MIGRATION_POSTCOPY_PREFETCH_H
+
+#include "qemu/bitmap.h"
+
+/* Largest stride that is considered, in host pages */
+#define POSTCOPY_PREFETCH_MAX_STRIDE 64
+
+/* Larger than the largest x-postcopy-prefetch-window */
+#define POSTCOPY_PREFETCH_RING 256
+
+typedef struct PostcopyPrefetchStream {
+    RAMBlock *rb;
+    /* offset of the last fault */
+    uint64_t last;
+    /* distance between faults in bytes, or 0 if not known */
+    int64_t stride;
+    /* number of faults that followed @stride */
+    unsigned int confidence;
+    /* pages already considered for prefetching after @last */
+    unsigned int ahead;
+    /*
+     * Position of @last along the stride, and which of the following
+     * positions were requested, modulo POSTCOPY_PREFETCH_RING
+     */
+    unsigned int pos;
+    DECLARE_BITMAP(requested, POSTCOPY_PREFETCH_RING);
+} PostcopyPrefetchStream;
+
+/*
+ * Update @s with a fault at @offset of @rb, whose pages are @pagesize
+ * bytes, and return how many pages can be prefetched after it, at most
+ * @max_window.  @hits is set to the number of requested pages that the
+ * thread skipped since the last fault.
+ */
+unsigned int postcopy_prefetch_update(PostcopyPrefetchStream *s,
+                                      RAMBlock *rb, uint64_t offset,
+                                      size_t pagesize,
+                                      unsigned int max_window,
+                                      unsigned int *hits);
+
+#endif
@@ -23,6 +23,7 @@
 #include "qemu-file.h"
 #include "savevm.h"
 #include "postcopy-ram.h"
+#include "postcopy-prefetch.h"
 #include "ram.h"
 #include "qapi/error.h"
 #include "qemu/notify.h"
@@ -324,8 +325,8 @@ static struct PostcopyBlocktimeContext *blocktime_context_new(void)
 
 /*
  * This function just populates MigrationInfo from postcopy's
- * blocktime context. It will not populate MigrationInfo,
- * unless postcopy-blocktime capability was set.
+ * prefetch counters and blocktime context. It will not populate
+ * the blocktime fields, unless postcopy-blocktime capability was set.
  *
  * @info: pointer to MigrationInfo to populate
  */
@@ -340,6 +341,15 @@ void fill_destination_postcopy_migration_info(MigrationInfo *info)
     uint64List *latency_buckets = NULL;
     int i;
 
+    if (migrate_postcopy_prefetch_window()) {
+        info->has_postcopy_prefetch_pages = true;
+        info->postcopy_prefetch_pages =
+            qatomic_read(&mis->postcopy_prefetch_pages);
+        info->has_postcopy_prefetch_hits = true;
+        info->postcopy_prefetch_hits =
+            qatomic_read(&mis->postcopy_prefetch_hits);
+    }
+
     if (!bc) {
         return;
     }
@@ -976,6 +986,101 @@ static int postcopy_request_page(MigrationIncomingState *mis, RAMBlock *rb,
     return migrate_send_rp_req_pages(mis, rb, start, haddr, tid);
 }
 
+/*
+ * Postcopy prefetching
+ *
+ * Every fault costs a round trip to the source, so a guest that scans
+ * memory sequentially (or with a fixed stride) is limited by network
+ * latency rather than bandwidth.  The fault thread follows the faults
+ * of each guest thread; once two consecutive faults of a thread are a
+ * small stride apart and a third one confirms it, it asks the source
+ * for the pages that the thread will touch next, right after the
+ * faulting page.  The window grows exponentially with the number of
+ * faults that confirm the stride, up to x-postcopy-prefetch-window
+ * pages.
+ *
+ * A prefetched page that arrives in time never faults, so hits are
+ * counted when the thread faults further along its stride than the
+ * next page: the prefetched pages that it skipped were hits.
+ */
+
+static int postcopy_prefetch_flush(MigrationIncomingState *mis, RAMBlock *rb,
+                                   ram_addr_t start, size_t len)
+{
+    if (!len) {
+        return 0;
+    }
+    trace_postcopy_prefetch(qemu_ram_get_idstr(rb), start, len);
+    qatomic_add(&mis->postcopy_prefetch_pages, len / qemu_ram_pagesize(rb));
+    return migrate_send_rp_message_req_pages(mis, rb, start, len);
+}
+
+/*
+ * Request the pages that the thread @tid is expected to touch after
+ * faulting at @offset of @rb.
+ */
+static int postcopy_prefetch(MigrationIncomingState *mis, GHashTable *streams,
+                             RAMBlock *rb, ram_addr_t offset, uint32_t tid)
+{
+    size_t pagesize = qemu_ram_pagesize(rb);
+    ram_addr_t used_length = qemu_ram_get_used_length(rb);
+    PostcopyPrefetchStream *s;
+    ram_addr_t run_start = 0;
+    size_t run_len = 0;
+    unsigned int window, hits, i;
+    int ret;
+
+    /* A huge page fault already brings in a lot of memory */
+    if (pagesize != qemu_real_host_page_size()) {
+        return 0;
+    }
+
+    s = g_hash_table_lookup(streams, GUINT_TO_POINTER(tid));
+    if (!s) {
+        s = g_new0(PostcopyPrefetchStream, 1);
+        g_hash_table_insert(streams, GUINT_TO_POINTER(tid), s);
+    }
+
+    window = postcopy_prefetch_update(s, rb, offset, pagesize,
+                                      migrate_postcopy_prefetch_window(),
+                                      &hits);
+    if (hits) {
+        qatomic_add(&mis->postcopy_prefetch_hits, hits);
+    }
+    for (i = s->ahead + 1; i <= window; i++) {
+        int64_t page = (int64_t)offset + s->stride * i;
+
+        if (page < 0 || (ram_addr_t)page >= used_length) {
+            break;
+        }
+        s->ahead = i;
+        if (ramblock_recv_bitmap_test_byte_offset(rb, page) ||
+            ramblock_page_is_discarded(rb, page)) {
+            continue;
+        }
+        set_bit((s->pos + i) % POSTCOPY_PREFETCH_RING, s->requested);
+
+        /* Merge adjacent pages into one request */
+        if (run_len && page == run_start + run_len) {
+            run_len += pagesize;
+            continue;
+        }
+        if (run_len && page + pagesize == run_start) {
+            run_start = page;
+            run_len += pagesize;
+            continue;
+        }
+        ret = postcopy_prefetch_flush(mis, rb, run_start, run_len);
+        if (ret) {
+            return ret;
+        }
+        run_start = page;
+        run_len = pagesize;
+    }
+
+    return postcopy_prefetch_flush(mis, rb, run_start, run_len);
+}
+
 /*
  * Callback from shared fault handlers to ask for a page,
  * the page must be specified by a RAMBlock and an offset in that rb
@@ -1279,6 +1384,7 @@ static void *postcopy_ram_fault_thread(void *opaque)
     int ret;
     size_t index;
     RAMBlock *rb = NULL;
+    g_autoptr(GHashTable) prefetch_streams = NULL;
 
     trace_postcopy_ram_fault_thread_entry();
     rcu_register_thread();
@@ -1295,6 +1401,9 @@ static void *postcopy_ram_fault_thread(void *opaque)
     pfd[1].fd = mis->userfault_event_fd;
     pfd[1].events = POLLIN; /* Waiting for eventfd to go positive */
     trace_postcopy_ram_fault_thread_fds_core(pfd[0].fd, pfd[1].fd);
+    if (migrate_postcopy_prefetch_window()) {
+        prefetch_streams = g_hash_table_new_full(NULL, NULL, NULL, g_free);
+    }
     for (index = 0; index < mis->postcopy_remote_fds->len; index++) {
         struct PostCopyFD *pcfd = &g_array_index(mis->postcopy_remote_fds,
                                                  struct PostCopyFD, index);
@@ -1400,6 +1509,15 @@ retry:
                 postcopy_pause_fault_thread(mis);
                 goto retry;
             }
+
+            /*
+             * Prefetching is only a hint: if the return path fails, the
+             * next fault will notice and wait for recovery.
+             */
+            if (prefetch_streams) {
+                postcopy_prefetch(mis, prefetch_streams, rb, rb_offset,
+                                  msg.arg.pagefault.feat.ptid);
+            }
         }
 
         /* Now handle any requests from external processes on shared memory */
@@ -59,6 +59,9 @@ struct QEMUFile {
 
     bool can_pass_fd;
     QTAILQ_HEAD(, FdEntry) fds;
+
+    /* Do not count the data in mig_stats */
+    bool unaccounted;
 };
 
 /*
@@ -141,6 +144,11 @@ QEMUFile *qemu_file_new_input(QIOChannel *ioc)
     return qemu_file_new_impl(ioc, false);
 }
 
+void qemu_file_set_unaccounted(QEMUFile *f)
+{
+    f->unaccounted = true;
+}
+
 /*
  * Get last error for stream f with optional Error*
  *
@@ -293,7 +301,7 @@ int qemu_fflush(QEMUFile *f)
                                    f->iov, f->iovcnt,
                                    &local_error) < 0) {
             qemu_file_set_error_obj(f, -EIO, local_error);
-        } else {
+        } else if (!f->unaccounted) {
             uint64_t size = iov_size(f->iov, f->iovcnt);
             qatomic_add(&mig_stats.qemu_file_transferred, size);
         }
@@ -35,6 +35,16 @@ int qemu_fclose(QEMUFile *f);
 
 G_DEFINE_AUTOPTR_CLEANUP_FUNC(QEMUFile, qemu_fclose)
 
+/*
+ * qemu_file_set_unaccounted:
+ *
+ * Do not count the data written to @f in the migration statistics.  This
+ * is for files that stage data which is then sent by other means, possibly
+ * from another thread while the migration stream is being written.
+ * qemu_file_transferred() must not be used on such files.
+ */
+void qemu_file_set_unaccounted(QEMUFile *f);
+
 /*
  * qemu_file_transferred:
  *
@@ -32,6 +32,7 @@
 #include "qemu/bitmap.h"
 #include "qemu/madvise.h"
 #include "qemu/main-loop.h"
+#include "qemu/units.h"
 #include "xbzrle.h"
 #include "ram.h"
 #include "migration.h"
@@ -62,7 +63,11 @@
 #include "rdma.h"
 #include "options.h"
 #include "system/dirtylimit.h"
+#include "system/hostmem.h"
+#include "system/system.h"
 #include "system/kvm.h"
+#include "io/channel-file.h"
+#include "block/thread-pool.h"
 
 #include "hw/core/boards.h" /* for machine_dump_guest_core() */
 
@@ -150,46 +155,36 @@ static struct {
     uint8_t *encoded_buf;
     /* buffer for storing page content */
     uint8_t *current_buf;
-    /* Cache for XBZRLE, Protected by lock. */
+    /*
+     * Cache for XBZRLE.  It is replaced with the BQL taken, and used by
+     * the migration thread within an RCU read-side critical section.
+     */
     PageCache *cache;
-    QemuMutex lock;
     /* it will store a page full of zeros */
     uint8_t *zero_target_page;
     /* buffer used for XBZRLE decoding */
     uint8_t *decoded_buf;
 } XBZRLE;
 
-static void XBZRLE_cache_lock(void)
-{
-    if (migrate_xbzrle()) {
-        qemu_mutex_lock(&XBZRLE.lock);
-    }
-}
-
-static void XBZRLE_cache_unlock(void)
-{
-    if (migrate_xbzrle()) {
-        qemu_mutex_unlock(&XBZRLE.lock);
-    }
-}
-
 /**
  * xbzrle_cache_resize: resize the xbzrle cache
  *
  * This function is called from migrate_post_update_params in main
  * thread, possibly while a migration is in progress.  A running
- * migration may be using the cache and might finish during this call,
- * hence changes to the cache are protected by XBZRLE.lock().
+ * migration may be using the cache, so the old cache is only freed
+ * after an RCU grace period; until then, the migration thread may
+ * still update it, to no effect.
  *
  * Returns 0 for success or -1 for error
  *
  * @new_size: new cache size
+ * @ways: new cache associativity
  * @errp: set *errp if the check failed, with reason
  */
-int xbzrle_cache_resize(uint64_t new_size, Error **errp)
+int xbzrle_cache_resize(uint64_t new_size, unsigned int ways, Error **errp)
 {
+    PageCache *old_cache = XBZRLE.cache;
     PageCache *new_cache;
-    int64_t ret = 0;
 
     /* Check for truncation */
     if (new_size != (size_t)new_size) {
@@ -197,26 +192,16 @@ int xbzrle_cache_resize(uint64_t new_size, Error **errp)
         return -1;
     }
 
-    if (new_size == migrate_xbzrle_cache_size()) {
-        /* nothing to do */
-        return 0;
-    }
-
-    XBZRLE_cache_lock();
-
-    if (XBZRLE.cache != NULL) {
-        new_cache = cache_init(new_size, TARGET_PAGE_SIZE, errp);
+    if (old_cache != NULL) {
+        new_cache = cache_init(new_size, TARGET_PAGE_SIZE, ways, errp);
         if (!new_cache) {
-            ret = -1;
-            goto out;
+            return -1;
         }
 
-        cache_fini(XBZRLE.cache);
-        XBZRLE.cache = new_cache;
+        qatomic_rcu_set(&XBZRLE.cache, new_cache);
+        cache_fini_rcu(old_cache);
     }
-out:
-    XBZRLE_cache_unlock();
-    return ret;
+    return 0;
 }
 
 static bool postcopy_preempt_active(void)
@@ -392,6 +377,8 @@ struct RAMState {
     uint64_t num_dirty_pages_period;
     /* xbzrle misses since the beginning of the period */
     uint64_t xbzrle_cache_miss_prev;
+    /* xbzrle hits since the beginning of the period */
+    uint64_t xbzrle_cache_hit_prev;
     /* Amount of xbzrle pages since the beginning of the period */
     uint64_t xbzrle_pages_prev;
     /* Amount of xbzrle encoded bytes since the beginning of the period */
@@ -414,6 +401,8 @@ struct RAMState {
      * - pss structures
      */
     QemuMutex bitmap_mutex;
+    /* Threads for x-dirty-sync-threads, created on first use */
+    ThreadPool *dirty_sync_pool;
     /* The RAMBlock used in the last src_page_requests */
     RAMBlock *last_req_rb;
     /* Queue of outstanding page requests from the destination */
@@ -602,10 +591,14 @@ void mig_throttle_counter_reset(void)
  */
 static void xbzrle_cache_zero_page(ram_addr_t current_addr)
 {
+    PageCache *cache = qatomic_rcu_read(&XBZRLE.cache);
+
     /* We don't care if this fails to allocate a new cache page
      * as long as it updated an old one */
-    cache_insert(XBZRLE.cache, current_addr, XBZRLE.zero_target_page,
-                 qatomic_read(&mig_stats.dirty_sync_count));
+    if (cache_insert(cache, current_addr, XBZRLE.zero_target_page,
+                     qatomic_read(&mig_stats.dirty_sync_count)) == 1) {
+        xbzrle_counters.cache_evictions++;
+    }
 }
 
 #define ENCODING_FLAG_XBZRLE 0x1
@@ -632,17 +625,23 @@ static int save_xbzrle_page(RAMState *rs, PageSearchStatus *pss,
     uint8_t *prev_cached_page;
     QEMUFile *file = pss->pss_channel;
     uint64_t generation = qatomic_read(&mig_stats.dirty_sync_count);
+    PageCache *cache = qatomic_rcu_read(&XBZRLE.cache);
 
-    if (!cache_is_cached(XBZRLE.cache, current_addr, generation)) {
+    if (!cache_is_cached(cache, current_addr, generation)) {
         xbzrle_counters.cache_miss++;
         if (!rs->last_stage) {
-            if (cache_insert(XBZRLE.cache, current_addr, *current_data,
-                             generation) == -1) {
+            int ret = cache_insert(cache, current_addr, *current_data,
+                                   generation);
+
+            if (ret == -1) {
                 return -1;
             } else {
+                if (ret == 1) {
+                    xbzrle_counters.cache_evictions++;
+                }
                 /* update *current_data when the page has been
                    inserted into cache */
-                *current_data = get_cached_data(XBZRLE.cache, current_addr);
+                *current_data = get_cached_data(cache, current_addr);
             }
         }
         return -1;
@@ -660,7 +659,7 @@ static int save_xbzrle_page(RAMState *rs, PageSearchStatus *pss,
      * guest page is good for xbzrle encoding.
      */
     xbzrle_counters.pages++;
-    prev_cached_page = get_cached_data(XBZRLE.cache, current_addr);
+    prev_cached_page = get_cached_data(cache, current_addr);
 
     /* save current buffer into memory */
     memcpy(XBZRLE.current_buf, *current_data, TARGET_PAGE_SIZE);
@@ -743,7 +742,12 @@ static void pss_find_next_dirty(PageSearchStatus *pss)
         size = MIN(size, pss->host_page_end);
     }
 
-    pss->page = find_next_bit(bitmap, size, pss->page);
+    if (rb->bmap_summary) {
+        pss->page = bitmap_summary_find_next(rb->bmap_summary, bitmap, size,
+                                             pss->page);
+    } else {
+        pss->page = find_next_bit(bitmap, size, pss->page);
+    }
 }
 
 static void migration_clear_memory_region_dirty_bitmap(RAMBlock *rb,
@@ -936,67 +940,121 @@ bool ramblock_page_is_discarded(RAMBlock *rb, ram_addr_t start)
     return false;
 }
 
+/*
+ * Move the dirty bits for @nr longs of the global migration bitmap
+ * @src, starting at long @word, into @dest starting at long @dest_word,
+ * and mark the longs that changed in level 0 of @summary, if not NULL.
+ * Returns the number of pages that were not already dirty in @dest.
+ *
+ * Called with RCU critical section.  This may run on a dirty sync
+ * thread, as long as no two threads work on the same longs of @src
+ * and @dest, or on the same longs of level 0 of @summary.
+ */
+static uint64_t ramblock_sync_dirty_words(unsigned long *dest,
+                                          BitmapSummary *summary,
+                                          unsigned long * const *src,
+                                          unsigned long word,
+                                          unsigned long dest_word,
+                                          unsigned long nr)
+{
+    unsigned long idx = (word * BITS_PER_LONG) / DIRTY_MEMORY_BLOCK_SIZE;
+    unsigned long offset = BIT_WORD((word * BITS_PER_LONG) %
+                                    DIRTY_MEMORY_BLOCK_SIZE);
+    uint64_t num_dirty = 0;
+    unsigned long k;
+
+    for (k = dest_word; k < dest_word + nr; k++) {
+        if (src[idx][offset]) {
+            unsigned long bits = qatomic_xchg(&src[idx][offset], 0);
+            unsigned long new_dirty;
+            new_dirty = ~dest[k];
+            dest[k] |= bits;
+            new_dirty &= bits;
+            num_dirty += ctpopl(new_dirty);
+            if (new_dirty && summary) {
+                bitmap_summary_mark_long(summary, k);
+            }
+        }
+
+        if (++offset >= BITS_TO_LONGS(DIRTY_MEMORY_BLOCK_SIZE)) {
+            offset = 0;
+            idx++;
+        }
+    }
+
+    return num_dirty;
+}
+
+/* Can the range be synced a long of the dirty bitmap at a time? */
+static bool ramblock_sync_is_aligned(RAMBlock *rb, ram_addr_t start,
+                                     ram_addr_t length)
+{
+    unsigned long word = BIT_WORD((start + rb->offset) >> TARGET_PAGE_BITS);
+
+    return ((word * BITS_PER_LONG) << TARGET_PAGE_BITS) ==
+           (start + rb->offset) &&
+           !(length & ((BITS_PER_LONG << TARGET_PAGE_BITS) - 1));
+}
+
+/*
+ * Finish the sync of an aligned range once its dirty bits have been
+ * moved into rb->bmap, @num_dirty of them new.
+ */
+static void ramblock_sync_dirty_done(RAMBlock *rb, ram_addr_t start,
+                                     ram_addr_t length, uint64_t num_dirty)
+{
+    if (num_dirty) {
+        physical_memory_dirty_bits_cleared(start, length);
+        if (rb->bmap_summary) {
+            bitmap_summary_propagate(rb->bmap_summary,
+                                     start >> TARGET_PAGE_BITS,
+                                     length >> TARGET_PAGE_BITS);
+        }
+    }
+
+    if (rb->clear_bmap) {
+        /*
+         * Postpone the dirty bitmap clear to the point before we
+         * really send the pages, also we will split the clear
+         * dirty procedure into smaller chunks.
+         */
+        clear_bmap_set(rb, start >> TARGET_PAGE_BITS,
+                       length >> TARGET_PAGE_BITS);
+    } else {
+        /* Slow path - still do that in a huge chunk */
+        memory_region_clear_dirty_bitmap(rb->mr, start, length);
+    }
+}
+
 /* Called with RCU critical section */
 static uint64_t physical_memory_sync_dirty_bitmap(RAMBlock *rb,
                                                   ram_addr_t start,
                                                   ram_addr_t length)
 {
-    unsigned long word = BIT_WORD((start + rb->offset) >> TARGET_PAGE_BITS);
-    uint64_t num_dirty = 0;
-    unsigned long *dest = rb->bmap;
+    uint64_t num_dirty;
 
     /* start address and length is aligned at the start of a word? */
-    if (((word * BITS_PER_LONG) << TARGET_PAGE_BITS) ==
-         (start + rb->offset) &&
-        !(length & ((BITS_PER_LONG << TARGET_PAGE_BITS) - 1))) {
-        int k;
-        int nr = BITS_TO_LONGS(length >> TARGET_PAGE_BITS);
+    if (ramblock_sync_is_aligned(rb, start, length)) {
         unsigned long * const *src;
-        unsigned long idx = (word * BITS_PER_LONG) / DIRTY_MEMORY_BLOCK_SIZE;
-        unsigned long offset = BIT_WORD((word * BITS_PER_LONG) %
-                                        DIRTY_MEMORY_BLOCK_SIZE);
-        unsigned long page = BIT_WORD(start >> TARGET_PAGE_BITS);
 
         src = qatomic_rcu_read(
                 &ram_list.dirty_memory[DIRTY_MEMORY_MIGRATION])->blocks;
-
-        for (k = page; k < page + nr; k++) {
-            if (src[idx][offset]) {
-                unsigned long bits = qatomic_xchg(&src[idx][offset], 0);
-                unsigned long new_dirty;
-                new_dirty = ~dest[k];
-                dest[k] |= bits;
-                new_dirty &= bits;
-                num_dirty += ctpopl(new_dirty);
-            }
-
-            if (++offset >= BITS_TO_LONGS(DIRTY_MEMORY_BLOCK_SIZE)) {
-                offset = 0;
-                idx++;
-            }
-        }
-        if (num_dirty) {
-            physical_memory_dirty_bits_cleared(start, length);
-        }
-
-        if (rb->clear_bmap) {
-            /*
-             * Postpone the dirty bitmap clear to the point before we
-             * really send the pages, also we will split the clear
-             * dirty procedure into smaller chunks.
-             */
-            clear_bmap_set(rb, start >> TARGET_PAGE_BITS,
-                           length >> TARGET_PAGE_BITS);
-        } else {
-            /* Slow path - still do that in a huge chunk */
-            memory_region_clear_dirty_bitmap(rb->mr, start, length);
-        }
+        num_dirty = ramblock_sync_dirty_words(
+                        rb->bmap, rb->bmap_summary, src,
+                        BIT_WORD((start + rb->offset) >> TARGET_PAGE_BITS),
+                        BIT_WORD(start >> TARGET_PAGE_BITS),
+                        BITS_TO_LONGS(length >> TARGET_PAGE_BITS));
+        ramblock_sync_dirty_done(rb, start, length, num_dirty);
     } else {
         num_dirty = physical_memory_test_and_clear_dirty(
                         start + rb->offset,
                         length,
                         DIRTY_MEMORY_MIGRATION,
-                        dest);
+                        rb->bmap);
+        if (num_dirty && rb->bmap_summary) {
+            bitmap_summary_mark(rb->bmap_summary, start >> TARGET_PAGE_BITS,
+                                length >> TARGET_PAGE_BITS);
+        }
     }
 
     return num_dirty;
@@ -1012,6 +1070,123 @@ static void ramblock_sync_dirty_bitmap(RAMState *rs, RAMBlock *rb)
     rs->num_dirty_pages_period += new_dirty_pages;
 }
 
+/*
+ * With x-dirty-sync-threads > 1, aligned RAMBlocks bigger than one chunk
+ * are split into about DIRTY_SYNC_CHUNKS_PER_THREAD chunks per thread,
+ * which are synced in parallel.  Chunks are a multiple of
+ * DIRTY_SYNC_CHUNK_ALIGN pages, so that they also use different longs of
+ * the bmap summary.
+ */
+#define DIRTY_SYNC_CHUNK_ALIGN        (BITS_PER_LONG * BITS_PER_LONG)
+#define DIRTY_SYNC_CHUNKS_PER_THREAD  4
+
+static unsigned long dirty_sync_chunk_pages(unsigned long pages, int threads)
+{
+    return ROUND_UP(DIV_ROUND_UP(pages,
+                                 threads * DIRTY_SYNC_CHUNKS_PER_THREAD),
+                    DIRTY_SYNC_CHUNK_ALIGN);
+}
+
+typedef struct DirtySyncChunk {
+    RAMBlock *rb;
+    unsigned long * const *src;
+    unsigned long word;
+    unsigned long dest_word;
+    unsigned long nr;
+    uint64_t num_dirty;
+} DirtySyncChunk;
+
+static int dirty_sync_chunk_run(void *opaque)
+{
+    DirtySyncChunk *chunk = opaque;
+
+    chunk->num_dirty = ramblock_sync_dirty_words(chunk->rb->bmap,
+                                                 chunk->rb->bmap_summary,
+                                                 chunk->src, chunk->word,
+                                                 chunk->dest_word, chunk->nr);
+    return 0;
+}
+
+/*
+ * Sync the dirty bitmap of every RAMBlock.  The bitmap of large RAMBlocks
+ * is split in chunks for the dirty sync threads, while the migration
+ * thread takes care of the rest and of the final, per-block bookkeeping.
+ *
+ * Called with RCU critical section and bitmap_mutex held.
+ */
+static void migration_bitmap_sync_blocks(RAMState *rs)
+{
+    int threads = migrate_dirty_sync_threads();
+    g_autoptr(GArray) chunks = NULL;
+    unsigned long * const *src;
+    RAMBlock *block;
+    guint i;
+
+    if (threads <= 1) {
+        RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+            ramblock_sync_dirty_bitmap(rs, block);
+        }
+        return;
+    }
+
+    chunks = g_array_new(FALSE, FALSE, sizeof(DirtySyncChunk));
+    src = qatomic_rcu_read(
+            &ram_list.dirty_memory[DIRTY_MEMORY_MIGRATION])->blocks;
+
+    RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+        unsigned long pages = block->used_length >> TARGET_PAGE_BITS;
+        unsigned long chunk_pages = dirty_sync_chunk_pages(pages, threads);
+        unsigned long page;
+
+        if (pages <= chunk_pages ||
+            !ramblock_sync_is_aligned(block, 0, block->used_length)) {
+            ramblock_sync_dirty_bitmap(rs, block);
+            continue;
+        }
+
+        for (page = 0; page < pages; page += chunk_pages) {
+            DirtySyncChunk chunk = {
+                .rb = block,
+                .src = src,
+                .word = BIT_WORD((block->offset >> TARGET_PAGE_BITS) + page),
+                .dest_word = BIT_WORD(page),
+                .nr = BITS_TO_LONGS(MIN(pages - page, chunk_pages)),
+            };
+            g_array_append_val(chunks, chunk);
+        }
+    }
+
+    if (!chunks->len) {
+        return;
+    }
+
+    if (!rs->dirty_sync_pool) {
+        rs->dirty_sync_pool = thread_pool_new();
+    }
+    thread_pool_set_max_threads(rs->dirty_sync_pool, threads);
+
+    for (i = 0; i < chunks->len; i++) {
+        thread_pool_submit(rs->dirty_sync_pool, dirty_sync_chunk_run,
+                           &g_array_index(chunks, DirtySyncChunk, i), NULL);
+    }
+    thread_pool_wait(rs->dirty_sync_pool);
+
+    /* Chunks of the same RAMBlock are adjacent in the array */
+    for (i = 0; i < chunks->len;) {
+        RAMBlock *rb = g_array_index(chunks, DirtySyncChunk, i).rb;
+        uint64_t num_dirty = 0;
+
+        for (; i < chunks->len &&
+               g_array_index(chunks, DirtySyncChunk, i).rb == rb; i++) {
+            num_dirty += g_array_index(chunks, DirtySyncChunk, i).num_dirty;
+        }
+
+        ramblock_sync_dirty_done(rb, 0, rb->used_length, num_dirty);
+        rs->migration_dirty_pages += num_dirty;
+        rs->num_dirty_pages_period += num_dirty;
+    }
+}
+
 /**
  * ram_pagesize_summary: calculate all the pagesizes of a VM
  *
@@ -1055,10 +1230,16 @@ static void migration_update_rates(RAMState *rs, int64_t end_time)
 
     if (migrate_xbzrle()) {
         double encoded_size, unencoded_size;
+        uint64_t hits, misses;
 
-        xbzrle_counters.cache_miss_rate = (double)(xbzrle_counters.cache_miss -
-            rs->xbzrle_cache_miss_prev) / page_count;
+        misses = xbzrle_counters.cache_miss - rs->xbzrle_cache_miss_prev;
+        xbzrle_counters.cache_miss_rate = (double)misses / page_count;
         rs->xbzrle_cache_miss_prev = xbzrle_counters.cache_miss;
+        /* each page that hits in the cache is encoded */
+        hits = xbzrle_counters.pages - rs->xbzrle_cache_hit_prev;
+        xbzrle_counters.cache_hit_rate =
+            hits + misses ? (double)hits / (hits + misses) : 0;
+        rs->xbzrle_cache_hit_prev = xbzrle_counters.pages;
         unencoded_size = (xbzrle_counters.pages - rs->xbzrle_pages_prev) *
                          TARGET_PAGE_SIZE;
         encoded_size = xbzrle_counters.bytes - rs->xbzrle_bytes_prev;
@@ -1083,6 +1264,21 @@ static void migration_dirty_limit_guest(void)
      */
     static int64_t quota_dirtyrate;
     MigrationState *s = migrate_get_current();
+    uint8_t pct = migrate_dirty_limit_bandwidth_pct();
+
+    if (pct) {
+        /*
+         * Let the guest dirty a share of the bandwidth, in MB/s like
+         * the rest of dirty-limit; s->mbps is in Mbit/s.
+         */
+        uint64_t target = s->mbps * 1000 * 1000 / 8 / MiB * pct / 100;
+
+        target = MAX(target, 1);
+        dirtylimit_set_target(target);
+        quota_dirtyrate = 0;
+        trace_migration_dirty_limit_target(target);
+        return;
+    }
 
     /*
      * If dirty limit already enabled and migration parameter
@@ -1128,13 +1324,17 @@ static void migration_trigger_throttle(RAMState *rs)
         } else if (migrate_dirty_limit()) {
             migration_dirty_limit_guest();
         }
+    } else if (migrate_dirty_limit() && migrate_dirty_limit_bandwidth_pct() &&
+               dirtylimit_in_service()) {
+        /* Once throttling, follow the changes of the bandwidth */
+        migration_dirty_limit_guest();
     }
 }
 
 static void migration_bitmap_sync(RAMState *rs, bool last_stage)
 {
-    RAMBlock *block;
-    int64_t end_time;
+    int64_t start_us = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
+    int64_t end_time, sync_us;
 
     qatomic_add(&mig_stats.dirty_sync_count, 1);
 
@@ -1147,9 +1347,7 @@ static void migration_bitmap_sync(RAMState *rs, bool last_stage)
 
     WITH_QEMU_LOCK_GUARD(&rs->bitmap_mutex) {
         WITH_RCU_READ_LOCK_GUARD() {
-            RAMBLOCK_FOREACH_NOT_IGNORED(block) {
-                ramblock_sync_dirty_bitmap(rs, block);
-            }
+            migration_bitmap_sync_blocks(rs);
             qatomic_set(&mig_stats.dirty_bytes_last_sync, ram_bytes_remaining());
         }
     }
@@ -1157,6 +1355,10 @@ static void migration_bitmap_sync(RAMState *rs, bool last_stage)
     memory_global_after_dirty_log_sync();
     trace_migration_bitmap_sync_end(rs->num_dirty_pages_period);
 
+    sync_us = qemu_clock_get_us(QEMU_CLOCK_REALTIME) - start_us;
+    qatomic_set(&mig_stats.dirty_sync_time_last, sync_us);
+    qatomic_add(&mig_stats.dirty_sync_time, sync_us);
+
     end_time = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
 
     /* more than 1 second = 1000 millisecons */
@@ -1251,9 +1453,7 @@ static int save_zero_page(RAMState *rs, PageSearchStatus *pss,
      * page would be stale.
      */
     if (rs->xbzrle_started) {
-        XBZRLE_cache_lock();
         xbzrle_cache_zero_page(pss->block->offset + offset);
-        XBZRLE_cache_unlock();
     }
 
     return len;
@@ -1319,7 +1519,6 @@ static int ram_save_page(RAMState *rs, PageSearchStatus *pss)
     p = block->host + offset;
     trace_ram_save_page(block->idstr, (uint64_t)offset, p);
 
-    XBZRLE_cache_lock();
     if (rs->xbzrle_started && !migration_in_postcopy()) {
         pages = save_xbzrle_page(rs, pss, &p, current_addr,
                                  block, offset);
@@ -1336,8 +1535,6 @@ static int ram_save_page(RAMState *rs, PageSearchStatus *pss)
         pages = save_normal_page(pss, block, offset, p, send_async);
     }
 
-    XBZRLE_cache_unlock();
-
     return pages;
 }
 
@@ -2422,6 +2619,9 @@ static void ram_state_cleanup(RAMState **rsp)
 {
     if (*rsp) {
         migration_page_queue_free(*rsp);
+        if ((*rsp)->dirty_sync_pool) {
+            thread_pool_free((*rsp)->dirty_sync_pool);
+        }
         qemu_mutex_destroy(&(*rsp)->bitmap_mutex);
         qemu_mutex_destroy(&(*rsp)->src_page_req_mutex);
         g_free(*rsp);
@@ -2431,7 +2631,6 @@ static void ram_state_cleanup(RAMState **rsp)
 
 static void xbzrle_cleanup(void)
 {
-    XBZRLE_cache_lock();
     if (XBZRLE.cache) {
         cache_fini(XBZRLE.cache);
         g_free(XBZRLE.encoded_buf);
@@ -2442,7 +2641,6 @@ static void xbzrle_cleanup(void)
         XBZRLE.current_buf = NULL;
         XBZRLE.zero_target_page = NULL;
     }
-    XBZRLE_cache_unlock();
 }
 
 static void ram_bitmaps_destroy(void)
@@ -2454,6 +2652,8 @@ static void ram_bitmaps_destroy(void)
         block->clear_bmap = NULL;
         g_free(block->bmap);
         block->bmap = NULL;
+        bitmap_summary_free(block->bmap_summary);
+        block->bmap_summary = NULL;
         g_free(block->file_bmap);
         block->file_bmap = NULL;
     }
@@ -2664,6 +2864,10 @@ static void postcopy_chunk_hostpages_pass(MigrationState *ms, RAMBlock *block)
                  */
                 rs->migration_dirty_pages += !test_and_set_bit(page, bitmap);
             }
+            if (block->bmap_summary) {
+                bitmap_summary_mark(block->bmap_summary, fixup_start_addr,
+                                    host_ratio);
+            }
         }
 
         /* Find the next dirty page for the next iteration */
@@ -2747,8 +2951,6 @@ static bool xbzrle_init(Error **errp)
         return true;
     }
 
-    XBZRLE_cache_lock();
-
     XBZRLE.zero_target_page = g_try_malloc0(TARGET_PAGE_SIZE);
     if (!XBZRLE.zero_target_page) {
         error_setg(errp, "%s: Error allocating zero page", __func__);
@@ -2756,7 +2958,8 @@ static bool xbzrle_init(Error **errp)
     }
 
     XBZRLE.cache = cache_init(migrate_xbzrle_cache_size(),
-                              TARGET_PAGE_SIZE, errp);
+                              TARGET_PAGE_SIZE,
+                              migrate_xbzrle_cache_associativity(), errp);
     if (!XBZRLE.cache) {
         goto free_zero_page;
     }
@@ -2774,7 +2977,6 @@ static bool xbzrle_init(Error **errp)
     }
 
     /* We are all good */
-    XBZRLE_cache_unlock();
     return true;
 
 free_encoded_buf:
@@ -2787,7 +2989,6 @@ free_zero_page:
     g_free(XBZRLE.zero_target_page);
     XBZRLE.zero_target_page = NULL;
 err_out:
-    XBZRLE_cache_unlock();
     return false;
 }
 
@@ -2849,6 +3050,8 @@ static void ram_list_init_bitmaps(void)
              */
             block->bmap = bitmap_new(pages);
             bitmap_set(block->bmap, 0, pages);
+            block->bmap_summary = bitmap_summary_new(pages);
+            bitmap_summary_mark(block->bmap_summary, 0, pages);
             if (migrate_mapped_ram()) {
                 block->file_bmap = bitmap_new(pages);
             }
@@ -3324,6 +3527,8 @@ static int ram_save_iterate(QEMUFile *f, void *opaque)
                 }
                 i++;
             }
+            qatomic_add(&mig_stats.ram_save_time,
+                        (qemu_clock_get_ns(QEMU_CLOCK_REALTIME) - t0) / 1000);
         }
     }
 
@@ -3370,6 +3575,7 @@ static int ram_save_complete(QEMUFile *f, void *opaque)
 {
     RAMState **temp = opaque;
     RAMState *rs = *temp;
+    int64_t t0;
     int ret = 0;
 
     trace_ram_save_complete(rs->migration_dirty_pages, 0);
@@ -3390,6 +3596,7 @@ static int ram_save_complete(QEMUFile *f, void *opaque)
         /* try transferring iterative blocks of memory */
 
         /* flush all remaining blocks regardless of rate limiting */
+        t0 = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
         qemu_mutex_lock(&rs->bitmap_mutex);
         while (true) {
             int pages;
@@ -3405,6 +3612,8 @@ static int ram_save_complete(QEMUFile *f, void *opaque)
             }
         }
         qemu_mutex_unlock(&rs->bitmap_mutex);
+        qatomic_add(&mig_stats.ram_save_time,
+                    qemu_clock_get_us(QEMU_CLOCK_REALTIME) - t0);
 
         ret = rdma_registration_stop(f, RAM_CONTROL_FINISH);
         if (ret < 0) {
@@ -4152,6 +4361,311 @@ err:
     return false;
 }
 
+#ifndef _WIN32
+/*
+ * x-instant-restore: zero pages between two runs of pages of the file are
+ * mapped along with the runs and then zeroed, if there are at most this
+ * many of them, to limit the number of mappings.
+ */
+#define MAPPED_RAM_MAP_MAX_GAP 16
+
+/* A block that would need more mappings than this is read as usual */
+#define MAPPED_RAM_MAP_MAX_RUNS 8192
+
+/* Mapped memory is prefetched in ranges of this size, one chunk at a time */
+#define MAPPED_RAM_PREFETCH_RANGE (64 * MiB)
+#define MAPPED_RAM_PREFETCH_CHUNK (2 * MiB)
+
+typedef struct {
+    char idstr[256];
+    /* host address of the block, to check that it still exists */
+    void *host;
+    ram_addr_t offset;
+    ram_addr_t length;
+} MappedRamRange;
+
+typedef struct {
+    /* MappedRamRange, not modified once the threads run */
+    GArray *ranges;
+    /* index of the next range to prefetch */
+    unsigned int next;
+    /* threads still running, the last one frees the structure */
+    unsigned int threads;
+} MappedRamPrefetch;
+
+/* Ranges mapped by the incoming migration so far */
+static MappedRamPrefetch *mapped_ram_prefetch;
+
+static void mapped_ram_prefetch_free(MappedRamPrefetch *p)
+{
+    g_array_free(p->ranges, true);
+    g_free(p);
+}
+
+static void mapped_ram_prefetch_add(RAMBlock *block, ram_addr_t offset,
+                                    ram_addr_t length)
+{
+    MappedRamRange r;
+
+    if (!mapped_ram_prefetch) {
+        mapped_ram_prefetch = g_new0(MappedRamPrefetch, 1);
+        mapped_ram_prefetch->ranges = g_array_new(false, false,
+                                                  sizeof(MappedRamRange));
+    }
+
+    pstrcpy(r.idstr, sizeof(r.idstr), block->idstr);
+    r.host = block->host;
+    while (length) {
+        r.offset = offset;
+        r.length = MIN(length, MAPPED_RAM_PREFETCH_RANGE);
+        g_array_append_val(mapped_ram_prefetch->ranges, r);
+        offset += r.length;
+        length -= r.length;
+    }
+}
+
+/* Returns false if the block of @r went away */
+static bool mapped_ram_prefetch_chunk(MappedRamRange *r, ram_addr_t offset,
+                                      size_t length)
+{
+    RAMBlock *block;
+    void *host;
+
+    RCU_READ_LOCK_GUARD();
+
+    block = qemu_ram_block_by_name(r->idstr);
+    if (!block || block->host != r->host) {
+        return false;
+    }
+
+    /* Fill the page tables if possible, else only start reading ahead */
+    host = block->host + offset;
+    if (qemu_madvise(host, length, QEMU_MADV_POPULATE_READ)) {
+        qemu_madvise(host, length, QEMU_MADV_WILLNEED);
+    }
+    return true;
+}
+
+static void *mapped_ram_prefetch_thread(void *opaque)
+{
+    MappedRamPrefetch *p = opaque;
+    unsigned int i;
+
+    rcu_register_thread();
+
+    while ((i = qatomic_fetch_inc(&p->next)) < p->ranges->len) {
+        MappedRamRange *r = &g_array_index(p->ranges, MappedRamRange, i);
+        ram_addr_t done, length;
+
+        for (done = 0; done < r->length; done += length) {
+            length = MIN(r->length - done, MAPPED_RAM_PREFETCH_CHUNK);
+            if (!mapped_ram_prefetch_chunk(r, r->offset + done, length)) {
+                break;
+            }
+        }
+    }
+
+    if (qatomic_fetch_dec(&p->threads) == 1) {
+        trace_mapped_ram_prefetch_end();
+        mapped_ram_prefetch_free(p);
+    }
+
+    rcu_unregister_thread();
+    return NULL;
+}
+
+/*
+ * Read the mapped memory in the background, so that the guest faults on
+ * as few pages as possible.  The threads outlive the migration.
+ */
+static void mapped_ram_prefetch_start(void)
+{
+    MappedRamPrefetch *p = g_steal_pointer(&mapped_ram_prefetch);
+    unsigned int i, nr_threads;
+
+    if (!p) {
+        return;
+    }
+
+    nr_threads = migrate_multifd() ? migrate_multifd_channels() : 1;
+    nr_threads = MIN(nr_threads, p->ranges->len);
+    p->threads = nr_threads;
+    trace_mapped_ram_prefetch_start(p->ranges->len, nr_threads);
+
+    for (i = 0; i < nr_threads; i++) {
+        QemuThread thread;
+
+        qemu_thread_create(&thread, "ram-prefetch",
+                           mapped_ram_prefetch_thread, p,
+                           QEMU_THREAD_DETACHED);
+    }
+}
+
+static void mapped_ram_prefetch_cancel(void)
+{
+    g_clear_pointer(&mapped_ram_prefetch, mapped_ram_prefetch_free);
+}
+
+/*
+ * Find the first run of pages of the file at or after @pos, including
+ * short gaps of zero pages.  Returns its first page, or @num_pages if
+ * there is none, and sets @end past its last page.
+ */
+static unsigned long mapped_ram_next_run(unsigned long *bitmap,
+                                         unsigned long num_pages,
+                                         unsigned long pos,
+                                         unsigned long *end)
+{
+    unsigned long start = find_next_bit(bitmap, num_pages, pos);
+    unsigned long next;
+
+    if (start >= num_pages) {
+        return num_pages;
+    }
+
+    *end = find_next_zero_bit(bitmap, num_pages, start + 1);
+    while (*end < num_pages) {
+        next = find_next_bit(bitmap, num_pages, *end + 1);
+        if (next >= num_pages || next - *end > MAPPED_RAM_MAP_MAX_GAP) {
+            break;
+        }
+        *end = find_next_zero_bit(bitmap, num_pages, next + 1);
+    }
+    return start;
+}
+
+/*
+ * x-instant-restore: map the pages of @block from the migration file
+ * instead of reading them.  Returns false if the block must be read.
+ */
+static bool mapped_ram_map_ramblock(QEMUFile *f, RAMBlock *block,
+                                    unsigned long num_pages,
+                                    unsigned long *bitmap)
+{
+    static bool discard_disabled;
+    QIOChannel *ioc = qemu_file_get_ioc(f);
+    HostMemoryBackend *backend;
+    unsigned long start, end = 0, i, j, runs = 0;
+    size_t page_size = qemu_real_host_page_size();
+    struct stat st;
+    int fd, ret;
+
+    /* Mapping only leaves zero pages as they are if memory is unused */
+    if (!migrate_instant_restore() || runstate_check(RUN_STATE_RESTORE_VM)) {
+        return false;
+    }
+
+    if (!object_dynamic_cast(OBJECT(ioc), TYPE_QIO_CHANNEL_FILE)) {
+        trace_mapped_ram_map_skip(block->idstr, "not a file");
+        return false;
+    }
+    fd = QIO_CHANNEL_FILE(ioc)->fd;
+
+    if (qemu_ram_is_shared(block) || block->fd >= 0 ||
+        block->guest_memfd >= 0 || (block->flags & RAM_READONLY)) {
+        trace_mapped_ram_map_skip(block->idstr, "not anonymous memory");
+        return false;
+    }
+
+    /*
+     * A new mapping is not bound to the host nodes of the backend, and
+     * with mem-lock it would be read in full as soon as it is created.
+     */
+    if (should_mlock(mlock_state)) {
+        trace_mapped_ram_map_skip(block->idstr, "memory is locked");
+        return false;
+    }
+    backend = (HostMemoryBackend *)
+        object_dynamic_cast(memory_region_owner(block->mr),
+                            TYPE_MEMORY_BACKEND);
+    if (backend && backend->policy != HOST_MEM_POLICY_DEFAULT) {
+        trace_mapped_ram_map_skip(block->idstr, "NUMA policy");
+        return false;
+    }
+
+    if (block->page_size != page_size || TARGET_PAGE_SIZE != page_size ||
+        !QEMU_IS_ALIGNED(block->pages_offset, page_size)) {
+        trace_mapped_ram_map_skip(block->idstr, "page size");
+        return false;
+    }
+
+    /* Accessing a mapping past the end of the file raises SIGBUS */
+    if (fstat(fd, &st) ||
+        st.st_size < block->pages_offset +
+                     ((uint64_t)num_pages << TARGET_PAGE_BITS)) {
+        trace_mapped_ram_map_skip(block->idstr, "file too short");
+        return false;
+    }
+
+    for (start = mapped_ram_next_run(bitmap, num_pages, 0, &end);
+         start < num_pages;
+         start = mapped_ram_next_run(bitmap, num_pages, end, &end)) {
+        runs++;
+    }
+    if (runs > MAPPED_RAM_MAP_MAX_RUNS) {
+        trace_mapped_ram_map_skip(block->idstr, "too many mappings");
+        return false;
+    }
+
+    /*
+     * Discarding a page of the mapping would bring back the page of the
+     * file instead of a zero page.  Also, whoever disabled discards
+     * before, e.g. VFIO, may have pinned the memory that is replaced.
+     */
+    if (!discard_disabled) {
+        if (ram_block_discard_is_disabled() ||
+            ram_block_discard_disable(true)) {
+            trace_mapped_ram_map_skip(block->idstr, "discards in use");
+            return false;
+        }
+        discard_disabled = true;
+    }
+
+    for (start = mapped_ram_next_run(bitmap, num_pages, 0, &end);
+         start < num_pages;
+         start = mapped_ram_next_run(bitmap, num_pages, end, &end)) {
+        ram_addr_t offset = (ram_addr_t)start << TARGET_PAGE_BITS;
+        ram_addr_t length = (ram_addr_t)(end - start) << TARGET_PAGE_BITS;
+
+        ret = qemu_ram_map_file(block, offset, length, fd,
+                                block->pages_offset + offset);
+        if (ret) {
+            /* Reading the block overwrites what was mapped so far */
+            trace_mapped_ram_map_skip(block->idstr, strerror(-ret));
+            return false;
+        }
+
+        /* The file may hold stale data for the zero pages of the run */
+        for (i = find_next_zero_bit(bitmap, end, start); i < end;
+             i = find_next_zero_bit(bitmap, end, j)) {
+            j = find_next_bit(bitmap, end, i);
+            ram_handle_zero(block->host + ((ram_addr_t)i << TARGET_PAGE_BITS),
+                            (uint64_t)(j - i) << TARGET_PAGE_BITS);
+        }
+
+        mapped_ram_prefetch_add(block, offset, length);
+    }
+
+    trace_mapped_ram_map(block->idstr, runs);
+    return true;
+}
+#else
+static bool mapped_ram_map_ramblock(QEMUFile *f, RAMBlock *block,
+                                    unsigned long num_pages,
+                                    unsigned long *bitmap)
+{
+    return false;
+}
+
+static void mapped_ram_prefetch_start(void)
+{
+}
+
+static void mapped_ram_prefetch_cancel(void)
+{
+}
+#endif /* !_WIN32 */
+
 static void parse_ramblock_mapped_ram(QEMUFile *f, RAMBlock *block,
                                       ram_addr_t length, Error **errp)
 {
@@ -4194,7 +4708,8 @@ static void parse_ramblock_mapped_ram(QEMUFile *f, RAMBlock *block,
         return;
     }
 
-    if (!read_ramblock_mapped_ram(f, block, num_pages, bitmap, errp)) {
+    if (!mapped_ram_map_ramblock(f, block, num_pages, bitmap) &&
+        !read_ramblock_mapped_ram(f, block, num_pages, bitmap, errp)) {
         return;
     }
 
@@ -4406,6 +4921,11 @@ static int ram_load_precopy(QEMUFile *f)
              */
             if (migrate_mapped_ram()) {
                 multifd_recv_sync_main();
+                if (ret) {
+                    mapped_ram_prefetch_cancel();
+                } else {
+                    mapped_ram_prefetch_start();
+                }
             }
             break;
 
@@ -4620,6 +5140,9 @@ bool ram_dirty_bitmap_reload(MigrationState *s, RAMBlock *block, Error **errp)
      * dirty bitmap for this ramblock.
      */
     bitmap_complement(block->bmap, block->bmap, nbits);
+    if (block->bmap_summary) {
+        bitmap_summary_mark(block->bmap_summary, 0, nbits);
+    }
 
     /* Clear dirty bits of discarded ranges that we don't want to migrate. */
     ramblock_dirty_bitmap_clear_discarded_pages(block);
@@ -4779,7 +5302,6 @@ static RAMBlockNotifier ram_mig_ram_notifier = {
 
 void ram_mig_init(void)
 {
-    qemu_mutex_init(&XBZRLE.lock);
     register_savevm_live("ram", 0, 4, &savevm_ram_handlers, &ram_state);
     ram_block_notifier_add(&ram_mig_ram_notifier);
 }
@@ -74,7 +74,7 @@ extern XBZRLECacheStats xbzrle_counters;
         if (!qemu_ram_is_migratable(block)) {} else
 
 void ram_mig_init(void);
-int xbzrle_cache_resize(uint64_t new_size, Error **errp);
+int xbzrle_cache_resize(uint64_t new_size, unsigned int ways, Error **errp);
 uint64_t ram_bytes_remaining(void);
 uint64_t ram_bytes_total(void);
 void mig_throttle_counter_reset(void);
@@ -250,6 +250,13 @@ typedef struct SaveStateEntry {
     void *opaque;
     CompatEntry *compat;
     int is_ram;
+    /* x-parallel-vmstate, source: the state is saved by a worker thread */
+    bool parallel_save;
+    int64_t parallel_save_time;
+    uint64_t parallel_save_size;
+    VMStateDowntime *parallel_downtime;
+    /* x-parallel-vmstate, destination: the state received via multifd */
+    GBytes *load_buf;
 } SaveStateEntry;
 
 typedef struct SaveState {
@@ -279,6 +286,7 @@ static bool should_validate_capability(int capability)
     switch (capability) {
     case MIGRATION_CAPABILITY_X_IGNORE_SHARED:
     case MIGRATION_CAPABILITY_MAPPED_RAM:
+    case MIGRATION_CAPABILITY_X_PARALLEL_VMSTATE:
         return true;
     default:
         return false;
@@ -1031,6 +1039,23 @@ static void save_section_footer(QEMUFile *f, SaveStateEntry *se)
     }
 }
 
+static VMStateDowntime *vmstate_downtime_record(VMStateDowntimeList **list,
+                                                SaveStateEntry *se,
+                                                int64_t time, bool has_size,
+                                                uint64_t size, bool parallel)
+{
+    VMStateDowntime *d = g_new0(VMStateDowntime, 1);
+
+    d->name = g_strdup(se->idstr);
+    d->instance_id = se->instance_id;
+    d->time = time;
+    d->has_size = has_size;
+    d->size = size;
+    d->parallel = parallel;
+    QAPI_LIST_PREPEND(*list, d);
+    return d;
+}
+
 static int vmstate_save(QEMUFile *f, SaveStateEntry *se, JSONWriter *vmdesc,
                         Error **errp)
 {
@@ -1588,10 +1613,15 @@ bool qemu_savevm_state_postcopy_prepare(QEMUFile *f, Error **errp)
 
 int qemu_savevm_state_complete_precopy_iterable(QEMUFile *f, bool in_postcopy)
 {
+    MigrationState *ms = migrate_get_current();
     int64_t start_ts_each, end_ts_each;
+    uint64_t start_size;
     SaveStateEntry *se;
     bool multifd_device_state = multifd_device_state_supported();
 
+    /* This is the start of the switchover */
+    g_clear_pointer(&ms->vmstate_downtime, qapi_free_VMStateDowntimeList);
+
     if (multifd_device_state) {
         QTAILQ_FOREACH(se, &savevm_state.handlers, entry) {
             SaveCompletePrecopyThreadHandler hdlr;
@@ -1624,6 +1654,7 @@ int qemu_savevm_state_complete_precopy_iterable(QEMUFile *f, bool in_postcopy)
         }
 
         start_ts_each = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
+        start_size = qemu_file_transferred(f);
         if (qemu_savevm_complete(se, f) < 0) {
             goto ret_fail_abort_threads;
         }
@@ -1631,6 +1662,9 @@ int qemu_savevm_state_complete_precopy_iterable(QEMUFile *f, bool in_postcopy)
 
         trace_vmstate_downtime_save("iterable", se->idstr, se->instance_id,
                                     end_ts_each - start_ts_each);
+        vmstate_downtime_record(&ms->vmstate_downtime, se,
+                                end_ts_each - start_ts_each, true,
+                                qemu_file_transferred(f) - start_size, false);
     }
 
     if (multifd_device_state) {
@@ -1657,39 +1691,152 @@ ret_fail_abort_threads:
     return -1;
 }
 
+/*
+ * Save the state of a device with a parallel_save VMSD into a buffer,
+ * and queue it on the multifd channels.
+ */
+static bool qemu_savevm_parallel_save_thread(SaveCompletePrecopyThreadData *d,
+                                             Error **errp)
+{
+    SaveStateEntry *se = d->handler_opaque;
+    int64_t start_ts = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
+    QIOChannelBuffer *bioc;
+    QEMUFile *f;
+    bool ok = false;
+
+    if (multifd_device_state_save_thread_should_exit()) {
+        return true;
+    }
+
+    bioc = qio_channel_buffer_new(4096);
+    qio_channel_set_name(QIO_CHANNEL(bioc), "migration-vmstate-buffer");
+    f = qemu_file_new_output(QIO_CHANNEL(bioc));
+    qemu_file_set_unaccounted(f);
+    object_unref(OBJECT(bioc));
+
+    trace_vmstate_save(se->idstr, se->vmsd->name);
+    if (vmstate_save_state(f, se->vmsd, se->opaque, NULL, errp)) {
+        goto out;
+    }
+    if (qemu_fflush(f)) {
+        error_setg(errp, "Failed to buffer the state of '%s'", se->idstr);
+        goto out;
+    }
+    if (!multifd_queue_device_state(d->idstr, d->instance_id,
+                                    (char *)bioc->data, bioc->usage)) {
+        error_setg(errp, "Failed to queue the state of '%s'", se->idstr);
+        goto out;
+    }
+
+    se->parallel_save_time = qemu_clock_get_us(QEMU_CLOCK_REALTIME) - start_ts;
+    se->parallel_save_size = bioc->usage;
+    trace_vmstate_downtime_save("parallel", se->idstr, se->instance_id,
+                                se->parallel_save_time);
+    ok = true;
+
+out:
+    qemu_fclose(f);
+    return ok;
+}
+
 int qemu_savevm_state_complete_precopy_non_iterable(QEMUFile *f,
                                                     bool in_postcopy)
 {
     MigrationState *ms = migrate_get_current();
     int64_t start_ts_each, end_ts_each;
+    uint64_t start_size;
     JSONWriter *vmdesc = ms->vmdesc;
     int vmdesc_len;
     SaveStateEntry *se;
     Error *local_err = NULL;
+    bool parallel;
     int ret;
 
+    /*
+     * The destination waits for the state of parallel devices in the
+     * main thread, which cannot happen while it loads the postcopy
+     * package.
+     */
+    parallel = !in_postcopy && migrate_parallel_vmstate() &&
+               multifd_device_state_supported();
+
     /* Making sure cpu states are synchronized before saving non-iterable */
     cpu_synchronize_all_states();
 
+    QTAILQ_FOREACH(se, &savevm_state.handlers, entry) {
+        se->parallel_save = parallel && se->vmsd && se->vmsd->parallel_save &&
+                            !se->vmsd->early_setup &&
+                            vmstate_section_needed(se->vmsd, se->opaque);
+        if (se->parallel_save) {
+            multifd_spawn_device_state_save_thread(
+                qemu_savevm_parallel_save_thread, se->idstr,
+                se->instance_id, se);
+        }
+    }
+
     QTAILQ_FOREACH(se, &savevm_state.handlers, entry) {
         if (se->vmsd && se->vmsd->early_setup) {
             /* Already saved during qemu_savevm_state_setup(). */
             continue;
         }
 
+        if (se->parallel_save) {
+            /*
+             * Only mark the position of the section in the stream; its
+             * content arrives through multifd.  It is not described in
+             * the vmdesc, since its fields are not in this stream.
+             */
+            trace_savevm_section_start(se->idstr, se->section_id);
+            save_section_header(f, se, QEMU_VM_SECTION_DEVICE_STATE);
+            trace_savevm_section_end(se->idstr, se->section_id, 0);
+            save_section_footer(f, se);
+            /* Filled in once the worker is done */
+            se->parallel_downtime =
+                vmstate_downtime_record(&ms->vmstate_downtime, se, 0,
+                                        true, 0, true);
+            continue;
+        }
+
         start_ts_each = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
+        start_size = qemu_file_transferred(f);
 
         ret = vmstate_save(f, se, vmdesc, &local_err);
         if (ret) {
             migrate_error_propagate(ms, error_copy(local_err));
             error_report_err(local_err);
             qemu_file_set_error(f, ret);
-            return ret;
+            goto ret_fail_abort_threads;
         }
 
         end_ts_each = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
         trace_vmstate_downtime_save("non-iterable", se->idstr, se->instance_id,
                                     end_ts_each - start_ts_each);
+        if (qemu_file_transferred(f) != start_size) {
+            vmstate_downtime_record(&ms->vmstate_downtime, se,
+                                    end_ts_each - start_ts_each, true,
+                                    qemu_file_transferred(f) - start_size,
+                                    false);
+        }
+    }
+
+    if (parallel) {
+        /*
+         * Wait for the workers, and for the multifd channels to write
+         * what they queued, before the end of the stream.
+         */
+        if (!multifd_join_device_state_save_threads() ||
+            multifd_send_sync_main(MULTIFD_SYNC_LOCAL) < 0) {
+            qemu_file_set_error(f, -EINVAL);
+            return -EINVAL;
+        }
+
+        QTAILQ_FOREACH(se, &savevm_state.handlers, entry) {
+            if (se->parallel_save) {
+                se->parallel_downtime->time = se->parallel_save_time;
+                se->parallel_downtime->size = se->parallel_save_size;
+                se->parallel_downtime = NULL;
+            }
+        }
     }
 
     if (!in_postcopy) {
@@ -1710,6 +1857,14 @@ int qemu_savevm_state_complete_precopy_non_iterable(QEMUFile *f,
     trace_vmstate_downtime_checkpoint("src-non-iterable-saved");
 
     return 0;
+
+ret_fail_abort_threads:
+    if (parallel) {
+        multifd_abort_device_state_save_threads();
+        multifd_join_device_state_save_threads();
+    }
+
+    return ret;
 }
 
 int qemu_savevm_state_complete_precopy(QEMUFile *f, bool iterable_only)
@@ -2209,7 +2364,8 @@ static gboolean postcopy_sync_page_req(gpointer key, gpointer value,
         return FALSE;
     }
 
-    ret = migrate_send_rp_message_req_pages(mis, rb, rb_offset);
+    ret = migrate_send_rp_message_req_pages(mis, rb, rb_offset,
+                                            qemu_ram_pagesize(rb));
     if (ret) {
         /* Please refer to above comment. */
         error_report("%s: send rp message failed for addr %p",
@@ -2593,11 +2749,52 @@ static bool check_section_footer(QEMUFile *f, SaveStateEntry *se)
     return true;
 }
 
+/*
+ * Load the state of @se that a QEMU_VM_SECTION_DEVICE_STATE section
+ * announced, once it arrived through the multifd channels.
+ */
+static int qemu_loadvm_state_buffer_load(SaveStateEntry *se, Error **errp)
+{
+    MigrationIncomingState *mis = migration_incoming_get_current();
+    GBytes *bytes;
+    QIOChannelBuffer *bioc;
+    QEMUFile *f;
+    int ret;
+
+    /* The multifd and load threads might need the BQL meanwhile */
+    bql_unlock();
+    WITH_QEMU_LOCK_GUARD(&mis->vmstate_bufs_mutex) {
+        while (!se->load_buf && !mis->vmstate_bufs_abort) {
+            qemu_cond_wait(&mis->vmstate_bufs_cond, &mis->vmstate_bufs_mutex);
+        }
+        bytes = g_steal_pointer(&se->load_buf);
+    }
+    bql_lock();
+
+    if (!bytes) {
+        error_setg(errp, "multifd channels stopped before the state of "
+                   "'%s' arrived", se->idstr);
+        return -EIO;
+    }
+
+    bioc = qio_channel_buffer_new(0);
+    qio_channel_set_name(QIO_CHANNEL(bioc), "migration-vmstate-buffer");
+    bioc->data = g_bytes_unref_to_data(bytes, &bioc->capacity);
+    bioc->usage = bioc->capacity;
+    f = qemu_file_new_input(QIO_CHANNEL(bioc));
+    object_unref(OBJECT(bioc));
+
+    ret = vmstate_load(f, se, errp);
+    qemu_fclose(f);
+    return ret;
+}
+
 static int
 qemu_loadvm_section_start_full(QEMUFile *f, uint8_t type, Error **errp)
 {
     ERRP_GUARD();
-    bool trace_downtime = (type == QEMU_VM_SECTION_FULL);
+    bool trace_downtime = (type == QEMU_VM_SECTION_FULL ||
+                           type == QEMU_VM_SECTION_DEVICE_STATE);
     uint32_t instance_id, version_id, section_id;
     int64_t start_ts, end_ts;
     SaveStateEntry *se;
@@ -2647,11 +2844,21 @@ qemu_loadvm_section_start_full(QEMUFile *f, uint8_t type, Error **errp)
         return -EINVAL;
     }
 
+    if (type == QEMU_VM_SECTION_DEVICE_STATE && !se->vmsd) {
+        error_setg(errp, "Device state section for '%s' which has no "
+                   "VMStateDescription", idstr);
+        return -EINVAL;
+    }
+
     if (trace_downtime) {
         start_ts = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
     }
 
-    ret = vmstate_load(f, se, errp);
+    if (type == QEMU_VM_SECTION_DEVICE_STATE) {
+        ret = qemu_loadvm_state_buffer_load(se, errp);
+    } else {
+        ret = vmstate_load(f, se, errp);
+    }
     if (ret < 0) {
         error_prepend(errp,
                       "error while loading state for instance 0x%"PRIx32" of"
@@ -2663,6 +2870,13 @@ qemu_loadvm_section_start_full(QEMUFile *f, uint8_t type, Error **errp)
         end_ts = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
         trace_vmstate_downtime_load("non-iterable", se->idstr,
                                     se->instance_id, end_ts - start_ts);
+        if (!migration_incoming_in_colo_state()) {
+            MigrationIncomingState *mis = migration_incoming_get_current();
+
+            vmstate_downtime_record(&mis->vmstate_downtime, se,
+                                    end_ts - start_ts, false, 0,
+                                    type == QEMU_VM_SECTION_DEVICE_STATE);
+        }
     }
 
     if (!check_section_footer(f, se)) {
@@ -2715,6 +2929,12 @@ qemu_loadvm_section_part_end(QEMUFile *f, uint8_t type, Error **errp)
         end_ts = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
         trace_vmstate_downtime_load("iterable", se->idstr,
                                     se->instance_id, end_ts - start_ts);
+        if (!migration_incoming_in_colo_state()) {
+            MigrationIncomingState *mis = migration_incoming_get_current();
+
+            vmstate_downtime_record(&mis->vmstate_downtime, se,
+                                    end_ts - start_ts, false, 0, false);
+        }
     }
 
     if (!check_section_footer(f, se)) {
@@ -2873,6 +3093,13 @@ void qemu_loadvm_state_cleanup(MigrationIncomingState *mis)
         }
     }
 
+    WITH_QEMU_LOCK_GUARD(&mis->vmstate_bufs_mutex) {
+        QTAILQ_FOREACH(se, &savevm_state.handlers, entry) {
+            g_clear_pointer(&se->load_buf, g_bytes_unref);
+        }
+        mis->vmstate_bufs_abort = false;
+    }
+
     qemu_loadvm_thread_pool_destroy(mis);
 }
 
@@ -2970,6 +3197,7 @@ retry:
         switch (section_type) {
         case QEMU_VM_SECTION_START:
         case QEMU_VM_SECTION_FULL:
+        case QEMU_VM_SECTION_DEVICE_STATE:
             ret = qemu_loadvm_section_start_full(f, section_type, errp);
             if (ret < 0) {
                 goto out;
@@ -3039,6 +3267,7 @@ int qemu_loadvm_state(QEMUFile *f, Error **errp)
     }
 
     qemu_loadvm_thread_pool_create(mis);
+    g_clear_pointer(&mis->vmstate_downtime, qapi_free_VMStateDowntimeList);
 
     ret = qemu_loadvm_state_header(f, errp);
     if (ret) {
@@ -3176,6 +3405,21 @@ bool qemu_loadvm_load_state_buffer(const char *idstr, uint32_t instance_id,
         return false;
     }
 
+    if (se->vmsd) {
+        MigrationIncomingState *mis = migration_incoming_get_current();
+
+        /* Loaded by the main thread, see qemu_loadvm_state_buffer_load() */
+        QEMU_LOCK_GUARD(&mis->vmstate_bufs_mutex);
+        if (se->load_buf) {
+            error_setg(errp, "Duplicate state buffer for idstr %s / "
+                       "instance %u", idstr, instance_id);
+            return false;
+        }
+        se->load_buf = g_bytes_new(buf, len);
+        qemu_cond_broadcast(&mis->vmstate_bufs_cond);
+        return true;
+    }
+
     if (!se->ops || !se->ops->load_state_buffer) {
         error_setg(errp,
                    "idstr %s / instance %u has no load state buffer operation",
@@ -3186,6 +3430,15 @@ bool qemu_loadvm_load_state_buffer(const char *idstr, uint32_t instance_id,
     return se->ops->load_state_buffer(se->opaque, buf, len, errp);
 }
 
+void qemu_loadvm_abort_state_buffers(void)
+{
+    MigrationIncomingState *mis = migration_incoming_get_current();
+
+    QEMU_LOCK_GUARD(&mis->vmstate_bufs_mutex);
+    mis->vmstate_bufs_abort = true;
+    qemu_cond_broadcast(&mis->vmstate_bufs_cond);
+}
+
 bool save_snapshot(const char *name, bool overwrite, const char *vmstate,
                   bool has_devices, strList *devices, Error **errp)
 {
@@ -27,6 +27,7 @@
 #define QEMU_VM_VMDESCRIPTION        0x06
 #define QEMU_VM_CONFIGURATION        0x07
 #define QEMU_VM_COMMAND              0x08
+#define QEMU_VM_SECTION_DEVICE_STATE 0x09
 #define QEMU_VM_SECTION_FOOTER       0x7e
 
 #define QEMU_VM_PING_PACKAGED_LOADED 0x42
@@ -77,5 +78,6 @@ int qemu_savevm_state_complete_precopy_non_iterable(QEMUFile *f,
 
 bool qemu_loadvm_load_state_buffer(const char *idstr, uint32_t instance_id,
                                    char *buf, size_t len, Error **errp);
+void qemu_loadvm_abort_state_buffers(void);
 
 #endif
@@ -15,10 +15,12 @@
 #include "qemu/host-utils.h"
 #include "xbzrle.h"
 
-#if defined(CONFIG_AVX512BW_OPT)
+#if defined(CONFIG_AVX512BW_OPT) || defined(CONFIG_AVX2_OPT)
 #include <immintrin.h>
 #include "host/cpuinfo.h"
+#endif
 
+#if defined(CONFIG_AVX512BW_OPT)
 static int __attribute__((target("avx512bw")))
 xbzrle_encode_buffer_avx512(uint8_t *old_buf, uint8_t *new_buf, int slen,
                             uint8_t *dst, int dlen)
@@ -136,20 +138,127 @@ xbzrle_encode_buffer_avx512(uint8_t *old_buf, uint8_t *new_buf, int slen,
     }
     return d;
 }
+#endif
+
+#if defined(CONFIG_AVX2_OPT)
+/*
+ * Return the index of the first byte at or after @i where @old_buf and
+ * @new_buf are equal (if @equal is true) or differ (if @equal is false),
+ * or @slen if there is none.
+ */
+static inline int __attribute__((always_inline, target("avx2")))
+xbzrle_find_avx2(uint8_t *old_buf, uint8_t *new_buf, int i, int slen,
+                 bool equal)
+{
+    while (i + 32 <= slen) {
+        __m256i old_data = _mm256_loadu_si256((__m256i *)(old_buf + i));
+        __m256i new_data = _mm256_loadu_si256((__m256i *)(new_buf + i));
+        uint32_t mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(old_data,
+                                                               new_data));
+
+        if (!equal) {
+            mask = ~mask;
+        }
+        if (mask) {
+            return i + ctz32(mask);
+        }
+        i += 32;
+    }
+    while (i < slen && (old_buf[i] == new_buf[i]) != equal) {
+        i++;
+    }
+    return i;
+}
+
+/*
+ * Same output as the generic version, including the overflow checks,
+ * but each run is measured 32 bytes at a time.
+ */
+static int __attribute__((target("avx2")))
+xbzrle_encode_buffer_avx2(uint8_t *old_buf, uint8_t *new_buf, int slen,
+                          uint8_t *dst, int dlen)
+{
+    uint32_t zrun_len, nzrun_len;
+    int d = 0, i = 0;
 
+    while (i < slen) {
+        /* overflow */
+        if (d + 2 > dlen) {
+            return -1;
+        }
+
+        zrun_len = xbzrle_find_avx2(old_buf, new_buf, i, slen, false) - i;
+        i += zrun_len;
+
+        /* buffer unchanged */
+        if (zrun_len == slen) {
+            return 0;
+        }
+
+        /* skip last zero run */
+        if (i == slen) {
+            return d;
+        }
+
+        d += uleb128_encode_small(dst + d, zrun_len);
+
+        /* overflow */
+        if (d + 2 > dlen) {
+            return -1;
+        }
+
+        nzrun_len = xbzrle_find_avx2(old_buf, new_buf, i, slen, true) - i;
+        d += uleb128_encode_small(dst + d, nzrun_len);
+        /* overflow */
+        if (d + nzrun_len > dlen) {
+            return -1;
+        }
+        memcpy(dst + d, new_buf + i, nzrun_len);
+        d += nzrun_len;
+        i += nzrun_len;
+    }
+
+    return d;
+}
+#endif
+
+#if defined(CONFIG_AVX512BW_OPT) || defined(CONFIG_AVX2_OPT)
 static int xbzrle_encode_buffer_int(uint8_t *old_buf, uint8_t *new_buf,
                                     int slen, uint8_t *dst, int dlen);
 
-static int (*accel_func)(uint8_t *, uint8_t *, int, uint8_t *, int);
+typedef int (*xbzrle_encode_fn)(uint8_t *, uint8_t *, int, uint8_t *, int);
+
+static xbzrle_encode_fn accel_func;
+
+/* The encoders supported by the host, from the slowest to the fastest */
+static xbzrle_encode_fn accel_table[3];
+static unsigned accel_index;
 
 static void __attribute__((constructor)) init_accel(void)
 {
     unsigned info = cpuinfo_init();
+
+    accel_table[0] = xbzrle_encode_buffer_int;
+#if defined(CONFIG_AVX2_OPT)
+    if (info & CPUINFO_AVX2) {
+        accel_table[++accel_index] = xbzrle_encode_buffer_avx2;
+    }
+#endif
+#if defined(CONFIG_AVX512BW_OPT)
     if (info & CPUINFO_AVX512BW) {
-        accel_func = xbzrle_encode_buffer_avx512;
-    } else {
-        accel_func = xbzrle_encode_buffer_int;
+        accel_table[++accel_index] = xbzrle_encode_buffer_avx512;
+    }
+#endif
+    accel_func = accel_table[accel_index];
+}
+
+bool test_xbzrle_encode_next_accel(void)
+{
+    if (accel_index != 0) {
+        accel_func = accel_table[--accel_index];
+        return true;
     }
+    return false;
 }
 
 int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
@@ -159,6 +268,11 @@ int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
 }
 
 #define xbzrle_encode_buffer xbzrle_encode_buffer_int
+#else
+bool test_xbzrle_encode_next_accel(void)
+{
+    return false;
+}
 #endif
 
 /*
@@ -19,4 +19,11 @@ int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
 
 int xbzrle_decode_buffer(uint8_t *src, int slen, uint8_t *dst, int dlen);
 
+/*
+ * For tests: make xbzrle_encode_buffer() use the next slower encoder
+ * supported by the host.  Returns false if the generic encoder is
+ * already in use.
+ */
+bool test_xbzrle_encode_next_accel(void);
+
 #endif
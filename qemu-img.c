@@ -44,6 +44,7 @@
 #include "qemu/sockets.h"
 #include "qemu/units.h"
 #include "qemu/memalign.h"
+#include "qemu/rcu.h"
 #include "qom/object_interfaces.h"
 #include "system/block-backend.h"
 #include "block/block_int.h"
@@ -87,6 +88,7 @@ enum {
     OPTION_FORCE = 276,
     OPTION_SKIP_BROKEN = 277,
     OPTION_LIMITS = 278,
+    OPTION_QUEUES = 279,
 };
 
 typedef enum OutputFormat {
@@ -4733,6 +4735,62 @@ static void bench_cb(void *opaque, int ret)
     }
 }
 
+/* A queue of requests that is processed by its own thread */
+typedef struct BenchQueue {
+    BenchData data;
+    AioContext *ctx;
+    QemuThread thread;
+} BenchQueue;
+
+static void bench_alloc_buffers(BenchData *b, int pattern)
+{
+    size_t buf_size = b->nrreq * b->bufsize;
+    int i;
+
+    b->buf = blk_blockalign(b->blk, buf_size);
+    memset(b->buf, pattern, buf_size);
+
+    blk_register_buf(b->blk, b->buf, buf_size, &error_fatal);
+
+    b->qiov = g_new(QEMUIOVector, b->nrreq);
+    for (i = 0; i < b->nrreq; i++) {
+        qemu_iovec_init(&b->qiov[i], 1);
+        qemu_iovec_add(&b->qiov[i], b->buf + i * b->bufsize, b->bufsize);
+    }
+}
+
+static void bench_free_buffers(BenchData *b)
+{
+    int i;
+
+    if (b->qiov) {
+        for (i = 0; i < b->nrreq; i++) {
+            qemu_iovec_destroy(&b->qiov[i]);
+        }
+        g_free(b->qiov);
+    }
+    if (b->buf) {
+        blk_unregister_buf(b->blk, b->buf, b->nrreq * b->bufsize);
+    }
+    qemu_vfree(b->buf);
+}
+
+static void *bench_queue_thread(void *opaque)
+{
+    BenchQueue *q = opaque;
+
+    rcu_register_thread();
+    qemu_set_current_aio_context(q->ctx);
+
+    bench_cb(&q->data, 0);
+    while (q->data.n > 0) {
+        aio_poll(q->ctx, true);
+    }
+
+    rcu_unregister_thread();
+    return NULL;
+}
+
 static int img_bench(const img_cmd_t *ccmd, int argc, char **argv)
 {
     int c, ret = 0;
@@ -4748,15 +4806,16 @@ static int img_bench(const img_cmd_t *ccmd, int argc, char **argv)
     ssize_t step = 0;
     int flush_interval = 0;
     bool drain_on_flush = true;
-    int64_t image_size;
+    int nr_queues = 1;
+    int64_t image_size, region;
     BlockBackend *blk = NULL;
     BenchData data = {};
+    BenchQueue *queues = NULL;
     int flags = 0;
     bool writethrough = false;
     struct timeval t1, t2;
     int i;
     bool force_share = false;
-    size_t buf_size = 0;
 
     for (;;) {
         static const struct option long_options[] = {
@@ -4773,6 +4832,7 @@ static int img_bench(const img_cmd_t *ccmd, int argc, char **argv)
             {"pattern", required_argument, 0, OPTION_PATTERN},
             {"flush-interval", required_argument, 0, OPTION_FLUSH_INTERVAL},
             {"no-drain", no_argument, 0, OPTION_NO_DRAIN},
+            {"queues", required_argument, 0, OPTION_QUEUES},
             {"aio", required_argument, 0, 'i'},
             {"native", no_argument, 0, 'n'},
             {"force-share", no_argument, 0, 'U'},
@@ -4791,7 +4851,7 @@ static int img_bench(const img_cmd_t *ccmd, int argc, char **argv)
             cmd_help(ccmd, "[-f FMT | --image-opts] [-t CACHE]\n"
 "        [-c COUNT] [-d DEPTH] [-o OFFSET] [-s BUFFER_SIZE] [-S STEP_SIZE]\n"
 "        [-w [--pattern PATTERN] [--flush-interval INTERVAL [--no-drain]]]\n"
-"        [-i AIO] [-n] [-U] [-q] FILE\n"
+"        [--queues QUEUES] [-i AIO] [-n] [-U] [-q] FILE\n"
 ,
 "  -f, --format FMT\n"
 "     specify FILE format explicitly\n"
@@ -4820,6 +4880,9 @@ static int img_bench(const img_cmd_t *ccmd, int argc, char **argv)
 "     issue flush after this number of requests\n"
 "  --no-drain\n"
 "     do not wait when flushing pending requests\n"
+"  --queues QUEUES\n"
+"     split the requests among this number of queues, each with its own\n"
+"     thread, depth and area of the image\n"
 "  -i, --aio AIO\n"
 "     async-io backend (threads, native, io_uring)\n"
 "  -n, --native\n"
@@ -4910,6 +4973,12 @@ static int img_bench(const img_cmd_t *ccmd, int argc, char **argv)
         case OPTION_NO_DRAIN:
             drain_on_flush = false;
             break;
+        case OPTION_QUEUES:
+            nr_queues = cvtnum_full("number of queues", optarg, false, 1, 256);
+            if (nr_queues < 0) {
+                return 1;
+            }
+            break;
         case 'U':
             force_share = true;
             break;
@@ -4973,24 +5042,48 @@ static int img_bench(const img_cmd_t *ccmd, int argc, char **argv)
         printf("Sending flush every %d requests\n", flush_interval);
     }
 
-    buf_size = data.nrreq * data.bufsize;
-    data.buf = blk_blockalign(blk, buf_size);
-    memset(data.buf, pattern, data.nrreq * data.bufsize);
+    /*
+     * Each queue starts in its own area of the image, so that writes to a
+     * new image allocate clusters concurrently, like a guest with several
+     * queues would.
+     */
+    region = QEMU_ALIGN_DOWN(image_size / nr_queues, data.bufsize);
+    if (nr_queues > 1) {
+        printf("Using %d queues, %" PRId64 " bytes apart\n",
+               nr_queues, region);
+    }
 
-    blk_register_buf(blk, data.buf, buf_size, &error_fatal);
+    queues = g_new0(BenchQueue, nr_queues);
+    for (i = 0; i < nr_queues; i++) {
+        BenchData *b = &queues[i].data;
 
-    data.qiov = g_new(QEMUIOVector, data.nrreq);
-    for (i = 0; i < data.nrreq; i++) {
-        qemu_iovec_init(&data.qiov[i], 1);
-        qemu_iovec_add(&data.qiov[i],
-                       data.buf + i * data.bufsize, data.bufsize);
+        *b = data;
+        b->n = count / nr_queues + (i < count % nr_queues);
+        b->offset = data.offset + i * region;
+        if (i > 0 && image_size > data.bufsize) {
+            b->offset %= image_size - data.bufsize;
+        }
+        bench_alloc_buffers(b, pattern);
     }
 
     gettimeofday(&t1, NULL);
-    bench_cb(&data, 0);
+    if (nr_queues == 1) {
+        bench_cb(&queues[0].data, 0);
 
-    while (data.n > 0) {
-        main_loop_wait(false);
+        while (queues[0].data.n > 0) {
+            main_loop_wait(false);
+        }
+    } else {
+        for (i = 0; i < nr_queues; i++) {
+            queues[i].ctx = aio_context_new(&error_fatal);
+            qemu_thread_create(&queues[i].thread, "bench-queue",
+                               bench_queue_thread, &queues[i],
+                               QEMU_THREAD_JOINABLE);
+        }
+        for (i = 0; i < nr_queues; i++) {
+            qemu_thread_join(&queues[i].thread);
+            aio_context_unref(queues[i].ctx);
+        }
     }
     gettimeofday(&t2, NULL);
 
@@ -4999,10 +5092,12 @@ static int img_bench(const img_cmd_t *ccmd, int argc, char **argv)
            + ((double)(t2.tv_usec - t1.tv_usec) / 1000000));
 
 out:
-    if (data.buf) {
-        blk_unregister_buf(blk, data.buf, buf_size);
+    if (queues) {
+        for (i = 0; i < nr_queues; i++) {
+            bench_free_buffers(&queues[i].data);
+        }
+        g_free(queues);
     }
-    qemu_vfree(data.buf);
     blk_unref(blk);
 
     if (ret) {
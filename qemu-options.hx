@@ -235,6 +235,7 @@ DEF("accel", HAS_ARG, QEMU_OPTION_accel,
     "                one-insn-per-tb=on|off (one guest instruction per TCG translation block)\n"
     "                split-wx=on|off (enable TCG split w^x mapping)\n"
     "                tb-size=n (TCG translation block cache size)\n"
+    "                tb-hugepages=on|off (back TCG translation block cache with huge pages)\n"
     "                dirty-ring-size=n (KVM dirty ring GFN count, default 0)\n"
     "                eager-split-size=n (KVM Eager Page Split chunk size, default 0, disabled. ARM only)\n"
     "                notify-vmexit=run|internal-error|disable,notify-window=n (enable notify VM exit and set notify window, x86 only)\n"
@@ -278,6 +279,16 @@ SRST
     ``tb-size=n``
         Controls the size (in MiB) of the TCG translation block cache.
 
+    ``tb-hugepages=on|off``
+        Aligns the TCG translation block cache and its per-thread regions
+        to the host's transparent huge page size and omits the guard pages
+        between regions, so that translated code can be backed by huge
+        pages and suffers fewer iTLB misses.  The cache memory is given
+        back to the host whenever it is flushed, so that each region is
+        allocated again on the NUMA node of the vCPU thread that next
+        generates code into it.  This has no effect together with
+        ``split-wx=on``.  The default is off.
+
     ``thread=single|multi``
         Controls number of TCG threads. When the TCG is multi-threaded
         there will be one thread per vCPU therefore taking advantage of
@@ -0,0 +1,78 @@
+/*
+ * Dirty page rate limit controller
+ *
+ * Copyright (c) 2026 The QEMU Project Developers
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include <math.h>
+#include "system/dirtylimit-control.h"
+
+/*
+ * Gains of the controller.  It works on the logarithm of the slowdown
+ * and of the ratio between the current and the quota dirty page rate,
+ * so that the same gains fit both lightly and heavily throttled vcpus.
+ */
+#define DIRTYLIMIT_PID_KP   0.1
+#define DIRTYLIMIT_PID_KI   0.7
+#define DIRTYLIMIT_PID_KD   0.05
+
+void dirtylimit_pid_reset(DirtyLimitPid *pid)
+{
+    pid->output = 0;
+    pid->error[0] = 0;
+    pid->error[1] = 0;
+}
+
+/* PID controller in velocity form */
+double dirtylimit_pid_update(DirtyLimitPid *pid, uint64_t quota,
+                             uint64_t current)
+{
+    double error, *prev = pid->error;
+
+    error = log((double)current / quota);
+    pid->output += DIRTYLIMIT_PID_KP * (error - prev[0]) +
+                   DIRTYLIMIT_PID_KI * error +
+                   DIRTYLIMIT_PID_KD * (error - 2 * prev[0] + prev[1]);
+    pid->output = MIN(pid->output, log(DIRTYLIMIT_THROTTLE_PCT_MAX + 1));
+
+    if (pid->output <= 0) {
+        /* Not throttled, forget the history */
+        dirtylimit_pid_reset(pid);
+    } else {
+        prev[1] = prev[0];
+        prev[0] = error;
+    }
+
+    return MIN(expm1(pid->output), DIRTYLIMIT_THROTTLE_PCT_MAX);
+}
+
+static int dirtylimit_demand_cmp(const void *a, const void *b)
+{
+    uint64_t da = **(const uint64_t * const *)a;
+    uint64_t db = **(const uint64_t * const *)b;
+
+    return da < db ? -1 : da > db;
+}
+
+void dirtylimit_split_target(uint64_t target, const uint64_t *demand,
+                             uint64_t *quota, int n)
+{
+    g_autofree const uint64_t **sorted = g_new(const uint64_t *, n);
+    int i;
+
+    for (i = 0; i < n; i++) {
+        sorted[i] = &demand[i];
+    }
+    qsort(sorted, n, sizeof(*sorted), dirtylimit_demand_cmp);
+
+    for (i = 0; i < n; i++) {
+        uint64_t share = target / (n - i);
+
+        quota[sorted[i] - demand] = MAX(share, 1);
+        target -= MIN(*sorted[i], share);
+    }
+}
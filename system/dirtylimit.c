@@ -11,12 +11,14 @@
  */
 
 #include "qemu/osdep.h"
+#include <math.h>
 #include "qemu/main-loop.h"
 #include "qapi/qapi-commands-migration.h"
 #include "qobject/qdict.h"
 #include "qapi/error.h"
 #include "system/dirtyrate.h"
 #include "system/dirtylimit.h"
+#include "system/dirtylimit-control.h"
 #include "monitor/hmp.h"
 #include "monitor/monitor.h"
 #include "system/memory.h"
@@ -38,11 +40,6 @@
  * Otherwise, plus or minus a fixed vcpu sleep time.
  */
 #define DIRTYLIMIT_LINEAR_ADJUSTMENT_PCT     50
-/*
- * Max vcpu sleep time percentage during a cycle
- * composed of dirty ring full and sleep time.
- */
-#define DIRTYLIMIT_THROTTLE_PCT_MAX 99
 
 struct {
     VcpuStat stat;
@@ -58,6 +55,8 @@ typedef struct VcpuDirtyLimitState {
      * zero if not enabled.
      */
     uint64_t quota;
+    /* Controller state when a target is set */
+    DirtyLimitPid pid;
 } VcpuDirtyLimitState;
 
 struct {
@@ -66,6 +65,11 @@ struct {
     int max_cpus;
     /* Number of vcpu under dirtylimit */
     int limited_nvcpu;
+    /*
+     * Dirty page rate shared by all the vcpus, unit is MB/s;
+     * zero if each vcpu has its own quota.
+     */
+    uint64_t target;
 } *dirtylimit_state;
 
 /* protect dirtylimit_state */
@@ -325,6 +329,31 @@ static void dirtylimit_set_throttle(CPUState *cpu,
     cpu->throttle_us_per_full = MAX(cpu->throttle_us_per_full, 0);
 }
 
+/*
+ * Compute the throttle time that brings the dirty page rate of the
+ * vcpu to its quota.
+ */
+static void dirtylimit_set_throttle_pid(CPUState *cpu,
+                                        VcpuDirtyLimitState *state,
+                                        uint64_t current)
+{
+    int64_t ring_full_time_us;
+
+    if (current == 0) {
+        dirtylimit_pid_reset(&state->pid);
+        cpu->throttle_us_per_full = 0;
+        return;
+    }
+
+    ring_full_time_us = dirtylimit_dirty_ring_full_time(current);
+    cpu->throttle_us_per_full =
+        ring_full_time_us * dirtylimit_pid_update(&state->pid, state->quota,
+                                                  current);
+
+    trace_dirtylimit_pid_throttle(cpu->cpu_index, state->quota, current,
+                                  cpu->throttle_us_per_full);
+}
+
 static void dirtylimit_adjust_throttle(CPUState *cpu)
 {
     uint64_t quota = 0;
@@ -334,11 +363,41 @@ static void dirtylimit_adjust_throttle(CPUState *cpu)
     quota = dirtylimit_vcpu_get_state(cpu_index)->quota;
     current = vcpu_dirty_rate_get(cpu_index);
 
-    if (!dirtylimit_done(quota, current)) {
+    if (dirtylimit_state->target) {
+        dirtylimit_set_throttle_pid(cpu, dirtylimit_vcpu_get_state(cpu_index),
+                                    current);
+    } else if (!dirtylimit_done(quota, current)) {
         dirtylimit_set_throttle(cpu, quota, current);
     }
 }
 
+/* Split the target among the enabled vcpus */
+static void dirtylimit_share_target(void)
+{
+    int max_cpus = dirtylimit_state->max_cpus;
+    g_autofree int *index = g_new(int, max_cpus);
+    g_autofree uint64_t *demand = g_new(uint64_t, max_cpus);
+    g_autofree uint64_t *quota = g_new(uint64_t, max_cpus);
+    int i, n = 0;
+
+    for (i = 0; i < max_cpus; i++) {
+        VcpuDirtyLimitState *state = &dirtylimit_state->states[i];
+
+        if (!state->enabled) {
+            continue;
+        }
+        /* Undo the slowdown of the throttle */
+        demand[n] = vcpu_dirty_rate_get(i) * exp(state->pid.output);
+        index[n++] = i;
+    }
+
+    dirtylimit_split_target(dirtylimit_state->target, demand, quota, n);
+
+    for (i = 0; i < n; i++) {
+        dirtylimit_state->states[index[i]].quota = quota[i];
+    }
+}
+
 void dirtylimit_process(void)
 {
     CPUState *cpu;
@@ -351,6 +410,10 @@ void dirtylimit_process(void)
             return;
         }
 
+        if (dirtylimit_state->target) {
+            dirtylimit_share_target();
+        }
+
         CPU_FOREACH(cpu) {
             if (!dirtylimit_vcpu_get_state(cpu->cpu_index)->enabled) {
                 continue;
@@ -539,6 +602,9 @@ void qmp_set_vcpu_dirty_limit(bool has_cpu_index,
         dirtylimit_init();
     }
 
+    /* Explicit quotas replace the shared target */
+    dirtylimit_state->target = 0;
+
     if (has_cpu_index) {
         dirtylimit_set_vcpu(cpu_index, dirty_rate, true);
     } else {
@@ -548,6 +614,36 @@ void qmp_set_vcpu_dirty_limit(bool has_cpu_index,
     dirtylimit_state_unlock();
 }
 
+/*
+ * Limit the dirty page rate of the whole guest to @target MB/s, and let
+ * the vcpus share it according to how fast each of them dirties memory.
+ * Used by migration, which has already checked that the dirty ring is
+ * enabled.
+ */
+void dirtylimit_set_target(uint64_t target)
+{
+    int i;
+
+    assert(target);
+    trace_dirtylimit_set_target(target);
+
+    dirtylimit_state_lock();
+
+    if (!dirtylimit_in_service()) {
+        dirtylimit_init();
+    }
+
+    if (!dirtylimit_state->target) {
+        for (i = 0; i < dirtylimit_state->max_cpus; i++) {
+            dirtylimit_pid_reset(&dirtylimit_state->states[i].pid);
+        }
+        dirtylimit_set_all(target, true);
+    }
+    dirtylimit_state->target = target;
+
+    dirtylimit_state_unlock();
+}
+
 void hmp_set_vcpu_dirty_limit(Monitor *mon, const QDict *qdict)
 {
     int64_t dirty_rate = qdict_get_int(qdict, "dirty_rate");
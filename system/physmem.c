@@ -2731,6 +2731,67 @@ void qemu_ram_remap(ram_addr_t addr)
         }
     }
 }
+
+/*
+ * qemu_ram_map_file - back a range of RAM with a private file mapping
+ *
+ * Replace the anonymous memory of @block at @start with a copy-on-write
+ * mapping of @fd at @fd_offset, so that the pages are read from the file
+ * when they are first accessed.  The previous content of the range is
+ * lost, even on failure.  The mapping is not bound to the NUMA policy of
+ * the memory backend, nor locked in memory, so callers must not use it
+ * for such blocks.
+ *
+ * Returns 0 on success, -errno on failure.
+ */
+int qemu_ram_map_file(RAMBlock *block, uint64_t start, size_t length,
+                      int fd, off_t fd_offset)
+{
+    void *host_startaddr = block->host + start;
+    Object *backend;
+    int flags, prot, ret = 0;
+    void *area;
+
+    assert(block->fd < 0 && !(block->flags & RAM_SHARED));
+    flags = MAP_FIXED | MAP_PRIVATE;
+    flags |= block->flags & RAM_NORESERVE ? MAP_NORESERVE : 0;
+    prot = PROT_READ;
+    prot |= block->flags & RAM_READONLY ? 0 : PROT_WRITE;
+    area = mmap(host_startaddr, length, prot, flags, fd, fd_offset);
+    if (area != host_startaddr) {
+        /*
+         * A failed MAP_FIXED mmap may already have unmapped the range.
+         * Put anonymous memory back, so that the caller can still fill
+         * it in.
+         */
+        ret = -errno;
+        if (qemu_ram_remap_mmap(block, start, length) != 0) {
+            error_report("Could not remap RAM %s:%" PRIx64 " +%zx",
+                         block->idstr, start, length);
+            exit(1);
+        }
+    }
+
+    /* The new mapping does not inherit the advice given to the old one */
+    backend = object_dynamic_cast(memory_region_owner(block->mr),
+                                  TYPE_MEMORY_BACKEND);
+    if (backend) {
+        /* As in host_memory_backend_memory_complete() */
+        if (MEMORY_BACKEND(backend)->merge) {
+            qemu_madvise(host_startaddr, length, QEMU_MADV_MERGEABLE);
+        }
+        if (!MEMORY_BACKEND(backend)->dump) {
+            qemu_madvise(host_startaddr, length, QEMU_MADV_DONTDUMP);
+        }
+    } else {
+        memory_try_enable_merging(host_startaddr, length);
+        qemu_ram_setup_dump(host_startaddr, length);
+    }
+    if (!qtest_enabled()) {
+        qemu_madvise(host_startaddr, length, QEMU_MADV_DONTFORK);
+    }
+    return ret;
+}
 #endif /* !_WIN32 */
 
 /*
@@ -926,6 +926,12 @@ static uint64_t page_limit_rev(uint64_t addr)
     return (addr & ~TARGET_PAGE_MASK) + 1;
 }
 
+/*
+ * Without MTE checks a forward step may span several pages, but keep it
+ * bounded so that the main-phase loops still check for interrupts.
+ */
+#define MOPS_STEP_MAX (16 * TARGET_PAGE_SIZE)
+
 /*
  * Perform part of a memory set on an area of guest memory starting at
  * toaddr (a dirty address) and extending for setsize bytes.
@@ -943,9 +949,11 @@ static uint64_t set_step(CPUARMState *env, uint64_t toaddr,
 {
     void *mem;
 
-    setsize = MIN(setsize, page_limit(toaddr));
     if (*mtedesc) {
-        uint64_t mtesize = mte_mops_probe(env, toaddr, setsize, *mtedesc);
+        uint64_t mtesize;
+
+        setsize = MIN(setsize, page_limit(toaddr));
+        mtesize = mte_mops_probe(env, toaddr, setsize, *mtedesc);
         if (mtesize == 0) {
             /* Trap, or not. All CPU state is up to date */
             mte_check_fail(env, *mtedesc, toaddr, ra);
@@ -955,27 +963,26 @@ static uint64_t set_step(CPUARMState *env, uint64_t toaddr,
             /* Advance to the end, or to the tag mismatch */
             setsize = MIN(setsize, mtesize);
         }
+    } else {
+        setsize = MIN(setsize, MOPS_STEP_MAX);
     }
 
     toaddr = useronly_clean_ptr(toaddr);
     /*
-     * Trapless lookup: returns NULL for invalid page, I/O,
-     * watchpoints, clean pages, etc.
+     * Probe as many pages as we can access directly.  This only faults
+     * for the first byte, and dirties clean pages as it goes.
      */
-    mem = tlb_vaddr_to_host(env, toaddr, MMU_DATA_STORE, memidx);
+    setsize = probe_access_range(env, toaddr, setsize, MMU_DATA_STORE,
+                                 memidx, &mem, ra);
 
-#ifndef CONFIG_USER_ONLY
     if (unlikely(!mem)) {
         /*
          * Slow-path: just do one byte write. This will handle the
-         * watchpoint, invalid page, etc handling correctly.
-         * For clean code pages, the next iteration will see
-         * the page dirty and will use the fast path.
+         * watchpoint, I/O, etc handling correctly.
          */
         cpu_stb_mmuidx_ra(env, toaddr, data, memidx, ra);
         return 1;
     }
-#endif
     /* Easy case: just memset the host memory */
     set_helper_retaddr(ra);
     memset(mem, data, setsize);
@@ -1302,9 +1309,13 @@ static uint64_t copy_step(CPUARMState *env, uint64_t toaddr, uint64_t fromaddr,
     void *rmem;
     void *wmem;
 
-    /* Don't cross a page boundary on either source or destination */
-    copysize = MIN(copysize, page_limit(toaddr));
-    copysize = MIN(copysize, page_limit(fromaddr));
+    if (*rdesc || *wdesc) {
+        /* Tag checks work a page at a time on source and destination */
+        copysize = MIN(copysize, page_limit(toaddr));
+        copysize = MIN(copysize, page_limit(fromaddr));
+    } else {
+        copysize = MIN(copysize, MOPS_STEP_MAX);
+    }
     /*
      * Handle MTE tag checks: either handle the tag mismatch for byte 0,
      * or else copy up to but not including the byte with the mismatch.
@@ -1330,32 +1341,28 @@ static uint64_t copy_step(CPUARMState *env, uint64_t toaddr, uint64_t fromaddr,
 
     toaddr = useronly_clean_ptr(toaddr);
     fromaddr = useronly_clean_ptr(fromaddr);
-    /* Trapless lookup of whether we can get a host memory pointer */
-    wmem = tlb_vaddr_to_host(env, toaddr, MMU_DATA_STORE, wmemidx);
-    rmem = tlb_vaddr_to_host(env, fromaddr, MMU_DATA_LOAD, rmemidx);
+    /*
+     * Probe the source first: a fault on the first byte must be reported
+     * for the read before the write, as for the byte-at-a-time path.
+     * Neither probe faults for anything beyond the first byte.
+     */
+    copysize = probe_access_range(env, fromaddr, copysize, MMU_DATA_LOAD,
+                                  rmemidx, &rmem, ra);
+    if (rmem) {
+        copysize = probe_access_range(env, toaddr, copysize, MMU_DATA_STORE,
+                                      wmemidx, &wmem, ra);
+    }
 
-#ifndef CONFIG_USER_ONLY
     /*
      * If we don't have host memory for both source and dest then just
-     * do a single byte copy. This will handle watchpoints, invalid pages,
-     * etc correctly. For clean code pages, the next iteration will see
-     * the page dirty and will use the fast path.
+     * do a single byte copy. This will handle watchpoints, I/O, etc
+     * correctly.
      */
     if (unlikely(!rmem || !wmem)) {
-        uint8_t byte;
-        if (rmem) {
-            byte = *(uint8_t *)rmem;
-        } else {
-            byte = cpu_ldub_mmuidx_ra(env, fromaddr, rmemidx, ra);
-        }
-        if (wmem) {
-            *(uint8_t *)wmem = byte;
-        } else {
-            cpu_stb_mmuidx_ra(env, toaddr, byte, wmemidx, ra);
-        }
+        uint8_t byte = cpu_ldub_mmuidx_ra(env, fromaddr, rmemidx, ra);
+        cpu_stb_mmuidx_ra(env, toaddr, byte, wmemidx, ra);
         return 1;
     }
-#endif
     /* Easy case: just memmove the host memory */
     set_helper_retaddr(ra);
     memmove(wmem, rmem, copysize);
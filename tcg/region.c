@@ -68,6 +68,7 @@ struct tcg_region_state {
     size_t size; /* size of one region */
     size_t stride; /* .size + guard size */
     size_t total_size; /* size of entire buffer, >= n * stride */
+    bool hugepages; /* huge page aligned regions, no guard pages */
 
     /* fields protected by the lock */
     size_t current; /* current region index */
@@ -403,6 +404,32 @@ void tcg_region_initial_alloc(TCGContext *s)
     qemu_mutex_unlock(&region.lock);
 }
 
+/*
+ * With huge pages, give the memory of all regions back to the host when
+ * the buffer is flushed.  Each region is then faulted in again by the
+ * first vCPU thread that generates code into it, which places it on that
+ * thread's NUMA node under the default first-touch policy, instead of
+ * staying on whichever node the region's previous owner ran.
+ */
+static void tcg_region_discard_all(void)
+{
+    if (!region.hugepages || tcg_splitwx_diff) {
+        return;
+    }
+
+    for (size_t i = 0; i < region.n; i++) {
+        void *start, *end;
+
+        tcg_region_bounds(i, &start, &end);
+        /* Leave the prologue and partial huge pages alone. */
+        start = QEMU_ALIGN_PTR_UP(start, QEMU_VMALLOC_ALIGN);
+        end = QEMU_ALIGN_PTR_DOWN(end, QEMU_VMALLOC_ALIGN);
+        if (start < end) {
+            qemu_madvise(start, end - start, QEMU_MADV_DONTNEED);
+        }
+    }
+}
+
 /* Call from a safe-work context */
 void tcg_region_reset_all(void)
 {
@@ -420,6 +447,7 @@ void tcg_region_reset_all(void)
     qemu_mutex_unlock(&region.lock);
 
     tcg_region_tree_reset_all();
+    tcg_region_discard_all();
 }
 
 static size_t tcg_n_regions(size_t tb_size, unsigned max_threads)
@@ -543,15 +571,30 @@ static int alloc_code_gen_buffer(size_t size, int splitwx, Error **errp)
 static int alloc_code_gen_buffer_anon(size_t size, int prot,
                                       int flags, Error **errp)
 {
+    size_t align = region.hugepages ? QEMU_VMALLOC_ALIGN : 0;
     void *buf;
 
-    buf = mmap(NULL, size, prot, flags, -1, 0);
+    /* Over-allocate so that the buffer can start on a huge page boundary. */
+    buf = mmap(NULL, size + align, prot, flags, -1, 0);
     if (buf == MAP_FAILED) {
         error_setg_errno(errp, errno,
                          "allocate %zu bytes for jit buffer", size);
         return -1;
     }
 
+    if (align) {
+        void *aligned = QEMU_ALIGN_PTR_UP(buf, align);
+        size_t head = aligned - buf;
+
+        if (head) {
+            munmap(buf, head);
+        }
+        if (align - head) {
+            munmap(aligned + size, align - head);
+        }
+        buf = aligned;
+    }
+
     region.start_aligned = buf;
     region.total_size = size;
     return prot;
@@ -734,10 +777,11 @@ static int alloc_code_gen_buffer(size_t size, int splitwx, Error **errp)
  * in practice. Multi-threaded guests share most if not all of their translated
  * code, which makes parallel code generation less appealing than in system-mode
  */
-void tcg_region_init(size_t tb_size, int splitwx, unsigned max_threads)
+void tcg_region_init(size_t tb_size, int splitwx, bool hugepages,
+                     unsigned max_threads)
 {
     const size_t page_size = qemu_real_host_page_size();
-    size_t region_size;
+    size_t region_size, guard_size;
     int have_prot, need_prot;
 
     /* Size the buffer.  */
@@ -757,6 +801,22 @@ void tcg_region_init(size_t tb_size, int splitwx, unsigned max_threads)
         tb_size = MAX_CODE_GEN_BUFFER_SIZE;
     }
 
+    /*
+     * Huge pages only pay off if they are not split up by guard pages,
+     * and they need the rw and rx views to be the same mapping.
+     */
+    region.hugepages = hugepages && splitwx <= 0 &&
+                       QEMU_VMALLOC_ALIGN > page_size &&
+                       tb_size >= QEMU_VMALLOC_ALIGN;
+#ifndef USE_STATIC_CODE_GEN_BUFFER
+    if (region.hugepages) {
+        splitwx = 0;
+        tb_size = QEMU_ALIGN_DOWN(tb_size, QEMU_VMALLOC_ALIGN);
+    }
+#else
+    region.hugepages = false;
+#endif
+
     have_prot = alloc_code_gen_buffer(tb_size, splitwx, &error_fatal);
     assert(have_prot >= 0);
 
@@ -774,15 +834,20 @@ void tcg_region_init(size_t tb_size, int splitwx, unsigned max_threads)
      */
     region.n = tcg_n_regions(tb_size, max_threads);
     region_size = tb_size / region.n;
-    region_size = QEMU_ALIGN_DOWN(region_size, page_size);
+    if (region.hugepages && region_size >= QEMU_VMALLOC_ALIGN) {
+        region_size = QEMU_ALIGN_DOWN(region_size, QEMU_VMALLOC_ALIGN);
+    } else {
+        region_size = QEMU_ALIGN_DOWN(region_size, page_size);
+    }
 
     /* A region must have at least 2 pages; one code, one guard */
     g_assert(region_size >= 2 * page_size);
     region.stride = region_size;
 
     /* Reserve space for guard pages. */
-    region.size = region_size - page_size;
-    region.total_size -= page_size;
+    guard_size = region.hugepages ? 0 : page_size;
+    region.size = region_size - guard_size;
+    region.total_size -= guard_size;
 
     /*
      * The first region will be smaller than the others, via the prologue,
@@ -832,7 +897,7 @@ void tcg_region_init(size_t tb_size, int splitwx, unsigned max_threads)
                 exit(1);
             }
         }
-        if (have_prot != 0) {
+        if (have_prot != 0 && guard_size) {
             /* Guard pages are nice for bug detection but are not essential. */
             (void)qemu_mprotect_none(end, page_size);
         }
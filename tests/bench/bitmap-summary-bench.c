@@ -0,0 +1,78 @@
+/*
+ * QEMU bitmap summary speed benchmark
+ *
+ * Walks a sparse bitmap covering 1 TiB of 4 KiB pages, as the migration
+ * code does when looking for dirty pages, with and without a summary.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/bitmap.h"
+#include "qemu/bitmap-summary.h"
+
+#define NBITS   (1UL << 28)
+
+static unsigned long walk(BitmapSummary *s, const unsigned long *bmap)
+{
+    unsigned long pos = 0, n = 0;
+
+    for (;;) {
+        if (s) {
+            pos = bitmap_summary_find_next(s, bmap, NBITS, pos);
+        } else {
+            pos = find_next_bit(bmap, NBITS, pos);
+        }
+        if (pos >= NBITS) {
+            return n;
+        }
+        n++;
+        pos++;
+    }
+}
+
+static void test_walk(const void *opaque)
+{
+    unsigned long dirty = GPOINTER_TO_SIZE(opaque);
+    unsigned long *bmap = bitmap_new(NBITS);
+    BitmapSummary *s = bitmap_summary_new(NBITS);
+    GRand *rand = g_rand_new_with_seed(dirty);
+    unsigned long i, n;
+    double flat, summary;
+
+    for (i = 0; i < dirty; i++) {
+        unsigned long pos = g_rand_int_range(rand, 0, NBITS);
+
+        set_bit(pos, bmap);
+        bitmap_summary_mark(s, pos, 1);
+    }
+
+    g_test_timer_start();
+    n = walk(NULL, bmap);
+    flat = g_test_timer_elapsed();
+
+    g_test_timer_start();
+    g_assert_cmpint(walk(s, bmap), ==, n);
+    summary = g_test_timer_elapsed();
+
+    g_test_message("%8lu dirty: find_next_bit %9.3f ms, summary %9.3f ms",
+                   n, flat * 1000, summary * 1000);
+
+    g_rand_free(rand);
+    bitmap_summary_free(s);
+    g_free(bmap);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long dirty;
+
+    g_test_init(&argc, &argv, NULL);
+    for (dirty = 16; dirty <= 16 * 1024 * 1024; dirty *= 16) {
+        g_autofree char *path = g_strdup_printf("/bitmap/summary/walk/%lu",
+                                                dirty);
+        g_test_add_data_func(path, GSIZE_TO_POINTER(dirty), test_walk);
+    }
+    return g_test_run();
+}
@@ -0,0 +1,102 @@
+/*
+ * QEMU out-of-line gvec helper acceleration benchmark
+ *
+ * Compares the host-accelerated saturating arithmetic used by
+ * accel/tcg/tcg-runtime-gvec.c with the scalar loops, for the vector
+ * sizes of NEON (16), AVX2 (32) and SVE/AVX-512 (64..256 bytes).
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/host-utils.h"
+#include "qemu/units.h"
+#include "host/gvec-accel.c.inc"
+
+#define MAX_OPRSZ 256
+
+static void ssadd64_run(void *d, void *a, void *b, intptr_t oprsz,
+                        bool accel)
+{
+    intptr_t i = accel ? gvec_accel_3(ssadd64, d, a, b, oprsz) : 0;
+
+    for (; i < oprsz; i += sizeof(int64_t)) {
+        int64_t ai = *(int64_t *)(a + i);
+        int64_t bi = *(int64_t *)(b + i);
+        int64_t di;
+        if (sadd64_overflow(ai, bi, &di)) {
+            di = (di < 0 ? INT64_MAX : INT64_MIN);
+        }
+        *(int64_t *)(d + i) = di;
+    }
+}
+
+static void usadd32_run(void *d, void *a, void *b, intptr_t oprsz,
+                        bool accel)
+{
+    intptr_t i = accel ? gvec_accel_3(usadd32, d, a, b, oprsz) : 0;
+
+    for (; i < oprsz; i += sizeof(uint32_t)) {
+        uint32_t ai = *(uint32_t *)(a + i);
+        uint32_t bi = *(uint32_t *)(b + i);
+        uint32_t di;
+        if (uadd32_overflow(ai, bi, &di)) {
+            di = UINT32_MAX;
+        }
+        *(uint32_t *)(d + i) = di;
+    }
+}
+
+typedef void (*gvec_bench_fn)(void *, void *, void *, intptr_t, bool);
+
+typedef struct {
+    const char *name;
+    gvec_bench_fn fn;
+} GVecBench;
+
+static const GVecBench benches[] = {
+    { "ssadd64", ssadd64_run },
+    { "usadd32", usadd32_run },
+};
+
+static void test(const void *opaque)
+{
+    const GVecBench *bench = opaque;
+    uint64_t a[MAX_OPRSZ / 8], b[MAX_OPRSZ / 8], d[MAX_OPRSZ / 8];
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(a); i++) {
+        a[i] = i * 0x0123456789abcdefull;
+        b[i] = ~a[i] + i;
+    }
+
+    for (intptr_t oprsz = 16; oprsz <= MAX_OPRSZ; oprsz *= 2) {
+        double rate[2];
+
+        for (i = 0; i < 2; i++) {
+            double total = 0.0;
+
+            g_test_timer_start();
+            do {
+                bench->fn(d, a, b, oprsz, i);
+                total += oprsz;
+            } while (g_test_timer_elapsed() < 0.25);
+            rate[i] = total / MiB / g_test_timer_last();
+        }
+        g_test_message("%s %3zd bytes: scalar %8.0f MB/sec, "
+                       "accel %8.0f MB/sec", bench->name, (ssize_t)oprsz,
+                       rate[0], rate[1]);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    for (int i = 0; i < ARRAY_SIZE(benches); i++) {
+        g_autofree char *path = g_strdup_printf("/tcg/gvec/%s",
+                                                benches[i].name);
+        g_test_add_data_func(path, &benches[i], test);
+    }
+    return g_test_run();
+}
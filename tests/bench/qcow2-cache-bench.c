@@ -0,0 +1,102 @@
+/*
+ * QEMU qcow2 metadata cache lookup benchmark
+ *
+ * Measures the cost of an L2 cache hit as a function of the number of
+ * cache entries.  The image uses 512 byte clusters and L2 slices, so that
+ * a large number of distinct L2 slices can be populated cheaply.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/main-loop.h"
+#include "qemu/units.h"
+#include "block/block.h"
+#include "system/block-backend.h"
+#include "qapi/error.h"
+#include "qobject/qdict.h"
+
+#define CLUSTER_SIZE        512
+/* Guest bytes covered by one 512 byte L2 slice (64 entries) */
+#define SLICE_COVERAGE      (CLUSTER_SIZE / sizeof(uint64_t) * CLUSTER_SIZE)
+
+static char img_path[] = "/tmp/qcow2-cache-bench.XXXXXX";
+
+static BlockBackend *open_image(int entries)
+{
+    BlockBackend *blk;
+    QDict *options = qdict_new();
+
+    qdict_put_str(options, "driver", "qcow2");
+    qdict_put_str(options, "file.driver", "file");
+    qdict_put_str(options, "file.filename", img_path);
+    qdict_put_int(options, "l2-cache-size", (int64_t)entries * CLUSTER_SIZE);
+    qdict_put_int(options, "l2-cache-entry-size", CLUSTER_SIZE);
+
+    blk = blk_new_open(NULL, NULL, options, BDRV_O_RDWR, &error_abort);
+    g_assert(blk);
+    return blk;
+}
+
+static void test_lookup(const void *opaque)
+{
+    int entries = GPOINTER_TO_INT(opaque);
+    uint64_t img_size = (uint64_t)entries * SLICE_COVERAGE;
+    g_autofree char *options = g_strdup_printf("cluster_size=%d",
+                                               CLUSTER_SIZE);
+    uint8_t buf[CLUSTER_SIZE] = { 1 };
+    BlockBackend *blk;
+    GRand *rand;
+    double total = 0.0;
+    int i;
+
+    bdrv_img_create(img_path, "qcow2", NULL, NULL, options, img_size,
+                    BDRV_O_RDWR, true, &error_abort);
+    blk = open_image(entries);
+
+    /* Allocate one cluster per L2 slice, which also fills the cache */
+    for (i = 0; i < entries; i++) {
+        g_assert(blk_pwrite(blk, (int64_t)i * SLICE_COVERAGE,
+                            sizeof(buf), buf, 0) == 0);
+    }
+
+    rand = g_rand_new_with_seed(entries);
+    g_test_timer_start();
+    do {
+        int slice = g_rand_int_range(rand, 0, entries);
+        g_assert(blk_pread(blk, (int64_t)slice * SLICE_COVERAGE,
+                           sizeof(buf), buf, 0) == 0);
+        total++;
+    } while (g_test_timer_elapsed() < 1.0);
+
+    g_test_message("l2 cache %7d entries: %10.0f lookups/sec",
+                   entries, total / g_test_timer_last());
+
+    g_rand_free(rand);
+    blk_unref(blk);
+}
+
+int main(int argc, char **argv)
+{
+    int fd, entries;
+    int ret;
+
+    bdrv_init();
+    qemu_init_main_loop(&error_abort);
+    g_test_init(&argc, &argv, NULL);
+
+    fd = mkstemp(img_path);
+    g_assert(fd >= 0);
+    close(fd);
+
+    for (entries = 16; entries <= 64 * 1024; entries *= 4) {
+        g_autofree char *path = g_strdup_printf("/qcow2/cache/lookup/%d",
+                                                entries);
+        g_test_add_data_func(path, GINT_TO_POINTER(entries), test_lookup);
+    }
+
+    ret = g_test_run();
+    unlink(img_path);
+    return ret;
+}
@@ -0,0 +1,84 @@
+/*
+ * QEMU block request list benchmark
+ *
+ * Measures the cost of looking for a conflicting request, as done for
+ * every block-copy task and copy-before-write operation, as a function
+ * of the number of requests in flight.  Each iteration retires the
+ * oldest request and starts a new one in a free area, so the number of
+ * requests stays constant.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/coroutine.h"
+#include "block/reqlist.h"
+
+#define REQ_SIZE        (64 * 1024)
+
+typedef struct ReqlistBench {
+    int depth;
+    double lookups;
+} ReqlistBench;
+
+static void coroutine_fn reqlist_bench_co(void *opaque)
+{
+    ReqlistBench *b = opaque;
+    BlockReq *reqs = g_new(BlockReq, b->depth);
+    BlockReqList list;
+    int64_t next = 0;
+    int i;
+
+    reqlist_init(&list);
+    for (i = 0; i < b->depth; i++) {
+        reqlist_init_req(&list, &reqs[i], next, REQ_SIZE);
+        next += 2 * REQ_SIZE;
+    }
+
+    i = 0;
+    g_test_timer_start();
+    do {
+        /* The gaps between requests never conflict */
+        g_assert(!reqlist_find_conflict(&list, next - REQ_SIZE, REQ_SIZE));
+        g_assert(reqlist_find_conflict(&list, reqs[i].offset, 1));
+
+        reqlist_remove_req(&reqs[i]);
+        reqlist_init_req(&list, &reqs[i], next, REQ_SIZE);
+        next += 2 * REQ_SIZE;
+        i = (i + 1) % b->depth;
+        b->lookups += 2;
+    } while (g_test_timer_elapsed() < 1.0);
+
+    for (i = 0; i < b->depth; i++) {
+        reqlist_remove_req(&reqs[i]);
+    }
+    g_free(reqs);
+}
+
+static void test_find_conflict(const void *opaque)
+{
+    ReqlistBench b = { .depth = GPOINTER_TO_INT(opaque) };
+    Coroutine *co = qemu_coroutine_create(reqlist_bench_co, &b);
+
+    qemu_coroutine_enter(co);
+
+    g_test_message("%5d requests in flight: %10.0f lookups/sec",
+                   b.depth, b.lookups / g_test_timer_last());
+}
+
+int main(int argc, char **argv)
+{
+    int depth;
+
+    g_test_init(&argc, &argv, NULL);
+
+    for (depth = 1; depth <= 4096; depth *= 4) {
+        g_autofree char *path = g_strdup_printf("/reqlist/find-conflict/%d",
+                                                depth);
+        g_test_add_data_func(path, GINT_TO_POINTER(depth),
+                             test_find_conflict);
+    }
+
+    return g_test_run();
+}
@@ -51,6 +51,27 @@ static void test_multifd_postcopy_tcp_zstd(char *name, MigrateCommon *args)
 
     test_precopy_common(args);
 }
+
+static void *
+migrate_hook_start_precopy_tcp_multifd_adaptive(QTestState *from,
+                                                QTestState *to)
+{
+    migrate_set_parameter_int(from, "multifd-zstd-level", 3);
+    migrate_set_parameter_int(to, "multifd-zstd-level", 3);
+
+    return migrate_hook_start_precopy_tcp_multifd_common(from, to,
+                                                         "adaptive");
+}
+
+static void test_multifd_tcp_adaptive(char *name, MigrateCommon *args)
+{
+    args->listen_uri = "defer";
+    args->start_hook = migrate_hook_start_precopy_tcp_multifd_adaptive;
+
+    args->start.caps[MIGRATION_CAPABILITY_MULTIFD] = true;
+
+    test_precopy_common(args);
+}
 #endif /* CONFIG_ZSTD */
 
 #ifdef CONFIG_QATZIP
@@ -140,6 +161,27 @@ static void test_precopy_unix_xbzrle(char *name, MigrateCommon *args)
     test_precopy_common(args);
 }
 
+static void *
+migrate_hook_start_precopy_tcp_multifd_xbzrle(QTestState *from,
+                                              QTestState *to)
+{
+    migrate_set_parameter_int(from, "xbzrle-cache-size", 33554432);
+    return migrate_hook_start_precopy_tcp_multifd_common(from, to, "xbzrle");
+}
+
+static void test_multifd_tcp_xbzrle(char *name, MigrateCommon *args)
+{
+    args->listen_uri = "defer";
+    args->start_hook = migrate_hook_start_precopy_tcp_multifd_xbzrle;
+    /* Pages must be sent twice for deltas to be used */
+    args->iterations = 2;
+    args->live = true;
+
+    args->start.caps[MIGRATION_CAPABILITY_MULTIFD] = true;
+
+    test_precopy_common(args);
+}
+
 static void *
 migrate_hook_start_precopy_tcp_multifd_zlib(QTestState *from,
                                             QTestState *to)
@@ -187,8 +229,13 @@ void migration_test_add_compression(MigrationTestEnv *env)
         migration_test_add("/migration/multifd+postcopy/tcp/plain/zstd",
                            test_multifd_postcopy_tcp_zstd);
     }
+    migration_test_add("/migration/multifd/tcp/plain/adaptive",
+                       test_multifd_tcp_adaptive);
 #endif
 
+    migration_test_add("/migration/multifd/tcp/plain/xbzrle",
+                       test_multifd_tcp_xbzrle);
+
 #ifdef CONFIG_QATZIP
     migration_test_add("/migration/multifd/tcp/plain/qatzip",
                        test_multifd_tcp_qatzip);
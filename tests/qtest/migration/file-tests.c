@@ -154,6 +154,39 @@ static void test_multifd_file_mapped_ram(char *name, MigrateCommon *args)
     test_file_common(args, true);
 }
 
+#ifndef _WIN32
+static void test_precopy_file_mapped_ram_instant_restore(char *name,
+                                                         MigrateCommon *args)
+{
+    g_autofree char *uri = g_strdup_printf("file:%s/%s", tmpfs,
+                                           FILE_TEST_FILENAME);
+
+    args->connect_uri = uri;
+    args->listen_uri = "defer";
+
+    args->start.caps[MIGRATION_CAPABILITY_MAPPED_RAM] = true;
+    args->start.caps[MIGRATION_CAPABILITY_X_INSTANT_RESTORE] = true;
+
+    test_file_common(args, true);
+}
+
+static void test_multifd_file_mapped_ram_instant_restore(char *name,
+                                                         MigrateCommon *args)
+{
+    g_autofree char *uri = g_strdup_printf("file:%s/%s", tmpfs,
+                                           FILE_TEST_FILENAME);
+
+    args->connect_uri = uri;
+    args->listen_uri = "defer";
+
+    args->start.caps[MIGRATION_CAPABILITY_MULTIFD] = true;
+    args->start.caps[MIGRATION_CAPABILITY_MAPPED_RAM] = true;
+    args->start.caps[MIGRATION_CAPABILITY_X_INSTANT_RESTORE] = true;
+
+    test_file_common(args, true);
+}
+#endif
+
 static void *migrate_hook_start_multifd_mapped_ram_dio(QTestState *from,
                                                        QTestState *to)
 {
@@ -327,6 +360,10 @@ void migration_test_add_file(MigrationTestEnv *env)
                        test_multifd_file_mapped_ram_live);
 
 #ifndef _WIN32
+    migration_test_add("/migration/precopy/file/mapped-ram/instant-restore",
+                       test_precopy_file_mapped_ram_instant_restore);
+    migration_test_add("/migration/multifd/file/mapped-ram/instant-restore",
+                       test_multifd_file_mapped_ram_instant_restore);
     migration_test_add("/migration/multifd/file/mapped-ram/fdset",
                        test_multifd_file_mapped_ram_fdset);
     migration_test_add("/migration/multifd/file/mapped-ram/fdset/dio",
@@ -44,6 +44,7 @@ typedef struct MigrationTestEnv {
     bool has_uffd;
     bool uffd_feature_thread_id;
     bool has_dirty_ring;
+    bool has_io_uring;
     bool is_x86;
     bool full_set;
     const char *arch;
@@ -33,6 +33,13 @@
 #include "qemu/userfaultfd.h"
 #endif
 
+/* for io_uring_supported() */
+#if defined(__linux__) && defined(__NR_io_uring_setup) && \
+    defined(CONFIG_LINUX_IO_URING) && defined(HAVE_IO_URING_PREP_SENDMSG_ZC)
+#include <linux/io_uring.h>
+#define HAVE_SOCKET_URING
+#endif
+
 /* For dirty ring test; so far only x86_64 is supported */
 #if defined(__linux__) && defined(HOST_X86_64)
 #include "linux/kvm.h"
@@ -370,6 +377,27 @@ bool ufd_version_check(bool *uffd_feature_thread_id)
 }
 #endif
 
+/*
+ * Whether QEMU was built with io_uring socket channels and the host
+ * kernel lets us create a ring.
+ */
+bool io_uring_supported(void)
+{
+#ifdef HAVE_SOCKET_URING
+    struct io_uring_params params = {};
+    int fd = syscall(__NR_io_uring_setup, 1, &params);
+
+    if (fd < 0) {
+        g_test_message("Skipping test: io_uring not available");
+        return false;
+    }
+    close(fd);
+    return true;
+#else
+    return false;
+#endif
+}
+
 bool kvm_dirty_ring_supported(void)
 {
 #if defined(__linux__) && defined(HOST_X86_64)
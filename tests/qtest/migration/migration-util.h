@@ -52,6 +52,7 @@ static inline bool probe_o_direct_support(const char *tmpfs)
 
 bool ufd_version_check(bool *uffd_feature_thread_id);
 bool kvm_dirty_ring_supported(void);
+bool io_uring_supported(void);
 
 void migration_test_add(const char *path,
                         void (*fn)(char *name, MigrateCommon *args));
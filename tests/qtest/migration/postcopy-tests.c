@@ -13,7 +13,9 @@
 #include "qemu/osdep.h"
 #include "libqtest.h"
 #include "migration/framework.h"
+#include "migration/migration-qmp.h"
 #include "migration/migration-util.h"
+#include "qobject/qdict.h"
 #include "qobject/qlist.h"
 #include "qemu/module.h"
 #include "qemu/option.h"
@@ -39,6 +41,37 @@ static void test_postcopy_preempt(char *name, MigrateCommon *args)
     test_postcopy_common(args);
 }
 
+static void *postcopy_prefetch_start(QTestState *from, QTestState *to)
+{
+    migrate_set_parameter_int(to, "x-postcopy-prefetch-window", 16);
+
+    return NULL;
+}
+
+static void postcopy_prefetch_end(QTestState *from, QTestState *to,
+                                  void *opaque)
+{
+    QDict *rsp_return = migrate_query_not_failed(to);
+
+    g_assert(qdict_haskey(rsp_return, "postcopy-prefetch-pages"));
+    g_assert(qdict_haskey(rsp_return, "postcopy-prefetch-hits"));
+    /* The test guest scans its memory sequentially */
+    g_assert_cmpint(qdict_get_int(rsp_return, "postcopy-prefetch-pages"), >,
+                    0);
+    g_assert_cmpint(qdict_get_int(rsp_return, "postcopy-prefetch-hits"), <=,
+                    qdict_get_int(rsp_return, "postcopy-prefetch-pages"));
+    qobject_unref(rsp_return);
+}
+
+static void test_postcopy_preempt_prefetch(char *name, MigrateCommon *args)
+{
+    args->start.caps[MIGRATION_CAPABILITY_POSTCOPY_PREEMPT] = true;
+    args->start_hook = postcopy_prefetch_start;
+    args->end_hook = postcopy_prefetch_end;
+
+    test_postcopy_common(args);
+}
+
 static void test_postcopy_recovery(char *name, MigrateCommon *args)
 {
     test_postcopy_recovery_common(args, POSTCOPY_FAIL_NONE);
@@ -100,6 +133,8 @@ void migration_test_add_postcopy(MigrationTestEnv *env)
     if (env->has_uffd) {
         migration_test_add("/migration/postcopy/preempt/recovery/plain",
                            test_postcopy_preempt_recovery);
+        migration_test_add("/migration/postcopy/preempt/prefetch",
+                           test_postcopy_preempt_prefetch);
 
         migration_test_add(
             "/migration/postcopy/recovery/double-failures/handshake",
@@ -13,6 +13,9 @@
 #include "qemu/osdep.h"
 #include "chardev/char.h"
 #include "crypto/tlscredspsk.h"
+#include "hw/misc/vmcoreinfo.h"
+#include "libqos/fw_cfg.h"
+#include "libqos/libqos.h"
 #include "libqtest.h"
 #include "migration/bootfile.h"
 #include "migration/framework.h"
@@ -21,10 +24,12 @@
 #include "ppc-util.h"
 #include "qobject/qlist.h"
 #include "qapi-types-migration.h"
+#include "qemu/bswap.h"
 #include "qemu/module.h"
 #include "qemu/option.h"
 #include "qemu/range.h"
 #include "qemu/sockets.h"
+#include "qemu/units.h"
 
 
 /*
@@ -207,6 +212,28 @@ static void test_precopy_tcp_plain(char *name, MigrateCommon *args)
     test_precopy_common(args);
 }
 
+static void *migrate_hook_start_dirty_sync_threads(QTestState *from,
+                                                   QTestState *to)
+{
+    /* Splits the guest RAM in chunks that are synced in parallel */
+    migrate_set_parameter_int(from, "x-dirty-sync-threads", 4);
+    return NULL;
+}
+
+static void test_precopy_tcp_dirty_sync_threads(char *name,
+                                                MigrateCommon *args)
+{
+    args->listen_uri = "tcp:127.0.0.1:0";
+    args->start_hook = migrate_hook_start_dirty_sync_threads;
+    /*
+     * The guest must dirty pages between the bitmap syncs, so that the
+     * pages found by the sync threads are checked on the destination.
+     */
+    args->live = true;
+
+    test_precopy_common(args);
+}
+
 static void test_precopy_tcp_switchover_ack(char *name, MigrateCommon *args)
 {
     args->listen_uri = "tcp:127.0.0.1:0";
@@ -481,6 +508,112 @@ static void test_multifd_tcp_no_zero_page(char *name, MigrateCommon *args)
     test_precopy_common(args);
 }
 
+static void test_multifd_tcp_io_uring(char *name, MigrateCommon *args)
+{
+    args->listen_uri = "defer";
+    args->start_hook = migrate_hook_start_precopy_tcp_multifd;
+    /*
+     * The ring sends straight from the guest pages as well, so check
+     * that it copes with them changing while they are in flight.
+     */
+    args->live = true;
+
+    args->start.caps[MIGRATION_CAPABILITY_MULTIFD] = true;
+    args->start.caps[MIGRATION_CAPABILITY_X_MULTIFD_IO_URING] = true;
+
+    test_precopy_common(args);
+}
+
+#define VMCOREINFO_TEST_SIZE    (1 * MiB)
+#define VMCOREINFO_TEST_PADDR   0xffffff00
+
+/*
+ * vmcoreinfo is saved in parallel.  Give it some state on the source, like
+ * a guest kernel would, so that the destination can check what it loaded.
+ */
+static void *migrate_hook_start_parallel_vmstate(QTestState *from,
+                                                 QTestState *to)
+{
+    FWCfgVMCoreInfo info = {
+        .host_format = cpu_to_le16(FW_CFG_VMCOREINFO_FORMAT_ELF),
+        .guest_format = cpu_to_le16(FW_CFG_VMCOREINFO_FORMAT_ELF),
+        .size = cpu_to_le32(VMCOREINFO_TEST_SIZE),
+        .paddr = cpu_to_le64(VMCOREINFO_TEST_PADDR),
+    };
+    QOSState qs = { .qts = from };
+    QFWCFG *fw_cfg = pc_fw_cfg_init(from);
+    size_t len;
+
+    /* The test guest does not use the memory below its boot sector */
+    alloc_init(&qs.alloc, ALLOC_NO_FLAGS, 0x1000, 0x7000, 4096);
+    len = qfw_cfg_write_file(fw_cfg, &qs, FW_CFG_VMCOREINFO_FILENAME,
+                             &info, sizeof(info));
+    g_assert_cmpint(len, ==, sizeof(info));
+    alloc_destroy(&qs.alloc);
+    pc_fw_cfg_uninit(fw_cfg);
+
+    return migrate_hook_start_precopy_tcp_multifd(from, to);
+}
+
+static void migrate_check_parallel_vmstate(QTestState *who)
+{
+    QDict *rsp_return = migrate_query_not_failed(who);
+    QList *downtime = qdict_get_qlist(rsp_return, "vmstate-downtime");
+    const QListEntry *entry;
+    bool found = false;
+
+    g_assert(downtime);
+    QLIST_FOREACH_ENTRY(downtime, entry) {
+        QDict *section = qobject_to(QDict, qlist_entry_obj(entry));
+
+        if (g_str_has_suffix(qdict_get_str(section, "name"), "vmcoreinfo")) {
+            g_assert(qdict_get_bool(section, "parallel"));
+            found = true;
+        }
+    }
+    g_assert(found);
+
+    qobject_unref(rsp_return);
+}
+
+static void migrate_hook_end_parallel_vmstate(QTestState *from,
+                                              QTestState *to, void *opaque)
+{
+    FWCfgVMCoreInfo info;
+    QFWCFG *fw_cfg;
+    size_t len;
+
+    migrate_check_parallel_vmstate(from);
+    migrate_check_parallel_vmstate(to);
+
+    /* The destination loaded the state that went through multifd */
+    fw_cfg = pc_fw_cfg_init(to);
+    len = qfw_cfg_get_file(fw_cfg, FW_CFG_VMCOREINFO_FILENAME,
+                           &info, sizeof(info));
+    pc_fw_cfg_uninit(fw_cfg);
+
+    g_assert_cmpint(len, ==, sizeof(info));
+    g_assert_cmpint(le16_to_cpu(info.guest_format), ==,
+                    FW_CFG_VMCOREINFO_FORMAT_ELF);
+    g_assert_cmpint(le32_to_cpu(info.size), ==, VMCOREINFO_TEST_SIZE);
+    g_assert_cmpint(le64_to_cpu(info.paddr), ==, VMCOREINFO_TEST_PADDR);
+}
+
+static void test_multifd_tcp_parallel_vmstate(char *name, MigrateCommon *args)
+{
+    args->listen_uri = "defer";
+    args->start_hook = migrate_hook_start_parallel_vmstate;
+    args->end_hook = migrate_hook_end_parallel_vmstate;
+    args->live = true;
+
+    args->start.opts_source = "-device vmcoreinfo";
+    args->start.opts_target = "-device vmcoreinfo";
+    args->start.caps[MIGRATION_CAPABILITY_MULTIFD] = true;
+    args->start.caps[MIGRATION_CAPABILITY_X_PARALLEL_VMSTATE] = true;
+
+    test_precopy_common(args);
+}
+
 static void test_multifd_tcp_channels_none(char *name, MigrateCommon *args)
 {
     args->listen_uri = "defer";
@@ -1212,6 +1345,8 @@ void migration_test_add_precopy(MigrationTestEnv *env)
 
     migration_test_add("/migration/precopy/tcp/plain/switchover-ack",
                        test_precopy_tcp_switchover_ack);
+    migration_test_add("/migration/precopy/tcp/plain/dirty-sync-threads",
+                       test_precopy_tcp_dirty_sync_threads);
 
 #ifndef _WIN32
     migration_test_add("/migration/precopy/fd/tcp",
@@ -1235,6 +1370,14 @@ void migration_test_add_precopy(MigrationTestEnv *env)
                        test_multifd_tcp_zero_page_legacy);
     migration_test_add("/migration/multifd/tcp/plain/zero-page/none",
                        test_multifd_tcp_no_zero_page);
+    if (env->has_io_uring) {
+        migration_test_add("/migration/multifd/tcp/plain/io-uring",
+                           test_multifd_tcp_io_uring);
+    }
+    if (g_str_equal(env->arch, "x86_64") && qtest_has_device("vmcoreinfo")) {
+        migration_test_add("/migration/multifd/tcp/plain/parallel-vmstate",
+                           test_multifd_tcp_parallel_vmstate);
+    }
     if (g_str_equal(env->arch, "x86_64")
         && env->has_kvm && env->has_dirty_ring) {
 
@@ -10,6 +10,7 @@
 
 #include "qemu/osdep.h"
 #include "qemu/bitmap.h"
+#include "qemu/bitmap-summary.h"
 
 #define BMAP_SIZE  1024
 
@@ -123,6 +124,64 @@ static void check_bitmap_set(void)
     bitmap_set_case(bitmap_set_atomic);
 }
 
+static void check_bitmap_summary(void)
+{
+    /* Large enough for three levels of summary */
+    unsigned long size = 4 * BITS_PER_LONG * BITS_PER_LONG * BITS_PER_LONG;
+    unsigned long *bmap = bitmap_new(size);
+    BitmapSummary *s = bitmap_summary_new(size);
+    GRand *rand = g_rand_new_with_seed(1);
+    unsigned long i, pos, want;
+    int round;
+
+    for (round = 0; round < 100; round++) {
+        /* Set a few bits, using both ways to mark the summary */
+        for (i = 0; i < 20; i++) {
+            pos = g_rand_int_range(rand, 0, size);
+            set_bit(pos, bmap);
+            if (i & 1) {
+                bitmap_summary_mark(s, pos, 1);
+            } else {
+                bitmap_summary_mark_long(s, BIT_WORD(pos));
+                bitmap_summary_propagate(s, pos, 1);
+            }
+        }
+        if (round % 10 == 0) {
+            pos = g_rand_int_range(rand, 0, size - 1000);
+            bitmap_set(bmap, pos, 1000);
+            bitmap_summary_mark(s, pos, 1000);
+        }
+
+        /* Clearing bits needs no update of the summary */
+        for (i = 0; i < 20; i++) {
+            clear_bit(g_rand_int_range(rand, 0, size), bmap);
+        }
+
+        for (i = 0; i < 100; i++) {
+            unsigned long limit = g_rand_int_range(rand, 1, size + 1);
+
+            pos = g_rand_int_range(rand, 0, limit + 1);
+            want = find_next_bit(bmap, limit, pos);
+            g_assert_cmpint(bitmap_summary_find_next(s, bmap, limit, pos),
+                            ==, want);
+        }
+
+        /* Walk and clear about half of the bits, as migration does */
+        pos = 0;
+        while ((pos = bitmap_summary_find_next(s, bmap, size, pos)) < size) {
+            g_assert_cmpint(find_next_bit(bmap, size, pos), ==, pos);
+            if (g_rand_boolean(rand)) {
+                clear_bit(pos, bmap);
+            }
+            pos++;
+        }
+    }
+
+    g_rand_free(rand);
+    bitmap_summary_free(s);
+    g_free(bmap);
+}
+
 int main(int argc, char **argv)
 {
     g_test_init(&argc, &argv, NULL);
@@ -131,6 +190,8 @@ int main(int argc, char **argv)
                     check_bitmap_copy_with_offset);
     g_test_add_func("/bitmap/bitmap_set",
                     check_bitmap_set);
+    g_test_add_func("/bitmap/bitmap_summary",
+                    check_bitmap_summary);
 
     g_test_run();
 
@@ -0,0 +1,124 @@
+/*
+ * Dirty page rate limit controller tests
+ *
+ * Copyright (c) 2026 The QEMU Project Developers
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "system/dirtylimit-control.h"
+
+static void test_split_skewed(void)
+{
+    uint64_t demand[] = { 5000, 10, 1000, 20 };
+    uint64_t quota[ARRAY_SIZE(demand)];
+
+    dirtylimit_split_target(1000, demand, quota, ARRAY_SIZE(demand));
+
+    /* The light vcpus are not held below what they use */
+    g_assert_cmpuint(quota[1], >=, demand[1]);
+    g_assert_cmpuint(quota[3], >=, demand[3]);
+
+    /* The heavy vcpus share what the light ones leave */
+    g_assert_cmpuint(quota[0], ==, 485);
+    g_assert_cmpuint(quota[2], ==, 485);
+}
+
+static void test_split_light(void)
+{
+    uint64_t demand[] = { 100, 300, 200 };
+    uint64_t quota[ARRAY_SIZE(demand)];
+    int i;
+
+    dirtylimit_split_target(1000, demand, quota, ARRAY_SIZE(demand));
+
+    for (i = 0; i < ARRAY_SIZE(demand); i++) {
+        g_assert_cmpuint(quota[i], >=, demand[i]);
+    }
+}
+
+static void test_split_tiny(void)
+{
+    uint64_t demand[] = { 100, 100, 100, 100 };
+    uint64_t quota[ARRAY_SIZE(demand)];
+    int i;
+
+    dirtylimit_split_target(2, demand, quota, ARRAY_SIZE(demand));
+
+    for (i = 0; i < ARRAY_SIZE(demand); i++) {
+        g_assert_cmpuint(quota[i], ==, 1);
+    }
+}
+
+/*
+ * Run the controller against a vcpu that dirties @demand MB/s when it is
+ * not throttled, and return the dirty page rate after @periods periods.
+ */
+static uint64_t run_controller(uint64_t demand, uint64_t quota, int periods)
+{
+    DirtyLimitPid pid;
+    uint64_t current = demand;
+    int i;
+
+    dirtylimit_pid_reset(&pid);
+    for (i = 0; i < periods; i++) {
+        double throttle = dirtylimit_pid_update(&pid, quota, current);
+
+        g_assert(throttle >= 0 && throttle <= DIRTYLIMIT_THROTTLE_PCT_MAX);
+        current = MAX(demand / (1 + throttle), 1);
+    }
+    return current;
+}
+
+static void test_pid_converge(void)
+{
+    static const struct {
+        uint64_t demand, quota;
+    } cases[] = {
+        { 1000, 500 },
+        { 10000, 100 },
+        { 100000, 2000 },
+    };
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(cases); i++) {
+        uint64_t current = run_controller(cases[i].demand, cases[i].quota, 10);
+
+        g_assert_cmpuint(current, >=, cases[i].quota * 95 / 100);
+        g_assert_cmpuint(current, <=, cases[i].quota * 105 / 100);
+    }
+}
+
+static void test_pid_below_quota(void)
+{
+    DirtyLimitPid pid;
+    int i;
+
+    dirtylimit_pid_reset(&pid);
+    for (i = 0; i < 10; i++) {
+        g_assert(dirtylimit_pid_update(&pid, 1000, 200) == 0);
+    }
+}
+
+static void test_pid_bounded(void)
+{
+    /* The quota cannot be reached, the throttle stays at its maximum */
+    g_assert_cmpuint(run_controller(1000000, 1, 20), ==,
+                     1000000 / (DIRTYLIMIT_THROTTLE_PCT_MAX + 1));
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/dirtylimit/split/skewed", test_split_skewed);
+    g_test_add_func("/dirtylimit/split/light", test_split_light);
+    g_test_add_func("/dirtylimit/split/tiny", test_split_tiny);
+    g_test_add_func("/dirtylimit/pid/converge", test_pid_converge);
+    g_test_add_func("/dirtylimit/pid/below-quota", test_pid_below_quota);
+    g_test_add_func("/dirtylimit/pid/bounded", test_pid_bounded);
+
+    return g_test_run();
+}
@@ -0,0 +1,175 @@
+/*
+ * Test the host acceleration of the out-of-line gvec helpers
+ *
+ * The accelerated saturating operations must give the same results as
+ * the scalar loops of accel/tcg/tcg-runtime-gvec.c, in particular for
+ * the lanes that overflow or underflow.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/host-utils.h"
+#include "host/gvec-accel.c.inc"
+
+#define MAX_OPRSZ 256
+#define ROUNDS    64
+
+/* Scalar reference, as in tcg-runtime-gvec.c. */
+#define GVEC_REF_SS(NAME, T, OVF, MIN, MAX)                               \
+static void NAME##_ref(void *d, const void *a, const void *b,             \
+                       intptr_t start, intptr_t oprsz)                    \
+{                                                                         \
+    for (intptr_t i = start; i < oprsz; i += sizeof(T)) {                 \
+        T ai = *(T *)(a + i);                                             \
+        T bi = *(T *)(b + i);                                             \
+        T di;                                                             \
+        if (OVF(ai, bi, &di)) {                                           \
+            di = ai < 0 ? MIN : MAX;                                      \
+        }                                                                 \
+        *(T *)(d + i) = di;                                               \
+    }                                                                     \
+}
+
+#define GVEC_REF_US(NAME, T, OVF, SAT)                                    \
+static void NAME##_ref(void *d, const void *a, const void *b,             \
+                       intptr_t start, intptr_t oprsz)                    \
+{                                                                         \
+    for (intptr_t i = start; i < oprsz; i += sizeof(T)) {                 \
+        T ai = *(T *)(a + i);                                             \
+        T bi = *(T *)(b + i);                                             \
+        T di;                                                             \
+        if (OVF(ai, bi, &di)) {                                           \
+            di = SAT;                                                     \
+        }                                                                 \
+        *(T *)(d + i) = di;                                               \
+    }                                                                     \
+}
+
+GVEC_REF_SS(ssadd32, int32_t, sadd32_overflow, INT32_MIN, INT32_MAX)
+GVEC_REF_SS(ssadd64, int64_t, sadd64_overflow, INT64_MIN, INT64_MAX)
+GVEC_REF_SS(sssub32, int32_t, ssub32_overflow, INT32_MIN, INT32_MAX)
+GVEC_REF_SS(sssub64, int64_t, ssub64_overflow, INT64_MIN, INT64_MAX)
+GVEC_REF_US(usadd32, uint32_t, uadd32_overflow, UINT32_MAX)
+GVEC_REF_US(usadd64, uint64_t, uadd64_overflow, UINT64_MAX)
+GVEC_REF_US(ussub32, uint32_t, usub32_overflow, 0)
+GVEC_REF_US(ussub64, uint64_t, usub64_overflow, 0)
+
+#define GVEC_ACCEL(NAME)                                                  \
+static intptr_t NAME##_accel(void *d, void *a, void *b, intptr_t oprsz)   \
+{                                                                         \
+    return gvec_accel_3(NAME, d, a, b, oprsz);                            \
+}
+
+GVEC_ACCEL(ssadd32)
+GVEC_ACCEL(ssadd64)
+GVEC_ACCEL(sssub32)
+GVEC_ACCEL(sssub64)
+GVEC_ACCEL(usadd32)
+GVEC_ACCEL(usadd64)
+GVEC_ACCEL(ussub32)
+GVEC_ACCEL(ussub64)
+
+typedef struct {
+    const char *name;
+    int esz;
+    intptr_t (*accel)(void *, void *, void *, intptr_t);
+    void (*ref)(void *, const void *, const void *, intptr_t, intptr_t);
+} GVecAccelTest;
+
+#define GVEC_TEST(NAME, ESZ)  { #NAME, ESZ, NAME##_accel, NAME##_ref }
+
+static const GVecAccelTest tests[] = {
+    GVEC_TEST(ssadd32, 4),
+    GVEC_TEST(ssadd64, 8),
+    GVEC_TEST(sssub32, 4),
+    GVEC_TEST(sssub64, 8),
+    GVEC_TEST(usadd32, 4),
+    GVEC_TEST(usadd64, 8),
+    GVEC_TEST(ussub32, 4),
+    GVEC_TEST(ussub64, 8),
+};
+
+/*
+ * Lane values: the first entries are the signed and unsigned boundaries,
+ * the others are random.  Over the rounds, every pair of boundary values
+ * meets in some lane.
+ */
+#define N_EDGES   8
+#define N_VALUES  12
+
+static int64_t lane_value(int esz, unsigned k)
+{
+    int64_t min = esz == 4 ? INT32_MIN : INT64_MIN;
+    int64_t max = esz == 4 ? INT32_MAX : INT64_MAX;
+    const int64_t edges[N_EDGES] = {
+        0, 1, -1, min, max, min + 1, max - 1, max / 2 + 1,
+    };
+
+    if (k % N_VALUES < N_EDGES) {
+        return edges[k % N_VALUES];
+    }
+    return ((int64_t)g_test_rand_int() << 32) | g_test_rand_int();
+}
+
+static void lane_set(void *buf, int esz, intptr_t i, int64_t v)
+{
+    if (esz == 4) {
+        *(int32_t *)(buf + i) = v;
+    } else {
+        *(int64_t *)(buf + i) = v;
+    }
+}
+
+static void test_gvec_accel(const void *opaque)
+{
+    const GVecAccelTest *t = opaque;
+    uint64_t a[MAX_OPRSZ / 8], b[MAX_OPRSZ / 8];
+    uint64_t d[MAX_OPRSZ / 8], expect[MAX_OPRSZ / 8];
+    bool accelerated = false;
+
+    for (intptr_t oprsz = 16; oprsz <= MAX_OPRSZ; oprsz += 16) {
+        intptr_t lanes = oprsz / t->esz;
+
+        for (unsigned round = 0; round < ROUNDS; round++) {
+            intptr_t done;
+
+            for (intptr_t j = 0; j < lanes; j++) {
+                unsigned k = round * lanes + j;
+
+                lane_set(a, t->esz, j * t->esz, lane_value(t->esz, k));
+                lane_set(b, t->esz, j * t->esz,
+                         lane_value(t->esz, k / N_VALUES));
+            }
+
+            memset(d, 0x5a, sizeof(d));
+            memset(expect, 0x5a, sizeof(expect));
+
+            t->ref(expect, a, b, 0, oprsz);
+            done = t->accel(d, a, b, oprsz);
+            g_assert_cmpint(done, >=, 0);
+            g_assert_cmpint(done, <=, oprsz);
+            g_assert_cmpint(done % t->esz, ==, 0);
+            t->ref(d, a, b, done, oprsz);
+            accelerated |= done != 0;
+
+            g_assert_cmpmem(d, sizeof(d), expect, sizeof(expect));
+        }
+    }
+
+    if (!accelerated) {
+        g_test_skip("no host acceleration for this operation");
+    }
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    for (int i = 0; i < ARRAY_SIZE(tests); i++) {
+        g_autofree char *path = g_strdup_printf("/tcg/gvec-accel/%s",
+                                                tests[i].name);
+        g_test_add_data_func(path, &tests[i], test_gvec_accel);
+    }
+    return g_test_run();
+}
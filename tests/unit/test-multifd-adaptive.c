@@ -0,0 +1,110 @@
+/*
+ * Multifd adaptive compression controller tests
+ *
+ * Copyright (c) 2026 The QEMU Project Developers
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "../migration/multifd-adaptive.h"
+
+#define PACKET_BYTES (128 * 4096)
+#define MAX_EFFORT   4
+
+/*
+ * Send one window of packets that take @prepare_ns to prepare and
+ * @write_ns to write, and that compress to @ratio percent of their size.
+ * Returns whether the effort changed at the end of the window.
+ */
+static bool run_window(MultiFDAdaptive *a, int64_t prepare_ns,
+                       int64_t write_ns, int ratio, uint64_t zero_pages)
+{
+    bool changed = false;
+    int i;
+
+    for (i = 0; i < MULTIFD_ADAPTIVE_WINDOW; i++) {
+        a->prepare_ns += prepare_ns;
+        a->in_bytes += PACKET_BYTES;
+        a->out_bytes += a->effort > 1 ? PACKET_BYTES * ratio / 100
+                                      : PACKET_BYTES;
+        a->zero_pages += zero_pages;
+        changed |= multifd_adaptive_update(a, write_ns, MAX_EFFORT);
+    }
+    return changed;
+}
+
+static void test_network_bound(void)
+{
+    MultiFDAdaptive a = { .effort = 0 };
+    int i;
+
+    /* The effort rises by one per window, up to the maximum */
+    for (i = 1; i <= MAX_EFFORT; i++) {
+        g_assert_true(run_window(&a, 100, 1000, 30, 0));
+        g_assert_cmpint(a.effort, ==, i);
+    }
+    g_assert_false(run_window(&a, 100, 1000, 30, 0));
+    g_assert_cmpint(a.effort, ==, MAX_EFFORT);
+}
+
+static void test_cpu_bound(void)
+{
+    MultiFDAdaptive a = { .effort = MAX_EFFORT };
+    int i;
+
+    /* Zero page detection is kept as long as it finds zero pages */
+    for (i = 0; i < 2 * MAX_EFFORT; i++) {
+        run_window(&a, 1000, 100, 30, 1);
+    }
+    g_assert_cmpint(a.effort, ==, 1);
+
+    g_assert_true(run_window(&a, 1000, 100, 30, 0));
+    g_assert_cmpint(a.effort, ==, 0);
+    g_assert_false(run_window(&a, 1000, 100, 30, 0));
+    g_assert_cmpint(a.effort, ==, 0);
+}
+
+static void test_balanced(void)
+{
+    MultiFDAdaptive a = { .effort = 2 };
+
+    /* Neither the network nor the CPU dominates */
+    g_assert_false(run_window(&a, 1000, 1500, 30, 0));
+    g_assert_cmpint(a.effort, ==, 2);
+}
+
+static void test_poor_ratio(void)
+{
+    MultiFDAdaptive a = { .effort = 3 };
+    int i;
+
+    /* Incompressible data stops compression, even if network bound */
+    g_assert_true(run_window(&a, 100, 1000, 95, 0));
+    g_assert_cmpint(a.effort, ==, 1);
+
+    /* ... for MULTIFD_ADAPTIVE_BACKOFF windows */
+    for (i = 1; i < MULTIFD_ADAPTIVE_BACKOFF; i++) {
+        g_assert_false(run_window(&a, 100, 1000, 95, 0));
+        g_assert_cmpint(a.effort, ==, 1);
+    }
+    g_assert_true(run_window(&a, 100, 1000, 95, 0));
+    g_assert_cmpint(a.effort, ==, 2);
+
+    /* Then it is dropped again right away */
+    g_assert_true(run_window(&a, 100, 1000, 95, 0));
+    g_assert_cmpint(a.effort, ==, 1);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/multifd/adaptive/network-bound", test_network_bound);
+    g_test_add_func("/multifd/adaptive/cpu-bound", test_cpu_bound);
+    g_test_add_func("/multifd/adaptive/balanced", test_balanced);
+    g_test_add_func("/multifd/adaptive/poor-ratio", test_poor_ratio);
+
+    return g_test_run();
+}
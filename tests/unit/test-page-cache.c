@@ -0,0 +1,184 @@
+/*
+ * XBZRLE page cache unit tests
+ *
+ * Copyright (c) 2026 The QEMU Project Developers
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qemu/units.h"
+#include "../migration/page_cache.h"
+
+#define TEST_PAGE_SIZE 4096
+
+static uint8_t *page_data(uint64_t addr)
+{
+    uint8_t *page = g_malloc(TEST_PAGE_SIZE);
+
+    memset(page, addr / TEST_PAGE_SIZE + 1, TEST_PAGE_SIZE);
+    return page;
+}
+
+static void assert_cached(PageCache *cache, uint64_t addr, uint64_t age)
+{
+    g_autofree uint8_t *expect = page_data(addr);
+    uint8_t *data;
+
+    g_assert_true(cache_is_cached(cache, addr, age));
+    data = get_cached_data(cache, addr);
+    g_assert_nonnull(data);
+    g_assert_cmpmem(data, TEST_PAGE_SIZE, expect, TEST_PAGE_SIZE);
+}
+
+static int insert(PageCache *cache, uint64_t addr, uint64_t age)
+{
+    g_autofree uint8_t *page = page_data(addr);
+
+    return cache_insert(cache, addr, page, age);
+}
+
+static void test_init_errors(void)
+{
+    Error *err = NULL;
+
+    g_assert_null(cache_init(TEST_PAGE_SIZE / 2, TEST_PAGE_SIZE, 1, &err));
+    error_free_or_abort(&err);
+
+    g_assert_null(cache_init(3 * TEST_PAGE_SIZE, TEST_PAGE_SIZE, 1, &err));
+    error_free_or_abort(&err);
+
+    g_assert_null(cache_init(4 * TEST_PAGE_SIZE, TEST_PAGE_SIZE, 3, &err));
+    error_free_or_abort(&err);
+}
+
+static void test_hit_miss(gconstpointer opaque)
+{
+    unsigned int ways = GPOINTER_TO_UINT(opaque);
+    PageCache *cache = cache_init(16 * TEST_PAGE_SIZE, TEST_PAGE_SIZE, ways,
+                                  &error_abort);
+    uint64_t addr;
+
+    for (addr = 0; addr < 16 * TEST_PAGE_SIZE; addr += TEST_PAGE_SIZE) {
+        g_assert_false(cache_is_cached(cache, addr, 0));
+        g_assert_null(get_cached_data(cache, addr));
+        g_assert_cmpint(insert(cache, addr, 0), ==, 0);
+    }
+
+    /* 16 consecutive pages fill all the sets, whatever the ways */
+    for (addr = 0; addr < 16 * TEST_PAGE_SIZE; addr += TEST_PAGE_SIZE) {
+        assert_cached(cache, addr, 1);
+    }
+    g_assert_false(cache_is_cached(cache, 16 * TEST_PAGE_SIZE, 1));
+
+    /* Inserting a cached page again updates its data */
+    g_assert_cmpint(cache_insert(cache, 0, (uint8_t[TEST_PAGE_SIZE]){ 42 },
+                                 1), ==, 0);
+    g_assert_cmpint(get_cached_data(cache, 0)[0], ==, 42);
+
+    cache_fini(cache);
+}
+
+/* With one way, a page replaces the page at the same index, once aged */
+static void test_evict_direct_mapped(void)
+{
+    PageCache *cache = cache_init(4 * TEST_PAGE_SIZE, TEST_PAGE_SIZE, 1,
+                                  &error_abort);
+    uint64_t a = TEST_PAGE_SIZE, b = 5 * TEST_PAGE_SIZE;
+
+    g_assert_cmpint(insert(cache, a, 0), ==, 0);
+
+    /* a is still fresh */
+    g_assert_cmpint(insert(cache, b, 1), ==, -1);
+    assert_cached(cache, a, 1);
+    g_assert_false(cache_is_cached(cache, b, 1));
+
+    g_assert_cmpint(insert(cache, b, 3), ==, 1);
+    g_assert_false(cache_is_cached(cache, a, 3));
+    assert_cached(cache, b, 3);
+
+    cache_fini(cache);
+}
+
+/*
+ * With several ways, the page that was least recently and least often
+ * hit is evicted.
+ */
+static void test_evict_associative(void)
+{
+    PageCache *cache = cache_init(4 * TEST_PAGE_SIZE, TEST_PAGE_SIZE, 4,
+                                  &error_abort);
+    uint64_t addr;
+    int i;
+
+    /* One set, whose four ways are filled at age 0 */
+    for (addr = 0; addr < 4 * TEST_PAGE_SIZE; addr += TEST_PAGE_SIZE) {
+        g_assert_cmpint(insert(cache, addr, 0), ==, 0);
+    }
+
+    /* All of them are fresh */
+    g_assert_cmpint(insert(cache, 4 * TEST_PAGE_SIZE, 1), ==, -1);
+
+    /* Pages 0 and 1 are hit at age 2, and page 2 often at age 1 */
+    assert_cached(cache, 0, 2);
+    assert_cached(cache, TEST_PAGE_SIZE, 2);
+    for (i = 0; i < 4; i++) {
+        assert_cached(cache, 2 * TEST_PAGE_SIZE, 1);
+    }
+
+    /* Page 3 was never hit, it goes first */
+    g_assert_cmpint(insert(cache, 4 * TEST_PAGE_SIZE, 4), ==, 1);
+    g_assert_false(cache_is_cached(cache, 3 * TEST_PAGE_SIZE, 4));
+    assert_cached(cache, 4 * TEST_PAGE_SIZE, 4);
+
+    /*
+     * Page 2 (age 1 + 4 hits) now scores higher than page 0 (age 2 + 1
+     * hit), which it would not without its hits.
+     */
+    g_assert_cmpint(insert(cache, 5 * TEST_PAGE_SIZE, 4), ==, 1);
+    g_assert_false(cache_is_cached(cache, 0, 4));
+    assert_cached(cache, 2 * TEST_PAGE_SIZE, 4);
+    assert_cached(cache, 5 * TEST_PAGE_SIZE, 4);
+
+    cache_fini(cache);
+}
+
+/* Pages are spread over several lazily allocated shards */
+static void test_shards(gconstpointer opaque)
+{
+    unsigned int ways = GPOINTER_TO_UINT(opaque);
+    uint64_t size = 16 * MiB;
+    PageCache *cache = cache_init(size, TEST_PAGE_SIZE, ways, &error_abort);
+    uint64_t addr;
+
+    for (addr = 0; addr < size; addr += 7 * TEST_PAGE_SIZE) {
+        g_assert_cmpint(insert(cache, addr, 0), ==, 0);
+    }
+    for (addr = 0; addr < size; addr += 7 * TEST_PAGE_SIZE) {
+        assert_cached(cache, addr, 0);
+    }
+    g_assert_false(cache_is_cached(cache, TEST_PAGE_SIZE, 0));
+
+    cache_fini(cache);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/page-cache/init-errors", test_init_errors);
+    g_test_add_data_func("/page-cache/hit-miss/1", GUINT_TO_POINTER(1),
+                         test_hit_miss);
+    g_test_add_data_func("/page-cache/hit-miss/4", GUINT_TO_POINTER(4),
+                         test_hit_miss);
+    g_test_add_func("/page-cache/evict/1", test_evict_direct_mapped);
+    g_test_add_func("/page-cache/evict/4", test_evict_associative);
+    g_test_add_data_func("/page-cache/shards/1", GUINT_TO_POINTER(1),
+                         test_shards);
+    g_test_add_data_func("/page-cache/shards/8", GUINT_TO_POINTER(8),
+                         test_shards);
+
+    return g_test_run();
+}
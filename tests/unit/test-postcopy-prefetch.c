@@ -0,0 +1,136 @@
+/*
+ * Postcopy prefetch stride detection tests
+ *
+ * Copyright (c) 2026 The QEMU Project Developers
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "../migration/postcopy-prefetch.h"
+
+#define PAGE_SIZE  4096
+#define MAX_WINDOW 16
+
+/* Only compared, never dereferenced */
+static char blocks[2];
+#define RB0 ((RAMBlock *)&blocks[0])
+#define RB1 ((RAMBlock *)&blocks[1])
+
+static unsigned int fault(PostcopyPrefetchStream *s, RAMBlock *rb,
+                          uint64_t offset, unsigned int *hits)
+{
+    unsigned int dummy;
+
+    return postcopy_prefetch_update(s, rb, offset, PAGE_SIZE, MAX_WINDOW,
+                                    hits ? hits : &dummy);
+}
+
+/* Request the pages up to @window, like postcopy_prefetch() does */
+static void request(PostcopyPrefetchStream *s, unsigned int window)
+{
+    unsigned int i;
+
+    for (i = s->ahead + 1; i <= window; i++) {
+        set_bit((s->pos + i) % POSTCOPY_PREFETCH_RING, s->requested);
+        s->ahead = i;
+    }
+}
+
+static void test_sequential(void)
+{
+    PostcopyPrefetchStream s = {};
+    unsigned int expected[] = { 0, 0, 2, 4, 8, 16, 16, 16 };
+    unsigned int i;
+
+    /* Two faults give the stride, the third one confirms it */
+    for (i = 0; i < ARRAY_SIZE(expected); i++) {
+        g_assert_cmpuint(fault(&s, RB0, i * PAGE_SIZE, NULL), ==,
+                         expected[i]);
+    }
+    g_assert_cmpint(s.stride, ==, PAGE_SIZE);
+}
+
+static void test_stride(void)
+{
+    PostcopyPrefetchStream s = {};
+    int64_t stride = -3 * PAGE_SIZE;
+    uint64_t offset = 1024 * PAGE_SIZE;
+
+    /* Backwards and with a gap */
+    g_assert_cmpuint(fault(&s, RB0, offset, NULL), ==, 0);
+    g_assert_cmpuint(fault(&s, RB0, offset + stride, NULL), ==, 0);
+    g_assert_cmpuint(fault(&s, RB0, offset + 2 * stride, NULL), ==, 2);
+    g_assert_cmpint(s.stride, ==, stride);
+
+    /* Too far apart */
+    s = (PostcopyPrefetchStream) {};
+    stride = (POSTCOPY_PREFETCH_MAX_STRIDE + 1) * PAGE_SIZE;
+    g_assert_cmpuint(fault(&s, RB0, offset, NULL), ==, 0);
+    g_assert_cmpuint(fault(&s, RB0, offset + stride, NULL), ==, 0);
+    g_assert_cmpuint(fault(&s, RB0, offset + 2 * stride, NULL), ==, 0);
+    g_assert_cmpint(s.stride, ==, 0);
+}
+
+static void test_reset(void)
+{
+    PostcopyPrefetchStream s = {};
+
+    fault(&s, RB0, 0, NULL);
+    fault(&s, RB0, PAGE_SIZE, NULL);
+    g_assert_cmpuint(fault(&s, RB0, 2 * PAGE_SIZE, NULL), ==, 2);
+
+    /* The same offsets in another block do not follow the stride */
+    g_assert_cmpuint(fault(&s, RB1, 3 * PAGE_SIZE, NULL), ==, 0);
+    g_assert_cmpint(s.stride, ==, 0);
+
+    /* A random access starts over, with the new distance as stride */
+    fault(&s, RB1, 4 * PAGE_SIZE, NULL);
+    g_assert_cmpuint(fault(&s, RB1, 5 * PAGE_SIZE, NULL), ==, 2);
+    g_assert_cmpuint(fault(&s, RB1, 100 * PAGE_SIZE, NULL), ==, 0);
+    g_assert_cmpuint(fault(&s, RB1, 101 * PAGE_SIZE, NULL), ==, 0);
+    g_assert_cmpuint(fault(&s, RB1, 102 * PAGE_SIZE, NULL), ==, 2);
+}
+
+static void test_hits(void)
+{
+    PostcopyPrefetchStream s = {};
+    unsigned int window, hits;
+
+    fault(&s, RB0, 0, NULL);
+    fault(&s, RB0, PAGE_SIZE, NULL);
+    window = fault(&s, RB0, 2 * PAGE_SIZE, &hits);
+    g_assert_cmpuint(window, ==, 2);
+    g_assert_cmpuint(hits, ==, 0);
+    request(&s, window);
+
+    /* Pages 3 and 4 were requested; 3 arrived in time, 4 faulted */
+    window = fault(&s, RB0, 4 * PAGE_SIZE, &hits);
+    g_assert_cmpuint(hits, ==, 1);
+    g_assert_cmpuint(window, ==, 4);
+    g_assert_cmpuint(s.ahead, ==, 0);
+    request(&s, window);
+
+    /* Pages 5 to 8 were requested and none of them faulted */
+    window = fault(&s, RB0, 9 * PAGE_SIZE, &hits);
+    g_assert_cmpuint(hits, ==, 4);
+    g_assert_cmpuint(window, ==, 8);
+
+    /* Skipping more than was requested is not the same stream */
+    window = fault(&s, RB0, 11 * PAGE_SIZE, &hits);
+    g_assert_cmpuint(hits, ==, 0);
+    g_assert_cmpuint(window, ==, 0);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/postcopy/prefetch/sequential", test_sequential);
+    g_test_add_func("/postcopy/prefetch/stride", test_stride);
+    g_test_add_func("/postcopy/prefetch/reset", test_reset);
+    g_test_add_func("/postcopy/prefetch/hits", test_hits);
+
+    return g_test_run();
+}
@@ -130,6 +130,139 @@ static void test_encode_decode_overflow(void)
     g_free(test);
 }
 
+/* One run of changed bytes, across all word and vector boundaries */
+static void test_encode_decode_runs(void)
+{
+    uint8_t *compressed = g_malloc(XBZRLE_PAGE_SIZE);
+    uint8_t *test = g_malloc0(XBZRLE_PAGE_SIZE);
+    uint8_t *buffer = g_malloc0(XBZRLE_PAGE_SIZE);
+    int start, len, i, dlen, rc;
+
+    for (start = 0; start < 130; start++) {
+        for (len = 1; len < 70; len++) {
+            memset(test, 0, XBZRLE_PAGE_SIZE);
+            for (i = 0; i < len; i++) {
+                test[start + i] = i + 1;
+            }
+
+            dlen = xbzrle_encode_buffer(buffer, test, XBZRLE_PAGE_SIZE,
+                                        compressed, XBZRLE_PAGE_SIZE);
+            g_assert_cmpint(dlen, ==,
+                            (start < 0x80 ? 1 : 2) + 1 + len);
+
+            rc = xbzrle_decode_buffer(compressed, dlen, buffer,
+                                      XBZRLE_PAGE_SIZE);
+            g_assert_cmpint(rc, ==, start + len);
+            g_assert(memcmp(test, buffer, XBZRLE_PAGE_SIZE) == 0);
+            memset(buffer, 0, XBZRLE_PAGE_SIZE);
+        }
+    }
+
+    g_free(buffer);
+    g_free(compressed);
+    g_free(test);
+}
+
+#define ACCEL_CASES 512
+
+/* Fill @new_buf with @old_buf, changed by a few random runs of bytes. */
+static void accel_case(uint8_t *old_buf, uint8_t *new_buf, int n)
+{
+    int runs = g_test_rand_int_range(0, 8);
+    int i, j;
+
+    for (i = 0; i < XBZRLE_PAGE_SIZE; i++) {
+        old_buf[i] = g_test_rand_int_range(0, 4);
+    }
+    memcpy(new_buf, old_buf, XBZRLE_PAGE_SIZE);
+
+    for (i = 0; i < runs; i++) {
+        /* Mostly short runs, whose ends fall inside a vector */
+        int len = g_test_rand_int_range(1, n % 2 ? 300 : 40);
+        int start = g_test_rand_int_range(0, XBZRLE_PAGE_SIZE - len);
+
+        for (j = start; j < start + len; j++) {
+            new_buf[j] = old_buf[j] + g_test_rand_int_range(0, 2);
+        }
+    }
+}
+
+/*
+ * Every encoder supported by the host gives the same output as the
+ * generic one, byte for byte, including when the output overflows.
+ * This leaves the generic encoder in use.
+ */
+static void test_encode_accel(void)
+{
+    g_autofree uint8_t *old_bufs = g_malloc(ACCEL_CASES * XBZRLE_PAGE_SIZE);
+    g_autofree uint8_t *new_bufs = g_malloc(ACCEL_CASES * XBZRLE_PAGE_SIZE);
+    g_autofree uint8_t *decoded = g_malloc(XBZRLE_PAGE_SIZE);
+    int dlen[ACCEL_CASES], *expect_len;
+    uint8_t *expect;
+    GArray *outputs = g_array_new(false, false, sizeof(uint8_t *));
+    GArray *lens = g_array_new(false, false, sizeof(int *));
+    int n, k;
+
+    for (n = 0; n < ACCEL_CASES; n++) {
+        accel_case(old_bufs + n * XBZRLE_PAGE_SIZE,
+                   new_bufs + n * XBZRLE_PAGE_SIZE, n);
+        /* A quarter of the cases has room for only a few runs */
+        dlen[n] = n % 4 ? XBZRLE_PAGE_SIZE : g_test_rand_int_range(2, 200);
+    }
+
+    /* The generic encoder is the last one */
+    do {
+        uint8_t *out = g_malloc(ACCEL_CASES * XBZRLE_PAGE_SIZE);
+        int *len = g_new(int, ACCEL_CASES);
+
+        for (n = 0; n < ACCEL_CASES; n++) {
+            len[n] = xbzrle_encode_buffer(old_bufs + n * XBZRLE_PAGE_SIZE,
+                                          new_bufs + n * XBZRLE_PAGE_SIZE,
+                                          XBZRLE_PAGE_SIZE,
+                                          out + n * XBZRLE_PAGE_SIZE,
+                                          dlen[n]);
+        }
+        g_array_append_val(outputs, out);
+        g_array_append_val(lens, len);
+    } while (test_xbzrle_encode_next_accel());
+
+    expect = g_array_index(outputs, uint8_t *, outputs->len - 1);
+    expect_len = g_array_index(lens, int *, lens->len - 1);
+
+    for (n = 0; n < ACCEL_CASES; n++) {
+        /* The generic output itself decodes to the new page */
+        if (expect_len[n] > 0) {
+            memcpy(decoded, old_bufs + n * XBZRLE_PAGE_SIZE,
+                   XBZRLE_PAGE_SIZE);
+            xbzrle_decode_buffer(expect + n * XBZRLE_PAGE_SIZE,
+                                 expect_len[n], decoded, XBZRLE_PAGE_SIZE);
+            g_assert(memcmp(decoded, new_bufs + n * XBZRLE_PAGE_SIZE,
+                            XBZRLE_PAGE_SIZE) == 0);
+        }
+    }
+
+    for (k = 0; k < outputs->len; k++) {
+        uint8_t *out = g_array_index(outputs, uint8_t *, k);
+        int *len = g_array_index(lens, int *, k);
+
+        for (n = 0; n < ACCEL_CASES; n++) {
+            g_assert_cmpint(len[n], ==, expect_len[n]);
+            if (len[n] > 0) {
+                g_assert_cmpmem(out + n * XBZRLE_PAGE_SIZE, len[n],
+                                expect + n * XBZRLE_PAGE_SIZE, len[n]);
+            }
+        }
+    }
+
+    for (k = 0; k < outputs->len; k++) {
+        g_free(g_array_index(outputs, uint8_t *, k));
+        g_free(g_array_index(lens, int *, k));
+    }
+
+    g_array_free(outputs, true);
+    g_array_free(lens, true);
+}
+
 static void encode_decode_range(void)
 {
     uint8_t *buffer = g_malloc0(XBZRLE_PAGE_SIZE);
@@ -184,7 +317,10 @@ int main(int argc, char **argv)
     g_test_add_func("/xbzrle/encode_decode_1_byte", test_encode_decode_1_byte);
     g_test_add_func("/xbzrle/encode_decode_overflow",
                     test_encode_decode_overflow);
+    g_test_add_func("/xbzrle/encode_decode_runs", test_encode_decode_runs);
     g_test_add_func("/xbzrle/encode_decode", test_encode_decode);
+    /* Last, as it leaves the generic encoder in use */
+    g_test_add_func("/xbzrle/encode_accel", test_encode_accel);
 
     return g_test_run();
 }
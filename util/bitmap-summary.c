@@ -0,0 +1,162 @@
+/*
+ * Summary of a sparse bitmap
+ *
+ * Copyright (c) 2026 The QEMU Project Developers
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bitops.h"
+#include "qemu/bitmap.h"
+#include "qemu/host-utils.h"
+#include "qemu/bitmap-summary.h"
+
+/*
+ * With 64-bit longs, three levels reduce a bitmap of 2^28 bits (1 TiB
+ * of 4 KiB pages) to 16 longs at the top level, which is scanned
+ * linearly.
+ */
+#define BITMAP_SUMMARY_LEVELS 3
+
+struct BitmapSummary {
+    /* Level i has nbits[i] bits, one for each long of level i - 1 */
+    unsigned long nbits[BITMAP_SUMMARY_LEVELS];
+    unsigned long *levels[BITMAP_SUMMARY_LEVELS];
+};
+
+BitmapSummary *bitmap_summary_new(unsigned long nbits)
+{
+    BitmapSummary *s = g_new(BitmapSummary, 1);
+    int i;
+
+    for (i = 0; i < BITMAP_SUMMARY_LEVELS; i++) {
+        nbits = BITS_TO_LONGS(nbits);
+        s->nbits[i] = nbits;
+        s->levels[i] = bitmap_new(nbits);
+    }
+    return s;
+}
+
+void bitmap_summary_free(BitmapSummary *s)
+{
+    int i;
+
+    if (!s) {
+        return;
+    }
+    for (i = 0; i < BITMAP_SUMMARY_LEVELS; i++) {
+        g_free(s->levels[i]);
+    }
+    g_free(s);
+}
+
+void bitmap_summary_mark(BitmapSummary *s, unsigned long start,
+                         unsigned long nr)
+{
+    unsigned long last = start + nr - 1;
+    int i;
+
+    if (!nr) {
+        return;
+    }
+    for (i = 0; i < BITMAP_SUMMARY_LEVELS; i++) {
+        start = BIT_WORD(start);
+        last = BIT_WORD(last);
+        bitmap_set(s->levels[i], start, last - start + 1);
+    }
+}
+
+void bitmap_summary_mark_long(BitmapSummary *s, unsigned long word)
+{
+    set_bit(word, s->levels[0]);
+}
+
+void bitmap_summary_propagate(BitmapSummary *s, unsigned long start,
+                              unsigned long nr)
+{
+    unsigned long last = start + nr - 1;
+    unsigned long word;
+    int i;
+
+    if (!nr) {
+        return;
+    }
+
+    /* [start, last] is the range of bits of level i - 1 */
+    start = BIT_WORD(start);
+    last = BIT_WORD(last);
+    for (i = 1; i < BITMAP_SUMMARY_LEVELS; i++) {
+        start = BIT_WORD(start);
+        last = BIT_WORD(last);
+        for (word = start; word <= last; word++) {
+            if (s->levels[i - 1][word]) {
+                set_bit(word, s->levels[i]);
+            }
+        }
+    }
+}
+
+/*
+ * Return the first set bit of level @i at or after @pos and before
+ * @limit, or @limit if there is none.  On the way, clear the bits of
+ * level @i + 1 that pointed to zero longs of level @i.
+ */
+static unsigned long bitmap_summary_next(BitmapSummary *s, int i,
+                                         unsigned long pos,
+                                         unsigned long limit)
+{
+    unsigned long *map = s->levels[i];
+    bool listed = false;
+
+    while (pos < limit) {
+        unsigned long word = BIT_WORD(pos);
+        unsigned long bits = map[word] & BITMAP_FIRST_WORD_MASK(pos);
+
+        if (bits) {
+            return MIN(word * BITS_PER_LONG + ctzl(bits), limit);
+        }
+        if (listed) {
+            /* The level above pointed here, but this long is empty */
+            clear_bit(word, s->levels[i + 1]);
+        }
+        if (i == BITMAP_SUMMARY_LEVELS - 1) {
+            pos = (word + 1) * BITS_PER_LONG;
+        } else {
+            word = bitmap_summary_next(s, i + 1, word + 1,
+                                       BITS_TO_LONGS(limit));
+            pos = word * BITS_PER_LONG;
+            listed = true;
+        }
+    }
+    return limit;
+}
+
+unsigned long bitmap_summary_find_next(BitmapSummary *s,
+                                       const unsigned long *map,
+                                       unsigned long size,
+                                       unsigned long offset)
+{
+    unsigned long nwords = BITS_TO_LONGS(size);
+    unsigned long word, bits;
+
+    if (offset >= size) {
+        return size;
+    }
+
+    word = BIT_WORD(offset);
+    bits = map[word] & BITMAP_FIRST_WORD_MASK(offset);
+    while (!bits) {
+        word = bitmap_summary_next(s, 0, word + 1, nwords);
+        if (word >= nwords) {
+            return size;
+        }
+        bits = map[word];
+        if (!bits) {
+            /* Stale summary bit: the bitmap was cleared since */
+            clear_bit(word, s->levels[0]);
+        }
+    }
+    return MIN(word * BITS_PER_LONG + ctzl(bits), size);
+}